@@ -0,0 +1,61 @@
+/**
+ * @file    adpcm.h
+ * @brief   IMA ADPCM encoder and decoder
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ * 
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the 
+ * accompanying materials are made available 
+ * under the terms of the GNU Public License 
+ * v3.0 which accompanies this distribution, 
+ * and is available at 
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef ADPCM_H_
+#define ADPCM_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  ADPCM ADPCM
+ * @brief     IMA ADPCM (WAVE_FORMAT_IMA_ADPCM) block encoder and decoder
+ */
+
+/**
+ * @addtogroup ADPCM
+ * @{
+ */
+
+#define ADPCM_MAX_CHANNELS    2 ///< Maximum number of interleaved channels
+
+/**
+ * @brief Number of samples (per channel) in an ADPCM block.
+ * @details Every channel starts the block with a 4 byte header
+ * holding the first sample, the rest are 4 bit codes.
+ */
+#define ADPCM_SAMPLES_PER_BLOCK(blockAlign, channels) \
+  ((((blockAlign) - 4 * (channels)) * 2) / (channels) + 1)
+
+/**
+ * @brief Encoder (or decoder) state of one channel.
+ */
+typedef struct {
+  int16_t predictor;  ///< Predicted sample
+  uint8_t index;      ///< Index in the step table
+} ADPCM_StateTypeDef;
+
+void      ADPCM_Init        (ADPCM_StateTypeDef* state, uint8_t channels);
+uint32_t  ADPCM_EncodeBlock (ADPCM_StateTypeDef* state, const int16_t* pcm,
+    uint8_t* block, uint8_t channels, uint16_t samplesPerBlock);
+uint32_t  ADPCM_DecodeBlock (const uint8_t* block, int16_t* pcm,
+    uint8_t channels, uint16_t samplesPerBlock);
+
+/**
+ * @}
+ */
+
+#endif /* ADPCM_H_ */
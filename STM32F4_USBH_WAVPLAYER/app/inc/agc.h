@@ -0,0 +1,66 @@
+/**
+ * @file    agc.h
+ * @brief   Automatic gain control
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef AGC_H_
+#define AGC_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  AGC AGC
+ * @brief     Block based fixed point automatic gain control with a peak limiter
+ */
+
+/**
+ * @addtogroup AGC
+ * @{
+ */
+
+#define AGC_UNITY_GAIN  65536 ///< Gain of 1.0 (Q16.16)
+
+/**
+ * @brief Automatic gain control.
+ * @details The parameters are set by AGC_Init and the AGC_Set functions,
+ * the rest is the internal state. Levels are Q15, gains are Q16.16.
+ */
+typedef struct {
+  int32_t  target;      ///< Output RMS level
+  int32_t  limit;       ///< Output peak limit
+  int32_t  floor;       ///< Input RMS below which the gain is held
+  int32_t  maxGain;     ///< Highest gain
+  uint16_t attack;      ///< Gain decrease coefficient per block (Q15)
+  uint16_t release;     ///< Gain increase coefficient per block (Q15)
+  uint16_t blockTime;   ///< Duration of one block in us
+
+  int32_t  gain;        ///< Gain following the level
+  int32_t  applied;     ///< Gain applied at the end of the last block
+  uint32_t limited;     ///< Blocks reduced by the limiter
+  uint8_t  enabled;     ///< Bypassed when 0
+} AGC_TypeDef;
+
+void  AGC_Init        (AGC_TypeDef* agc, uint16_t blockTime);
+void  AGC_SetTarget   (AGC_TypeDef* agc, int8_t targetDb);
+void  AGC_SetLimit    (AGC_TypeDef* agc, int8_t limitDb);
+void  AGC_SetMaxGain  (AGC_TypeDef* agc, uint8_t maxGainDb);
+void  AGC_SetTimes    (AGC_TypeDef* agc, uint16_t attackMs, uint16_t releaseMs);
+void  AGC_Process     (AGC_TypeDef* agc, int16_t* samples, uint32_t len);
+
+/**
+ * @}
+ */
+
+#endif /* AGC_H_ */
@@ -0,0 +1,72 @@
+/**
+ * @file    denoise.h
+ * @brief   Spectral noise suppressor
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef DENOISE_H_
+#define DENOISE_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  DENOISE DENOISE
+ * @brief     FFT based suppressor of steady background noise
+ */
+
+/**
+ * @addtogroup DENOISE
+ * @{
+ */
+
+#define DENOISE_FFT_LEN   256                     ///< Samples per analysis frame
+#define DENOISE_HOP       (DENOISE_FFT_LEN / 2)   ///< New samples per frame (50% overlap)
+#define DENOISE_BINS      (DENOISE_FFT_LEN / 2 + 1) ///< Frequency bins of a frame
+
+/**
+ * @brief Noise suppressor.
+ * @details The parameters are set by DENOISE_Init and may be changed
+ * afterwards, the rest is the internal state. The output is delayed by
+ * DENOISE_FFT_LEN samples.
+ */
+typedef struct {
+  uint16_t overSub;     ///< Noise over-subtraction (Q8)
+  uint16_t minGain;     ///< Lowest gain of a bin (Q15)
+  uint8_t  riseShift;   ///< Noise floor rises with 2^riseShift frames
+  uint8_t  enabled;     ///< Bypassed when 0 (the delay is kept)
+
+  int16_t  hist[DENOISE_HOP];   ///< Previous half of the frame
+  int16_t  in[DENOISE_HOP];     ///< Current half of the frame
+  int16_t  out[DENOISE_HOP];    ///< Output waiting to be returned
+  int32_t  tail[DENOISE_HOP];   ///< Second half of the last output frame
+  int32_t  buf[DENOISE_FFT_LEN];///< Spectrum (re, im pairs)
+  int32_t  level[DENOISE_BINS]; ///< Smoothed magnitude
+  int32_t  noise[DENOISE_BINS]; ///< Noise floor magnitude
+  int16_t  gain[DENOISE_BINS];  ///< Gain of the last frame (Q15)
+  uint16_t pos;                 ///< Samples in the current half
+  uint8_t  noiseValid;          ///< Noise floor initialized
+
+  uint32_t frames;      ///< Frames processed
+  uint64_t inEnergy;    ///< Sum of squares of the input
+  uint64_t outEnergy;   ///< Sum of squares of the output
+} DENOISE_TypeDef;
+
+void  DENOISE_Init    (DENOISE_TypeDef* ns, uint32_t freq);
+void  DENOISE_Process (DENOISE_TypeDef* ns, int16_t* samples, uint32_t len);
+
+/**
+ * @}
+ */
+
+#endif /* DENOISE_H_ */
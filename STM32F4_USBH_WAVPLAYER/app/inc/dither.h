@@ -0,0 +1,56 @@
+/**
+ * @file    dither.h
+ * @brief   Dithered reduction to 16 bits
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef DITHER_H_
+#define DITHER_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  DITHER DITHER
+ * @brief     TPDF dither with optional error feedback noise shaping
+ */
+
+/**
+ * @addtogroup DITHER
+ * @{
+ */
+
+#define DITHER_MAX_ORDER  2 ///< Highest order of the noise shaping
+
+/**
+ * @brief Dither of one stream.
+ * @details The parameters are set by DITHER_Init and may be changed
+ * afterwards, the rest is the internal state.
+ */
+typedef struct {
+  uint8_t  channels;    ///< Interleaved channels (1 or 2)
+  uint8_t  order;       ///< Noise shaping order (0: none, 1 or 2)
+  uint8_t  enabled;     ///< Truncation when 0
+
+  uint32_t seed;        ///< State of the xorshift generator
+  int32_t  err[2][DITHER_MAX_ORDER]; ///< Last errors of each channel (1/256 LSB)
+} DITHER_TypeDef;
+
+void  DITHER_Init     (DITHER_TypeDef* dither, uint8_t channels, uint8_t order);
+void  DITHER_Process  (DITHER_TypeDef* dither, int16_t* out, const int32_t* in, uint32_t len);
+
+/**
+ * @}
+ */
+
+#endif /* DITHER_H_ */
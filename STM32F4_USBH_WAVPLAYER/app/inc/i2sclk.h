@@ -0,0 +1,70 @@
+/**
+ * @file    i2sclk.h
+ * @brief   I2S clock planner
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef I2SCLK_H_
+#define I2SCLK_H_
+
+#include <inttypes.h>
+#include <stm32f4xx.h>
+
+/**
+ * @defgroup  I2SCLK I2SCLK
+ * @brief     Choice of the PLLI2S and I2S prescaler settings giving the
+ *            sampling frequency closest to the requested one
+ */
+
+/**
+ * @addtogroup I2SCLK
+ * @{
+ */
+
+#define I2SCLK_DIV_MCLK   256 ///< I2S clock per sample with the master clock output
+#define I2SCLK_DIV_16B    32  ///< I2S clock per sample, 16 bit channels, no master clock
+#define I2SCLK_DIV_32B    64  ///< I2S clock per sample, 32 bit channels, no master clock
+
+#define I2SCLK_SHARE_CODEC  48000   ///< Codec frequency (with the master clock) served by the PLLI2S of the microphone
+#define I2SCLK_SHARE_MIC    96000   ///< Highest microphone I2S frequency (3.072 MHz PDM clock) served by the PLLI2S of the codec
+#define I2SCLK_SHARE_STEP   32000   ///< Microphone I2S frequencies served are the multiples of this one up to I2SCLK_SHARE_MIC
+#define I2SCLK_SHARE_COST   200000  ///< Largest error in ppb of an I2S taking a PLLI2S shared with the other one
+#define I2SCLK_SHARE_LIMIT  2500000 ///< Largest error in ppb of an I2S without the master clock started next to the codec
+
+/**
+ * @brief Clock settings of an I2S sampling frequency.
+ */
+typedef struct {
+  uint16_t plln;    ///< PLLI2S multiplier (PLLI2SN)
+  uint8_t  pllr;    ///< PLLI2S divider (PLLI2SR)
+  uint8_t  div;     ///< I2S linear prescaler (I2SDIV)
+  uint8_t  odd;     ///< Odd factor of the prescaler (ODD)
+  int32_t  error;   ///< Error of the sampling frequency in ppb
+} I2SCLK_PlanTypeDef;
+
+uint8_t I2SCLK_Plan       (uint32_t ref, uint32_t freq, uint16_t clkDiv,
+                           uint8_t keepPll, I2SCLK_PlanTypeDef* plan);
+uint8_t I2SCLK_PlanPair   (uint32_t ref, uint32_t freq, uint16_t clkDiv,
+                           uint32_t freq2, uint16_t clkDiv2,
+                           I2SCLK_PlanTypeDef* plan, I2SCLK_PlanTypeDef* plan2);
+uint8_t I2SCLK_PlanShared (uint32_t ref, uint32_t freq, uint16_t clkDiv,
+                           uint32_t otherFreq, uint16_t otherDiv,
+                           I2SCLK_PlanTypeDef* plan, I2SCLK_PlanTypeDef* other);
+uint8_t I2SCLK_Config     (SPI_TypeDef* spi, uint32_t freq, I2SCLK_PlanTypeDef* plan);
+
+/**
+ * @}
+ */
+
+#endif /* I2SCLK_H_ */
@@ -0,0 +1,58 @@
+/**
+ * @file    pdmsim.h
+ * @brief   Synthetic PDM bitstream generator
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef PDMSIM_H_
+#define PDMSIM_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  PDMSIM PDMSIM
+ * @brief     Second order sigma-delta modulator of a tone and noise,
+ *            producing the words the microphone SPI receives
+ */
+
+/**
+ * @addtogroup PDMSIM
+ * @{
+ */
+
+/**
+ * @brief PDM generator.
+ * @details The parameters are set by PDMSIM_Init, the rest is the
+ * internal state.
+ */
+typedef struct {
+  uint32_t phase;       ///< Phase of the tone (2^32 is a full turn)
+  uint32_t step;        ///< Phase increment per word
+  int32_t  amplitude;   ///< Amplitude of the tone (Q15)
+  int32_t  noise;       ///< Amplitude of the noise (Q15)
+  uint32_t seed;        ///< State of the noise generator
+  int32_t  int1;        ///< First integrator of the modulator
+  int32_t  int2;        ///< Second integrator of the modulator
+  int32_t  feedback;    ///< Last output bit (+/- full scale)
+} PDMSIM_TypeDef;
+
+void  PDMSIM_Init     (PDMSIM_TypeDef* sim, uint32_t pdmClock, uint32_t toneFreq,
+                       int8_t toneDb, int8_t noiseDb);
+void  PDMSIM_Generate (PDMSIM_TypeDef* sim, uint16_t* words, uint32_t len);
+
+/**
+ * @}
+ */
+
+#endif /* PDMSIM_H_ */
@@ -0,0 +1,62 @@
+/**
+ * @file    vad.h
+ * @brief   Voice activity detector
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ * 
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the 
+ * accompanying materials are made available 
+ * under the terms of the GNU Public License 
+ * v3.0 which accompanies this distribution, 
+ * and is available at 
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef VAD_H_
+#define VAD_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  VAD VAD
+ * @brief     Energy and zero crossing voice activity detector
+ */
+
+/**
+ * @addtogroup VAD
+ * @{
+ */
+
+/**
+ * @brief Voice activity detector.
+ * @details The parameters are set by VAD_Init and may be changed
+ * afterwards, the rest is the internal state.
+ */
+typedef struct {
+  uint16_t frameLen;    ///< Samples per analysis frame
+  uint16_t hangover;    ///< Frames kept active after the last voiced frame
+  uint8_t  snrShift;    ///< Voiced when energy > noise floor << snrShift
+  uint32_t minEnergy;   ///< Energy (mean square) always treated as silence
+  uint16_t zcrMin;      ///< Zero crossings per frame of unvoiced speech
+
+  uint64_t acc;         ///< Energy accumulator of the current frame
+  uint32_t noise;       ///< Noise floor (mean square)
+  uint16_t count;       ///< Samples in the current frame
+  uint16_t zcr;         ///< Zero crossings in the current frame
+  uint16_t hangCount;   ///< Remaining hangover frames
+  int16_t  last;        ///< Last sample (for zero crossings)
+  uint8_t  noiseValid;  ///< Noise floor initialized
+  uint8_t  active;      ///< Current decision
+} VAD_TypeDef;
+
+void    VAD_Init    (VAD_TypeDef* vad, uint16_t frameLen, uint16_t hangover);
+uint8_t VAD_Process (VAD_TypeDef* vad, const int16_t* samples, uint32_t len);
+
+/**
+ * @}
+ */
+
+#endif /* VAD_H_ */
@@ -17,6 +17,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <timers.h>
 #include <led.h>
@@ -27,11 +28,15 @@
 #include <usbh_msc_core.h>
 #include <usbh_usr.h>
 #include <stm32f4xx.h>
+#include <waverecorder.h>
+#include <i2sclk.h>
+#include <audiosink.h>
 
 #define SYSTICK_FREQ 1000 ///< Frequency of the SysTick set at 1kHz.
 #define COMM_BAUD_RATE 115200UL ///< Baud rate for communication with PC
 
 void softTimerCallback(void);
+void commandCallback(void);
 
 #define DEBUG
 
@@ -49,10 +54,16 @@ void softTimerCallback(void);
 #endif
 
 volatile uint8_t RepeatState = 0;
+uint32_t BenchTime = 10000;   ///< Audio recorded by the benchmark in ms
+uint32_t BenchSpeed = 0;      ///< Rate of the benchmark in % of real time (0: unpaced)
 volatile uint16_t CCR_Val = 16826;
 extern volatile uint8_t LED_Toggle1;
+extern volatile uint8_t Command_index;
+extern uint32_t RecDenoiseCycles;
+extern FATFS fatfs;
 
 static void TIM_LED_Config(void);
+static void DitherTest(void);
 
 /**
  * @brief Main
@@ -81,9 +92,6 @@ int main(void) {
 
   KEYS_Init(); // Initialize matrix keyboard
 
-  uint8_t buf[255]; // buffer for receiving commands from PC
-  uint8_t len;      // length of command
-
   // Configure TIM4 Peripheral to manage LEDs lighting
   TIM_LED_Config();
 
@@ -110,24 +118,7 @@ int main(void) {
 
     USBH_Process(&USB_OTG_Core, &USB_Host);
 
-    // check for new frames from PC
-    if (!COMM_GetFrame(buf, &len)) {
-      println("Got frame of length %d: %s", (int)len, (char*)buf);
-
-      // control LED0 from terminal
-      if (!strcmp((char*)buf, ":LED 0 ON")) {
-        LED_ChangeState(LED0, LED_ON);
-      }
-      if (!strcmp((char*)buf, ":LED 0 OFF")) {
-        LED_ChangeState(LED0, LED_OFF);
-      }
-      if (!strcmp((char*)buf, ":LED 1 ON")) {
-        LED_ChangeState(LED1, LED_ON);
-      }
-      if (!strcmp((char*)buf, ":LED 1 OFF")) {
-        LED_ChangeState(LED1, LED_OFF);
-      }
-    }
+    commandCallback(); // check for new frames from PC
 
     TIMER_SoftTimersUpdate(); // run timers
     KEYS_Update(); // run keyboard
@@ -137,6 +128,180 @@ int main(void) {
 #endif
 }
 
+/**
+ * @brief Handles the commands from PC.
+ * @details Called from the main loop and polled by the audio loops
+ * (playback, recording), so the audio commands work while they run.
+ */
+void commandCallback(void) {
+
+  static uint8_t buf[255]; // buffer for receiving commands from PC
+  uint8_t len;             // length of command
+
+  // check for new frames from PC
+  if (COMM_GetFrame(buf, &len)) {
+    return;
+  }
+
+  println("Got frame of length %d: %s", (int)len, (char*)buf);
+
+  // control LED0 from terminal
+  if (!strcmp((char*)buf, ":LED 0 ON")) {
+    LED_ChangeState(LED0, LED_ON);
+  }
+  if (!strcmp((char*)buf, ":LED 0 OFF")) {
+    LED_ChangeState(LED0, LED_OFF);
+  }
+  if (!strcmp((char*)buf, ":LED 1 ON")) {
+    LED_ChangeState(LED1, LED_ON);
+  }
+  if (!strcmp((char*)buf, ":LED 1 OFF")) {
+    LED_ChangeState(LED1, LED_OFF);
+  }
+
+  // audio commands
+  if (!strcmp((char*)buf, ":PLAY")) {
+    RepeatState = 0;
+    Command_index = CMD_PLAY;
+  }
+  if (!strcmp((char*)buf, ":RECORD") && (Command_index != CMD_RECORD)) {
+    WaveRecorderTrigger();
+    Command_index = CMD_RECORD;
+  }
+  if (!strcmp((char*)buf, ":DUPLEX")) {
+    RepeatState = 0;
+    Command_index = CMD_DUPLEX; // play audio.wav and record at the same time
+  }
+  if (!strcmp((char*)buf, ":MONITOR ON")) {
+    WaveRecorderSetMonitor(1); // hear the microphone while recording
+  }
+  if (!strcmp((char*)buf, ":MONITOR OFF")) {
+    WaveRecorderSetMonitor(0);
+  }
+  if (!strncmp((char*)buf, ":BENCH ", 7)) { // seconds and speed in % of real time
+    char* next;
+    BenchTime = strtol((char*)buf + 7, &next, 10) * 1000;
+    BenchSpeed = strtol(next, NULL, 10);
+    Command_index = CMD_BENCH;
+  }
+  if (!strncmp((char*)buf, ":SEGMENT ", 9)) {
+    WaveRecorderSetSegment(atoi((char*)buf + 9)); // seconds per file, 0: one file
+  }
+  if (!strncmp((char*)buf, ":SINK ", 6)) { // output of the next playback: I2S, DAC, NULL or FILE
+    if (SINK_Select((char*)buf + 6)) {
+      println("Unknown sink %s", (char*)buf + 6);
+    } else {
+      println("Playing to %s", SINK_Selected()->name);
+    }
+  }
+
+  // automatic gain control of the microphone, levels in dBFS, gain in dB
+  AGC_TypeDef* agc = WaveRecorderGetAgc();
+  if (!strcmp((char*)buf, ":AGC ON")) {
+    agc->enabled = 1;
+  }
+  if (!strcmp((char*)buf, ":AGC OFF")) {
+    agc->enabled = 0;
+  }
+  if (!strncmp((char*)buf, ":AGC TARGET ", 12)) {
+    AGC_SetTarget(agc, atoi((char*)buf + 12));
+  }
+  if (!strncmp((char*)buf, ":AGC LIMIT ", 11)) {
+    AGC_SetLimit(agc, atoi((char*)buf + 11));
+  }
+  if (!strncmp((char*)buf, ":AGC MAXGAIN ", 13)) {
+    AGC_SetMaxGain(agc, atoi((char*)buf + 13));
+  }
+  if (!strncmp((char*)buf, ":AGC TIMES ", 11)) { // attack and release in ms
+    char* next;
+    long attack = strtol((char*)buf + 11, &next, 10);
+    AGC_SetTimes(agc, attack, strtol(next, NULL, 10));
+  }
+
+  // noise suppression of the recording, used by the next recording
+  if (!strcmp((char*)buf, ":DENOISE ON")) {
+    WaveRecorderSetDenoise(1);
+  }
+  if (!strcmp((char*)buf, ":DENOISE OFF")) {
+    WaveRecorderSetDenoise(0);
+  }
+  if (!strcmp((char*)buf, ":DENOISE STATS")) {
+    DENOISE_TypeDef* ns = WaveRecorderGetDenoise();
+    println("Denoise: %u frames, max %u cycles per block, output energy %u%% of input",
+        (unsigned int)ns->frames, (unsigned int)RecDenoiseCycles,
+        ns->inEnergy ? (unsigned int)((ns->outEnergy * 100) / ns->inEnergy) : 100);
+  }
+
+  // reduction of 24 and 32-bit files to 16 bits for the sinks taking 16 bits
+  DITHER_TypeDef* dither = WavePlayerGetDither();
+  if (!strcmp((char*)buf, ":DITHER ON")) {
+    dither->enabled = 1;
+  }
+  if (!strcmp((char*)buf, ":DITHER OFF")) {
+    dither->enabled = 0; // truncation
+  }
+  if (!strncmp((char*)buf, ":DITHER SHAPE ", 14)) { // noise shaping order: 0, 1 or 2
+    dither->order = atoi((char*)buf + 14);
+    if (dither->order > DITHER_MAX_ORDER) {
+      dither->order = DITHER_MAX_ORDER;
+    }
+  }
+  if (!strcmp((char*)buf, ":DITHER TEST")) {
+    DitherTest();
+  }
+
+  // sector cache of the file system since the mount: the hits are reads
+  // saved, the dirty sectors kept and not written back are writes saved
+  if (!strcmp((char*)buf, ":FAT CACHE")) {
+#if _FS_CACHE_SECTS
+    uint32_t loads = fatfs.c_hit + fatfs.c_miss;
+    println("FAT cache: %u hits, %u misses (%u%% hits), %u dirty sectors kept, %u written back",
+        (unsigned int)fatfs.c_hit, (unsigned int)fatfs.c_miss,
+        loads ? (unsigned int)((fatfs.c_hit * 100ULL) / loads) : 0,
+        (unsigned int)fatfs.c_kept, (unsigned int)fatfs.c_flush);
+#else
+    println("FAT cache disabled");
+#endif
+  }
+
+  // error of the codec clock (with MCLK) at the standard rates, in ppm,
+  // alone, with the fixed PLLI2S, and sharing the PLLI2S with the
+  // microphone (1.024 MHz PDM clock of a 16 kHz recording, I2S at 32 kHz)
+  if (!strcmp((char*)buf, ":I2S PLAN")) {
+    const uint32_t rates[] = {8000, 11025, 16000, 22050, 32000, 44100, 48000, 96000};
+    const uint32_t mic = 32000;
+    uint32_t ref = HSE_VALUE / (RCC->PLLCFGR & RCC_PLLCFGR_PLLM);
+    I2SCLK_PlanTypeDef plan, fixed, micPlan, codec, micLate, other;
+    uint8_t i;
+
+    println("codec                                  alone     fixed     mic, then codec  then mic");
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+      plan.plln = fixed.plln = micPlan.plln = 258; // PLLI2S of the system clock setup
+      plan.pllr = fixed.pllr = micPlan.pllr = 3;
+      I2SCLK_PlanShared(ref, rates[i], I2SCLK_DIV_MCLK, 0, 0, &plan, &other);
+      I2SCLK_Plan(ref, rates[i], I2SCLK_DIV_MCLK, 1, &fixed);
+
+      // recording first, the playback may restart the microphone
+      I2SCLK_PlanShared(ref, mic, I2SCLK_DIV_16B, 0, 0, &micPlan, &other);
+      codec = micPlan;
+      if (I2SCLK_PlanShared(ref, rates[i], I2SCLK_DIV_MCLK, mic, I2SCLK_DIV_16B,
+          &codec, &other) == 2) {
+        micPlan = other;
+      }
+
+      // playback first, the microphone takes its PLLI2S
+      micLate = plan;
+      I2SCLK_PlanShared(ref, mic, I2SCLK_DIV_16B, rates[i], I2SCLK_DIV_MCLK, &micLate, &other);
+
+      println("%6u Hz: N %3u R %u DIV %3u ODD %u %5d ppm %5d ppm %5d ppm %5d ppm %5d ppm",
+          (unsigned int)rates[i], plan.plln, plan.pllr, plan.div, plan.odd,
+          (int)(plan.error / 1000), (int)(fixed.error / 1000),
+          (int)(codec.error / 1000), (int)(micPlan.error / 1000),
+          (int)(micLate.error / 1000));
+    }
+  }
+}
+
 /**
  * @brief Callback function called on every soft timer overflow
  */
@@ -200,3 +365,68 @@ static void TIM_LED_Config(void)
   /* TIM4 enable counter */
   TIM_Cmd(TIM4, ENABLE);
 }
+
+#define DITHER_TEST_LEN   1024        ///< Samples of the dither test
+#define DITHER_TEST_COEF  2129111628  ///< 2cos(2pi 1 kHz / 48 kHz) in Q30
+#define DITHER_TEST_AMP   2147484     ///< -60 dBFS in Q31
+
+/**
+ * @brief Measure the reduction of a quiet tone to 16 bits.
+ * @details A 1 kHz tone at -60 dBFS (48 kHz, 24 bits) is reduced by
+ * truncation and by the dither with each noise shaping order. For each
+ * the cycles per sample are printed, with the mean square error in squared
+ * output LSB: in total (thousandths) and below about 3 kHz (millionths,
+ * the error averaged over 8 samples twice, with the first zero at 6 kHz).
+ * The shaping shows as a lower error below 3 kHz for a higher total.
+ */
+static void DitherTest(void) {
+
+  static int32_t in[DITHER_TEST_LEN];
+  static int16_t out[DITHER_TEST_LEN];
+  DITHER_TypeDef test;
+  int32_t e, hist[2][8], sum[2];
+  uint64_t total, low;
+  uint32_t i, cycles;
+  int8_t mode;
+
+  // recursive oscillator in 24 bits (the lowest byte stays clear)
+  in[0] = 0;
+  in[1] = (int32_t)((DITHER_TEST_AMP * 130526LL) / 1000000); // sin(7.5 deg)
+  for (i = 2; i < DITHER_TEST_LEN; i++) {
+    in[i] = (int32_t)(((int64_t)DITHER_TEST_COEF * in[i - 1]) >> 30) - in[i - 2];
+  }
+  for (i = 0; i < DITHER_TEST_LEN; i++) {
+    in[i] &= ~0xFF;
+  }
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  for (mode = -1; mode <= DITHER_MAX_ORDER; mode++) {
+    DITHER_Init(&test, 1, (mode < 0) ? 0 : mode);
+    test.enabled = (mode >= 0);
+
+    cycles = DWT->CYCCNT;
+    DITHER_Process(&test, out, in, DITHER_TEST_LEN);
+    cycles = DWT->CYCCNT - cycles;
+
+    // error in 1/256 of an output LSB
+    total = low = 0;
+    sum[0] = sum[1] = 0;
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i < DITHER_TEST_LEN; i++) {
+      e = ((int32_t)out[i] << 8) - (in[i] >> 8);
+      total += (int64_t)e * e;
+      sum[0] += e - hist[0][i & 7];
+      hist[0][i & 7] = e;
+      sum[1] += sum[0] - hist[1][i & 7]; // 64 times the average
+      hist[1][i & 7] = sum[0];
+      low += (int64_t)sum[1] * sum[1];
+    }
+    println("%s: %u.%u cycles per sample, error %u mLSB2, below 3 kHz %u uLSB2",
+        (mode < 0) ? "Truncation" : (mode == 0) ? "TPDF" : (mode == 1) ? "TPDF, 1st order" : "TPDF, 2nd order",
+        (unsigned int)(cycles / DITHER_TEST_LEN), (unsigned int)((cycles * 10 / DITHER_TEST_LEN) % 10),
+        (unsigned int)((total * 1000) / (65536ULL * DITHER_TEST_LEN)),
+        (unsigned int)((low * 1000000) / (65536ULL * 4096 * DITHER_TEST_LEN)));
+  }
+}
@@ -0,0 +1,264 @@
+/**
+ * @file    adpcm.c
+ * @brief   IMA ADPCM encoder and decoder
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ * 
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the 
+ * accompanying materials are made available 
+ * under the terms of the GNU Public License 
+ * v3.0 which accompanies this distribution, 
+ * and is available at 
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <adpcm.h>
+
+/**
+ * @addtogroup ADPCM
+ * @{
+ */
+
+#define ADPCM_MAX_INDEX   88  ///< Last index of the step table
+
+/**
+ * @brief Quantizer step sizes.
+ */
+static const int16_t stepTable[ADPCM_MAX_INDEX + 1] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+  19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+  130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+  876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+  5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+/**
+ * @brief Step index adjustment for every code (sign bit ignored).
+ */
+static const int8_t indexTable[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+  -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+/**
+ * @brief Encode one sample.
+ * @param state Channel state
+ * @param sample Sample to encode
+ * @return 4 bit ADPCM code
+ */
+static inline uint8_t ADPCM_EncodeSample(ADPCM_StateTypeDef* state, int16_t sample) {
+
+  int32_t step    = stepTable[state->index];
+  int32_t diff    = (int32_t)sample - state->predictor;
+  int32_t vpdiff  = step >> 3;
+  int32_t pred    = state->predictor;
+  int32_t index;
+  uint8_t code    = 0;
+
+  if (diff < 0) {
+    code = 8;
+    diff = -diff;
+  }
+  // successive approximation of diff/step on 3 bits
+  if (diff >= step) {
+    code   |= 4;
+    diff   -= step;
+    vpdiff += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    code   |= 2;
+    diff   -= step;
+    vpdiff += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    code   |= 1;
+    vpdiff += step;
+  }
+
+  // update the predictor exactly as the decoder does
+  pred += (code & 8) ? -vpdiff : vpdiff;
+  if (pred > 32767) {
+    pred = 32767;
+  } else if (pred < -32768) {
+    pred = -32768;
+  }
+  state->predictor = (int16_t)pred;
+
+  index = (int32_t)state->index + indexTable[code];
+  if (index < 0) {
+    index = 0;
+  } else if (index > ADPCM_MAX_INDEX) {
+    index = ADPCM_MAX_INDEX;
+  }
+  state->index = (uint8_t)index;
+
+  return code;
+}
+
+/**
+ * @brief Decode one sample.
+ * @param state Channel state
+ * @param code 4 bit ADPCM code
+ * @return Decoded sample
+ */
+static inline int16_t ADPCM_DecodeSample(ADPCM_StateTypeDef* state, uint8_t code) {
+
+  int32_t step    = stepTable[state->index];
+  int32_t vpdiff  = step >> 3;
+  int32_t pred    = state->predictor;
+  int32_t index;
+
+  if (code & 4) {
+    vpdiff += step;
+  }
+  if (code & 2) {
+    vpdiff += step >> 1;
+  }
+  if (code & 1) {
+    vpdiff += step >> 2;
+  }
+
+  pred += (code & 8) ? -vpdiff : vpdiff;
+  if (pred > 32767) {
+    pred = 32767;
+  } else if (pred < -32768) {
+    pred = -32768;
+  }
+  state->predictor = (int16_t)pred;
+
+  index = (int32_t)state->index + indexTable[code];
+  if (index < 0) {
+    index = 0;
+  } else if (index > ADPCM_MAX_INDEX) {
+    index = ADPCM_MAX_INDEX;
+  }
+  state->index = (uint8_t)index;
+
+  return state->predictor;
+}
+
+/**
+ * @brief Initialize the encoder state.
+ * @param state Array of states, one per channel
+ * @param channels Number of channels
+ */
+void ADPCM_Init(ADPCM_StateTypeDef* state, uint8_t channels) {
+
+  uint8_t ch;
+
+  for (ch = 0; ch < channels; ch++) {
+    state[ch].predictor = 0;
+    state[ch].index     = 0;
+  }
+}
+
+/**
+ * @brief Encode one block of interleaved samples.
+ *
+ * @details The block layout is the one used by WAVE_FORMAT_IMA_ADPCM:
+ * a 4 byte header per channel (first sample, step index, 0) followed
+ * by groups of 4 bytes (8 codes, low nibble first) for every channel
+ * in turn. The step index is carried over from the previous block.
+ *
+ * @param state Array of states, one per channel
+ * @param pcm Interleaved 16 bit samples (samplesPerBlock frames)
+ * @param block Output block
+ * @param channels Number of channels (1 or 2)
+ * @param samplesPerBlock Samples per channel, see ADPCM_SAMPLES_PER_BLOCK
+ * @return Number of bytes written to the block
+ */
+uint32_t ADPCM_EncodeBlock(ADPCM_StateTypeDef* state, const int16_t* pcm,
+    uint8_t* block, uint8_t channels, uint16_t samplesPerBlock) {
+
+  uint8_t* out = block;
+  const int16_t* in;
+  uint32_t frame, i;
+  uint8_t ch, lo, hi;
+
+  // block header - the first sample is stored as is
+  for (ch = 0; ch < channels; ch++) {
+    state[ch].predictor = pcm[ch];
+    *out++ = (uint8_t)(pcm[ch] & 0xff);
+    *out++ = (uint8_t)((pcm[ch] >> 8) & 0xff);
+    *out++ = state[ch].index;
+    *out++ = 0;
+  }
+
+  // 8 samples of every channel in turn
+  for (frame = 1; frame < samplesPerBlock; frame += 8) {
+    for (ch = 0; ch < channels; ch++) {
+      in = pcm + frame * channels + ch;
+      for (i = 0; i < 4; i++) {
+        lo = ADPCM_EncodeSample(&state[ch], in[0]);
+        hi = ADPCM_EncodeSample(&state[ch], in[channels]);
+        *out++ = lo | (hi << 4);
+        in += 2 * channels;
+      }
+    }
+  }
+
+  return (uint32_t)(out - block);
+}
+
+/**
+ * @brief Decode one block of a WAVE_FORMAT_IMA_ADPCM file.
+ *
+ * @details The decoder state is taken from the block headers, so the
+ * blocks can be decoded in any order. The samples are written in
+ * increasing order and do not overtake the codes still to be read, so
+ * the block may be decoded in place when it starts at least
+ * samplesPerBlock * channels * 2 - blockAlign + 4 bytes after the samples.
+ *
+ * @param block Input block
+ * @param pcm Interleaved 16 bit samples (samplesPerBlock frames)
+ * @param channels Number of channels (1 or 2)
+ * @param samplesPerBlock Samples per channel, see ADPCM_SAMPLES_PER_BLOCK
+ * @return Number of bytes read from the block
+ */
+uint32_t ADPCM_DecodeBlock(const uint8_t* block, int16_t* pcm,
+    uint8_t channels, uint16_t samplesPerBlock) {
+
+  ADPCM_StateTypeDef state[ADPCM_MAX_CHANNELS];
+  const uint8_t* in = block;
+  int16_t* out;
+  uint32_t frame, i;
+  uint8_t ch;
+
+  // block header - the first sample is stored as is
+  for (ch = 0; ch < channels; ch++) {
+    state[ch].predictor = (int16_t)(in[0] | (in[1] << 8));
+    state[ch].index     = (in[2] > ADPCM_MAX_INDEX) ? ADPCM_MAX_INDEX : in[2];
+    in += 4;
+  }
+  for (ch = 0; ch < channels; ch++) {
+    pcm[ch] = state[ch].predictor;
+  }
+
+  // 8 samples of every channel in turn
+  for (frame = 1; frame < samplesPerBlock; frame += 8) {
+    for (ch = 0; ch < channels; ch++) {
+      out = pcm + frame * channels + ch;
+      for (i = 0; i < 4; i++) {
+        out[0]        = ADPCM_DecodeSample(&state[ch], *in & 0x0f);
+        out[channels] = ADPCM_DecodeSample(&state[ch], *in >> 4);
+        out += 2 * channels;
+        in++;
+      }
+    }
+  }
+
+  return (uint32_t)(in - block);
+}
+
+/**
+ * @}
+ */
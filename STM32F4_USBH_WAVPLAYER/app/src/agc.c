@@ -0,0 +1,247 @@
+/**
+ * @file    agc.c
+ * @brief   Automatic gain control
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The gain follows the RMS level of every block: it drops with
+ * the attack time constant and rises with the release time constant,
+ * and it is held when the input is below the noise floor. A peak limiter
+ * then lowers the gain of a block whose peak would exceed the limit, so
+ * the output never clips. The work per block is one pass to measure the
+ * level, one pass to apply the gain and a constant part (one square root
+ * and two divisions), so the cost is fixed for a given block length.
+ * On the Cortex-M4 the passes use the DSP instructions on sample pairs.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <agc.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include <stm32f4xx.h>
+#define AGC_ENERGY(pair, acc) __SMLALD((pair), (pair), (acc))
+#define AGC_SAT16(x)          ((int32_t)__SSAT((x), 16))
+#define AGC_PACK(lo, hi)      __PKHBT((lo), (hi), 16)
+#else
+#define AGC_ENERGY(pair, acc) ((acc) + \
+    (uint64_t)((int32_t)(int16_t)(pair) * (int16_t)(pair)) + \
+    (uint64_t)((int32_t)(int16_t)((pair) >> 16) * (int16_t)((pair) >> 16)))
+#define AGC_SAT16(x)          ((x) > 32767 ? 32767 : ((x) < -32768 ? -32768 : (x)))
+#define AGC_PACK(lo, hi)      (((uint32_t)(lo) & 0xFFFF) | ((uint32_t)(hi) << 16))
+#endif
+
+/**
+ * @addtogroup AGC
+ * @{
+ */
+
+#define AGC_TARGET_DB     -20   ///< Default output RMS level in dBFS
+#define AGC_LIMIT_DB      -1    ///< Default output peak limit in dBFS
+#define AGC_FLOOR_DB      -60   ///< Input RMS level of silence in dBFS
+#define AGC_MAX_GAIN_DB   30    ///< Default highest gain in dB
+#define AGC_MIN_GAIN      (AGC_UNITY_GAIN / 16) ///< Lowest gain (-24 dB)
+#define AGC_ATTACK_MS     5     ///< Default attack time
+#define AGC_RELEASE_MS    500   ///< Default release time
+
+#define AGC_MINUS_1DB     29205 ///< -1 dB in Q15
+#define AGC_PLUS_1DB      36766 ///< +1 dB in Q15
+
+/**
+ * @brief Convert a level in dBFS to Q15.
+ * @param db Level (0 or less)
+ * @return Level in Q15
+ */
+static int32_t AGC_DbToQ15(int8_t db) {
+
+  int32_t value = 32767;
+
+  while (db++ < 0) {
+    value = (value * AGC_MINUS_1DB) >> 15;
+  }
+  return value;
+}
+
+/**
+ * @brief Convert a gain in dB to Q16.16.
+ * @param db Gain (0 or more)
+ * @return Gain in Q16.16
+ */
+static int32_t AGC_DbToGain(uint8_t db) {
+
+  int64_t value = AGC_UNITY_GAIN;
+
+  while (db--) {
+    value = (value * AGC_PLUS_1DB) >> 15;
+  }
+  return (int32_t)value;
+}
+
+/**
+ * @brief Integer square root.
+ * @param x Value
+ * @return Square root rounded down
+ */
+static uint32_t AGC_Sqrt(uint32_t x) {
+
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+  uint8_t i;
+
+  // fixed number of iterations
+  for (i = 0; i < 16; i++) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+/**
+ * @brief Initialize the AGC with the default parameters.
+ * @param agc AGC structure
+ * @param blockTime Duration of one block in us
+ */
+void AGC_Init(AGC_TypeDef* agc, uint16_t blockTime) {
+
+  agc->blockTime  = blockTime;
+  agc->floor      = AGC_DbToQ15(AGC_FLOOR_DB);
+  AGC_SetTarget(agc, AGC_TARGET_DB);
+  AGC_SetLimit(agc, AGC_LIMIT_DB);
+  AGC_SetMaxGain(agc, AGC_MAX_GAIN_DB);
+  AGC_SetTimes(agc, AGC_ATTACK_MS, AGC_RELEASE_MS);
+
+  agc->gain       = AGC_UNITY_GAIN;
+  agc->applied    = AGC_UNITY_GAIN;
+  agc->limited    = 0;
+  agc->enabled    = 1;
+}
+
+/**
+ * @brief Set the output level.
+ * @param agc AGC structure
+ * @param targetDb Output RMS level in dBFS
+ */
+void AGC_SetTarget(AGC_TypeDef* agc, int8_t targetDb) {
+  agc->target = AGC_DbToQ15(targetDb > 0 ? 0 : targetDb);
+}
+
+/**
+ * @brief Set the peak limit.
+ * @param agc AGC structure
+ * @param limitDb Output peak limit in dBFS
+ */
+void AGC_SetLimit(AGC_TypeDef* agc, int8_t limitDb) {
+  agc->limit = AGC_DbToQ15(limitDb > 0 ? 0 : limitDb);
+}
+
+/**
+ * @brief Set the highest gain.
+ * @param agc AGC structure
+ * @param maxGainDb Highest gain in dB (up to 48 dB)
+ */
+void AGC_SetMaxGain(AGC_TypeDef* agc, uint8_t maxGainDb) {
+  agc->maxGain = AGC_DbToGain(maxGainDb > 48 ? 48 : maxGainDb);
+}
+
+/**
+ * @brief Set the time constants.
+ * @param agc AGC structure
+ * @param attackMs Time to follow a louder input
+ * @param releaseMs Time to follow a quieter input
+ */
+void AGC_SetTimes(AGC_TypeDef* agc, uint16_t attackMs, uint16_t releaseMs) {
+
+  uint32_t coef;
+
+  // one block moves the gain by blockTime / time of the difference
+  coef = attackMs ? (32768UL * agc->blockTime) / (attackMs * 1000UL) : 32767;
+  agc->attack = (coef == 0) ? 1 : ((coef > 32767) ? 32767 : coef);
+  coef = releaseMs ? (32768UL * agc->blockTime) / (releaseMs * 1000UL) : 32767;
+  agc->release = (coef == 0) ? 1 : ((coef > 32767) ? 32767 : coef);
+}
+
+/**
+ * @brief Process a block of samples in place.
+ * @param agc AGC structure
+ * @param samples Mono 16 bit samples, 32-bit aligned
+ * @param len Number of samples (even)
+ */
+void AGC_Process(AGC_TypeDef* agc, int16_t* samples, uint32_t len) {
+
+  uint32_t* pairs = (uint32_t*)samples;
+  uint64_t energy = 0;
+  int32_t peak = 0;
+  int32_t lo, hi, rms, desired, diff, g, step;
+  uint32_t i, x;
+
+  if (!agc->enabled || (len < 2)) {
+    return;
+  }
+  len >>= 1;
+
+  // level of the block
+  for (i = 0; i < len; i++) {
+    x = pairs[i];
+    energy = AGC_ENERGY(x, energy);
+    lo = (int16_t)x;
+    hi = (int16_t)(x >> 16);
+    lo = (lo < 0) ? -lo : lo;
+    hi = (hi < 0) ? -hi : hi;
+    peak = (lo > peak) ? lo : peak;
+    peak = (hi > peak) ? hi : peak;
+  }
+  rms = AGC_Sqrt((uint32_t)(energy / (len << 1)));
+
+  // gain following the level, held in silence
+  desired = agc->gain;
+  if (rms > agc->floor) {
+    desired = (int32_t)(((uint32_t)agc->target << 16) / (uint32_t)rms);
+    desired = (desired > agc->maxGain) ? agc->maxGain : desired;
+    desired = (desired < AGC_MIN_GAIN) ? AGC_MIN_GAIN : desired;
+  }
+  diff = desired - agc->gain;
+  agc->gain += (int32_t)(((int64_t)diff * ((diff < 0) ? agc->attack : agc->release)) >> 15);
+
+  // peak limiter
+  g = agc->gain;
+  if (((int64_t)peak * g) >> 16 > agc->limit) {
+    g = (int32_t)(((uint32_t)agc->limit << 16) / (uint32_t)peak);
+    agc->limited++;
+  }
+
+  // a lower gain applies at once, a higher one is ramped over the block
+  step = 0;
+  if (g > agc->applied) {
+    step = (g - agc->applied) / (int32_t)(len << 1);
+    g = agc->applied;
+  }
+
+  for (i = 0; i < len; i++) {
+    x = pairs[i];
+    lo = (int32_t)(((int64_t)g * (int16_t)x) >> 16);
+    g += step;
+    hi = (int32_t)(((int64_t)g * (int16_t)(x >> 16)) >> 16);
+    g += step;
+    lo = AGC_SAT16(lo);
+    hi = AGC_SAT16(hi);
+    pairs[i] = AGC_PACK(lo, hi);
+  }
+  agc->applied = g;
+}
+
+/**
+ * @}
+ */
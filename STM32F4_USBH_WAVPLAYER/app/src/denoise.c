@@ -0,0 +1,342 @@
+/**
+ * @file    denoise.c
+ * @brief   Spectral noise suppressor
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The samples are analysed in frames of DENOISE_FFT_LEN with 50%
+ * overlap and a Hann window, so the processed frames simply add up to the
+ * output (overlap-add). Every frame is transformed with a fixed point real
+ * FFT (a complex FFT of half the length and a split step). The noise floor
+ * of every bin follows the minimum of the smoothed magnitude: it drops at
+ * once and rises slowly, so speech, which is never steady, does not lift it.
+ * The gain of a bin is a magnitude spectral subtraction, limited to
+ * minGain to keep the residual noise natural, and smoothed over two frames.
+ * All the memory is in the DENOISE_TypeDef structure.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <string.h>
+#include <denoise.h>
+
+/**
+ * @addtogroup DENOISE
+ * @{
+ */
+
+#define DENOISE_HALF      (DENOISE_FFT_LEN / 2) ///< Length of the complex FFT
+#define DENOISE_LOG2_HALF 7                     ///< log2(DENOISE_HALF)
+#define DENOISE_SHIFT     4     ///< Extra fractional bits of the samples in the FFT
+#define DENOISE_RISE_TIME 2     ///< Time constant of the noise floor rise in seconds
+#define DENOISE_OVER_SUB  384   ///< Default over-subtraction (1.5 in Q8)
+#define DENOISE_MIN_GAIN  5827  ///< Default lowest gain (-15 dB in Q15)
+
+#define DENOISE_SIN(i)    sinTable[(i) & (DENOISE_FFT_LEN - 1)]
+#define DENOISE_COS(i)    sinTable[((i) + DENOISE_FFT_LEN / 4) & (DENOISE_FFT_LEN - 1)]
+
+/**
+ * @brief One period of the sine in Q15 (DENOISE_FFT_LEN points).
+ */
+static const int16_t sinTable[DENOISE_FFT_LEN] = {
+       0,    804,   1608,   2410,   3212,   4011,   4808,   5602,
+    6393,   7179,   7962,   8739,   9512,  10278,  11039,  11793,
+   12539,  13279,  14010,  14732,  15446,  16151,  16846,  17530,
+   18204,  18868,  19519,  20159,  20787,  21403,  22005,  22594,
+   23170,  23731,  24279,  24811,  25329,  25832,  26319,  26790,
+   27245,  27683,  28105,  28510,  28898,  29268,  29621,  29956,
+   30273,  30571,  30852,  31113,  31356,  31580,  31785,  31971,
+   32137,  32285,  32412,  32521,  32609,  32678,  32728,  32757,
+   32767,  32757,  32728,  32678,  32609,  32521,  32412,  32285,
+   32137,  31971,  31785,  31580,  31356,  31113,  30852,  30571,
+   30273,  29956,  29621,  29268,  28898,  28510,  28105,  27683,
+   27245,  26790,  26319,  25832,  25329,  24811,  24279,  23731,
+   23170,  22594,  22005,  21403,  20787,  20159,  19519,  18868,
+   18204,  17530,  16846,  16151,  15446,  14732,  14010,  13279,
+   12539,  11793,  11039,  10278,   9512,   8739,   7962,   7179,
+    6393,   5602,   4808,   4011,   3212,   2410,   1608,    804,
+       0,   -804,  -1608,  -2410,  -3212,  -4011,  -4808,  -5602,
+   -6393,  -7179,  -7962,  -8739,  -9512, -10278, -11039, -11793,
+  -12539, -13279, -14010, -14732, -15446, -16151, -16846, -17530,
+  -18204, -18868, -19519, -20159, -20787, -21403, -22005, -22594,
+  -23170, -23731, -24279, -24811, -25329, -25832, -26319, -26790,
+  -27245, -27683, -28105, -28510, -28898, -29268, -29621, -29956,
+  -30273, -30571, -30852, -31113, -31356, -31580, -31785, -31971,
+  -32137, -32285, -32412, -32521, -32609, -32678, -32728, -32757,
+  -32767, -32757, -32728, -32678, -32609, -32521, -32412, -32285,
+  -32137, -31971, -31785, -31580, -31356, -31113, -30852, -30571,
+  -30273, -29956, -29621, -29268, -28898, -28510, -28105, -27683,
+  -27245, -26790, -26319, -25832, -25329, -24811, -24279, -23731,
+  -23170, -22594, -22005, -21403, -20787, -20159, -19519, -18868,
+  -18204, -17530, -16846, -16151, -15446, -14732, -14010, -13279,
+  -12539, -11793, -11039, -10278,  -9512,  -8739,  -7962,  -7179,
+   -6393,  -5602,  -4808,  -4011,  -3212,  -2410,  -1608,   -804
+};
+
+/**
+ * @brief Multiply by a Q15 coefficient.
+ */
+static inline int32_t DENOISE_Mul(int32_t x, int32_t coef) {
+  return (int32_t)(((int64_t)x * coef) >> 15);
+}
+
+/**
+ * @brief In place complex FFT of DENOISE_HALF points (not scaled).
+ * @param x Data (re, im pairs)
+ * @param inverse 1 for the inverse transform
+ */
+static void DENOISE_Fft(int32_t* x, uint8_t inverse) {
+
+  uint32_t i, j, k, bit, size, half, step;
+  int32_t tr, ti, wr, wi;
+
+  // bit reversed order
+  for (i = 0; i < DENOISE_HALF; i++) {
+    j = 0;
+    for (bit = 0; bit < DENOISE_LOG2_HALF; bit++) {
+      j |= ((i >> bit) & 1) << (DENOISE_LOG2_HALF - 1 - bit);
+    }
+    if (j > i) {
+      tr = x[2 * i];
+      ti = x[2 * i + 1];
+      x[2 * i] = x[2 * j];
+      x[2 * i + 1] = x[2 * j + 1];
+      x[2 * j] = tr;
+      x[2 * j + 1] = ti;
+    }
+  }
+
+  // radix 2 butterflies
+  for (size = 2; size <= DENOISE_HALF; size <<= 1) {
+    half = size >> 1;
+    step = DENOISE_FFT_LEN / size;
+    for (k = 0; k < half; k++) {
+      wr = DENOISE_COS(k * step);
+      wi = inverse ? DENOISE_SIN(k * step) : -DENOISE_SIN(k * step);
+      for (i = k; i < DENOISE_HALF; i += size) {
+        j = i + half;
+        tr = DENOISE_Mul(x[2 * j], wr) - DENOISE_Mul(x[2 * j + 1], wi);
+        ti = DENOISE_Mul(x[2 * j], wi) + DENOISE_Mul(x[2 * j + 1], wr);
+        x[2 * j] = x[2 * i] - tr;
+        x[2 * j + 1] = x[2 * i + 1] - ti;
+        x[2 * i] += tr;
+        x[2 * i + 1] += ti;
+      }
+    }
+  }
+}
+
+/**
+ * @brief In place real FFT of DENOISE_FFT_LEN points.
+ * @details The spectrum is packed: bins 1..DENOISE_HALF-1 are re, im
+ * pairs, x[0] is bin 0 and x[1] is bin DENOISE_HALF (both real).
+ * @param x Samples
+ */
+static void DENOISE_RealFft(int32_t* x) {
+
+  uint32_t k, m;
+  int32_t fer, fei, for_, foi, tr, ti, c, s;
+
+  DENOISE_Fft(x, 0);
+
+  tr = x[0];
+  x[0] = tr + x[1];
+  x[1] = tr - x[1];
+
+  for (k = 1; k <= DENOISE_HALF / 2; k++) {
+    m = DENOISE_HALF - k;
+    fer = (x[2 * k] + x[2 * m]) >> 1;
+    fei = (x[2 * k + 1] - x[2 * m + 1]) >> 1;
+    for_ = (x[2 * k + 1] + x[2 * m + 1]) >> 1;
+    foi = (x[2 * m] - x[2 * k]) >> 1;
+    c = DENOISE_COS(k);
+    s = DENOISE_SIN(k);
+    tr = DENOISE_Mul(for_, c) + DENOISE_Mul(foi, s);
+    ti = DENOISE_Mul(foi, c) - DENOISE_Mul(for_, s);
+    x[2 * m] = fer - tr;
+    x[2 * m + 1] = ti - fei;
+    x[2 * k] = fer + tr;
+    x[2 * k + 1] = fei + ti;
+  }
+}
+
+/**
+ * @brief In place inverse of DENOISE_RealFft (scaled by DENOISE_HALF).
+ * @param x Packed spectrum
+ */
+static void DENOISE_RealIfft(int32_t* x) {
+
+  uint32_t k, m;
+  int32_t fer, fei, for_, foi, dr, di, c, s;
+
+  fer = (x[0] + x[1]) >> 1;
+  x[1] = (x[0] - x[1]) >> 1;
+  x[0] = fer;
+
+  for (k = 1; k <= DENOISE_HALF / 2; k++) {
+    m = DENOISE_HALF - k;
+    fer = (x[2 * k] + x[2 * m]) >> 1;
+    fei = (x[2 * k + 1] - x[2 * m + 1]) >> 1;
+    dr = (x[2 * k] - x[2 * m]) >> 1;
+    di = (x[2 * k + 1] + x[2 * m + 1]) >> 1;
+    c = DENOISE_COS(k);
+    s = DENOISE_SIN(k);
+    for_ = DENOISE_Mul(dr, c) - DENOISE_Mul(di, s);
+    foi = DENOISE_Mul(dr, s) + DENOISE_Mul(di, c);
+    x[2 * m] = fer + foi;
+    x[2 * m + 1] = for_ - fei;
+    x[2 * k] = fer - foi;
+    x[2 * k + 1] = fei + for_;
+  }
+
+  DENOISE_Fft(x, 1);
+}
+
+/**
+ * @brief Initialize the suppressor with the default parameters.
+ * @param ns Suppressor
+ * @param freq Sampling frequency
+ */
+void DENOISE_Init(DENOISE_TypeDef* ns, uint32_t freq) {
+
+  uint32_t frames = freq / DENOISE_HOP; // per second
+
+  memset(ns, 0, sizeof(DENOISE_TypeDef));
+  ns->overSub = DENOISE_OVER_SUB;
+  ns->minGain = DENOISE_MIN_GAIN;
+  ns->enabled = 1;
+
+  // longer than a word, so the floor stays below the speech
+  frames *= DENOISE_RISE_TIME;
+  while ((2UL << ns->riseShift) <= frames) {
+    ns->riseShift++;
+  }
+}
+
+/**
+ * @brief Process one frame and produce the next DENOISE_HOP output samples.
+ * @param ns Suppressor
+ */
+static void DENOISE_Frame(DENOISE_TypeDef* ns) {
+
+  int32_t* x = ns->buf;
+  int32_t re, im, mag, lo, g;
+  uint32_t i, k;
+
+  if (ns->enabled == 0) {
+    // the frames add up to the input delayed by one frame
+    memcpy(ns->out, ns->hist, sizeof(ns->out));
+    for (i = 0; i < DENOISE_HOP; i++) {
+      ns->tail[i] = DENOISE_Mul(ns->in[i] << DENOISE_SHIFT, 16384 + (DENOISE_COS(i) >> 1)) << DENOISE_LOG2_HALF;
+    }
+    memcpy(ns->hist, ns->in, sizeof(ns->hist));
+    return;
+  }
+
+  // Hann window (periodic, the halves of overlapping frames add up to 1)
+  for (i = 0; i < DENOISE_HOP; i++) {
+    x[i] = DENOISE_Mul(ns->hist[i] << DENOISE_SHIFT, 16384 - (DENOISE_COS(i) >> 1));
+    x[i + DENOISE_HOP] = DENOISE_Mul(ns->in[i] << DENOISE_SHIFT, 16384 + (DENOISE_COS(i) >> 1));
+  }
+  DENOISE_RealFft(x);
+
+  for (k = 0; k < DENOISE_BINS; k++) {
+    if (k == 0) {
+      re = x[0];
+      im = 0;
+    } else if (k == DENOISE_HALF) {
+      re = x[1];
+      im = 0;
+    } else {
+      re = x[2 * k];
+      im = x[2 * k + 1];
+    }
+
+    // magnitude: max + 3/8 min
+    mag = (re < 0) ? -re : re;
+    lo = (im < 0) ? -im : im;
+    if (lo > mag) {
+      g = mag;
+      mag = lo;
+      lo = g;
+    }
+    mag += (lo * 3) >> 3;
+    ns->level[k] += (mag - ns->level[k]) >> 1;
+
+    // noise floor: minimum of the level, rising slowly
+    if ((ns->noiseValid == 0) || (ns->level[k] < ns->noise[k])) {
+      ns->noise[k] = ns->level[k];
+    } else {
+      ns->noise[k] += ((ns->level[k] - ns->noise[k]) >> ns->riseShift) + 1;
+    }
+
+    // spectral subtraction
+    g = ns->minGain;
+    if (ns->level[k] > 0) {
+      g = 32767 - (int32_t)((((int64_t)ns->noise[k] * ns->overSub) << 7) / ns->level[k]);
+      g = (g < ns->minGain) ? ns->minGain : g;
+    }
+    g = (g + ns->gain[k]) >> 1;
+    ns->gain[k] = g;
+
+    if (k == 0) {
+      x[0] = DENOISE_Mul(re, g);
+    } else if (k == DENOISE_HALF) {
+      x[1] = DENOISE_Mul(re, g);
+    } else {
+      x[2 * k] = DENOISE_Mul(re, g);
+      x[2 * k + 1] = DENOISE_Mul(im, g);
+    }
+  }
+  ns->noiseValid = 1;
+
+  DENOISE_RealIfft(x);
+
+  // overlap-add
+  for (i = 0; i < DENOISE_HOP; i++) {
+    re = (x[i] + ns->tail[i]) >> (DENOISE_LOG2_HALF + DENOISE_SHIFT);
+    ns->out[i] = (re > 32767) ? 32767 : ((re < -32768) ? -32768 : re);
+    ns->tail[i] = x[i + DENOISE_HOP];
+  }
+  memcpy(ns->hist, ns->in, sizeof(ns->hist));
+  ns->frames++;
+}
+
+/**
+ * @brief Process samples in place.
+ * @details The samples are replaced by the output delayed by
+ * DENOISE_FFT_LEN samples. Any number of samples can be passed.
+ * @param ns Suppressor
+ * @param samples Mono 16 bit samples
+ * @param len Number of samples
+ */
+void DENOISE_Process(DENOISE_TypeDef* ns, int16_t* samples, uint32_t len) {
+
+  int32_t s;
+  uint32_t i;
+
+  for (i = 0; i < len; i++) {
+    s = samples[i];
+    samples[i] = ns->out[ns->pos];
+    ns->in[ns->pos] = s;
+    ns->inEnergy += (uint32_t)(s * s);
+    ns->outEnergy += (uint32_t)(samples[i] * samples[i]);
+
+    if (++ns->pos == DENOISE_HOP) {
+      ns->pos = 0;
+      DENOISE_Frame(ns);
+    }
+  }
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,176 @@
+/**
+ * @file    dither.c
+ * @brief   Dithered reduction to 16 bits
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The samples (32 bits, most significant bits used) are reduced
+ * to 24 bits, so 1 LSB of the output is 256 and the error feedback cannot
+ * overflow. Triangular dither of +/- 1 LSB, the sum of two uniform values
+ * taken from the halves of a xorshift word, is added before rounding.
+ * The error feedback filter (first order 1 - z^-1, second order
+ * (1 - z^-1)^2) moves the total error, dither included, out of the low
+ * frequencies, at the cost of more noise in total. The fed back error is
+ * limited to 4 LSB, so clipped samples do not make the loop unstable.
+ * The xorshift generator costs a few cycles per sample, the hardware RNG
+ * (a new word every 40 cycles of its 48 MHz clock) only seeds it.
+ * A stereo block is processed frame by frame with both results stored in
+ * one word.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stm32f4xx.h>
+#include <dither.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#define DITHER_SAT16(x)       ((int32_t)__SSAT((x), 16))
+#define DITHER_PACK(lo, hi)   __PKHBT((lo), (hi), 16)
+#else
+#define DITHER_SAT16(x)       ((x) > 32767 ? 32767 : ((x) < -32768 ? -32768 : (x)))
+#define DITHER_PACK(lo, hi)   (((uint32_t)(lo) & 0xFFFF) | ((uint32_t)(hi) << 16))
+#endif
+
+/**
+ * @addtogroup DITHER
+ * @{
+ */
+
+#define DITHER_SHIFT        8     ///< Fraction bits of an output LSB
+#define DITHER_ERR_LIMIT    (4 << DITHER_SHIFT) ///< Highest error fed back
+#define DITHER_RNG_TIMEOUT  1000  ///< Loops waiting for the RNG
+#define DITHER_DEFAULT_SEED 2463534242UL ///< When the RNG does not answer
+
+/**
+ * @brief Get a seed from the hardware RNG.
+ * @details The RNG is clocked only for this.
+ * @return Seed (never 0)
+ */
+static uint32_t DITHER_Seed(void) {
+
+  uint32_t seed = 0, timeout = DITHER_RNG_TIMEOUT;
+
+  RCC_AHB2PeriphClockCmd(RCC_AHB2Periph_RNG, ENABLE);
+  RNG_Cmd(ENABLE);
+  while ((RNG_GetFlagStatus(RNG_FLAG_DRDY) == RESET) && --timeout);
+  if (timeout) {
+    seed = RNG_GetRandomNumber();
+  }
+  RNG_Cmd(DISABLE);
+  RCC_AHB2PeriphClockCmd(RCC_AHB2Periph_RNG, DISABLE);
+
+  return seed ? seed : DITHER_DEFAULT_SEED;
+}
+
+/**
+ * @brief Get the next triangular dither value.
+ * @param seed State of the generator
+ * @return Dither in 1/256 LSB (-256..254)
+ */
+static inline int32_t DITHER_Tpdf(uint32_t* seed) {
+
+  uint32_t x = *seed;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return ((int32_t)(int16_t)x + (int16_t)(x >> 16)) >> DITHER_SHIFT;
+}
+
+/**
+ * @brief Quantize one sample.
+ * @param x Sample in 1/256 LSB
+ * @param d Dither in 1/256 LSB
+ * @param err Last errors of the channel
+ * @param order Noise shaping order
+ * @return 16 bit sample
+ */
+static inline int32_t DITHER_Quantize(int32_t x, int32_t d, int32_t* err, uint8_t order) {
+
+  int32_t q, e;
+
+  if (order == 1) {
+    x -= err[0];
+  } else if (order == 2) {
+    x -= 2 * err[0] - err[1];
+  }
+  q = DITHER_SAT16((x + d + (1 << (DITHER_SHIFT - 1))) >> DITHER_SHIFT);
+
+  if (order) {
+    e = (q << DITHER_SHIFT) - x;
+    e = (e > DITHER_ERR_LIMIT) ? DITHER_ERR_LIMIT : ((e < -DITHER_ERR_LIMIT) ? -DITHER_ERR_LIMIT : e);
+    err[1] = err[0];
+    err[0] = e;
+  }
+  return q;
+}
+
+/**
+ * @brief Initialize the dither.
+ * @param dither Dither structure
+ * @param channels Interleaved channels (1 or 2)
+ * @param order Noise shaping order (0: none, 1 or 2)
+ */
+void DITHER_Init(DITHER_TypeDef* dither, uint8_t channels, uint8_t order) {
+
+  uint8_t i;
+
+  dither->channels  = (channels == 2) ? 2 : 1;
+  dither->order     = (order > DITHER_MAX_ORDER) ? DITHER_MAX_ORDER : order;
+  dither->enabled   = 1;
+  dither->seed      = DITHER_Seed();
+  for (i = 0; i < DITHER_MAX_ORDER; i++) {
+    dither->err[0][i] = 0;
+    dither->err[1][i] = 0;
+  }
+}
+
+/**
+ * @brief Reduce a block to 16 bits.
+ * @details The output may be the same buffer as the input.
+ * @param dither Dither structure
+ * @param out 16 bit samples, 32-bit aligned
+ * @param in 32 bit samples
+ * @param len Number of samples (whole frames)
+ */
+void DITHER_Process(DITHER_TypeDef* dither, int16_t* out, const int32_t* in, uint32_t len) {
+
+  uint32_t* words = (uint32_t*)out;
+  uint32_t seed = dither->seed, i;
+  uint8_t order = dither->order;
+  int32_t lo, hi;
+
+  if (!dither->enabled) {
+    for (i = 0; i < len; i++) {
+      out[i] = (int16_t)(in[i] >> 16);
+    }
+    return;
+  }
+
+  if (dither->channels == 2) {
+    for (i = 0; i < len / 2; i++) {
+      lo = DITHER_Quantize(in[0] >> DITHER_SHIFT, DITHER_Tpdf(&seed), dither->err[0], order);
+      hi = DITHER_Quantize(in[1] >> DITHER_SHIFT, DITHER_Tpdf(&seed), dither->err[1], order);
+      in += 2;
+      words[i] = DITHER_PACK(lo, hi);
+    }
+  } else {
+    for (i = 0; i < len; i++) {
+      out[i] = DITHER_Quantize(in[i] >> DITHER_SHIFT, DITHER_Tpdf(&seed), dither->err[0], order);
+    }
+  }
+  dither->seed = seed;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,510 @@
+/**
+ * @file    i2sclk.c
+ * @brief   I2S clock planner
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The sampling frequency of an I2S is
+ * ref * PLLI2SN / PLLI2SR / (clkDiv * (2 * I2SDIV + ODD)), where ref is
+ * the PLL input (HSE / PLLM). The fixed PLLI2S of the system clock setup
+ * suits 48 kHz, the 44.1 kHz family plays up to a few hundred ppm off.
+ * The planner tries every PLLI2S setting allowed for the PLL and the two
+ * prescalers around the ideal one, and keeps the smallest error. Both
+ * I2S (the codec on SPI3 and the microphone on SPI2) share the PLLI2S,
+ * and the one with the master clock (the codec) has the priority: its
+ * error never goes above I2SCLK_SHARE_COST (or its error alone, if
+ * larger), the other one takes what is left.
+ * - The codec started first takes, among the PLLI2S settings within its
+ *   limit, the one giving the smallest error to the microphone at any
+ *   multiple of I2SCLK_SHARE_STEP up to I2SCLK_SHARE_MIC.
+ * - The microphone started first prefers a PLLI2S which also serves the
+ *   codec at I2SCLK_SHARE_CODEC if its own error stays within
+ *   I2SCLK_SHARE_COST.
+ * - The microphone started second only sets its prescaler, and it is
+ *   refused if its error is above I2SCLK_SHARE_LIMIT.
+ * - The codec started second keeps the PLLI2S if its error is within its
+ *   limit. Otherwise the PLLI2S is planned for the codec as if it were
+ *   first, around the running microphone, which is restarted (it loses a
+ *   few PDM samples, while the codec would lose its master clock).
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <i2sclk.h>
+
+/**
+ * @addtogroup I2SCLK
+ * @{
+ */
+
+#define I2SCLK_N_MIN        192         ///< Lowest PLLI2SN
+#define I2SCLK_N_MAX        432         ///< Highest PLLI2SN
+#define I2SCLK_R_MIN        2           ///< Lowest PLLI2SR
+#define I2SCLK_R_MAX        7           ///< Highest PLLI2SR
+#define I2SCLK_VCO_MIN      192000000UL ///< Lowest VCO frequency
+#define I2SCLK_VCO_MAX      432000000UL ///< Highest VCO frequency
+#define I2SCLK_MAX          192000000UL ///< Highest I2S clock
+#define I2SCLK_PRESC_MIN    4           ///< Lowest 2 * I2SDIV + ODD
+#define I2SCLK_PRESC_MAX    511         ///< Highest 2 * I2SDIV + ODD
+#define I2SCLK_NO_ERROR     0x7FFFFFFF  ///< No valid setting yet
+#define I2SCLK_LOCK_TIMEOUT 100000      ///< PLLI2S lock wait loops
+
+static uint32_t I2SCLK_Freq[2]; ///< Frequency set on SPI2 and SPI3
+
+/**
+ * @brief Larger of the absolute errors of two settings.
+ * @param a First setting
+ * @param b Second setting
+ * @return Error in ppb
+ */
+static int32_t I2SCLK_Worst(const I2SCLK_PlanTypeDef* a, const I2SCLK_PlanTypeDef* b) {
+
+  int32_t ea = (a->error < 0) ? -a->error : a->error;
+  int32_t eb = (b->error < 0) ? -b->error : b->error;
+
+  return (ea > eb) ? ea : eb;
+}
+
+/**
+ * @brief I2S clock per sample of an initialized I2S.
+ * @param spi SPI2 or SPI3
+ * @return I2SCLK_DIV_MCLK, I2SCLK_DIV_16B or I2SCLK_DIV_32B
+ */
+static uint16_t I2SCLK_ClkDiv(SPI_TypeDef* spi) {
+
+  if (spi->I2SPR & SPI_I2SPR_MCKOE) {
+    return I2SCLK_DIV_MCLK;
+  }
+  return (spi->I2SCFGR & SPI_I2SCFGR_CHLEN) ? I2SCLK_DIV_32B : I2SCLK_DIV_16B;
+}
+
+/**
+ * @brief Error of a prescaler.
+ * @param i2sclk I2S clock in Hz
+ * @param freq Requested sampling frequency in Hz
+ * @param clkDiv I2S clock per sample (without the prescaler)
+ * @param presc Prescaler (2 * I2SDIV + ODD)
+ * @return Error in ppb
+ */
+static int32_t I2SCLK_Error(uint32_t i2sclk, uint32_t freq, uint16_t clkDiv,
+    uint32_t presc) {
+
+  uint64_t den = (uint64_t)clkDiv * presc * freq;
+  int64_t ppb;
+
+  ppb = (int64_t)(((uint64_t)i2sclk * 1000000000ULL + den / 2) / den) - 1000000000LL;
+
+  if (ppb > I2SCLK_NO_ERROR - 1) {
+    return I2SCLK_NO_ERROR - 1;
+  }
+  if (ppb < -(I2SCLK_NO_ERROR - 1)) {
+    return -(I2SCLK_NO_ERROR - 1);
+  }
+  return (int32_t)ppb;
+}
+
+/**
+ * @brief Find the best prescaler for one PLLI2S setting.
+ * @details The best prescaler is one of the two around the ideal ratio.
+ * @param ref PLL input frequency in Hz
+ * @param freq Requested sampling frequency in Hz
+ * @param clkDiv I2S clock per sample (without the prescaler)
+ * @param plan PLLI2S setting to try, the prescaler and error are updated
+ * if this setting is better than the one in plan
+ * @param n PLLI2SN
+ * @param r PLLI2SR
+ */
+static void I2SCLK_Try(uint32_t ref, uint32_t freq, uint16_t clkDiv,
+    I2SCLK_PlanTypeDef* plan, uint16_t n, uint8_t r) {
+
+  uint32_t vco = ref * n;
+  uint32_t i2sclk = vco / r;
+  uint32_t presc;
+  int32_t error;
+  uint8_t i;
+
+  if ((vco < I2SCLK_VCO_MIN) || (vco > I2SCLK_VCO_MAX) || (i2sclk > I2SCLK_MAX)) {
+    return;
+  }
+
+  presc = i2sclk / ((uint32_t)clkDiv * freq);
+
+  for (i = 0; i < 2; i++, presc++) {
+    if ((presc < I2SCLK_PRESC_MIN) || (presc > I2SCLK_PRESC_MAX)) {
+      continue;
+    }
+    error = I2SCLK_Error(i2sclk, freq, clkDiv, presc);
+    if (((error < 0) ? -error : error) <
+        ((plan->error < 0) ? -plan->error : plan->error)) {
+      plan->plln  = n;
+      plan->pllr  = r;
+      plan->div   = presc >> 1;
+      plan->odd   = presc & 1;
+      plan->error = error;
+    }
+  }
+}
+
+/**
+ * @brief Plan the clock of a sampling frequency.
+ * @details The setting in plan is tried first, so it is kept when no other
+ * setting is better.
+ * @param ref PLL input frequency in Hz (HSE / PLLM)
+ * @param freq Requested sampling frequency in Hz
+ * @param clkDiv I2S clock per sample: I2SCLK_DIV_MCLK, I2SCLK_DIV_16B or
+ * I2SCLK_DIV_32B
+ * @param keepPll Only the prescaler is chosen if 1
+ * @param plan Current PLLI2S setting (plln, pllr) on input, the best
+ * setting on output
+ * @retval 0 Success
+ * @retval 1 The frequency cannot be reached
+ */
+uint8_t I2SCLK_Plan(uint32_t ref, uint32_t freq, uint16_t clkDiv,
+    uint8_t keepPll, I2SCLK_PlanTypeDef* plan) {
+
+  uint16_t n = plan->plln;
+  uint8_t r = plan->pllr;
+
+  if ((freq == 0) || (clkDiv == 0)) {
+    return 1;
+  }
+
+  plan->error = I2SCLK_NO_ERROR;
+  I2SCLK_Try(ref, freq, clkDiv, plan, n, r);
+
+  if (!keepPll) {
+    for (n = I2SCLK_N_MIN; n <= I2SCLK_N_MAX; n++) {
+      for (r = I2SCLK_R_MIN; r <= I2SCLK_R_MAX; r++) {
+        I2SCLK_Try(ref, freq, clkDiv, plan, n, r);
+      }
+    }
+  }
+
+  return (plan->error == I2SCLK_NO_ERROR) ? 1 : 0;
+}
+
+/**
+ * @brief Try one PLLI2S setting for two sampling frequencies.
+ * @param ref PLL input frequency in Hz
+ * @param freq First sampling frequency in Hz
+ * @param clkDiv I2S clock per sample of the first one
+ * @param freq2 Second sampling frequency in Hz
+ * @param clkDiv2 I2S clock per sample of the second one
+ * @param plan Setting of the first one, updated if the larger of the two
+ * errors is smaller with this PLLI2S setting
+ * @param plan2 Setting of the second one, updated with plan
+ * @param n PLLI2SN
+ * @param r PLLI2SR
+ */
+static void I2SCLK_TryPair(uint32_t ref, uint32_t freq, uint16_t clkDiv,
+    uint32_t freq2, uint16_t clkDiv2, I2SCLK_PlanTypeDef* plan,
+    I2SCLK_PlanTypeDef* plan2, uint16_t n, uint8_t r) {
+
+  I2SCLK_PlanTypeDef a, b;
+
+  a.error = I2SCLK_NO_ERROR;
+  b.error = I2SCLK_NO_ERROR;
+  I2SCLK_Try(ref, freq, clkDiv, &a, n, r);
+  I2SCLK_Try(ref, freq2, clkDiv2, &b, n, r);
+
+  if ((a.error == I2SCLK_NO_ERROR) || (b.error == I2SCLK_NO_ERROR)) {
+    return;
+  }
+  if (I2SCLK_Worst(&a, &b) < I2SCLK_Worst(plan, plan2)) {
+    *plan = a;
+    *plan2 = b;
+  }
+}
+
+/**
+ * @brief Plan the clocks of two sampling frequencies sharing the PLLI2S.
+ * @details The PLLI2S setting giving the smallest of the larger of the two
+ * errors is chosen. The setting in plan is tried first.
+ * @param ref PLL input frequency in Hz (HSE / PLLM)
+ * @param freq First sampling frequency in Hz
+ * @param clkDiv I2S clock per sample of the first one
+ * @param freq2 Second sampling frequency in Hz
+ * @param clkDiv2 I2S clock per sample of the second one
+ * @param plan Current PLLI2S setting on input, the setting of the first
+ * frequency on output
+ * @param plan2 Setting of the second frequency
+ * @retval 0 Success
+ * @retval 1 The frequencies cannot be reached
+ */
+uint8_t I2SCLK_PlanPair(uint32_t ref, uint32_t freq, uint16_t clkDiv,
+    uint32_t freq2, uint16_t clkDiv2, I2SCLK_PlanTypeDef* plan,
+    I2SCLK_PlanTypeDef* plan2) {
+
+  uint16_t n = plan->plln;
+  uint8_t r = plan->pllr;
+
+  if ((freq == 0) || (clkDiv == 0) || (freq2 == 0) || (clkDiv2 == 0)) {
+    return 1;
+  }
+
+  plan->error = I2SCLK_NO_ERROR;
+  plan2->error = I2SCLK_NO_ERROR;
+  I2SCLK_TryPair(ref, freq, clkDiv, freq2, clkDiv2, plan, plan2, n, r);
+
+  for (n = I2SCLK_N_MIN; n <= I2SCLK_N_MAX; n++) {
+    for (r = I2SCLK_R_MIN; r <= I2SCLK_R_MAX; r++) {
+      I2SCLK_TryPair(ref, freq, clkDiv, freq2, clkDiv2, plan, plan2, n, r);
+    }
+  }
+
+  return (plan->error == I2SCLK_NO_ERROR) ? 1 : 0;
+}
+
+/**
+ * @brief Try one PLLI2S setting for an I2S with the priority.
+ * @param ref PLL input frequency in Hz
+ * @param freq Sampling frequency of the I2S with the priority in Hz
+ * @param clkDiv I2S clock per sample of the one with the priority
+ * @param limit Largest error in ppb of the one with the priority
+ * @param freq2 Sampling frequency of the other one in Hz
+ * @param clkDiv2 I2S clock per sample of the other one
+ * @param step2 The other one runs at any multiple of step2 up to freq2,
+ * only at freq2 if 0
+ * @param plan Setting of the one with the priority, updated if the
+ * largest error of the other one is smaller with this PLLI2S setting
+ * @param plan2 Setting of the other one at freq2, updated with plan
+ * @param worst Largest error of the other one with plan, updated with plan
+ * @param n PLLI2SN
+ * @param r PLLI2SR
+ */
+static void I2SCLK_TryFirst(uint32_t ref, uint32_t freq, uint16_t clkDiv,
+    int32_t limit, uint32_t freq2, uint16_t clkDiv2, uint32_t step2,
+    I2SCLK_PlanTypeDef* plan, I2SCLK_PlanTypeDef* plan2, int32_t* worst,
+    uint16_t n, uint8_t r) {
+
+  I2SCLK_PlanTypeDef a, b, at;
+  int32_t w = 0;
+  uint32_t f;
+
+  a.error = I2SCLK_NO_ERROR;
+  I2SCLK_Try(ref, freq, clkDiv, &a, n, r);
+  if (I2SCLK_Worst(&a, &a) > limit) {
+    return;
+  }
+
+  for (f = freq2; f > 0; f = (step2 && (f > step2)) ? f - step2 : 0) {
+    b.error = I2SCLK_NO_ERROR;
+    I2SCLK_Try(ref, f, clkDiv2, &b, n, r);
+    if (I2SCLK_Worst(&b, &b) > w) {
+      w = I2SCLK_Worst(&b, &b);
+    }
+    if (f == freq2) {
+      at = b;
+    }
+  }
+
+  // a setting missing the other one is still better than none
+  if (w > I2SCLK_NO_ERROR - 1) {
+    w = I2SCLK_NO_ERROR - 1;
+  }
+  if (w < *worst) {
+    *plan = a;
+    *plan2 = at;
+    *worst = w;
+  }
+}
+
+/**
+ * @brief Plan the clock of an I2S with the priority over the other one.
+ * @details Among the PLLI2S settings within the limit of the I2S with the
+ * priority (I2SCLK_SHARE_COST or its error alone, if larger), the one
+ * giving the smallest error to the other one is chosen. The setting in
+ * plan is tried first.
+ * @param ref PLL input frequency in Hz (HSE / PLLM)
+ * @param freq Sampling frequency of the I2S with the priority in Hz
+ * @param clkDiv I2S clock per sample of the one with the priority
+ * @param freq2 Sampling frequency of the other one in Hz
+ * @param clkDiv2 I2S clock per sample of the other one
+ * @param step2 The other one runs at any multiple of step2 up to freq2,
+ * only at freq2 if 0
+ * @param plan Current PLLI2S setting on input, the setting of the one with
+ * the priority on output
+ * @param plan2 Setting of the other one at freq2
+ * @retval 0 Success
+ * @retval 1 The frequencies cannot be reached
+ */
+static uint8_t I2SCLK_PlanFirst(uint32_t ref, uint32_t freq, uint16_t clkDiv,
+    uint32_t freq2, uint16_t clkDiv2, uint32_t step2, I2SCLK_PlanTypeDef* plan,
+    I2SCLK_PlanTypeDef* plan2) {
+
+  I2SCLK_PlanTypeDef alone = *plan, best;
+  int32_t limit, worst = I2SCLK_NO_ERROR;
+  uint16_t n;
+  uint8_t r;
+
+  if (I2SCLK_Plan(ref, freq, clkDiv, 0, &alone)) {
+    return 1;
+  }
+  limit = I2SCLK_Worst(&alone, &alone);
+  if (limit < I2SCLK_SHARE_COST) {
+    limit = I2SCLK_SHARE_COST;
+  }
+
+  best.error = I2SCLK_NO_ERROR;
+  I2SCLK_TryFirst(ref, freq, clkDiv, limit, freq2, clkDiv2, step2, &best, plan2,
+      &worst, plan->plln, plan->pllr);
+
+  for (n = I2SCLK_N_MIN; n <= I2SCLK_N_MAX; n++) {
+    for (r = I2SCLK_R_MIN; r <= I2SCLK_R_MAX; r++) {
+      I2SCLK_TryFirst(ref, freq, clkDiv, limit, freq2, clkDiv2, step2, &best,
+          plan2, &worst, n, r);
+    }
+  }
+
+  if (best.error == I2SCLK_NO_ERROR) {
+    return 1;
+  }
+  *plan = best;
+  return 0;
+}
+
+/**
+ * @brief Plan the clock of an I2S next to the other one.
+ * @details The PLLI2S is shared as described at the top of the file, the
+ * I2S with the master clock (clkDiv I2SCLK_DIV_MCLK) has the priority.
+ * @param ref PLL input frequency in Hz (HSE / PLLM)
+ * @param freq Requested sampling frequency in Hz
+ * @param clkDiv I2S clock per sample
+ * @param otherFreq Sampling frequency of the running I2S, 0 if the other
+ * one is stopped
+ * @param otherDiv I2S clock per sample of the running I2S
+ * @param plan Current PLLI2S setting on input, the best setting on output
+ * @param other Setting of the running I2S if it has to be restarted (the
+ * setting at the share frequency if the other one is stopped)
+ * @retval 0 Success
+ * @retval 1 The frequency cannot be reached, or it is refused next to the
+ * running I2S with the master clock
+ * @retval 2 Success, the running I2S has to be restarted with other
+ */
+uint8_t I2SCLK_PlanShared(uint32_t ref, uint32_t freq, uint16_t clkDiv,
+    uint32_t otherFreq, uint16_t otherDiv, I2SCLK_PlanTypeDef* plan,
+    I2SCLK_PlanTypeDef* other) {
+
+  I2SCLK_PlanTypeDef kept = *plan, alone = *plan;
+
+  if (otherFreq == 0) {
+    if (clkDiv == I2SCLK_DIV_MCLK) {
+      return I2SCLK_PlanFirst(ref, freq, clkDiv, I2SCLK_SHARE_MIC, I2SCLK_DIV_16B,
+          I2SCLK_SHARE_STEP, plan, other);
+    }
+    if ((I2SCLK_PlanPair(ref, freq, clkDiv, I2SCLK_SHARE_CODEC, I2SCLK_DIV_MCLK,
+        plan, other) == 0) && (I2SCLK_Worst(plan, plan) <= I2SCLK_SHARE_COST)) {
+      return 0;
+    }
+    *plan = kept;
+    return I2SCLK_Plan(ref, freq, clkDiv, 0, plan);
+  }
+
+  if (I2SCLK_Plan(ref, freq, clkDiv, 1, &kept)) {
+    kept.error = I2SCLK_NO_ERROR;
+  }
+
+  // the running I2S has the priority, only the prescaler is set
+  if (otherDiv == I2SCLK_DIV_MCLK) {
+    if (I2SCLK_Worst(&kept, &kept) > I2SCLK_SHARE_LIMIT) {
+      return 1;
+    }
+    *plan = kept;
+    return 0;
+  }
+
+  // the running I2S has no master clock, it can be restarted
+  if ((I2SCLK_Plan(ref, freq, clkDiv, 0, &alone) == 0) &&
+      (I2SCLK_Worst(&kept, &kept) <= I2SCLK_SHARE_COST ||
+       I2SCLK_Worst(&kept, &kept) <= I2SCLK_Worst(&alone, &alone))) {
+    *plan = kept;
+    return 0;
+  }
+  if ((I2SCLK_PlanFirst(ref, freq, clkDiv, otherFreq, otherDiv, 0, plan, other) == 0) &&
+      (other->error != I2SCLK_NO_ERROR)) {
+    return 2;
+  }
+  if (kept.error == I2SCLK_NO_ERROR) {
+    return 1;
+  }
+  *plan = kept;
+  return 0;
+}
+
+/**
+ * @brief Set the clock of an initialized I2S to the best setting.
+ * @details Call it after I2S_Init and before the I2S is enabled. The
+ * PLLI2S is reprogrammed only if the other I2S is not enabled, otherwise
+ * only the prescaler is set, or the other I2S is restarted with a new
+ * PLLI2S setting if it has no master clock (see I2SCLK_PlanShared).
+ * @param spi SPI2 or SPI3
+ * @param freq Sampling frequency in Hz
+ * @param plan The setting used
+ * @retval 0 Success
+ * @retval 1 The frequency cannot be reached or is refused next to the
+ * other I2S, the I2S is not changed
+ */
+uint8_t I2SCLK_Config(SPI_TypeDef* spi, uint32_t freq, I2SCLK_PlanTypeDef* plan) {
+
+  SPI_TypeDef* other = (spi == SPI2) ? SPI3 : SPI2;
+  uint32_t ref = HSE_VALUE / (RCC->PLLCFGR & RCC_PLLCFGR_PLLM);
+  uint32_t otherFreq = 0;
+  I2SCLK_PlanTypeDef otherPlan;
+  uint16_t clkDiv, otherDiv, n;
+  uint8_t r, res;
+  uint32_t timeout;
+
+  clkDiv = I2SCLK_ClkDiv(spi);
+  otherDiv = I2SCLK_ClkDiv(other);
+  if (other->I2SCFGR & SPI_I2SCFGR_I2SE) {
+    otherFreq = I2SCLK_Freq[(other == SPI2) ? 0 : 1];
+  }
+
+  n = (RCC->PLLI2SCFGR & RCC_PLLI2SCFGR_PLLI2SN) >> 6;
+  r = (RCC->PLLI2SCFGR & RCC_PLLI2SCFGR_PLLI2SR) >> 28;
+  plan->plln = n;
+  plan->pllr = r;
+
+  res = I2SCLK_PlanShared(ref, freq, clkDiv, otherFreq, otherDiv, plan, &otherPlan);
+  if (res == 1) {
+    return 1;
+  }
+
+  if ((plan->plln != n) || (plan->pllr != r)) {
+    if (res == 2) {
+      other->I2SCFGR &= ~SPI_I2SCFGR_I2SE;
+    }
+
+    RCC_PLLI2SCmd(DISABLE);
+    RCC_PLLI2SConfig(plan->plln, plan->pllr);
+    RCC_PLLI2SCmd(ENABLE);
+
+    // locks in about 100 us
+    timeout = I2SCLK_LOCK_TIMEOUT;
+    while ((RCC_GetFlagStatus(RCC_FLAG_PLLI2SRDY) == RESET) && --timeout) {
+    }
+
+    if (res == 2) {
+      other->I2SPR = (other->I2SPR & SPI_I2SPR_MCKOE) |
+          ((uint16_t)otherPlan.odd << 8) | otherPlan.div;
+      other->I2SCFGR |= SPI_I2SCFGR_I2SE;
+    }
+  }
+
+  spi->I2SPR = (spi->I2SPR & SPI_I2SPR_MCKOE) | ((uint16_t)plan->odd << 8) | plan->div;
+  I2SCLK_Freq[(spi == SPI2) ? 0 : 1] = freq;
+
+  return 0;
+}
+
+/**
+ * @}
+ */
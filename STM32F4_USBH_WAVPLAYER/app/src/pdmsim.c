@@ -0,0 +1,121 @@
+/**
+ * @file    pdmsim.c
+ * @brief   Synthetic PDM bitstream generator
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The input of the modulator (a tone plus uniform noise) is
+ * computed once per 16 bit word, that is at 1/16 of the PDM clock, which
+ * is far above the audio band. Every bit costs two additions and a
+ * comparison. The words are in the order of the SPI data register: the
+ * first bit in time is the most significant one. The second order
+ * modulator is stable for inputs below about -3 dBFS.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <pdmsim.h>
+
+/**
+ * @addtogroup PDMSIM
+ * @{
+ */
+
+#define PDMSIM_FULL_SCALE   32768 ///< Feedback of one bit
+#define PDMSIM_MINUS_1DB    29205 ///< -1 dB in Q15
+
+/**
+ * @brief Convert a level in dBFS to Q15.
+ * @param db Level (0 or less)
+ * @return Level in Q15
+ */
+static int32_t PDMSIM_DbToQ15(int8_t db) {
+
+  int32_t value = 32767;
+
+  while (db++ < 0) {
+    value = (value * PDMSIM_MINUS_1DB) >> 15;
+  }
+  return value;
+}
+
+/**
+ * @brief Parabolic sine approximation (error about 0.1%).
+ * @param phase Phase (2^32 is a full turn)
+ * @return Sine in Q15
+ */
+static int32_t PDMSIM_Sin(uint32_t phase) {
+
+  int32_t x = (int32_t)phase >> 16; // -1..1 is -pi..pi
+  int32_t y;
+
+  y = (x * (32768 - ((x < 0) ? -x : x))) >> 13;
+  y += (230 * (((y * ((y < 0) ? -y : y)) >> 15) - y)) >> 10;
+  return y;
+}
+
+/**
+ * @brief Initialize the generator.
+ * @param sim Generator
+ * @param pdmClock PDM bit rate in Hz
+ * @param toneFreq Frequency of the tone in Hz
+ * @param toneDb Level of the tone in dBFS
+ * @param noiseDb Level of the noise (peak) in dBFS
+ */
+void PDMSIM_Init(PDMSIM_TypeDef* sim, uint32_t pdmClock, uint32_t toneFreq,
+    int8_t toneDb, int8_t noiseDb) {
+
+  sim->phase      = 0;
+  sim->step       = (uint32_t)(((uint64_t)toneFreq << 32) / (pdmClock / 16));
+  sim->amplitude  = PDMSIM_DbToQ15(toneDb > 0 ? 0 : toneDb);
+  sim->noise      = PDMSIM_DbToQ15(noiseDb > 0 ? 0 : noiseDb);
+  sim->seed       = 1;
+  sim->int1       = 0;
+  sim->int2       = 0;
+  sim->feedback   = -PDMSIM_FULL_SCALE;
+}
+
+/**
+ * @brief Generate PDM words.
+ * @param sim Generator
+ * @param words Output, 16 bits of the stream per word
+ * @param len Number of words
+ */
+void PDMSIM_Generate(PDMSIM_TypeDef* sim, uint16_t* words, uint32_t len) {
+
+  int32_t input, int1 = sim->int1, int2 = sim->int2, fb = sim->feedback;
+  uint32_t i, word;
+  uint8_t bit;
+
+  for (i = 0; i < len; i++) {
+    sim->seed = sim->seed * 1664525UL + 1013904223UL;
+    input = (PDMSIM_Sin(sim->phase) * sim->amplitude) >> 15;
+    input += (((int32_t)sim->seed >> 16) * sim->noise) >> 15;
+    sim->phase += sim->step;
+
+    word = 0;
+    for (bit = 0; bit < 16; bit++) {
+      int1 += input - fb;
+      int2 += int1 - fb;
+      fb = (int2 >= 0) ? PDMSIM_FULL_SCALE : -PDMSIM_FULL_SCALE;
+      word = (word << 1) | (int2 >= 0);
+    }
+    words[i] = (uint16_t)word;
+  }
+
+  sim->int1 = int1;
+  sim->int2 = int2;
+  sim->feedback = fb;
+}
+
+/**
+ * @}
+ */
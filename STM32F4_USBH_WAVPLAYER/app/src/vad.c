@@ -0,0 +1,133 @@
+/**
+ * @file    vad.c
+ * @brief   Voice activity detector
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ * 
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the 
+ * accompanying materials are made available 
+ * under the terms of the GNU Public License 
+ * v3.0 which accompanies this distribution, 
+ * and is available at 
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <vad.h>
+
+/**
+ * @addtogroup VAD
+ * @{
+ */
+
+#define VAD_SNR_SHIFT       2     ///< Voiced frames are 6 dB above the noise floor
+#define VAD_MIN_ENERGY      16    ///< About -66 dBFS
+#define VAD_ZCR_PERCENT     25    ///< Zero crossing rate of unvoiced speech (% of samples)
+#define VAD_NOISE_ATTACK    3     ///< Noise floor tracking speed in silence (shift)
+#define VAD_NOISE_DRIFT     10    ///< Noise floor tracking speed in speech (shift)
+
+/**
+ * @brief Initialize the voice activity detector.
+ * @param vad VAD structure
+ * @param frameLen Number of samples per analysis frame (e.g. 10 ms)
+ * @param hangover Number of frames kept active after the last voiced frame
+ */
+void VAD_Init(VAD_TypeDef* vad, uint16_t frameLen, uint16_t hangover) {
+
+  vad->frameLen   = frameLen;
+  vad->hangover   = hangover;
+  vad->snrShift   = VAD_SNR_SHIFT;
+  vad->minEnergy  = VAD_MIN_ENERGY;
+  vad->zcrMin     = (uint16_t)(((uint32_t)frameLen * VAD_ZCR_PERCENT) / 100);
+
+  vad->acc        = 0;
+  vad->noise      = 0;
+  vad->count      = 0;
+  vad->zcr        = 0;
+  vad->hangCount  = 0;
+  vad->last       = 0;
+  vad->noiseValid = 0;
+  vad->active     = 0;
+}
+
+/**
+ * @brief Classify one analysis frame and track the noise floor.
+ * @param vad VAD structure
+ */
+static void VAD_Decide(VAD_TypeDef* vad) {
+
+  uint32_t energy = (uint32_t)(vad->acc / vad->frameLen);
+  uint64_t threshold;
+  uint8_t voiced;
+
+  if (!vad->noiseValid) {
+    // the first frame is the initial noise estimate
+    vad->noise = energy;
+    vad->noiseValid = 1;
+  }
+
+  threshold = (uint64_t)vad->noise << vad->snrShift;
+
+  // voiced speech is loud, unvoiced speech is quieter but noisy
+  voiced = (energy > vad->minEnergy) &&
+      ((energy > threshold) ||
+      ((vad->zcr >= vad->zcrMin) && (energy > (vad->noise << 1))));
+
+  // track the noise floor - fast down, slow up
+  if (energy < vad->noise) {
+    vad->noise = energy;
+  } else if (!voiced) {
+    vad->noise += (energy - vad->noise) >> VAD_NOISE_ATTACK;
+  } else {
+    vad->noise += (energy - vad->noise) >> VAD_NOISE_DRIFT;
+  }
+
+  if (voiced) {
+    vad->hangCount = vad->hangover;
+    vad->active = 1;
+  } else if (vad->hangCount) {
+    vad->hangCount--;
+  } else {
+    vad->active = 0;
+  }
+
+  vad->acc    = 0;
+  vad->zcr    = 0;
+  vad->count  = 0;
+}
+
+/**
+ * @brief Process a block of samples.
+ * @details The decision is updated at the end of every analysis
+ * frame, blocks do not have to be aligned to frames.
+ * @param vad VAD structure
+ * @param samples Mono 16 bit samples
+ * @param len Number of samples
+ * @retval 1 Voice activity (including hangover)
+ * @retval 0 Silence
+ */
+uint8_t VAD_Process(VAD_TypeDef* vad, const int16_t* samples, uint32_t len) {
+
+  int32_t x;
+
+  while (len--) {
+    x = *samples++;
+    vad->acc += (uint32_t)(x * x);
+    if ((x ^ vad->last) < 0) {
+      vad->zcr++;
+    }
+    vad->last = (int16_t)x;
+
+    if (++vad->count == vad->frameLen) {
+      VAD_Decide(vad);
+    }
+  }
+
+  return vad->active;
+}
+
+/**
+ * @}
+ */
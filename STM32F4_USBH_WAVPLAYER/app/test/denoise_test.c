@@ -0,0 +1,156 @@
+/**
+ * @file    denoise_test.c
+ * @brief   Host test of the noise suppressor
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details Bursts of two tones (250 ms on, 250 ms off, like words) are
+ * mixed with white noise at several levels and processed at 16 kHz in
+ * blocks of 1 ms, as by the recorder. After the noise floor has settled
+ * the report gives the SNR of the input and of the output (the output is
+ * compared with the clean signal delayed by DENOISE_FFT_LEN), the noise
+ * reduction in the pauses, the loss of the bursts and the host time per
+ * block. The SNR of the output includes the distortion of the bursts,
+ * which start under the gain of the noise. The test fails when the
+ * suppressor removes less than DT_MIN_REDUCTION dB of noise, or when it
+ * does not improve the SNR of a noisy input (below DT_NOISY_SNR dB).
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <denoise.h>
+
+#define DT_FREQ           16000   ///< Sampling frequency
+#define DT_BLOCK          (DT_FREQ / 1000) ///< Samples per call (1 ms)
+#define DT_TIME           10      ///< Length of a run in seconds
+#define DT_SETTLE         3       ///< Seconds left out of the results
+#define DT_BURST          (DT_FREQ / 4) ///< Samples of a burst and of a pause
+#define DT_LEVEL          8000    ///< Peak of each tone
+#define DT_MIN_REDUCTION  6.0     ///< Lowest noise reduction in dB
+#define DT_NOISY_SNR      15.0    ///< SNR of the input which has to be improved
+
+static DENOISE_TypeDef ns;
+static int16_t clean[DT_FREQ * DT_TIME];  ///< Signal without the noise
+
+/**
+ * @brief White noise (sum of 4 uniform values, close to Gaussian).
+ * @param seed State of the xorshift generator
+ * @param rms RMS value of the noise
+ * @return Noise sample
+ */
+static double DT_Noise(uint32_t* seed, double rms) {
+
+  double sum = 0;
+  uint32_t i;
+
+  for (i = 0; i < 4; i++) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    sum += (double)*seed / 4294967296.0 - 0.5;
+  }
+  // the variance of the sum is 4 / 12
+  return sum * rms * sqrt(3.0);
+}
+
+/**
+ * @brief Decibels of a power ratio.
+ */
+static double DT_Db(double num, double den) {
+
+  return 10.0 * log10(num / (den > 0 ? den : 1e-12));
+}
+
+/**
+ * @brief Process the signal with one noise level and print the results.
+ * @param noiseRms RMS value of the noise
+ * @return 0 if the results are within the limits
+ */
+static int DT_Run(double noiseRms) {
+
+  int16_t block[DT_BLOCK];
+  uint32_t seed = 2463534242UL, n, i, j;
+  double sig = 0, noise = 0, err = 0, gapIn = 0, gapOut = 0, burst = 0, burstOut = 0;
+  double snrIn, snrOut, reduction, time = 0;
+  struct timespec t0, t1;
+  int32_t s;
+
+  for (n = 0; n < DT_FREQ * DT_TIME; n++) {
+    s = 0;
+    if ((n / DT_BURST) % 2 == 0) {
+      s = lrint(DT_LEVEL * (sin(2 * M_PI * 500.0 * n / DT_FREQ) +
+          sin(2 * M_PI * 1500.0 * n / DT_FREQ)) / 2);
+    }
+    clean[n] = (int16_t)s;
+  }
+
+  DENOISE_Init(&ns, DT_FREQ);
+  for (n = 0; n < DT_FREQ * DT_TIME; n += DT_BLOCK) {
+    for (i = 0; i < DT_BLOCK; i++) {
+      s = clean[n + i] + lrint(DT_Noise(&seed, noiseRms));
+      block[i] = (int16_t)(s > 32767 ? 32767 : (s < -32768 ? -32768 : s));
+      if (n >= DT_FREQ * DT_SETTLE) {
+        sig += (double)clean[n + i] * clean[n + i];
+        noise += (double)(block[i] - clean[n + i]) * (block[i] - clean[n + i]);
+        if (clean[n + i] == 0 && (((n + i) / DT_BURST) % 2)) {
+          gapIn += (double)block[i] * block[i];
+        }
+      }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    DENOISE_Process(&ns, block, DT_BLOCK);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    time += (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+
+    // the output is delayed by DENOISE_FFT_LEN samples
+    for (i = 0; i < DT_BLOCK; i++) {
+      j = n + i;
+      if (j < DT_FREQ * DT_SETTLE + DENOISE_FFT_LEN) {
+        continue;
+      }
+      j -= DENOISE_FFT_LEN;
+      err += (double)(block[i] - clean[j]) * (block[i] - clean[j]);
+      if ((j / DT_BURST) % 2) {
+        gapOut += (double)block[i] * block[i];
+      } else {
+        burst += (double)clean[j] * clean[j];
+        burstOut += (double)block[i] * block[i];
+      }
+    }
+  }
+
+  snrIn = DT_Db(sig, noise);
+  snrOut = DT_Db(sig, err);
+  reduction = DT_Db(gapIn, gapOut);
+  printf("%9.0f %8.1f %8.1f %10.1f %8.1f %9.0f\n", noiseRms, snrIn, snrOut,
+      reduction, DT_Db(burstOut, burst), time / (DT_FREQ * DT_TIME / DT_BLOCK));
+
+  return ((snrIn < DT_NOISY_SNR) && (snrOut <= snrIn)) || (reduction < DT_MIN_REDUCTION);
+}
+
+int main(void) {
+
+  static const double levels[] = { 100, 300, 1000, 3000 };
+  uint32_t i;
+  int fail = 0;
+
+  printf("%9s %8s %8s %10s %8s %9s\n", "noise.rms", "snr.in", "snr.out",
+      "reduct.dB", "burst.dB", "ns/block");
+  for (i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    fail |= DT_Run(levels[i]);
+  }
+  printf("%s\n", fail ? "FAIL" : "PASS");
+  return fail;
+}
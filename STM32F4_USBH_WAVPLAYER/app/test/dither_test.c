@@ -0,0 +1,197 @@
+/**
+ * @file    dither_test.c
+ * @brief   Host test of the dither
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details A 1 kHz tone of DI_LEVEL LSB (a fade out at about -78 dBFS) in
+ * 32 bit samples at 48 kHz is reduced to 16 bits by truncation and by the
+ * dither without and with noise shaping, in blocks of DI_BLOCK samples as
+ * by the player, mono and stereo. The report gives the power of the error
+ * (output minus input) in LSB^2 in total and in three bands, the highest
+ * harmonic of the tone above the noise around it, and the host time per
+ * sample. The test fails when the plain dither does not add the expected
+ * noise (rounding and TPDF, 1/4 LSB^2, within DI_TOLERANCE dB), when a
+ * dithered output keeps harmonics more than DI_MAX_SPUR dB above the noise,
+ * or when the noise shaping of order 1 and 2 does not lower the noise
+ * below 4 kHz by DI_MIN_SHAPING and twice as much.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <dither.h>
+
+#define DI_FREQ         48000   ///< Sampling frequency
+#define DI_LEN          65536   ///< Samples analysed (one FFT)
+#define DI_BLOCK        1024    ///< Samples per call
+#define DI_TONE_BIN     1365    ///< Tone at 1365 * 48000 / 65536 = 999.8 Hz
+#define DI_LEVEL        4.3     ///< Peak of the tone in LSB
+#define DI_TOLERANCE    0.5     ///< Tolerance of the plain dither noise in dB
+#define DI_MAX_SPUR     10.0    ///< Highest harmonic above the noise in dB
+#define DI_MIN_SHAPING  6.0     ///< Lowest gain below 4 kHz of the first order
+#define DI_HARMONICS    5       ///< Harmonics checked
+
+static int32_t in[2 * DI_LEN];        ///< Input, stereo at most
+static int16_t out[2 * DI_LEN];       ///< Output
+static double  re[DI_LEN], im[DI_LEN]; ///< Spectrum of the error
+
+/**
+ * @brief In place radix 2 FFT.
+ * @param x Real parts
+ * @param y Imaginary parts
+ * @param n Length, a power of 2
+ */
+static void DI_Fft(double* x, double* y, uint32_t n) {
+
+  uint32_t i, j, k, m;
+  double a, c, s, tr, ti;
+
+  for (i = 1, j = 0; i < n; i++) {
+    for (k = n >> 1; j & k; k >>= 1) {
+      j ^= k;
+    }
+    j |= k;
+    if (i < j) {
+      tr = x[i]; x[i] = x[j]; x[j] = tr;
+      ti = y[i]; y[i] = y[j]; y[j] = ti;
+    }
+  }
+  for (m = 2; m <= n; m <<= 1) {
+    for (k = 0; k < m / 2; k++) {
+      a = -2 * M_PI * k / m;
+      c = cos(a);
+      s = sin(a);
+      for (i = k; i < n; i += m) {
+        j = i + m / 2;
+        tr = c * x[j] - s * y[j];
+        ti = s * x[j] + c * y[j];
+        x[j] = x[i] - tr;
+        y[j] = y[i] - ti;
+        x[i] += tr;
+        y[i] += ti;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Power of the error in a band of bins, in LSB^2.
+ */
+static double DI_Band(uint32_t first, uint32_t last) {
+
+  double sum = 0;
+  uint32_t k;
+
+  // both halves of the spectrum of a real signal
+  for (k = first; k < last; k++) {
+    sum += 2 * (re[k] * re[k] + im[k] * im[k]);
+  }
+  return sum / ((double)DI_LEN * DI_LEN);
+}
+
+/**
+ * @brief Decibels of a power ratio.
+ */
+static double DI_Db(double p) {
+
+  return 10.0 * log10(p > 0 ? p : 1e-12);
+}
+
+/**
+ * @brief Reduce the tone with one setting and print the results.
+ * @param name Setting
+ * @param channels 1 or 2
+ * @param order Noise shaping order, -1 for the truncation
+ * @param low Error below 4 kHz in LSB^2
+ * @param spur Highest harmonic above the noise in dB
+ * @return Error power in LSB^2
+ */
+static double DI_Run(const char* name, uint8_t channels, int order, double* low,
+    double* spur) {
+
+  DITHER_TypeDef dither;
+  struct timespec t0, t1;
+  double total, noise, h, time;
+  uint32_t n, i, k;
+
+  for (n = 0; n < DI_LEN; n++) {
+    for (i = 0; i < channels; i++) {
+      in[n * channels + i] = lrint(DI_LEVEL * 65536.0 *
+          sin(2 * M_PI * DI_TONE_BIN * n / DI_LEN + i));
+    }
+  }
+
+  DITHER_Init(&dither, channels, order < 0 ? 0 : order);
+  dither.enabled = (order >= 0);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (n = 0; n < DI_LEN * channels; n += DI_BLOCK) {
+    DITHER_Process(&dither, &out[n], &in[n], DI_BLOCK);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  time = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / (DI_LEN * channels);
+
+  // error of the last channel
+  for (n = 0; n < DI_LEN; n++) {
+    i = n * channels + channels - 1;
+    re[n] = out[i] - in[i] / 65536.0;
+    im[n] = 0;
+  }
+  DI_Fft(re, im, DI_LEN);
+
+  total = DI_Band(1, DI_LEN / 2);
+  *low = DI_Band(1, DI_LEN / 12);
+
+  // harmonics against the mean bin power 50 bins around
+  *spur = -100;
+  for (k = 2; k <= DI_HARMONICS; k++) {
+    n = k * DI_TONE_BIN;
+    noise = (DI_Band(n - 50, n) + DI_Band(n + 1, n + 51)) / 100;
+    h = DI_Db(DI_Band(n, n + 1) / noise);
+    *spur = (h > *spur) ? h : *spur;
+  }
+
+  printf("%-16s %8.3f %8.1f %8.1f %8.1f %7.1f %7.1f\n", name, total, DI_Db(*low),
+      DI_Db(DI_Band(DI_LEN / 12, DI_LEN / 4)), DI_Db(DI_Band(DI_LEN / 4, DI_LEN / 2)),
+      *spur, time);
+  return total;
+}
+
+int main(void) {
+
+  double total, low[3], spur;
+  int fail = 0;
+
+  printf("%-16s %8s %8s %8s %8s %7s %7s\n", "mode", "lsb^2", "<4k.dB", "4-12k.dB",
+      ">12k.dB", "spur.dB", "ns/smp");
+  DI_Run("truncation", 1, -1, &low[0], &spur);
+
+  total = DI_Run("tpdf", 1, 0, &low[0], &spur);
+  fail |= fabs(DI_Db(total / 0.25)) > DI_TOLERANCE;
+  fail |= spur > DI_MAX_SPUR;
+
+  DI_Run("tpdf order 1", 1, 1, &low[1], &spur);
+  fail |= spur > DI_MAX_SPUR;
+  fail |= DI_Db(low[0] / low[1]) < DI_MIN_SHAPING;
+
+  DI_Run("tpdf order 2", 1, 2, &low[2], &spur);
+  fail |= spur > DI_MAX_SPUR;
+  fail |= DI_Db(low[0] / low[2]) < 2 * DI_MIN_SHAPING;
+
+  DI_Run("stereo order 2", 2, 2, &low[1], &spur);
+  fail |= spur > DI_MAX_SPUR;
+  fail |= DI_Db(low[0] / low[1]) < 2 * DI_MIN_SHAPING;
+
+  printf("%s\n", fail ? "FAIL" : "PASS");
+  return fail;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file    i2sclk_test.c
+ * @brief   Host test of the I2S clock planner
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details I2SCLK_Config runs on the host registers of
+ * ../../usb/bench/host/stm32f4xx.h for the codec (SPI3, master clock) at
+ * the standard rates and the microphone (SPI2, 16 bit channels) at the PDM
+ * clocks of the recordings (64 x 16, 32 and 48 kHz): the codec alone, the
+ * microphone started first (the codec may restart it with a new PLLI2S)
+ * and the codec started first (the microphone only gets a prescaler). The
+ * errors are computed from the PLLI2S and prescaler registers. Every pair
+ * of rates is checked in both orders: the test fails when a call fails,
+ * when the codec is more than IT_MAX_CODEC ppm off (it has the priority,
+ * alone or not), or when the microphone is more than IT_MAX_MIC ppm off.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <i2sclk.h>
+
+#define IT_MAX_CODEC    200                         ///< Largest error of the codec in ppm
+#define IT_MAX_MIC      (I2SCLK_SHARE_LIMIT / 1000) ///< Largest error of the microphone in ppm
+#define IT_PLLM         8       ///< PLL input divider of the board (1 MHz)
+
+RCC_TypeDef HOST_Rcc;
+SPI_TypeDef HOST_Spi2, HOST_Spi3;
+
+/**
+ * @brief Reset the clock registers: PLLI2S of the system clock setup,
+ * both I2S initialized and stopped.
+ */
+static void IT_Reset(void) {
+
+  RCC->PLLCFGR = IT_PLLM;
+  RCC_PLLI2SConfig(258, 3);
+  SPI2->I2SCFGR = 0;
+  SPI2->I2SPR = 0;
+  SPI3->I2SCFGR = 0;
+  SPI3->I2SPR = SPI_I2SPR_MCKOE;
+}
+
+/**
+ * @brief Error of an I2S from the registers.
+ * @param spi SPI2 or SPI3
+ * @param freq Requested sampling frequency in Hz
+ * @return Error in ppm
+ */
+static double IT_Error(SPI_TypeDef* spi, uint32_t freq) {
+
+  double n = (RCC->PLLI2SCFGR & RCC_PLLI2SCFGR_PLLI2SN) >> 6;
+  double r = (RCC->PLLI2SCFGR & RCC_PLLI2SCFGR_PLLI2SR) >> 28;
+  double presc = 2 * (spi->I2SPR & 0xFF) + ((spi->I2SPR >> 8) & 1);
+  double clkDiv = (spi->I2SPR & SPI_I2SPR_MCKOE) ? I2SCLK_DIV_MCLK : I2SCLK_DIV_16B;
+
+  return ((HSE_VALUE / IT_PLLM) * n / r / (clkDiv * presc) / freq - 1) * 1e6;
+}
+
+int main(void) {
+
+  const uint32_t rates[] = {8000, 11025, 16000, 22050, 32000, 44100, 48000, 96000};
+  const uint32_t mics[] = {32000, 64000, 96000}; // I2S frequency, twice the PDM output
+  I2SCLK_PlanTypeDef plan;
+  double alone, codec, mic, codecFirst, late, worstCodec = 0, worstMic = 0;
+  uint32_t i, j;
+  int fail = 0, err;
+
+  for (j = 0; j < sizeof(mics) / sizeof(mics[0]); j++) {
+    printf("microphone %4.3f MHz\n", mics[j] * 32 / 1e6);
+    printf("%8s %8s %19s %19s\n", "codec", "alone", "mic, then codec", "codec, then mic");
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+      err = 0;
+
+      IT_Reset();
+      err |= I2SCLK_Config(SPI3, rates[i], &plan);
+      alone = IT_Error(SPI3, rates[i]);
+
+      IT_Reset();
+      err |= I2SCLK_Config(SPI2, mics[j], &plan);
+      I2S_Cmd(SPI2, ENABLE);
+      err |= I2SCLK_Config(SPI3, rates[i], &plan);
+      codec = IT_Error(SPI3, rates[i]);
+      mic = IT_Error(SPI2, mics[j]);
+      err |= !(SPI2->I2SCFGR & SPI_I2SCFGR_I2SE);
+
+      IT_Reset();
+      err |= I2SCLK_Config(SPI3, rates[i], &plan);
+      I2S_Cmd(SPI3, ENABLE);
+      err |= I2SCLK_Config(SPI2, mics[j], &plan);
+      codecFirst = IT_Error(SPI3, rates[i]);
+      late = IT_Error(SPI2, mics[j]);
+
+      err |= (fmax(fmax(fabs(alone), fabs(codec)), fabs(codecFirst)) > IT_MAX_CODEC) ||
+          (fmax(fabs(mic), fabs(late)) > IT_MAX_MIC);
+      printf("%8u %8.0f %9.0f %9.0f %9.0f %9.0f%s\n", (unsigned)rates[i], alone,
+          codec, mic, codecFirst, late, err ? "  FAIL" : "");
+      worstCodec = fmax(worstCodec, fmax(fmax(fabs(alone), fabs(codec)), fabs(codecFirst)));
+      worstMic = fmax(worstMic, fmax(fabs(mic), fabs(late)));
+      fail |= err;
+    }
+    printf("\n");
+  }
+
+  printf("largest error: codec %.0f ppm (max %u), microphone %.0f ppm (max %u)\n",
+      worstCodec, IT_MAX_CODEC, worstMic, IT_MAX_MIC);
+  printf("%s\n", fail ? "FAIL" : "PASS");
+  return fail;
+}
@@ -0,0 +1,766 @@
+/**
+ * @file    bench.c
+ * @brief   Host benchmark of FatFs over a disk image file
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The module is built for Linux with the configuration of the
+ * player (ffconf.h) and drive 0 mapped to a FAT12/16/32 (or exFAT) image.
+ * The workloads of the player and the recorder are run one after the
+ * other: mount, directory walk, free space count, files created, listed,
+ * opened and removed in a folder (as a music folder), recordings written in
+ * small blocks with periodic f_sync (16 bit PCM, then IMA ADPCM with a
+ * quarter of the data and of the time between two f_sync calls, as the
+ * recorder writes it), reads of every file with several
+ * chunk sizes, random seeks and removal of the recordings, and with -F
+ * the volume filled up, one more file tried on the full volume and the
+ * fill removed (the image has to fit in RAM, or be written with -w). The
+ * file system
+ * is mounted again before each workload, so every one starts with empty
+ * FatFs buffers, as after inserting the stick. For each workload the disk
+ * commands, sectors and wall time are reported. The commands and sectors
+ * do not depend on the host, so a change of FatFs can be judged by them
+ * before it is tried on the board. A second table gives the counters of
+ * FatFs: the window loads served by the sector cache and missed, and the
+ * sector transfers it saved (loads from the cache, plus dirty windows kept
+ * in it less those written back, a FAT sector counting once whatever the
+ * number of FAT copies). With _FS_CACHE_SIZE 0 the disk commands of each
+ * workload grow by that number. The table also gives the KB moved by each
+ * read and write command, and the clusters joined to a direct read of
+ * f_read: each one is a read command saved against transfers stopping at
+ * the end of every cluster. The writes joined the same way are not
+ * counted, the write-back buffer (_FS_WBUF) sends them in the same
+ * commands anyway. The next column gives the FAT entries the free space map
+ * saved from reading: the full regions skipped by the allocation, and the
+ * clusters of a free space count summed from the map. The last two give
+ * the name searches answered by the directory index (_FS_DIRINDEX) and the
+ * directory entries compared by all the name searches of f_open, f_stat,
+ * f_unlink and the others, an entry of the index counting as one (the
+ * entries read to build the index are in the disk commands only, exFAT
+ * entry sets are not counted).
+ *
+ * Usage: bench [-f MB [-c cluster] [-x]] [-w] [-n files] [-s KB]
+ * [-b bytes] [-k KB] [-d files] [-F] image
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ff.h"
+#include "diskio_img.h"
+#include "mkexfat.h"
+
+/**
+ * @defgroup  BENCH BENCH
+ * @brief     FatFs workloads measured over an image file
+ */
+
+/**
+ * @addtogroup BENCH
+ * @{
+ */
+
+#define BENCH_MAX_FILES   64    ///< Files kept from the directory walk
+#define BENCH_PATH_LEN    128   ///< Longest path
+#define BENCH_BUF_SIZE    32768 ///< Largest read or write chunk
+#define BENCH_HEADER_SIZE 512   ///< Header of a recording (as the recorder)
+#define BENCH_SEEKS       1000  ///< Random seeks of the seek workload
+#define BENCH_SEEK_READ   512   ///< Bytes read after each seek
+#define BENCH_DIR         "/BENCHDIR" ///< Folder of the directory workloads
+#define BENCH_FILL        "/BENCHFIL.DAT" ///< File filling the volume
+#define BENCH_FULL        "/BENCHFUL.DAT" ///< File tried on the full volume
+
+/**
+ * @brief Workload.
+ */
+typedef struct {
+  const char* name;                 ///< Name in the report
+  FRESULT   (*Run)(uint32_t arg);   ///< Workload, FR_OK if done
+  uint32_t    arg;                  ///< Argument of Run
+  uint8_t     keep;                 ///< Do not mount again before the workload
+} BENCH_TypeDef;
+
+/**
+ * @brief FatFs counters of a workload.
+ */
+typedef struct {
+  uint32_t    hit;                  ///< Window loads from the cache
+  uint32_t    miss;                 ///< Window loads from the disk
+  uint32_t    saved;                ///< Sector transfers saved by the cache
+  double      rdSize;               ///< KB per read command
+  double      wrSize;               ///< KB per write command
+  uint32_t    join;                 ///< Clusters joined to a direct read
+  uint32_t    skip;                 ///< FAT entries not read thanks to the free space map
+  uint32_t    find;                 ///< Name searches answered by the directory index
+  uint32_t    scan;                 ///< Directory entries compared by the name searches
+} BENCH_CountTypeDef;
+
+/**
+ * @brief File found by the directory walk or written by the benchmark.
+ */
+typedef struct {
+  char      path[BENCH_PATH_LEN];   ///< Full path
+  DWORD     size;                   ///< Size in bytes
+} BENCH_FileTypeDef;
+
+static FATFS              fs;                         ///< Drive 0
+static FIL                file;                       ///< File of the workloads
+static BYTE               buf[BENCH_BUF_SIZE];        ///< Data buffer
+static BENCH_FileTypeDef  files[BENCH_MAX_FILES];     ///< Files to read
+static uint32_t           nFiles;                     ///< Entries of files
+static uint32_t           nRecorded;                  ///< Recordings written, at the end of files
+static uint64_t           appBytes;                   ///< Bytes moved by the workload
+
+static uint32_t recFiles    = 2;      ///< Recordings written
+static uint32_t recSize     = 4096;   ///< Size of a recording in KB
+static uint32_t recBlock    = 3000;   ///< Bytes per f_write of the recorder
+static uint32_t recSync     = 256;    ///< KB between two f_sync calls (0: never)
+static uint32_t dirFiles    = 300;    ///< Files of the directory workloads
+static uint8_t  fillVolume  = 0;      ///< Run the fill workloads
+
+/**
+ * @brief Time stamp of new files.
+ * @details Fixed, so the images written with -w do not depend on the
+ * time of the run.
+ * @return 19.10.2026 12:00:00 in the FAT format
+ */
+DWORD get_fattime(void) {
+
+  return ((DWORD)(2026 - 1980) << 25) | (10UL << 21) | (19UL << 16) | (12UL << 11);
+}
+
+/**
+ * @brief Mount drive 0.
+ * @details The volume is checked by the first access, not by f_mount.
+ * @return FR_OK if the volume is mounted
+ */
+static FRESULT BENCH_Mount(void) {
+
+  DIR dir;
+
+  f_mount(0, NULL);
+  f_mount(0, &fs);
+  return f_opendir(&dir, "");
+}
+
+/**
+ * @brief Mount workload.
+ * @param arg Not used
+ */
+static FRESULT BENCH_MountRun(uint32_t arg) {
+
+  (void)arg;
+  return BENCH_Mount();
+}
+
+/**
+ * @brief Walk a directory and its subdirectories.
+ * @param path Path of the directory, extended by the names found
+ * @param len Length of path
+ * @return FR_OK if done
+ */
+static FRESULT BENCH_WalkDir(char* path, uint32_t len) {
+
+  FILINFO fno;
+  DIR dir;
+  FRESULT res;
+  uint32_t n;
+
+  res = f_opendir(&dir, path);
+  while (res == FR_OK) {
+    res = f_readdir(&dir, &fno);
+    if (res != FR_OK || !fno.fname[0]) {
+      break;
+    }
+    if (fno.fname[0] == '.') {
+      continue;
+    }
+    n = strlen(fno.fname);
+    if (len + n + 2 > BENCH_PATH_LEN) {
+      continue;
+    }
+    path[len] = '/';
+    memcpy(path + len + 1, fno.fname, n + 1);
+    if (fno.fattrib & AM_DIR) {
+      res = BENCH_WalkDir(path, len + 1 + n);
+    } else if (fno.fsize && nFiles < BENCH_MAX_FILES) {
+      strcpy(files[nFiles].path, path);
+      files[nFiles].size = fno.fsize;
+      nFiles++;
+    }
+    path[len] = 0;
+  }
+  return res;
+}
+
+/**
+ * @brief Directory walk workload: every entry of the volume is read.
+ * @param arg Not used
+ */
+static FRESULT BENCH_WalkRun(uint32_t arg) {
+
+  char path[BENCH_PATH_LEN] = "";
+
+  (void)arg;
+  nFiles = 0;
+  return BENCH_WalkDir(path, 0);
+}
+
+/**
+ * @brief Free space workload.
+ * @param arg Not used
+ */
+static FRESULT BENCH_GetFreeRun(uint32_t arg) {
+
+  FATFS* pfs;
+  DWORD clusters;
+
+  (void)arg;
+  return f_getfree("", &clusters, &pfs);
+}
+
+/**
+ * @brief Path of a file of the directory workloads.
+ * @param path Buffer of BENCH_PATH_LEN bytes
+ * @param i Number of the file
+ */
+static void BENCH_DirPath(char* path, uint32_t i) {
+
+  sprintf(path, BENCH_DIR "/F%06u.DAT", (unsigned)i);
+}
+
+/**
+ * @brief Creation of the files of the folder, each with a header.
+ * @param arg Not used
+ */
+static FRESULT BENCH_CreateRun(uint32_t arg) {
+
+  char path[BENCH_PATH_LEN];
+  FRESULT res;
+  uint32_t i;
+  UINT bw;
+
+  (void)arg;
+  if (!dirFiles) {
+    return FR_OK;
+  }
+  memset(buf, 0x55, BENCH_HEADER_SIZE);
+  res = f_mkdir(BENCH_DIR);
+  if (res == FR_EXIST) {
+    res = FR_OK;
+  }
+  for (i = 0; i < dirFiles && res == FR_OK; i++) {
+    BENCH_DirPath(path, i);
+    res = f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (res != FR_OK) {
+      break;
+    }
+    res = f_write(&file, buf, BENCH_HEADER_SIZE, &bw);
+    if (f_close(&file) != FR_OK && res == FR_OK) {
+      res = FR_DISK_ERR;
+    }
+    appBytes += bw;
+  }
+  return res;
+}
+
+/**
+ * @brief Listing of the folder.
+ * @param arg Not used
+ */
+static FRESULT BENCH_ListRun(uint32_t arg) {
+
+  FILINFO fno;
+  DIR dir;
+  FRESULT res;
+
+  (void)arg;
+  if (!dirFiles) {
+    return FR_OK;
+  }
+  res = f_opendir(&dir, BENCH_DIR);
+  while (res == FR_OK) {
+    res = f_readdir(&dir, &fno);
+    if (!fno.fname[0]) {
+      break;
+    }
+  }
+  return res;
+}
+
+/**
+ * @brief Opening of every file of the folder, as a playlist does.
+ * @param arg Not used
+ */
+static FRESULT BENCH_OpenRun(uint32_t arg) {
+
+  char path[BENCH_PATH_LEN];
+  FRESULT res = FR_OK;
+  uint32_t i;
+
+  (void)arg;
+  for (i = 0; i < dirFiles && res == FR_OK; i++) {
+    BENCH_DirPath(path, i);
+    res = f_open(&file, path, FA_READ);
+    if (res == FR_OK) {
+      res = f_close(&file);
+    }
+  }
+  return res;
+}
+
+/**
+ * @brief Removal of the folder and its files.
+ * @param arg Not used
+ */
+static FRESULT BENCH_RemoveRun(uint32_t arg) {
+
+  char path[BENCH_PATH_LEN];
+  FRESULT res = FR_OK;
+  uint32_t i;
+
+  (void)arg;
+  if (!dirFiles) {
+    return FR_OK;
+  }
+  for (i = 0; i < dirFiles && res == FR_OK; i++) {
+    BENCH_DirPath(path, i);
+    res = f_unlink(path);
+  }
+  if (res == FR_OK) {
+    res = f_unlink(BENCH_DIR);
+  }
+  return res;
+}
+
+/**
+ * @brief Recording workload.
+ * @details Each file is written as by the recorder: a header, the audio
+ * data in small blocks with f_sync at regular intervals, then the header
+ * again. The recorder writes the same blocks whatever the format, so a
+ * compressed recording of the same length has fewer writes, and the
+ * f_sync calls (periodic checkpoints) come after less data.
+ * @param arg Ratio of the captured to the written audio data: 1 for
+ * 16 bit PCM, 4 for IMA ADPCM
+ */
+static FRESULT BENCH_RecordRun(uint32_t arg) {
+
+  FRESULT res = FR_OK;
+  uint32_t i, size, synced, n, rec;
+  uint32_t total = recSize * 1024 / arg, sync = recSync * 1024 / arg;
+  UINT bw;
+
+  memset(buf, 0x55, sizeof(buf));
+  for (rec = 0; rec < recFiles && nFiles < BENCH_MAX_FILES; rec++) {
+    sprintf(files[nFiles].path, "/BENCH%03u.WAV", (unsigned)nRecorded);
+    res = f_open(&file, files[nFiles].path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (res != FR_OK) {
+      break;
+    }
+    res = f_write(&file, buf, BENCH_HEADER_SIZE, &bw);
+    size = synced = 0;
+    for (i = 0; res == FR_OK && size < total; i++) {
+      n = total - size;
+      n = (n < recBlock) ? n : recBlock;
+      res = f_write(&file, buf, n, &bw);
+      if (bw != n) {
+        res = FR_DENIED;
+      }
+      size += n;
+      if (res == FR_OK && sync && size - synced >= sync) {
+        res = f_sync(&file);
+        synced = size;
+      }
+    }
+    if (res == FR_OK) {
+      res = f_lseek(&file, 0);
+    }
+    if (res == FR_OK) {
+      res = f_write(&file, buf, BENCH_HEADER_SIZE, &bw);
+    }
+    if (f_close(&file) != FR_OK && res == FR_OK) {
+      res = FR_DISK_ERR;
+    }
+    if (res != FR_OK) {
+      break;
+    }
+    appBytes += BENCH_HEADER_SIZE * 2 + size;
+    files[nFiles].size = BENCH_HEADER_SIZE + size;
+    nFiles++;
+    nRecorded++;
+  }
+  return res;
+}
+
+/**
+ * @brief Read workload: every file is read from the start to the end.
+ * @param arg Bytes per f_read
+ */
+static FRESULT BENCH_ReadRun(uint32_t arg) {
+
+  FRESULT res = FR_OK;
+  uint32_t i;
+  UINT br;
+
+  for (i = 0; i < nFiles && res == FR_OK; i++) {
+    res = f_open(&file, files[i].path, FA_READ);
+    if (res != FR_OK) {
+      break;
+    }
+    do {
+      res = f_read(&file, buf, arg, &br);
+      appBytes += br;
+    } while (res == FR_OK && br == arg);
+    f_close(&file);
+  }
+  return res;
+}
+
+/**
+ * @brief Seek workload: short reads at random places of the largest file.
+ * @details The generator is always seeded the same, so the runs can be
+ * compared.
+ * @param arg Not used
+ */
+static FRESULT BENCH_SeekRun(uint32_t arg) {
+
+  FRESULT res;
+  uint32_t i, big = 0, seed = 2463534242UL;
+  UINT br;
+
+  (void)arg;
+  if (!nFiles) {
+    return FR_OK;
+  }
+  for (i = 1; i < nFiles; i++) {
+    if (files[i].size > files[big].size) {
+      big = i;
+    }
+  }
+  res = f_open(&file, files[big].path, FA_READ);
+  for (i = 0; i < BENCH_SEEKS && res == FR_OK; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    res = f_lseek(&file, seed % files[big].size);
+    if (res == FR_OK) {
+      res = f_read(&file, buf, BENCH_SEEK_READ, &br);
+      appBytes += br;
+    }
+  }
+  f_close(&file);
+  return res;
+}
+
+/**
+ * @brief Removal of the recordings.
+ * @param arg Not used
+ */
+static FRESULT BENCH_UnlinkRun(uint32_t arg) {
+
+  FRESULT res = FR_OK;
+
+  (void)arg;
+  while (nRecorded && res == FR_OK) {
+    nRecorded--;
+    nFiles--;
+    res = f_unlink(files[nFiles].path);
+  }
+  return res;
+}
+
+/**
+ * @brief Fill workload: one file takes all the free space.
+ * @param arg Not used
+ */
+static FRESULT BENCH_FillRun(uint32_t arg) {
+
+  FRESULT res;
+  UINT bw;
+
+  (void)arg;
+  if (!fillVolume) {
+    return FR_OK;
+  }
+  memset(buf, 0xAA, sizeof(buf));
+  res = f_open(&file, BENCH_FILL, FA_CREATE_ALWAYS | FA_WRITE);
+  if (res != FR_OK) {
+    return res;
+  }
+  do {
+    res = f_write(&file, buf, sizeof(buf), &bw);
+    appBytes += bw;
+  } while (res == FR_OK && bw == sizeof(buf));
+  if (f_close(&file) != FR_OK && res == FR_OK) {
+    res = FR_DISK_ERR;
+  }
+  return res;
+}
+
+/**
+ * @brief Write to the full volume: the allocation finds no free cluster.
+ * @param arg Not used
+ */
+static FRESULT BENCH_FullRun(uint32_t arg) {
+
+  FRESULT res;
+  UINT bw;
+
+  (void)arg;
+  if (!fillVolume) {
+    return FR_OK;
+  }
+  res = f_open(&file, BENCH_FULL, FA_CREATE_ALWAYS | FA_WRITE);
+  if (res != FR_OK) {
+    return res;
+  }
+  res = f_write(&file, buf, sizeof(buf), &bw);
+  if (f_close(&file) != FR_OK && res == FR_OK) {
+    res = FR_DISK_ERR;
+  }
+  if (res == FR_OK && bw) {
+    res = FR_INT_ERR;   // the volume was not full
+  }
+  if (res == FR_OK) {
+    res = f_unlink(BENCH_FULL);
+  }
+  return res;
+}
+
+/**
+ * @brief Removal of the file filling the volume.
+ * @param arg Not used
+ */
+static FRESULT BENCH_UnfillRun(uint32_t arg) {
+
+  (void)arg;
+  return fillVolume ? f_unlink(BENCH_FILL) : FR_OK;
+}
+
+/**
+ * @brief Workloads in the order they are run.
+ */
+static const BENCH_TypeDef workloads[] = {
+  { "mount",      BENCH_MountRun,   0,      0 },
+  { "walk",       BENCH_WalkRun,    0,      0 },
+  { "getfree",    BENCH_GetFreeRun, 0,      0 },
+  { "getfree2",   BENCH_GetFreeRun, 0,      1 },
+  { "create",     BENCH_CreateRun,  0,      0 },
+  { "list",       BENCH_ListRun,    0,      0 },
+  { "open",       BENCH_OpenRun,    0,      0 },
+  { "record",     BENCH_RecordRun,  1,      0 },
+  { "rec adpcm",  BENCH_RecordRun,  4,      0 },
+  { "read 512",   BENCH_ReadRun,    512,    0 },
+  { "read 3000",  BENCH_ReadRun,    3000,   0 },
+  { "read 4096",  BENCH_ReadRun,    4096,   0 },
+  { "read 32768", BENCH_ReadRun,    32768,  0 },
+  { "seek",       BENCH_SeekRun,    0,      0 },
+  { "unlink",     BENCH_UnlinkRun,  0,      0 },
+  { "remove",     BENCH_RemoveRun,  0,      0 },
+  { "fill",       BENCH_FillRun,    0,      0 },
+  { "full",       BENCH_FullRun,    0,      0 },
+  { "getfree3",   BENCH_GetFreeRun, 0,      1 },
+  { "unfill",     BENCH_UnfillRun,  0,      0 },
+};
+
+/**
+ * @brief Run a workload and print its line of the report.
+ * @param w Workload
+ * @param count Counters of FatFs for the second table
+ * @return FR_OK if done
+ */
+static FRESULT BENCH_Run(const BENCH_TypeDef* w, BENCH_CountTypeDef* count) {
+
+  struct timespec t0, t1;
+  FRESULT res;
+  double ms;
+
+  if (!w->keep && w->Run != BENCH_MountRun) {
+    res = BENCH_Mount();
+    if (res != FR_OK) {
+      return res;
+    }
+  }
+  memset(&IMG_Stats, 0, sizeof(IMG_Stats));
+#if _FS_CACHE_SECTS
+  fs.c_hit = fs.c_miss = fs.c_kept = fs.c_flush = 0;
+#endif
+  fs.r_join = 0;
+#if _FS_FREEMAP
+  fs.m_skip = 0;
+#endif
+#if _FS_DIRINDEX
+  fs.h_find = 0;
+#endif
+  fs.d_scan = 0;
+  appBytes = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  res = w->Run(w->arg);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if (res != FR_OK) {
+    return res;
+  }
+
+  ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+  printf("%-11s %9u %9u %9u %9u %6u",
+      w->name, (unsigned)IMG_Stats.rdCalls, (unsigned)IMG_Stats.rdSectors,
+      (unsigned)IMG_Stats.wrCalls, (unsigned)IMG_Stats.wrSectors,
+      (unsigned)IMG_Stats.syncs);
+  printf(" %10.2f %9.3f %8.1f\n", appBytes / 1048576.0, ms,
+      ms > 0 ? appBytes / 1048576.0 / (ms / 1e3) : 0.0);
+
+  memset(count, 0, sizeof(*count));
+#if _FS_CACHE_SECTS
+  count->hit = fs.c_hit;
+  count->miss = fs.c_miss;
+  count->saved = fs.c_hit + fs.c_kept - fs.c_flush;
+#endif
+  count->rdSize = IMG_Stats.rdCalls ? IMG_Stats.rdBytes / 1024.0 / IMG_Stats.rdCalls : 0.0;
+  count->wrSize = IMG_Stats.wrCalls ? IMG_Stats.wrBytes / 1024.0 / IMG_Stats.wrCalls : 0.0;
+  count->join = fs.r_join;
+#if _FS_FREEMAP
+  count->skip = fs.m_skip;
+#endif
+#if _FS_DIRINDEX
+  count->find = fs.h_find;
+#endif
+  count->scan = fs.d_scan;
+  return FR_OK;
+}
+
+/**
+ * @brief Print the second table: the counters of FatFs.
+ * @param counts Counters of the workloads
+ * @param n Workloads run
+ */
+static void BENCH_PrintCounts(const BENCH_CountTypeDef* counts, uint32_t n) {
+
+  uint32_t i;
+
+  printf("\n%-11s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n", "workload", "c.hit",
+      "c.miss", "c.saved", "rd.KB/cmd", "wr.KB/cmd", "r.join", "m.skip", "d.find",
+      "d.scan");
+  for (i = 0; i < n; i++) {
+    printf("%-11s %9u %9u %9u %9.1f %9.1f %9u %9u %9u %9u\n", workloads[i].name,
+        (unsigned)counts[i].hit, (unsigned)counts[i].miss, (unsigned)counts[i].saved,
+        counts[i].rdSize, counts[i].wrSize, (unsigned)counts[i].join,
+        (unsigned)counts[i].skip, (unsigned)counts[i].find, (unsigned)counts[i].scan);
+  }
+}
+
+/**
+ * @brief Print the usage.
+ */
+static void BENCH_Usage(void) {
+
+  fprintf(stderr,
+      "usage: bench [options] image\n"
+      "  -f MB     create the image and format it (f_mkfs), implies -w\n"
+      "  -c bytes  cluster size for -f (default: by the size)\n"
+      "  -x        format exFAT with -f (mkexfat.c, f_mkfs formats FAT)\n"
+      "  -w        write the changes to the image (default: private copy)\n"
+      "  -n files  recordings written (%u)\n"
+      "  -s KB     size of a recording (%u)\n"
+      "  -b bytes  bytes per f_write of the recorder (%u, max %u)\n"
+      "  -k KB     data between f_sync calls of the recorder (%u, 0: never)\n"
+      "  -d files  files of the directory workloads in " BENCH_DIR " (%u)\n"
+      "  -F        fill the volume at the end\n",
+      (unsigned)recFiles, (unsigned)recSize, (unsigned)recBlock,
+      BENCH_BUF_SIZE, (unsigned)recSync, (unsigned)dirFiles);
+}
+
+int main(int argc, char* argv[]) {
+
+  static const char* types[] = { "?", "FAT12", "FAT16", "FAT32", "exFAT" };
+  BENCH_CountTypeDef counts[sizeof(workloads) / sizeof(workloads[0])];
+  uint32_t formatMB = 0, cluster = 0, i;
+  uint8_t writeBack = 0, exFat = 0;
+  FRESULT res;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:c:xwn:s:b:k:d:F")) != -1) {
+    switch (opt) {
+    case 'f': formatMB  = strtoul(optarg, 0, 0); break;
+    case 'c': cluster   = strtoul(optarg, 0, 0); break;
+    case 'x': exFat     = 1; break;
+    case 'w': writeBack = 1; break;
+    case 'n': recFiles  = strtoul(optarg, 0, 0); break;
+    case 's': recSize   = strtoul(optarg, 0, 0); break;
+    case 'b': recBlock  = strtoul(optarg, 0, 0); break;
+    case 'k': recSync   = strtoul(optarg, 0, 0); break;
+    case 'd': dirFiles  = strtoul(optarg, 0, 0); break;
+    case 'F': fillVolume = 1; break;
+    default:
+      BENCH_Usage();
+      return 2;
+    }
+  }
+  if (optind != argc - 1 || !recBlock || recBlock > BENCH_BUF_SIZE) {
+    BENCH_Usage();
+    return 2;
+  }
+
+  if (IMG_Open(argv[optind], formatMB, writeBack || formatMB)) {
+    perror(argv[optind]);
+    return 1;
+  }
+  if (formatMB && exFat) {
+    if (MKEXFAT_Format(cluster)) {
+      fprintf(stderr, "mkexfat: error\n");
+      IMG_Close();
+      return 1;
+    }
+  } else if (formatMB) {
+    f_mount(0, &fs);
+    res = f_mkfs(0, 0, cluster);
+    if (res != FR_OK) {
+      fprintf(stderr, "f_mkfs: error %d\n", res);
+      IMG_Close();
+      return 1;
+    }
+  }
+
+  res = BENCH_Mount();
+  if (res != FR_OK) {
+    fprintf(stderr, "mount: error %d\n", res);
+    IMG_Close();
+    return 1;
+  }
+  printf("%s: %s, %u clusters of %u bytes\n\n", argv[optind],
+      fs.fs_type < 5 ? types[fs.fs_type] : types[0],
+      (unsigned)(fs.max_clust - 2), (unsigned)fs.csize * SS(&fs));
+
+  printf("%-11s %9s %9s %9s %9s %6s", "workload", "rd.calls", "rd.sect",
+      "wr.calls", "wr.sect", "syncs");
+  printf(" %10s %9s %8s\n", "app.MB", "time.ms", "MB/s");
+
+  for (i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++) {
+    res = BENCH_Run(&workloads[i], &counts[i]);
+    if (res != FR_OK) {
+      fprintf(stderr, "%s: error %d\n", workloads[i].name, res);
+      break;
+    }
+  }
+  BENCH_PrintCounts(counts, i);
+
+  f_mount(0, NULL);
+  IMG_Close();
+  return res != FR_OK;
+}
+
+/**
+ * @}
+ */
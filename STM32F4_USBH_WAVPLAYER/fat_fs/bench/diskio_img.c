@@ -0,0 +1,159 @@
+/**
+ * @file    diskio_img.c
+ * @brief   FatFs disk I/O over a disk image file (host build)
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The image is mapped to memory, so the transfers cost a memcpy
+ * and the measured time is the time spent in FatFs. By default the mapping
+ * is private: the benchmark modifies only its copy of the image and every
+ * run starts from the same state. With write back the changes go to the
+ * file.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "diskio.h"
+#include "diskio_img.h"
+
+/**
+ * @addtogroup IMG
+ * @{
+ */
+
+IMG_StatsTypeDef IMG_Stats;
+
+static uint8_t* imgData;      ///< Mapped image
+static uint32_t imgSectors;   ///< Sectors in the image
+static int      imgFile = -1; ///< Image file descriptor
+
+/**
+ * @brief Map an image file.
+ * @param path Image file
+ * @param sizeMB Create (or resize) the file with this size in MB, 0 to use
+ * the file as it is
+ * @param writeBack 1: changes are written to the file, 0: private copy
+ * @return 0 if OK
+ */
+int IMG_Open(const char* path, uint32_t sizeMB, uint8_t writeBack) {
+
+  struct stat st;
+
+  imgFile = open(path, (sizeMB || writeBack) ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if (imgFile < 0) {
+    return -1;
+  }
+  if (sizeMB && ftruncate(imgFile, (off_t)sizeMB << 20)) {
+    IMG_Close();
+    return -1;
+  }
+  if (fstat(imgFile, &st) || st.st_size < IMG_SECTOR_SIZE) {
+    IMG_Close();
+    return -1;
+  }
+
+  imgSectors = st.st_size / IMG_SECTOR_SIZE;
+  imgData = mmap(0, (size_t)imgSectors * IMG_SECTOR_SIZE, PROT_READ | PROT_WRITE,
+      writeBack ? MAP_SHARED : MAP_PRIVATE, imgFile, 0);
+  if (imgData == MAP_FAILED) {
+    imgData = 0;
+    IMG_Close();
+    return -1;
+  }
+  memset(&IMG_Stats, 0, sizeof(IMG_Stats));
+  return 0;
+}
+
+/**
+ * @brief Unmap the image.
+ */
+void IMG_Close(void) {
+
+  if (imgData) {
+    munmap(imgData, (size_t)imgSectors * IMG_SECTOR_SIZE);
+    imgData = 0;
+  }
+  if (imgFile >= 0) {
+    close(imgFile);
+    imgFile = -1;
+  }
+}
+
+DSTATUS disk_initialize(BYTE drv) {
+
+  return disk_status(drv);
+}
+
+DSTATUS disk_status(BYTE drv) {
+
+  return (drv || !imgData) ? STA_NOINIT : 0;
+}
+
+DRESULT disk_read(BYTE drv, BYTE* buff, DWORD sector, UINT count) {
+
+  if (drv || !imgData) {
+    return RES_NOTRDY;
+  }
+  if (!count || sector >= imgSectors || count > imgSectors - sector) {
+    return RES_PARERR;
+  }
+  memcpy(buff, imgData + (size_t)sector * IMG_SECTOR_SIZE, (size_t)count * IMG_SECTOR_SIZE);
+  IMG_Stats.rdCalls++;
+  IMG_Stats.rdSectors += count;
+  IMG_Stats.rdBytes += (uint64_t)count * IMG_SECTOR_SIZE;
+  return RES_OK;
+}
+
+DRESULT disk_write(BYTE drv, const BYTE* buff, DWORD sector, UINT count) {
+
+  if (drv || !imgData) {
+    return RES_NOTRDY;
+  }
+  if (!count || sector >= imgSectors || count > imgSectors - sector) {
+    return RES_PARERR;
+  }
+  memcpy(imgData + (size_t)sector * IMG_SECTOR_SIZE, buff, (size_t)count * IMG_SECTOR_SIZE);
+  IMG_Stats.wrCalls++;
+  IMG_Stats.wrSectors += count;
+  IMG_Stats.wrBytes += (uint64_t)count * IMG_SECTOR_SIZE;
+  return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void* buff) {
+
+  if (drv || !imgData) {
+    return RES_NOTRDY;
+  }
+  switch (ctrl) {
+  case CTRL_SYNC:
+    IMG_Stats.syncs++;
+    return RES_OK;
+  case GET_SECTOR_COUNT:
+    *(DWORD*)buff = imgSectors;
+    return RES_OK;
+  case GET_SECTOR_SIZE:
+    *(WORD*)buff = IMG_SECTOR_SIZE;
+    return RES_OK;
+  case GET_BLOCK_SIZE:
+    *(DWORD*)buff = 1;
+    return RES_OK;
+  }
+  return RES_PARERR;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,59 @@
+/**
+ * @file    diskio_img.h
+ * @brief   FatFs disk I/O over a disk image file (host build)
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef DISKIO_IMG_H_
+#define DISKIO_IMG_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  IMG IMG
+ * @brief     Drive 0 of FatFs mapped to an image file, with I/O counters
+ */
+
+/**
+ * @addtogroup IMG
+ * @{
+ */
+
+#define IMG_SECTOR_SIZE 512 ///< Sector size of the image
+
+/**
+ * @brief Disk I/O counters.
+ * @details Every disk_read and disk_write call is one command of the
+ * USB mass storage device, so the calls count as much as the sectors.
+ */
+typedef struct {
+  uint32_t rdCalls;     ///< disk_read calls
+  uint32_t rdSectors;   ///< Sectors read
+  uint64_t rdBytes;     ///< Bytes read
+  uint32_t wrCalls;     ///< disk_write calls
+  uint32_t wrSectors;   ///< Sectors written
+  uint64_t wrBytes;     ///< Bytes written
+  uint32_t syncs;       ///< CTRL_SYNC requests
+} IMG_StatsTypeDef;
+
+extern IMG_StatsTypeDef IMG_Stats; ///< Counters, cleared by the user
+
+int   IMG_Open    (const char* path, uint32_t sizeMB, uint8_t writeBack);
+void  IMG_Close   (void);
+
+/**
+ * @}
+ */
+
+#endif /* DISKIO_IMG_H_ */
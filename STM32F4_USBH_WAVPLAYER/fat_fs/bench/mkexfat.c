@@ -0,0 +1,275 @@
+/**
+ * @file    mkexfat.c
+ * @brief   exFAT formatter of the host benchmark
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details Writes an empty exFAT volume over the whole drive 0 (no
+ * partition table, as f_mkfs with the super floppy format): the boot
+ * region and its backup (boot sector, extended boot sectors, OEM
+ * parameters and checksum sector), one FAT, and in the cluster heap the
+ * allocation bitmap, the up-case table and the root directory, one after
+ * the other from cluster 2. The up-case table maps the ASCII letters only
+ * (the other characters are their own upper case), which is all FatFs
+ * compares. The volume is aligned on the cluster size, the default
+ * cluster size follows the one of the Windows formatter.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <string.h>
+#include "diskio.h"
+#include "diskio_img.h"
+#include "mkexfat.h"
+
+/**
+ * @addtogroup MKEXFAT
+ * @{
+ */
+
+#define MKEXFAT_SS          IMG_SECTOR_SIZE ///< Sector size
+#define MKEXFAT_SS_SHIFT    9               ///< log2 of the sector size
+#define MKEXFAT_FAT_OFFSET  128             ///< First sector of the FAT
+#define MKEXFAT_BOOT_SECTS  12              ///< Sectors of a boot region
+#define MKEXFAT_UPCASE_LEN  128             ///< Characters of the up-case table
+#define MKEXFAT_SERIAL      0x20261019UL    ///< Volume serial number
+#define MKEXFAT_MAX_CLUSTER (32UL << 20)    ///< Largest cluster size
+
+static BYTE sect[MKEXFAT_SS]; ///< Sector buffer
+
+/**
+ * @brief Store a little endian value.
+ */
+static void MKEXFAT_Store(BYTE* p, uint64_t val, uint8_t bytes) {
+
+  while (bytes--) {
+    *p++ = (BYTE)val;
+    val >>= 8;
+  }
+}
+
+/**
+ * @brief Write the sector buffer.
+ * @return 0 if OK
+ */
+static int MKEXFAT_Write(DWORD sector) {
+
+  return disk_write(0, sect, sector, 1) != RES_OK;
+}
+
+/**
+ * @brief Write zeros over sectors.
+ * @return 0 if OK
+ */
+static int MKEXFAT_Clear(DWORD sector, DWORD count) {
+
+  memset(sect, 0, MKEXFAT_SS);
+  while (count--) {
+    if (MKEXFAT_Write(sector++)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Default cluster size of a volume.
+ * @param sectors Sectors of the volume
+ * @return Cluster size in bytes
+ */
+static uint32_t MKEXFAT_ClusterSize(DWORD sectors) {
+
+  uint64_t bytes = (uint64_t)sectors * MKEXFAT_SS;
+
+  if (bytes <= (256ULL << 20)) {
+    return 4096;
+  }
+  if (bytes <= (32ULL << 30)) {
+    return 32768;
+  }
+  return 131072;
+}
+
+/**
+ * @brief Write one boot region.
+ * @param base First sector of the region (0 or its backup)
+ * @param boot Boot sector
+ * @return 0 if OK
+ */
+static int MKEXFAT_BootRegion(DWORD base, const BYTE* boot) {
+
+  uint32_t sum = 0, i, s;
+
+  for (s = 0; s < MKEXFAT_BOOT_SECTS - 1; s++) {
+    if (s == 0) {
+      memcpy(sect, boot, MKEXFAT_SS);
+    } else {
+      memset(sect, 0, MKEXFAT_SS);
+      if (s <= 8) { // extended boot sectors
+        sect[MKEXFAT_SS - 2] = 0x55;
+        sect[MKEXFAT_SS - 1] = 0xAA;
+      }
+    }
+    // the volume flags and the percent in use are not in the checksum
+    for (i = 0; i < MKEXFAT_SS; i++) {
+      if (s == 0 && (i == 106 || i == 107 || i == 112)) {
+        continue;
+      }
+      sum = ((sum & 1) ? 0x80000000UL : 0) + (sum >> 1) + sect[i];
+    }
+    if (MKEXFAT_Write(base + s)) {
+      return -1;
+    }
+  }
+
+  for (i = 0; i < MKEXFAT_SS; i += 4) {
+    MKEXFAT_Store(sect + i, sum, 4);
+  }
+  return MKEXFAT_Write(base + s);
+}
+
+/**
+ * @brief Format drive 0 as exFAT.
+ * @param clusterBytes Cluster size in bytes (a power of 2 from the sector
+ * size to 32 MB), 0 for the default one
+ * @return 0 if OK
+ */
+int MKEXFAT_Format(uint32_t clusterBytes) {
+
+  static BYTE boot[MKEXFAT_SS];
+  DWORD sectors, spc, fatLen, heap, clusters, bitmapLen, bitmapClus, upcase, root;
+  DWORD s, i, c;
+  uint32_t upSum = 0;
+  uint8_t spcShift = 0;
+  WORD up;
+
+  if (disk_initialize(0) & STA_NOINIT || disk_ioctl(0, GET_SECTOR_COUNT, &sectors) != RES_OK) {
+    return -1;
+  }
+  if (!clusterBytes) {
+    clusterBytes = MKEXFAT_ClusterSize(sectors);
+  }
+  if (clusterBytes < MKEXFAT_SS || clusterBytes > MKEXFAT_MAX_CLUSTER ||
+      (clusterBytes & (clusterBytes - 1))) {
+    return -1;
+  }
+  spc = clusterBytes / MKEXFAT_SS;
+  while ((1UL << spcShift) < spc) {
+    spcShift++;
+  }
+
+  // the FAT is sized for the clusters it leaves, the heap starts on a cluster
+  clusters = (sectors - MKEXFAT_FAT_OFFSET) / spc;
+  fatLen = ((clusters + 2) * 4 + MKEXFAT_SS - 1) / MKEXFAT_SS;
+  heap = (MKEXFAT_FAT_OFFSET + fatLen + spc - 1) / spc * spc;
+  if (sectors <= heap) {
+    return -1;
+  }
+  clusters = (sectors - heap) / spc;
+  bitmapLen = (clusters + 7) / 8;
+  bitmapClus = (bitmapLen + clusterBytes - 1) / clusterBytes;
+  upcase = 2 + bitmapClus;
+  root = upcase + 1;
+  if (clusters < root) { // clusters 2 to root in use, one left
+    return -1;
+  }
+
+  // boot regions
+  memset(boot, 0, MKEXFAT_SS);
+  boot[0] = 0xEB;
+  boot[1] = 0x76;
+  boot[2] = 0x90;
+  memcpy(boot + 3, "EXFAT   ", 8);
+  MKEXFAT_Store(boot + 72, sectors, 8);           // VolumeLength
+  MKEXFAT_Store(boot + 80, MKEXFAT_FAT_OFFSET, 4); // FatOffset
+  MKEXFAT_Store(boot + 84, fatLen, 4);            // FatLength
+  MKEXFAT_Store(boot + 88, heap, 4);              // ClusterHeapOffset
+  MKEXFAT_Store(boot + 92, clusters, 4);          // ClusterCount
+  MKEXFAT_Store(boot + 96, root, 4);              // FirstClusterOfRootDirectory
+  MKEXFAT_Store(boot + 100, MKEXFAT_SERIAL, 4);   // VolumeSerialNumber
+  MKEXFAT_Store(boot + 104, 0x0100, 2);           // FileSystemRevision 1.00
+  boot[108] = MKEXFAT_SS_SHIFT;                   // BytesPerSectorShift
+  boot[109] = spcShift;                           // SectorsPerClusterShift
+  boot[110] = 1;                                  // NumberOfFats
+  boot[111] = 0x80;                               // DriveSelect
+  boot[112] = 0xFF;                               // PercentInUse (unknown)
+  boot[510] = 0x55;
+  boot[511] = 0xAA;
+  if (MKEXFAT_BootRegion(0, boot) || MKEXFAT_BootRegion(MKEXFAT_BOOT_SECTS, boot)) {
+    return -1;
+  }
+
+  // FAT: media, end of chain, then the chains of the system clusters
+  for (s = 0; s < fatLen; s++) {
+    memset(sect, 0, MKEXFAT_SS);
+    for (i = 0; i < MKEXFAT_SS / 4; i++) {
+      c = s * (MKEXFAT_SS / 4) + i;
+      if (c == 0) {
+        MKEXFAT_Store(sect, 0xFFFFFFF8UL, 4);
+      } else if (c == 1 || c == upcase - 1 || c == upcase || c == root) {
+        MKEXFAT_Store(sect + i * 4, 0xFFFFFFFFUL, 4);
+      } else if (c >= 2 && c < root) { // bitmap
+        MKEXFAT_Store(sect + i * 4, c + 1, 4);
+      }
+    }
+    if (MKEXFAT_Write(MKEXFAT_FAT_OFFSET + s)) {
+      return -1;
+    }
+  }
+
+  // allocation bitmap with the system clusters in use
+  for (s = 0; s < bitmapClus * spc; s++) {
+    memset(sect, 0, MKEXFAT_SS);
+    for (i = 0; i < MKEXFAT_SS * 8; i++) {
+      if (s * MKEXFAT_SS * 8 + i < root - 1) {
+        sect[i / 8] |= 1 << (i % 8);
+      }
+    }
+    if (MKEXFAT_Write(heap + s)) {
+      return -1;
+    }
+  }
+
+  // up-case table
+  if (MKEXFAT_Clear(heap + (upcase - 2) * spc, spc)) {
+    return -1;
+  }
+  for (i = 0; i < MKEXFAT_UPCASE_LEN; i++) {
+    up = (i >= 'a' && i <= 'z') ? i - 'a' + 'A' : i;
+    MKEXFAT_Store(sect + i * 2, up, 2);
+    upSum = ((upSum & 1) ? 0x80000000UL : 0) + (upSum >> 1) + (BYTE)up;
+    upSum = ((upSum & 1) ? 0x80000000UL : 0) + (upSum >> 1) + (BYTE)(up >> 8);
+  }
+  if (MKEXFAT_Write(heap + (upcase - 2) * spc)) {
+    return -1;
+  }
+
+  // root directory: bitmap and up-case table entries, then the end mark
+  if (MKEXFAT_Clear(heap + (root - 2) * spc, spc)) {
+    return -1;
+  }
+  sect[0] = 0x81;
+  MKEXFAT_Store(sect + 20, 2, 4);
+  MKEXFAT_Store(sect + 24, bitmapLen, 8);
+  sect[32] = 0x82;
+  MKEXFAT_Store(sect + 32 + 4, upSum, 4);
+  MKEXFAT_Store(sect + 32 + 20, upcase, 4);
+  MKEXFAT_Store(sect + 32 + 24, MKEXFAT_UPCASE_LEN * 2, 8);
+  if (MKEXFAT_Write(heap + (root - 2) * spc)) {
+    return -1;
+  }
+
+  return disk_ioctl(0, CTRL_SYNC, 0) != RES_OK;
+}
+
+/**
+ * @}
+ */
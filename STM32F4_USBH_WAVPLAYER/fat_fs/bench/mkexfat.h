@@ -0,0 +1,39 @@
+/**
+ * @file    mkexfat.h
+ * @brief   exFAT formatter of the host benchmark
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef MKEXFAT_H_
+#define MKEXFAT_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  MKEXFAT MKEXFAT
+ * @brief     Empty exFAT volume on drive 0 (f_mkfs makes only FAT volumes)
+ */
+
+/**
+ * @addtogroup MKEXFAT
+ * @{
+ */
+
+int MKEXFAT_Format (uint32_t clusterBytes);
+
+/**
+ * @}
+ */
+
+#endif /* MKEXFAT_H_ */
@@ -8,7 +8,9 @@
 #define _USE_IOCTL	1
 
 #include "integer.h"
+#ifndef _FS_HOST
 #include "usbh_msc_core.h"
+#endif
 
 /* Status of Disk Functions */
 typedef BYTE	DSTATUS;
@@ -29,9 +31,9 @@ typedef enum {
 BOOL assign_drives (int argc, char *argv[]);
 DSTATUS disk_initialize (BYTE);
 DSTATUS disk_status (BYTE);
-DRESULT disk_read (BYTE, BYTE*, DWORD, BYTE);
+DRESULT disk_read (BYTE, BYTE*, DWORD, UINT);
 #if	_READONLY == 0
-DRESULT disk_write (BYTE, const BYTE*, DWORD, BYTE);
+DRESULT disk_write (BYTE, const BYTE*, DWORD, UINT);
 #endif
 DRESULT disk_ioctl (BYTE, BYTE, void*);
 
@@ -285,6 +285,35 @@ const PARTITION Drives[];			/* Logical drive# to physical location conversion ta
 
 
 
+/* Number of entries in the sector cache (512 byte sectors) */
+
+#define	_FS_CACHE_SECTS	(_FS_CACHE_SIZE / 512)
+
+#if _FS_CACHE_SECTS && _FS_TINY
+#error The sector cache cannot be used with _FS_TINY.
+#endif
+
+#if _FS_WBUF && _FS_TINY
+#error The write-back buffer cannot be used with _FS_TINY.
+#endif
+
+#if _FS_WBUF % _MAX_SS
+#error _FS_WBUF must be a multiple of _MAX_SS.
+#endif
+
+#if _FS_DIRINDEX && _USE_LFN
+#error The directory index cannot be used with _USE_LFN.
+#endif
+#if _FS_DIRINDEX & (_FS_DIRINDEX - 1)
+#error _FS_DIRINDEX must be a power of 2.
+#endif
+
+#if _FS_EXFAT && (_USE_LFN || _FS_RPATH)
+#error _FS_EXFAT requires _USE_LFN = 0 and _FS_RPATH = 0.
+#endif
+
+
+
 /* Type of file name on FatFs API */
 
 #if _LFN_UNICODE && _USE_LFN
@@ -300,7 +329,7 @@ typedef char XCHAR;		/* SBCS, DBCS */
 typedef struct _FATFS_ {
 	BYTE	fs_type;	/* FAT sub type */
 	BYTE	drive;		/* Physical drive number */
-	BYTE	csize;		/* Number of sectors per cluster */
+	WORD	csize;		/* Number of sectors per cluster */
 	BYTE	n_fats;		/* Number of FAT copies */
 	BYTE	wflag;		/* win[] dirty flag (1:must be written back) */
 	BYTE	fsi_flag;	/* fsinfo dirty flag (1:must be written back) */
@@ -319,6 +348,17 @@ typedef struct _FATFS_ {
 #endif
 #if _FS_RPATH
 	DWORD	cdir;		/* Current directory (0:root)*/
+#endif
+#if !_FS_READONLY && _FS_FREEMAP
+	DWORD	frsize;		/* Clusters per region of the free space map (0:map not used) */
+	DWORD	m_skip;		/* FAT entries not read thanks to the map */
+	WORD	fmap[_FS_FREEMAP];	/* Free clusters in each region (0xFFFF:not counted) */
+#endif
+#if _FS_DIRINDEX
+	DWORD	hdir;		/* Start cluster of the indexed directory (1:none) */
+	WORD	hcnt;		/* Used slots of the index (0xFFFF:directory not indexed) */
+	DWORD	h_find;		/* Name searches answered by the index */
+	DWORD	htab[_FS_DIRINDEX];	/* Hash and entry index of the names (0:empty slot) */
 #endif
 	DWORD	sects_fat;	/* Sectors per fat */
 	DWORD	max_clust;	/* Maximum cluster# + 1. Number of clusters is max_clust - 2 */
@@ -326,7 +366,31 @@ typedef struct _FATFS_ {
 	DWORD	dirbase;	/* Root directory start sector (Cluster# on FAT32) */
 	DWORD	database;	/* Data start sector */
 	DWORD	winsect;	/* Current sector appearing in the win[] */
+	DWORD	r_join;		/* Clusters joined to a direct read (commands saved) */
+	DWORD	d_scan;		/* Entries compared by the name searches */
 	BYTE	win[_MAX_SS];/* Disk access window for Directory/FAT */
+#if _FS_EXFAT
+	DWORD	bitbase;	/* Allocation bitmap start sector (exFAT) */
+	BYTE	xdir[32];	/* SFN entry made from the last exFAT entry set read */
+#endif
+#if _FS_CACHE_SECTS
+	UINT	n_cache;	/* Number of entries used for the sector size */
+	DWORD	ctick;		/* Cache use counter */
+	DWORD	c_hit;		/* Window loads from the cache */
+	DWORD	c_miss;		/* Window loads from the disk */
+	DWORD	c_kept;		/* Dirty windows kept in the cache */
+	DWORD	c_flush;	/* Dirty sectors written back from the cache */
+	DWORD	csect[_FS_CACHE_SECTS];	/* Sectors in the cache (0:free entry) */
+	DWORD	cstamp[_FS_CACHE_SECTS];	/* Last use of each entry (0:free entry) */
+	BYTE	cflag[_FS_CACHE_SECTS];	/* Dirty flags of the entries */
+	BYTE	cbuf[_FS_CACHE_SIZE];	/* Cached sectors */
+#endif
+#if !_FS_READONLY && _FS_WBUF
+	struct _FIL_*	wown;	/* File object owning the write-back buffer */
+	DWORD	wsect;		/* First sector in the write-back buffer */
+	UINT	wcnt;		/* Sectors in the write-back buffer */
+	BYTE	wbuf[_FS_WBUF];	/* Write-back buffer */
+#endif
 } FATFS;
 
 
@@ -346,6 +410,12 @@ typedef struct _DIR_ {
 	WCHAR*	lfn;		/* Pointer to the LFN working buffer */
 	WORD	lfn_idx;	/* Last matched LFN index number (0xFFFF:No LFN) */
 #endif
+#if _FS_EXFAT
+	DWORD	ncont;		/* Clusters of a contiguous table (exFAT, 0:FAT chain) */
+	DWORD	xclst;		/* Clusters allocated to the object found (exFAT) */
+	WORD	xidx;		/* Index of the file entry of the object found (exFAT) */
+	BYTE	xstat;		/* Stream flags of the object found (exFAT, bit7:not writable) */
+#endif
 } DIR;
 
 
@@ -356,7 +426,7 @@ typedef struct _FIL_ {
 	FATFS*	fs;			/* Pointer to the owner file system object */
 	WORD	id;			/* Owner file system mount ID */
 	BYTE	flag;		/* File status flags */
-	BYTE	csect;		/* Sector address in the cluster */
+	WORD	csect;		/* Sector address in the cluster */
 	DWORD	fptr;		/* File R/W pointer */
 	DWORD	fsize;		/* File size */
 	DWORD	org_clust;	/* File start cluster */
@@ -365,6 +435,11 @@ typedef struct _FIL_ {
 #if !_FS_READONLY
 	DWORD	dir_sect;	/* Sector containing the directory entry */
 	BYTE*	dir_ptr;	/* Pointer to the directory entry in the window */
+#if _FS_EXFAT
+	DWORD	dir_sclust;	/* Start cluster of the directory (exFAT) */
+	DWORD	dir_ncont;	/* Clusters of the contiguous directory (exFAT, 0:FAT chain) */
+	WORD	dir_xidx;	/* Index of the file entry in the directory (exFAT) */
+#endif
 #endif
 #if !_FS_TINY
 	BYTE	buf[_MAX_SS];/* File R/W buffer */
@@ -427,6 +502,7 @@ FRESULT f_stat (const XCHAR*, FILINFO*);			/* Get file status */
 FRESULT f_getfree (const XCHAR*, DWORD*, FATFS**);	/* Get number of free clusters on the drive */
 FRESULT f_truncate (FIL*);							/* Truncate file */
 FRESULT f_sync (FIL*);								/* Flush cached data of a writing file */
+FRESULT f_flush (FIL*);								/* Write the buffered data of a file */
 FRESULT f_unlink (const XCHAR*);					/* Delete an existing file or directory */
 FRESULT	f_mkdir (const XCHAR*);						/* Create a new directory */
 FRESULT f_chmod (const XCHAR*, BYTE, BYTE);			/* Change attribute of the file/dir */
@@ -493,6 +569,9 @@ void ff_rel_grant(_SYNC_t);
 #define FA__DIRTY			0x40
 #endif
 #define FA__ERROR			0x80
+#if _FS_EXFAT
+#define FA__CONT			0x10	/* Contiguous clusters (the open mode bits are cleared) */
+#endif
 
 
 /* FAT sub type (FATFS.fs_type) */
@@ -500,6 +579,7 @@ void ff_rel_grant(_SYNC_t);
 #define FS_FAT12	1
 #define FS_FAT16	2
 #define FS_FAT32	3
+#define FS_EXFAT	4
 
 
 /* File attribute bits for directory entry */
@@ -557,6 +637,16 @@ void ff_rel_grant(_SYNC_t);
 #define	FSI_Free_Count		488
 #define	FSI_Nxt_Free		492
 
+#define BPB_TotSecEx		72
+#define BPB_FatOfsEx		80
+#define BPB_FatSzEx			84
+#define BPB_DataOfsEx		88
+#define BPB_NumClusEx		92
+#define BPB_RootClusEx		96
+#define BPB_BytsPerSecEx	108
+#define BPB_SecPerClusEx	109
+#define BPB_NumFATsEx		110
+
 #define MBR_Table			446
 
 #define	DIR_Name			0
@@ -574,6 +664,20 @@ void ff_rel_grant(_SYNC_t);
 #define	LDIR_Type			12
 #define	LDIR_Chksum			13
 #define	LDIR_FstClusLO		26
+#define	XDIR_Type			0	/* exFAT entries: type */
+#define	XDIR_NumSec			1	/* File entry: number of secondary entries */
+#define	XDIR_SetSum			2	/* File entry: sum of the entry set */
+#define	XDIR_Attr			4	/* File entry: attribute */
+#define	XDIR_CrtTime		8	/* File entry: created time and date */
+#define	XDIR_ModTime		12	/* File entry: modified time and date */
+#define	XDIR_AccTime		16	/* File entry: accessed time and date */
+#define	XDIR_GenFlags		1	/* Stream entry: flags (bit1:NoFatChain) */
+#define	XDIR_NumName		3	/* Stream entry: name length */
+#define	XDIR_NameHash		4	/* Stream entry: hash of the up-case name */
+#define	XDIR_ValidFileSize	8	/* Stream entry: valid data length */
+#define	XDIR_FstClus		20	/* Stream and bitmap entries: first cluster */
+#define	XDIR_FileSize		24	/* Stream and bitmap entries: data length */
+#define	XDIR_Name			2	/* Name entry: characters */
 
 
 
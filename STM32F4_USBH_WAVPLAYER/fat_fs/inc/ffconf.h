@@ -20,6 +20,57 @@
 /  data transfer. This reduces memory consumption 512 bytes each file object. */
 
 
+#define	_FS_CACHE_SIZE	4096	/* 0 or RAM in bytes */
+/* The _FS_CACHE_SIZE option sets the RAM of the sector cache in each file
+/  system object, which keeps the FAT and directory sectors leaving the sector
+/  window (_FS_CACHE_SIZE / sector size sectors, least recently used replaced).
+/  Dirty sectors are written back when replaced or on sync. 0 disables it.
+/  The cache requires _FS_TINY = 0. */
+
+
+#define	_FS_WBUF	4096	/* 0 or buffer size in bytes */
+/* The _FS_WBUF option sets the size of the write-back buffer in bytes, a
+/  multiple of _MAX_SS. There is one buffer in each file system object,
+/  used by one file at a time. The sectors written by f_write into
+/  consecutive sectors are collected there and written with one disk_write
+/  when the buffer is full, the run breaks, another file writes, the file is
+/  read, seeked or opened again, or on f_flush, f_sync, f_close and
+/  f_mount. A run is dropped when the medium is changed or when f_mount
+/  fails to write it (FR_DISK_ERR). Writes of the buffer size or more go
+/  directly when the buffer is empty.
+/  0 disables it. The buffer requires _FS_TINY = 0. */
+
+
+#define	_FS_FREEMAP	512		/* 0 or number of regions */
+/* The _FS_FREEMAP option splits the clusters into regions whose free clusters
+/  are counted once and then kept up to date (2 bytes of RAM per region), so
+/  that the cluster allocation skips the full regions without reading their
+/  FAT sectors. 0 disables it. Not used with _FS_READONLY = 1. */
+
+
+#define	_FS_DIRINDEX	2048	/* 0 or number of slots (power of 2) */
+/* The _FS_DIRINDEX option sets the slots of the name hash index in each file
+/  system object (4 bytes of RAM per slot). The index is built for the last
+/  directory searched beyond its first sector and then finds an entry with a
+/  single directory sector read. Directories with more entries than 3/4 of the
+/  slots are not indexed. 0 disables it. The index requires _USE_LFN = 0. */
+
+
+#define	_FS_EXFAT	1		/* 0 or 1 */
+/* Setting _FS_EXFAT to 1 enables the exFAT volumes (512 byte sectors, one
+/  FAT, clusters up to 16 MB). File sizes are 32-bit, so files over 4 GB
+/  are out of scope: they are read as 4 GB - 1 bytes and cannot be written,
+/  and the recorder closes its file before 4 GB (REC_MAX_FILE_SIZE). The
+/  bench (bench/bench.c -x) formats its exFAT images with bench/mkexfat.c,
+/  as f_mkfs makes only FAT volumes. An object is found by its name when it
+/  fits the 8.3 format, else by an alias made of up to 3 characters of the
+/  name, '~', the name hash in hex and the extension, e.g. "MYS~1A2F.WAV".
+/  The files of contiguous clusters (NoFatChain) are read without the FAT
+/  and the files written in contiguous clusters are marked so.
+/  Sub-directories do not grow beyond their clusters. It requires
+/  _USE_LFN = 0 and _FS_RPATH = 0. */
+
+
 #define _FS_READONLY	0	/* 0 or 1 */
 /* Setting _FS_READONLY to 1 defines read only configuration. This removes
 /  writing functions, f_write, f_sync, f_unlink, f_mkdir, f_chmod, f_rename,
@@ -8,7 +8,11 @@
 #include <windows.h>
 #else
 
+#ifdef _FS_HOST
+#include <stdint.h>	/* Host build (bench/), long may be 64-bit */
+#else
 #include "usb_conf.h"
+#endif
 
 /* These types must be 16-bit, 32-bit or larger integer */
 typedef int				INT;
@@ -26,9 +30,15 @@ typedef unsigned short	WORD;
 typedef unsigned short	WCHAR;
 
 /* These types must be 32-bit integer */
+#ifdef _FS_HOST
+typedef int32_t			LONG;
+typedef uint32_t		ULONG;
+typedef uint32_t		DWORD;
+#else
 typedef long			LONG;
 typedef unsigned long	ULONG;
 typedef unsigned long	DWORD;
+#endif
 
 /* Boolean type */
 // typedef enum { FALSE = 0, TRUE } BOOL;
@@ -118,6 +118,12 @@
 #define NS_EXT		0x10	/* Lower case flag (ext) */
 #define NS_DOT		0x20	/* Dot entry */
 
+/* Start cluster of an SFN entry */
+#define	LD_CLUST(dir)	(((DWORD)LD_WORD(dir+DIR_FstClusHI) << 16) | LD_WORD(dir+DIR_FstClusLO))
+
+/* Clusters of the sub-directory found if it is a contiguous one (exFAT) */
+#define	XD_NCONT(dj)	(((dj)->fs->fs_type == FS_EXFAT && ((dj)->xstat & 2)) ? (dj)->xclst : 0)
+
 
 
 
@@ -236,6 +242,169 @@ void unlock_fs (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Write back a FAT/Directory sector                                     */
+/*-----------------------------------------------------------------------*/
+#if !_FS_READONLY
+static
+FRESULT write_sect (
+	FATFS *fs,			/* File system object */
+	const BYTE *buff,	/* Sector data */
+	DWORD sect			/* Sector number */
+)
+{
+	BYTE nf;
+
+
+	if (disk_write(fs->drive, buff, sect, 1) != RES_OK)
+		return FR_DISK_ERR;
+	if (sect < (fs->fatbase + fs->sects_fat)) {	/* In FAT area */
+		for (nf = fs->n_fats; nf > 1; nf--) {	/* Reflect the change to all FAT copies */
+			sect += fs->sects_fat;
+			disk_write(fs->drive, buff, sect, 1);
+		}
+	}
+
+	return FR_OK;
+}
+#endif
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Sector cache behind the window                                        */
+/*-----------------------------------------------------------------------*/
+/* A sector leaving the window is kept in the cache, with its dirty flag,
+/  and a sector coming into the window is taken out of the cache, so that
+/  a sector is never both in the window and in the cache. The least
+/  recently used entry makes room, written back first if dirty. */
+#if _FS_CACHE_SECTS
+
+static
+void cache_init (
+	FATFS *fs		/* File system object */
+)
+{
+	UINT i;
+
+
+	fs->n_cache = _FS_CACHE_SIZE / SS(fs);
+	for (i = 0; i < _FS_CACHE_SECTS; i++) {
+		fs->csect[i] = 0;
+		fs->cstamp[i] = 0;
+		fs->cflag[i] = 0;
+	}
+	fs->ctick = fs->c_hit = fs->c_miss = fs->c_kept = fs->c_flush = 0;
+}
+
+
+static
+void cache_drop (	/* Forget the cached sectors in a range without writing them */
+	FATFS *fs,		/* File system object */
+	DWORD sect,		/* First sector of the range */
+	DWORD count		/* Number of sectors */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < fs->n_cache; i++) {
+		if (fs->cstamp[i] && fs->csect[i] - sect < count) {
+			fs->csect[i] = 0;
+			fs->cstamp[i] = 0;
+			fs->cflag[i] = 0;
+		}
+	}
+}
+
+
+static
+FRESULT cache_put (	/* Keep the window in the cache */
+	FATFS *fs		/* File system object */
+)
+{
+	UINT i, n = 0;
+
+
+	for (i = 0; i < fs->n_cache; i++) {
+		if (fs->cstamp[i] && fs->csect[i] == fs->winsect) {	/* Older copy of the window */
+			n = i; break;
+		}
+		if (fs->cstamp[i] < fs->cstamp[n]) n = i;	/* Least recently used or free */
+	}
+#if !_FS_READONLY
+	if (fs->cstamp[n] && fs->csect[n] != fs->winsect && fs->cflag[n]) {	/* Write back the replaced sector */
+		if (write_sect(fs, fs->cbuf + n * SS(fs), fs->csect[n]) != FR_OK)
+			return FR_DISK_ERR;
+		fs->c_flush++;
+	}
+	if (fs->wflag) fs->c_kept++;
+	fs->cflag[n] = fs->wflag;
+#endif
+	mem_cpy(fs->cbuf + n * SS(fs), fs->win, SS(fs));
+	fs->csect[n] = fs->winsect;
+	fs->cstamp[n] = ++fs->ctick;
+
+	return FR_OK;
+}
+
+
+static
+BYTE cache_get (	/* 1: The sector has been moved to the window, 0: Not cached */
+	FATFS *fs,		/* File system object */
+	DWORD sect		/* Sector number */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < fs->n_cache; i++) {
+		if (fs->cstamp[i] && fs->csect[i] == sect) {
+			mem_cpy(fs->win, fs->cbuf + i * SS(fs), SS(fs));
+#if !_FS_READONLY
+			fs->wflag = fs->cflag[i];
+#endif
+			fs->csect[i] = 0;
+			fs->cstamp[i] = 0;
+			fs->cflag[i] = 0;
+			fs->c_hit++;
+			return 1;
+		}
+	}
+	fs->c_miss++;
+
+	return 0;
+}
+
+
+#if !_FS_READONLY
+static
+FRESULT cache_flush (	/* Write back all dirty sectors in the cache */
+	FATFS *fs		/* File system object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < fs->n_cache; i++) {
+		if (fs->cstamp[i] && fs->cflag[i]) {
+			if (write_sect(fs, fs->cbuf + i * SS(fs), fs->csect[i]) != FR_OK)
+				return FR_DISK_ERR;
+			fs->cflag[i] = 0;
+			fs->c_flush++;
+		}
+	}
+
+	return FR_OK;
+}
+#endif
+
+#endif /* _FS_CACHE_SECTS */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Change window offset                                                  */
 /*-----------------------------------------------------------------------*/
@@ -251,23 +420,37 @@ FRESULT move_window (
 
 	wsect = fs->winsect;
 	if (wsect != sector) {	/* Changed current window */
+#if _FS_CACHE_SECTS
+		if (sector && wsect) {	/* Keep the current window in the cache */
+			if (cache_put(fs) != FR_OK)
+				return FR_DISK_ERR;
+#if !_FS_READONLY
+			fs->wflag = 0;
+#endif
+		}
+#endif
 #if !_FS_READONLY
 		if (fs->wflag) {	/* Write back dirty window if needed */
-			if (disk_write(fs->drive, fs->win, wsect, 1) != RES_OK)
+			if (write_sect(fs, fs->win, wsect) != FR_OK)
 				return FR_DISK_ERR;
 			fs->wflag = 0;
-			if (wsect < (fs->fatbase + fs->sects_fat)) {	/* In FAT area */
-				BYTE nf;
-				for (nf = fs->n_fats; nf > 1; nf--) {	/* Reflect the change to all FAT copies */
-					wsect += fs->sects_fat;
-					disk_write(fs->drive, fs->win, wsect, 1);
-				}
-			}
+#if _FS_CACHE_SECTS
+			cache_drop(fs, wsect, 1);	/* Forget an older copy */
+#endif
 		}
 #endif
 		if (sector) {
+#if _FS_CACHE_SECTS
+			if (!cache_get(fs, sector)) {
+				if (disk_read(fs->drive, fs->win, sector, 1) != RES_OK) {
+					fs->winsect = 0;	/* The window is in the cache, only invalidate it */
+					return FR_DISK_ERR;
+				}
+			}
+#else
 			if (disk_read(fs->drive, fs->win, sector, 1) != RES_OK)
 				return FR_DISK_ERR;
+#endif
 			fs->winsect = sector;
 		}
 	}
@@ -291,6 +474,10 @@ FRESULT sync (	/* FR_OK: successful, FR_DISK_ERR: failed */
 
 
 	res = move_window(fs, 0);
+#if _FS_CACHE_SECTS
+	if (res == FR_OK)
+		res = cache_flush(fs);
+#endif
 	if (res == FR_OK) {
 		/* Update FSInfo sector if needed */
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag) {
@@ -350,6 +537,13 @@ DWORD get_fat (	/* 0xFFFFFFFF:Disk error, 1:Internal error, Else:Cluster status
 	case FS_FAT32 :
 		if (move_window(fs, fsect + (clst / (SS(fs) / 4)))) break;
 		return LD_DWORD(&fs->win[((WORD)clst * 4) & (SS(fs) - 1)]) & 0x0FFFFFFF;
+#if _FS_EXFAT
+	case FS_EXFAT :
+		if (move_window(fs, fsect + (clst / (SS(fs) / 4)))) break;
+		wc = ((WORD)clst * 4) & (SS(fs) - 1);
+		if (LD_DWORD(&fs->win[wc]) >= 0xFFFFFFF7) return 0x0FFFFFFF;	/* Bad cluster or end of chain */
+		return LD_DWORD(&fs->win[wc]);
+#endif
 	}
 
 	return 0xFFFFFFFF;	/* An error occurred at the disk I/O layer */
@@ -379,6 +573,20 @@ FRESULT put_fat (
 		res = FR_INT_ERR;
 
 	} else {
+#if _FS_FREEMAP
+		if (fs->frsize) {	/* Keep the free cluster count of the region */
+			WORD *cnt = &fs->fmap[(clst - 2) / fs->frsize];
+			if (*cnt != 0xFFFF) {
+				fsect = get_fat(fs, clst);	/* Current value */
+				if (fsect == 1 || fsect == 0xFFFFFFFF)
+					*cnt = 0xFFFF;			/* Count it again when needed */
+				else if (!fsect && val)
+					(*cnt)--;
+				else if (fsect && !val)
+					(*cnt)++;
+			}
+		}
+#endif
 		fsect = fs->fatbase;
 		switch (fs->fs_type) {
 		case FS_FAT12 :
@@ -406,6 +614,14 @@ FRESULT put_fat (
 			if (res != FR_OK) break;
 			ST_DWORD(&fs->win[((WORD)clst * 4) & (SS(fs) - 1)], val);
 			break;
+#if _FS_EXFAT
+		case FS_EXFAT :
+			res = move_window(fs, fsect + (clst / (SS(fs) / 4)));
+			if (res != FR_OK) break;
+			if (val == 0x0FFFFFFF) val = 0xFFFFFFFF;	/* End of chain */
+			ST_DWORD(&fs->win[((WORD)clst * 4) & (SS(fs) - 1)], val);
+			break;
+#endif
 
 		default :
 			res = FR_INT_ERR;
@@ -420,6 +636,142 @@ FRESULT put_fat (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Free space map                                         */
+/*-----------------------------------------------------------------------*/
+/* The free clusters of a region are counted when the allocation first
+/  reaches it (or all at once by the scan of f_getfree) and then kept by
+/  put_fat. The regions without free cluster are skipped by create_chain. */
+#if !_FS_READONLY && _FS_FREEMAP
+static
+void fmap_init (
+	FATFS *fs		/* File system object */
+)
+{
+	DWORD n, r;
+
+
+	n = fs->max_clust - 2;					/* Number of clusters */
+	fs->m_skip = 0;
+	fs->frsize = (n + _FS_FREEMAP - 1) / _FS_FREEMAP;
+	if (fs->frsize >= 0xFFFF) fs->frsize = 0;	/* Too large regions for the counters */
+#if _FS_EXFAT
+	if (fs->fs_type == FS_EXFAT) fs->frsize = 0;	/* The allocation bitmap is searched instead */
+#endif
+	for (r = 0; r < _FS_FREEMAP; r++) {
+		fs->fmap[r] = 0xFFFF;
+		if (fs->free_clust == n && r * fs->frsize < n)	/* Empty volume by FSInfo: no need to count */
+			fs->fmap[r] = (WORD)((n - r * fs->frsize < fs->frsize) ? n - r * fs->frsize : fs->frsize);
+	}
+}
+
+
+static
+FRESULT fmap_count (
+	FATFS *fs,		/* File system object */
+	DWORD r			/* Region to count the free clusters of */
+)
+{
+	DWORD clst, end, stat;
+	WORD n = 0;
+
+
+	clst = 2 + r * fs->frsize;
+	end = clst + fs->frsize;
+	if (end > fs->max_clust) end = fs->max_clust;
+	for ( ; clst < end; clst++) {
+		stat = get_fat(fs, clst);
+		if (stat == 0xFFFFFFFF) return FR_DISK_ERR;
+		if (stat == 1) return FR_INT_ERR;
+		if (stat == 0) n++;
+	}
+	fs->fmap[r] = n;
+
+	return FR_OK;
+}
+#endif
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Allocation bitmap (exFAT)                              */
+/*-----------------------------------------------------------------------*/
+/* The bitmap tells the clusters in use. The FAT is still written for the
+/  chains made here, so a file can leave the contiguous clusters any time,
+/  but it is not valid for the objects marked NoFatChain by other systems. */
+#if !_FS_READONLY && _FS_EXFAT
+static
+FRESULT bit_put (
+	FATFS *fs,		/* File system object */
+	DWORD clst,		/* First cluster# to mark */
+	DWORD n,		/* Number of clusters */
+	BYTE val		/* 1:In use, 0:Free */
+)
+{
+	FRESULT res = FR_OK;
+	DWORD i;
+	BYTE *p;
+
+
+	if (clst < 2 || clst + n > fs->max_clust) return FR_INT_ERR;
+	for (i = clst - 2; n; i++, n--) {
+		res = move_window(fs, fs->bitbase + i / 8 / SS(fs));
+		if (res != FR_OK) break;
+		p = &fs->win[i / 8 % SS(fs)];
+		*p = val ? (*p | (1 << (i % 8))) : (*p & ~(1 << (i % 8)));
+		fs->wflag = 1;
+	}
+
+	return res;
+}
+
+
+static
+FRESULT remove_cont (	/* Free the clusters of a NoFatChain object */
+	FATFS *fs,		/* File system object */
+	DWORD clst,		/* First cluster# */
+	DWORD n			/* Number of clusters */
+)
+{
+	FRESULT res;
+
+
+	res = bit_put(fs, clst, n, 0);
+	if (res == FR_OK) {
+#if _FS_CACHE_SECTS
+		cache_drop(fs, fs->database + (clst - 2) * fs->csize, n * fs->csize);	/* Forget the cached sectors of the clusters */
+#endif
+#if _FS_DIRINDEX
+		if (clst == fs->hdir) fs->hdir = 1;	/* The indexed directory is removed */
+#endif
+		if (fs->free_clust != 0xFFFFFFFF) fs->free_clust += n;
+	}
+
+	return res;
+}
+
+
+static
+FRESULT fill_fat (	/* Write the FAT chain of a NoFatChain object before it is changed */
+	FATFS *fs,		/* File system object */
+	DWORD clst,		/* First cluster# */
+	DWORD n			/* Number of clusters */
+)
+{
+	FRESULT res = FR_OK;
+
+
+	for ( ; n && res == FR_OK; clst++, n--)
+		res = put_fat(fs, clst, (n > 1) ? clst + 1 : 0x0FFFFFFF);
+
+	return res;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Remove a cluster chain                                 */
 /*-----------------------------------------------------------------------*/
@@ -439,13 +791,23 @@ FRESULT remove_chain (
 
 	} else {
 		res = FR_OK;
+#if _FS_DIRINDEX
+		if (clst == fs->hdir) fs->hdir = 1;		/* The indexed directory is removed */
+#endif
 		while (clst < fs->max_clust) {			/* Not a last link? */
 			nxt = get_fat(fs, clst);			/* Get cluster status */
 			if (nxt == 0) break;				/* Empty cluster? */
 			if (nxt == 1) { res = FR_INT_ERR; break; }	/* Internal error? */
 			if (nxt == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }	/* Disk error? */
 			res = put_fat(fs, clst, 0);			/* Mark the cluster "empty" */
+#if _FS_EXFAT
+			if (res == FR_OK && fs->fs_type == FS_EXFAT)
+				res = bit_put(fs, clst, 1, 0);	/* Clear the bit in the allocation bitmap */
+#endif
 			if (res != FR_OK) break;
+#if _FS_CACHE_SECTS
+			cache_drop(fs, fs->database + (clst - 2) * fs->csize, fs->csize);	/* Forget the cached sectors of the cluster */
+#endif
 			if (fs->free_clust != 0xFFFFFFFF) {	/* Update FSInfo */
 				fs->free_clust++;
 				fs->fsi_flag = 1;
@@ -472,6 +834,11 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 )
 {
 	DWORD cs, ncl, scl, mcl;
+#if _FS_FREEMAP
+	DWORD r, rend;
+	FRESULT res;
+	BYTE known;
+#endif
 
 
 	mcl = fs->max_clust;
@@ -493,6 +860,36 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 			ncl = 2;
 			if (ncl > scl) return 0;	/* No free cluster */
 		}
+#if _FS_FREEMAP
+		if (fs->frsize) {				/* Skip the region if it is full */
+			r = (ncl - 2) / fs->frsize;
+			known = (fs->fmap[r] != 0xFFFF);	/* Counted before (else its FAT entries are read now) */
+			if (!known) {
+				res = fmap_count(fs, r);
+				if (res == FR_DISK_ERR) return 0xFFFFFFFF;
+				if (res != FR_OK) return 1;
+			}
+			if (fs->fmap[r] == 0) {
+				rend = 2 + (r + 1) * fs->frsize;	/* First cluster of the next region */
+				if (scl >= ncl && scl < rend) {	/* No free cluster */
+					if (known) fs->m_skip += scl - ncl + 1;
+					return 0;
+				}
+				if (rend > mcl) rend = mcl;
+				if (known) fs->m_skip += rend - ncl;
+				ncl = rend - 1;
+				continue;
+			}
+		}
+#endif
+#if _FS_EXFAT
+		if (fs->fs_type == FS_EXFAT) {	/* Check the allocation bitmap */
+			if (move_window(fs, fs->bitbase + (ncl - 2) / 8 / SS(fs))) return 0xFFFFFFFF;
+			if (!(fs->win[(ncl - 2) / 8 % SS(fs)] & (1 << ((ncl - 2) % 8)))) break;	/* Found a free cluster */
+			if (ncl == scl) return 0;	/* No free cluster */
+			continue;
+		}
+#endif
 		cs = get_fat(fs, ncl);			/* Get the cluster status */
 		if (cs == 0) break;				/* Found a free cluster */
 		if (cs == 0xFFFFFFFF || cs == 1)/* An error occurred */
@@ -502,6 +899,10 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 
 	if (put_fat(fs, ncl, 0x0FFFFFFF))	/* Mark the new cluster "in use" */
 		return 0xFFFFFFFF;
+#if _FS_EXFAT
+	if (fs->fs_type == FS_EXFAT && bit_put(fs, ncl, 1, 1))	/* and in the allocation bitmap */
+		return 0xFFFFFFFF;
+#endif
 	if (clst != 0) {					/* Link it to the previous one if needed */
 		if (put_fat(fs, clst, ncl))
 			return 0xFFFFFFFF;
@@ -548,15 +949,14 @@ FRESULT dir_seek (
 	WORD idx		/* Directory index number */
 )
 {
-	DWORD clst;
-	WORD ic;
+	DWORD clst, ic;
 
 
 	dj->index = idx;
 	clst = dj->sclust;
 	if (clst == 1 || clst >= dj->fs->max_clust)	/* Check start cluster range */
 		return FR_INT_ERR;
-	if (!clst && dj->fs->fs_type == FS_FAT32)	/* Replace cluster# 0 with root cluster# if in FAT32 */
+	if (!clst && (dj->fs->fs_type == FS_FAT32 || dj->fs->fs_type == FS_EXFAT))	/* Replace cluster# 0 with root cluster# if in FAT32/exFAT */
 		clst = dj->fs->dirbase;
 
 	if (clst == 0) {	/* Static table */
@@ -567,6 +967,13 @@ FRESULT dir_seek (
 	}
 	else {				/* Dynamic table */
 		ic = SS(dj->fs) / 32 * dj->fs->csize;	/* Entries per cluster */
+#if _FS_EXFAT
+		if (dj->ncont) {	/* Contiguous table (NoFatChain) */
+			if (idx / ic >= dj->ncont) return FR_INT_ERR;
+			clst += idx / ic;
+			idx %= ic;
+		}
+#endif
 		while (idx >= ic) {	/* Follow cluster chain */
 			clst = get_fat(dj->fs, clst);				/* Get next cluster */
 			if (clst == 0xFFFFFFFF) return FR_DISK_ERR;	/* Disk error */
@@ -613,13 +1020,23 @@ FRESULT dir_next (	/* FR_OK:Succeeded, FR_NO_FILE:End of table, FR_DENIED:EOT an
 		}
 		else {					/* Dynamic table */
 			if (((i / (SS(dj->fs) / 32)) & (dj->fs->csize - 1)) == 0) {	/* Cluster changed? */
+#if _FS_EXFAT
+				if (dj->ncont) {								/* Contiguous table (NoFatChain) */
+					clst = dj->clust + 1;
+					if (clst >= dj->sclust + dj->ncont) return streach ? FR_DENIED : FR_NO_FILE;
+				} else
+#endif
 				clst = get_fat(dj->fs, dj->clust);				/* Get next cluster */
 				if (clst <= 1) return FR_INT_ERR;
 				if (clst == 0xFFFFFFFF) return FR_DISK_ERR;
 				if (clst >= dj->fs->max_clust) {				/* When it reached end of dynamic table */
 #if !_FS_READONLY
-					BYTE c;
+					WORD c;
 					if (!streach) return FR_NO_FILE;			/* When do not stretch, report EOT */
+#if _FS_EXFAT
+					if (dj->fs->fs_type == FS_EXFAT && dj->sclust)	/* The size of a sub-directory is not updated */
+						return FR_DENIED;
+#endif
 					clst = create_chain(dj->fs, dj->clust);		/* Stretch cluster chain */
 					if (clst == 0) return FR_DENIED;			/* No free cluster */
 					if (clst == 1) return FR_INT_ERR;
@@ -815,10 +1232,529 @@ BYTE sum_sfn (
 	BYTE sum = 0;
 	int n = 11;
 
-	do sum = (sum >> 1) + (sum << 7) + *dir++; while (--n);
-	return sum;
+	do sum = (sum >> 1) + (sum << 7) + *dir++; while (--n);
+	return sum;
+}
+#endif
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Name hash index                                  */
+/*-----------------------------------------------------------------------*/
+/* A slot keeps the upper half of the SFN hash and the entry index, so that
+/  a search reads only the sector of the entry (after the FAT sectors needed
+/  to reach its cluster). The name is always compared in the entry itself.
+/  The slots of removed entries are left as tombstones until reused. */
+#if _FS_DIRINDEX
+#define	HASH_DEL	0x0000FFFF	/* Tombstone of a removed entry */
+
+static
+DWORD hash_sfn (	/* FNV-1a hash with the bit 16 set */
+	const BYTE *name	/* SFN (11 bytes) */
+)
+{
+	DWORD h = 2166136261UL;
+	int n = 11;
+
+	do h = (h ^ *name++) * 16777619UL; while (--n);
+	return h | 0x10000;
+}
+
+
+static
+void hash_add (
+	FATFS *fs,			/* File system object */
+	const BYTE *name,	/* SFN of the entry */
+	WORD idx			/* Index of the entry */
+)
+{
+	DWORD h;
+	UINT i;
+
+
+	if (fs->hcnt >= _FS_DIRINDEX / 4 * 3) {	/* Too many entries: do not index the directory */
+		fs->hcnt = 0xFFFF;
+		return;
+	}
+	h = hash_sfn(name);
+	i = (UINT)h & (_FS_DIRINDEX - 1);
+	while (fs->htab[i] && fs->htab[i] != HASH_DEL)	/* Find an empty slot or a tombstone */
+		i = (i + 1) & (_FS_DIRINDEX - 1);
+	if (!fs->htab[i]) fs->hcnt++;
+	fs->htab[i] = (h & 0xFFFF0000) | idx;
+}
+
+
+#if !_FS_READONLY
+static
+void hash_del (
+	FATFS *fs,			/* File system object */
+	const BYTE *name,	/* SFN of the entry */
+	WORD idx			/* Index of the entry */
+)
+{
+	DWORD h;
+	UINT i;
+
+
+	h = hash_sfn(name);
+	i = (UINT)h & (_FS_DIRINDEX - 1);
+	while (fs->htab[i]) {
+		if (fs->htab[i] == ((h & 0xFFFF0000) | idx)) {
+			fs->htab[i] = HASH_DEL;
+			break;
+		}
+		i = (i + 1) & (_FS_DIRINDEX - 1);
+	}
+}
+#endif
+
+
+static
+FRESULT hash_find (	/* FR_OK:Found, FR_NO_FILE:Not in the directory, FR_DISK_ERR:Disk error */
+	DIR *dj			/* Directory object of the indexed directory */
+)
+{
+	FRESULT res;
+	DWORD h, e;
+	UINT i;
+
+
+	dj->fs->h_find++;
+	h = hash_sfn(dj->fn);
+	i = (UINT)h & (_FS_DIRINDEX - 1);
+	while ((e = dj->fs->htab[i]) != 0) {
+		if ((e & 0xFFFF0000) == (h & 0xFFFF0000)) {	/* Same hash: check the entry */
+			res = dir_seek(dj, (WORD)e);
+			if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+			if (res != FR_OK) return res;
+			dj->fs->d_scan++;
+			if (!(dj->dir[DIR_Attr] & AM_VOL) && !mem_cmp(dj->dir, dj->fn, 11))
+				return FR_OK;
+		}
+		i = (i + 1) & (_FS_DIRINDEX - 1);
+	}
+
+	return FR_NO_FILE;
+}
+
+
+static
+FRESULT hash_build (
+	DIR *dj			/* Directory object of the directory to be indexed */
+)
+{
+	FRESULT res;
+	FATFS *fs = dj->fs;
+	BYTE c;
+
+
+	fs->hdir = 1;
+	fs->hcnt = 0;
+	mem_set(fs->htab, 0, sizeof(fs->htab));
+	res = dir_seek(dj, 0);
+	while (res == FR_OK) {
+		res = move_window(fs, dj->sect);
+		if (res != FR_OK) break;
+		c = dj->dir[DIR_Name];
+		if (c == 0) break;				/* Reached to end of table */
+		if (c != 0xE5 && !(dj->dir[DIR_Attr] & AM_VOL)) {
+			hash_add(fs, dj->dir, dj->index);
+			if (fs->hcnt == 0xFFFF) break;	/* Too large directory */
+		}
+		res = dir_next(dj, FALSE);		/* Next entry */
+	}
+	if (res == FR_NO_FILE) res = FR_OK;	/* End of the cluster chain */
+	if (res == FR_OK) fs->hdir = dj->sclust;
+
+	return res;
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - exFAT entry sets                                 */
+/*-----------------------------------------------------------------------*/
+/* An exFAT object is a set of a file entry, a stream entry and the name
+/  entries. The set read last is shown as an SFN entry in fs->xdir (name or
+/  alias, attribute, modified time, start cluster and size), so that the
+/  code for the FAT entries can look at it through dj->dir. Any change is
+/  written into the set with its sum updated. */
+#if _FS_EXFAT
+
+static
+BOOL xchr_plain (	/* TRUE: The char can be put into an SFN as it is */
+	WCHAR w			/* Unicode char of the exFAT name */
+)
+{
+	return (w > ' ' && w < 0x7F && w != '.' && !chk_chr("\"*+,[=]|", w)) ? TRUE : FALSE;
+}
+
+
+static
+FRESULT xdir_read (	/* FR_OK:An object is read, FR_NO_FILE:End of table, FR_DISK_ERR:Disk error */
+	DIR *dj			/* Directory object pointing the entry to start from */
+)					/* dj is left at the last entry of the set read */
+{
+	FRESULT res;
+	FATFS *fs = dj->fs;
+	BYTE *dir, *sfn = fs->xdir;
+	BYTE nc, n, i, ni, dp, na, ne, ab[3], ap[3], ae[3];
+	BOOL fit;
+	WORD hash;
+	WCHAR w;
+	DWORD lo, hi, bcs;
+
+
+	res = FR_NO_FILE;
+	while (dj->sect) {
+		res = move_window(fs, dj->sect);
+		if (res != FR_OK) break;
+		dir = dj->dir;
+		if (dir[XDIR_Type] == 0) { res = FR_NO_FILE; break; }	/* Reached to end of table */
+		if (dir[XDIR_Type] == 0x85 && dir[XDIR_NumSec] >= 2) {	/* A file entry is found */
+			mem_set(sfn, ' ', 11);
+			mem_set(sfn + 11, 0, 21);
+			sfn[DIR_Attr] = dir[XDIR_Attr] & (AM_RDO | AM_HID | AM_SYS | AM_DIR | AM_ARC);
+			ST_WORD(sfn+DIR_WrtTime, LD_WORD(dir+XDIR_ModTime));
+			ST_WORD(sfn+DIR_WrtDate, LD_WORD(dir+XDIR_ModTime+2));
+			dj->xidx = dj->index;
+			res = dir_next(dj, FALSE);				/* Stream entry */
+			if (res == FR_OK) res = move_window(fs, dj->sect);
+			if (res != FR_OK) break;
+			dir = dj->dir;
+			if (dir[XDIR_Type] != 0xC0) continue;	/* Broken set: go on from this entry */
+			dj->xstat = dir[XDIR_GenFlags] & 0x03;
+			lo = LD_DWORD(dir+XDIR_FileSize);
+			hi = LD_DWORD(dir+XDIR_FileSize+4);
+			if (hi || LD_DWORD(dir+XDIR_ValidFileSize+4) || LD_DWORD(dir+XDIR_ValidFileSize) != lo)
+				dj->xstat |= 0x80;					/* Over 4 GB or not all valid: no writing */
+			ST_DWORD(sfn+DIR_FileSize, LD_DWORD(dir+XDIR_ValidFileSize+4) ? 0xFFFFFFFF : LD_DWORD(dir+XDIR_ValidFileSize));
+			bcs = (DWORD)fs->csize * SS(fs);		/* Clusters allocated */
+			dj->xclst = hi * (0xFFFFFFFF / bcs + 1) + lo / bcs + ((lo % bcs) ? 1 : 0);
+			lo = LD_DWORD(dir+XDIR_FstClus);
+			ST_WORD(sfn+DIR_FstClusHI, lo >> 16);
+			ST_WORD(sfn+DIR_FstClusLO, lo);
+			nc = dir[XDIR_NumName];
+			hash = LD_WORD(dir+XDIR_NameHash);
+
+			/* Take the name as an SFN if it fits the 8.3 format, and keep the parts of the alias */
+			fit = TRUE; i = dp = na = ne = 0; ni = 8;
+			for (n = 0; n < nc; n++) {
+				if (n % 15 == 0) {					/* Next name entry */
+					res = dir_next(dj, FALSE);
+					if (res == FR_OK) res = move_window(fs, dj->sect);
+					if (res != FR_OK || dj->dir[XDIR_Type] != 0xC1) break;
+				}
+				w = LD_WORD(dj->dir+XDIR_Name+n%15*2);
+				if (w == '.') {						/* Start of an extension */
+					if (!n || ni == 11) fit = FALSE;	/* Leading dot or second dot */
+					i = 8; ni = 11;
+					dp = n + 1; ne = 0;
+					continue;
+				}
+				if (!xchr_plain(w)) { fit = FALSE; continue; }
+				if (IsLower(w)) w -= 0x20;
+				if (i < ni) sfn[i++] = (BYTE)w; else fit = FALSE;
+				if (na < 3) { ab[na] = (BYTE)w; ap[na++] = n; }
+				if (dp && ne < 3) ae[ne++] = (BYTE)w;
+			}
+			if (res != FR_OK) break;
+			if (n < nc) continue;					/* Broken set: go on from this entry */
+			if (!nc || dp == nc) fit = FALSE;		/* Trailing dot */
+			if (!fit) {								/* Create the alias */
+				mem_set(sfn, ' ', 11);
+				for (i = n = 0; n < na && (!dp || ap[n] < dp - 1); n++) sfn[i++] = ab[n];
+				sfn[i++] = '~';
+				for (n = 0; n < 4; n++) sfn[i++] = "0123456789ABCDEF"[(hash >> (12 - n * 4)) & 15];
+				for (n = 0; n < ne; n++) sfn[8 + n] = ae[n];
+			}
+			dj->dir = sfn;
+			return FR_OK;
+		}
+		res = dir_next(dj, FALSE);					/* Next entry */
+		if (res != FR_OK) break;
+	}
+
+	dj->sect = 0;
+
+	return res;
+}
+
+
+static
+FRESULT xdir_find (	/* FR_OK:Found, FR_NO_FILE:Not found, FR_DISK_ERR:Disk error */
+	DIR *dj			/* Directory object with the SFN to find */
+)
+{
+	FRESULT res;
+
+
+	res = dir_seek(dj, 0);
+	while (res == FR_OK) {
+		res = xdir_read(dj);
+		if (res != FR_OK) break;
+		if (!mem_cmp(dj->dir, dj->fn, 11)) break;	/* Name or alias matched? */
+		res = dir_next(dj, FALSE);
+	}
+
+	return res;
+}
+
+
+static
+FRESULT find_bitmap (	/* Locate the allocation bitmap in the root directory */
+	FATFS *fs			/* File system object */
+)
+{
+	FRESULT res;
+	DIR dj;
+	DWORD clst, n, nxt;
+
+
+	dj.fs = fs; dj.sclust = 0; dj.ncont = 0;
+	res = dir_seek(&dj, 0);
+	while (res == FR_OK) {
+		res = move_window(fs, dj.sect);
+		if (res != FR_OK) break;
+		if (dj.dir[XDIR_Type] == 0) break;		/* No bitmap */
+		if (dj.dir[XDIR_Type] == 0x81) {		/* The first bitmap (the second one is for TexFAT) */
+			clst = LD_DWORD(dj.dir+XDIR_FstClus);
+			n = LD_DWORD(dj.dir+XDIR_FileSize);
+			fs->bitbase = clust2sect(fs, clst);
+			if (!fs->bitbase || n < (fs->max_clust - 2 + 7) / 8) return FR_NO_FILESYSTEM;
+			for (n = (n - 1) / SS(fs) / fs->csize; n; n--, clst++) {	/* It must be in contiguous clusters */
+				nxt = get_fat(fs, clst);
+				if (nxt == 0xFFFFFFFF) return FR_DISK_ERR;
+				if (nxt != clst + 1) return FR_NO_FILESYSTEM;
+			}
+			return FR_OK;
+		}
+		res = dir_next(&dj, FALSE);
+	}
+
+	return (res == FR_OK || res == FR_NO_FILE) ? FR_NO_FILESYSTEM : res;
+}
+
+
+#if !_FS_READONLY
+static
+WORD xsum (			/* Add an entry to the sum of the set */
+	WORD sum,		/* Sum of the previous entries */
+	const BYTE *ent,/* Entry */
+	BOOL first		/* TRUE: The file entry (the sum itself is skipped) */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < 32; i++) {
+		if (first && (i == XDIR_SetSum || i == XDIR_SetSum + 1)) continue;
+		sum = ((sum & 1) ? 0x8000 : 0) + (sum >> 1) + ent[i];
+	}
+
+	return sum;
+}
+
+
+static
+FRESULT xset_load (	/* Read the file and stream entries of the set */
+	DIR *dj,		/* Directory object with the index of the set */
+	BYTE *buf		/* 64 byte buffer */
+)
+{
+	FRESULT res;
+
+
+	res = dir_seek(dj, dj->xidx);
+	if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+	if (res == FR_OK) {
+		mem_cpy(buf, dj->dir, 32);
+		res = dir_next(dj, FALSE);
+		if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+		if (res == FR_OK) mem_cpy(buf + 32, dj->dir, 32);
+	}
+	if (res == FR_NO_FILE) res = FR_INT_ERR;
+
+	return res;
+}
+
+
+static
+FRESULT xset_store (	/* Write the file and stream entries of the set with the new sum */
+	DIR *dj,			/* Directory object with the index of the set */
+	BYTE *buf			/* File and stream entries */
+)
+{
+	FRESULT res;
+	WORD sum;
+	BYTE n;
+
+
+	sum = xsum(xsum(0, buf, TRUE), buf + 32, FALSE);
+	res = dir_seek(dj, dj->xidx);
+	if (res == FR_OK) res = dir_next(dj, FALSE);
+	for (n = buf[XDIR_NumSec]; res == FR_OK && n > 1; n--) {	/* Add the name entries */
+		res = dir_next(dj, FALSE);
+		if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+		if (res == FR_OK) sum = xsum(sum, dj->dir, FALSE);
+	}
+	ST_WORD(buf+XDIR_SetSum, sum);
+
+	if (res == FR_OK) res = dir_seek(dj, dj->xidx);
+	if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+	if (res == FR_OK) {
+		mem_cpy(dj->dir, buf, 32);
+		dj->fs->wflag = 1;
+		res = dir_next(dj, FALSE);
+		if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+		if (res == FR_OK) {
+			mem_cpy(dj->dir, buf + 32, 32);
+			dj->fs->wflag = 1;
+		}
+	}
+	if (res == FR_NO_FILE) res = FR_INT_ERR;
+
+	return res;
+}
+
+
+#if !_FS_MINIMIZE
+static
+FRESULT xdir_sync (	/* Write the attribute and the time changed in fs->xdir into the set */
+	DIR *dj			/* Directory object of the set */
+)
+{
+	FRESULT res;
+	BYTE buf[64], *dir = dj->fs->xdir;
+
+
+	res = xset_load(dj, buf);
+	if (res == FR_OK) {
+		buf[XDIR_Attr] = dir[DIR_Attr];
+		ST_WORD(buf+XDIR_ModTime, LD_WORD(dir+DIR_WrtTime));
+		ST_WORD(buf+XDIR_ModTime+2, LD_WORD(dir+DIR_WrtDate));
+		buf[21] = 0;						/* 10 ms increments of the modified time */
+		res = xset_store(dj, buf);
+	}
+
+	return res;
+}
+#endif
+
+
+static
+FRESULT xdir_register (	/* FR_OK:Successful, FR_DENIED:No free entry, FR_INVALID_NAME:Not an ASCII name */
+	DIR *dj				/* Target directory with the SFN to be created */
+)
+{
+	FRESULT res;
+	BYTE buf[64], name[12], *fn = dj->fn, *dir, c;
+	UINT i, nc;
+	WORD hash;
+	DWORD tim;
+
+
+	/* The exFAT name is the SFN with the lower case flags applied */
+	for (i = nc = 0; i < 8 && fn[i] != ' '; i++)
+		name[nc++] = fn[i] + (((fn[NS] & NS_BODY) && IsUpper(fn[i])) ? 0x20 : 0);
+	if (fn[8] != ' ') {
+		name[nc++] = '.';
+		for (i = 8; i < 11 && fn[i] != ' '; i++)
+			name[nc++] = fn[i] + (((fn[NS] & NS_EXT) && IsUpper(fn[i])) ? 0x20 : 0);
+	}
+	hash = 0;
+	for (i = 0; i < nc; i++) {				/* Hash of the up-case name in UTF-16 */
+		c = name[i];
+		if (c < ' ' || c >= 0x80) return FR_INVALID_NAME;	/* No code conversion */
+		if (IsLower(c)) c -= 0x20;
+		hash = ((hash & 1) ? 0x8000 : 0) + (hash >> 1) + c;
+		hash = ((hash & 1) ? 0x8000 : 0) + (hash >> 1);
+	}
+
+	/* Find three contiguous free entries */
+	res = dir_seek(dj, 0);
+	i = 0;
+	while (res == FR_OK) {
+		res = move_window(dj->fs, dj->sect);
+		if (res != FR_OK) break;
+		i = (dj->dir[XDIR_Type] & 0x80) ? 0 : i + 1;
+		if (i == 3) break;
+		res = dir_next(dj, TRUE);			/* Next entry with table stretch */
+	}
+	if (res == FR_NO_FILE) res = FR_DENIED;
+	if (res != FR_OK) return res;
+
+	dir = dj->dir;							/* Name entry */
+	mem_set(dir, 0, 32);
+	dir[XDIR_Type] = 0xC1;
+	for (i = 0; i < nc; i++) {
+		ST_WORD(dir+XDIR_Name+i*2, name[i]);
+	}
+	dj->fs->wflag = 1;
+
+	mem_set(buf, 0, 64);					/* File and stream entries */
+	buf[XDIR_Type] = 0x85;
+	buf[XDIR_NumSec] = 2;
+	tim = get_fattime();
+	ST_DWORD(buf+XDIR_CrtTime, tim);
+	ST_DWORD(buf+XDIR_ModTime, tim);
+	ST_DWORD(buf+XDIR_AccTime, tim);
+	buf[32+XDIR_Type] = 0xC0;
+	buf[32+XDIR_GenFlags] = 1;				/* Allocation possible */
+	buf[32+XDIR_NumName] = (BYTE)nc;
+	ST_WORD(buf+32+XDIR_NameHash, hash);
+	dj->xidx = dj->index - 2;
+	res = xset_store(dj, buf);
+
+	if (res == FR_OK) {						/* Show the new object in fs->xdir */
+		dir = dj->fs->xdir;
+		mem_cpy(dir, fn, 11);
+		mem_set(dir + 11, 0, 21);
+		ST_DWORD(dir+DIR_WrtTime, tim);
+		dj->dir = dir;
+		dj->xstat = 1;
+		dj->xclst = 0;
+	}
+
+	return res;
+}
+
+
+#if !_FS_MINIMIZE
+static
+FRESULT xdir_remove (	/* FR_OK: Successful, FR_DISK_ERR: A disk error */
+	DIR *dj				/* Directory object of the set to be removed */
+)
+{
+	FRESULT res;
+	BYTE n;
+
+
+	res = dir_seek(dj, dj->xidx);
+	if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+	if (res == FR_OK) {
+		n = dj->dir[XDIR_NumSec];
+		for (;;) {
+			dj->dir[XDIR_Type] &= 0x7F;		/* Mark the entry "not in use" */
+			dj->fs->wflag = 1;
+			if (!n--) break;
+			res = dir_next(dj, FALSE);
+			if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+			if (res != FR_OK) break;
+		}
+	}
+	if (res == FR_NO_FILE) res = FR_INT_ERR;
+
+	return res;
 }
 #endif
+#endif /* !_FS_READONLY */
+#endif /* _FS_EXFAT */
+
 
 
 
@@ -837,6 +1773,18 @@ FRESULT dir_find (
 #if _USE_LFN
 	BYTE a, ord, sum;
 #endif
+#if _FS_DIRINDEX
+	WORD i;
+#endif
+
+#if _FS_EXFAT
+	if (dj->fs->fs_type == FS_EXFAT)	/* Search the entry sets */
+		return xdir_find(dj);
+#endif
+#if _FS_DIRINDEX
+	if (dj->sclust == dj->fs->hdir && dj->fs->hcnt != 0xFFFF)	/* Indexed directory */
+		return hash_find(dj);
+#endif
 
 	res = dir_seek(dj, 0);			/* Rewind directory object */
 	if (res != FR_OK) return res;
@@ -847,6 +1795,7 @@ FRESULT dir_find (
 	do {
 		res = move_window(dj->fs, dj->sect);
 		if (res != FR_OK) break;
+		dj->fs->d_scan++;
 		dir = dj->dir;					/* Ptr to the directory entry of current index */
 		c = dir[DIR_Name];
 		if (c == 0) { res = FR_NO_FILE; break; }	/* Reached to end of table */
@@ -878,6 +1827,18 @@ FRESULT dir_find (
 		res = dir_next(dj, FALSE);		/* Next entry */
 	} while (res == FR_OK);
 
+#if _FS_DIRINDEX
+	if ((res == FR_OK || res == FR_NO_FILE) && dj->sclust != dj->fs->hdir
+		&& dj->index >= SS(dj->fs) / 32) {	/* More than a sector searched: index the directory */
+		i = dj->index;
+		hash_build(dj);
+		if (res == FR_OK) {				/* Return to the found entry */
+			res = dir_seek(dj, i);
+			if (res == FR_OK) res = move_window(dj->fs, dj->sect);
+		}
+	}
+#endif
+
 	return res;
 }
 
@@ -899,6 +1860,10 @@ FRESULT dir_read (
 	BYTE a, ord = 0xFF, sum = 0xFF;
 #endif
 
+#if _FS_EXFAT
+	if (dj->fs->fs_type == FS_EXFAT)	/* Read an entry set */
+		return xdir_read(dj);
+#endif
 	res = FR_NO_FILE;
 	while (dj->sect) {
 		res = move_window(dj->fs, dj->sect);
@@ -1015,6 +1980,10 @@ FRESULT dir_register (	/* FR_OK:Successful, FR_DENIED:No free entry or too many
 	}
 
 #else	/* Non LFN configuration */
+#if _FS_EXFAT
+	if (dj->fs->fs_type == FS_EXFAT)	/* Create an entry set */
+		return xdir_register(dj);
+#endif
 	res = dir_seek(dj, 0);
 	if (res == FR_OK) {
 		do {	/* Find a blank entry for the SFN */
@@ -1035,6 +2004,12 @@ FRESULT dir_register (	/* FR_OK:Successful, FR_DENIED:No free entry or too many
 			mem_cpy(dir, dj->fn, 11);	/* Put SFN */
 			dir[DIR_NTres] = *(dj->fn+NS) & (NS_BODY | NS_EXT);	/* Put NT flag */
 			dj->fs->wflag = 1;
+#if _FS_DIRINDEX
+			if (dj->sclust == dj->fs->hdir && dj->fs->hcnt != 0xFFFF) {	/* Add the entry to the index */
+				hash_add(dj->fs, dir, dj->index);
+				if (dj->fs->hcnt == 0xFFFF) dj->fs->hdir = 1;	/* Full of tombstones? Rebuild on the next search */
+			}
+#endif
 		}
 	}
 
@@ -1073,10 +2048,18 @@ FRESULT dir_remove (	/* FR_OK: Successful, FR_DISK_ERR: A disk error */
 	}
 
 #else			/* Non LFN configuration */
+#if _FS_EXFAT
+	if (dj->fs->fs_type == FS_EXFAT)	/* Remove the entry set */
+		return xdir_remove(dj);
+#endif
 	res = dir_seek(dj, dj->index);
 	if (res == FR_OK) {
 		res = move_window(dj->fs, dj->sect);
 		if (res == FR_OK) {
+#if _FS_DIRINDEX
+			if (dj->sclust == dj->fs->hdir && dj->fs->hcnt != 0xFFFF)	/* Remove the entry from the index */
+				hash_del(dj->fs, dj->dir, dj->index);
+#endif
 			*dj->dir = 0xE5;			/* Mark the entry "deleted" */
 			dj->fs->wflag = 1;
 		}
@@ -1399,6 +2382,9 @@ FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 		path++;
 	dj->sclust = 0;						/* Start from the root dir */
 #endif
+#if _FS_EXFAT
+	dj->ncont = 0;
+#endif
 
 	if ((UINT)*path < ' ') {			/* Null path means the start directory itself */
 		res = dir_seek(dj, 0);
@@ -1421,6 +2407,9 @@ FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 				res = FR_NO_PATH; break;
 			}
 			dj->sclust = ((DWORD)LD_WORD(dir+DIR_FstClusHI) << 16) | LD_WORD(dir+DIR_FstClusLO);
+#if _FS_EXFAT
+			dj->ncont = XD_NCONT(dj);
+#endif
 		}
 	}
 
@@ -1435,7 +2424,7 @@ FRESULT follow_path (	/* FR_OK(0): successful, !=0: error code */
 /*-----------------------------------------------------------------------*/
 
 static
-BYTE check_fs (	/* 0:The FAT boot record, 1:Valid boot record but not an FAT, 2:Not a boot record, 3:Error */
+BYTE check_fs (	/* 0:The FAT boot record, 1:Valid boot record but not an FAT, 2:Not a boot record, 3:Error, 4:The exFAT boot record */
 	FATFS *fs,	/* File system object */
 	DWORD sect	/* Sector# (lba) to check if it is an FAT boot record or not */
 )
@@ -1449,6 +2438,10 @@ BYTE check_fs (	/* 0:The FAT boot record, 1:Valid boot record but not an FAT, 2:
 		return 0;
 	if ((LD_DWORD(&fs->win[BS_FilSysType32]) & 0xFFFFFF) == 0x544146)
 		return 0;
+#if _FS_EXFAT
+	if (!mem_cmp(&fs->win[BS_OEMName], "EXFAT   ", 8))	/* Check "EXFAT" string */
+		return 4;
+#endif
 
 	return 1;
 }
@@ -1456,6 +2449,76 @@ BYTE check_fs (	/* 0:The FAT boot record, 1:Valid boot record but not an FAT, 2:
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Volume write-back buffer                                              */
+/*-----------------------------------------------------------------------*/
+/* One buffer per file system object holds a run of data sectors of the
+/  file object in fs->wown. Another file writing takes the buffer over
+/  after writing the run out, and f_mount writes it out before the file
+/  system object is released. */
+#if !_FS_READONLY && _FS_WBUF
+
+static
+FRESULT wb_send (	/* FR_OK:succeeded, FR_DISK_ERR:failed */
+	FATFS *fs		/* File system object */
+)
+{
+	if (fs->wcnt) {
+		if (disk_write(fs->drive, fs->wbuf, fs->wsect, fs->wcnt) != RES_OK)
+			return FR_DISK_ERR;
+		fs->wcnt = 0;
+	}
+	return FR_OK;
+}
+
+
+static
+FRESULT wb_flush (	/* FR_OK:succeeded, FR_DISK_ERR:failed */
+	FIL *fp			/* Pointer to the file object */
+)					/* Only the sectors of this file are written */
+{
+	return (fp->fs->wown == fp) ? wb_send(fp->fs) : FR_OK;
+}
+
+
+static
+FRESULT wb_write (	/* FR_OK:succeeded, FR_DISK_ERR:failed */
+	FIL *fp,		/* Pointer to the file object */
+	const BYTE *buff,	/* Data to be written */
+	DWORD sect,		/* First sector */
+	UINT cc			/* Number of sectors */
+)
+{
+	FATFS *fs = fp->fs;
+	UINT n, max = _FS_WBUF / SS(fs);	/* Sectors in the buffer */
+
+
+	while (cc) {
+		if (fs->wcnt && (fs->wown != fp || sect != fs->wsect + fs->wcnt)) {	/* Another file or not following the run */
+			if (wb_send(fs) != FR_OK) return FR_DISK_ERR;
+		}
+		if (!fs->wcnt) {
+			if (cc >= max)						/* Large transfer goes directly */
+				return (disk_write(fs->drive, buff, sect, cc) == RES_OK) ? FR_OK : FR_DISK_ERR;
+			fs->wown = fp;
+			fs->wsect = sect;
+		}
+		n = max - fs->wcnt;						/* Fill the buffer */
+		if (n > cc) n = cc;
+		mem_cpy(&fs->wbuf[fs->wcnt * SS(fs)], buff, n * SS(fs));
+		fs->wcnt += n;
+		buff += n * SS(fs); sect += n; cc -= n;
+		if (fs->wcnt == max && wb_send(fs) != FR_OK) return FR_DISK_ERR;	/* Write it when full */
+	}
+
+	return FR_OK;
+}
+
+#endif /* !_FS_READONLY && _FS_WBUF */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Make sure that the file system is valid                               */
 /*-----------------------------------------------------------------------*/
@@ -1531,33 +2594,52 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occurred */
 		}
 	}
 	if (fmt == 3) return FR_DISK_ERR;
-	if (fmt || LD_WORD(fs->win+BPB_BytsPerSec) != SS(fs))	/* No valid FAT partition is found */
-		return FR_NO_FILESYSTEM;
-
-	/* Initialize the file system object */
-	fsize = LD_WORD(fs->win+BPB_FATSz16);				/* Number of sectors per FAT */
-	if (!fsize) fsize = LD_DWORD(fs->win+BPB_FATSz32);
-	fs->sects_fat = fsize;
-	fs->n_fats = fs->win[BPB_NumFATs];					/* Number of FAT copies */
-	fsize *= fs->n_fats;								/* (Number of sectors in FAT area) */
-	fs->fatbase = bsect + LD_WORD(fs->win+BPB_RsvdSecCnt); /* FAT start sector (lba) */
-	fs->csize = fs->win[BPB_SecPerClus];				/* Number of sectors per cluster */
-	fs->n_rootdir = LD_WORD(fs->win+BPB_RootEntCnt);	/* Number of root directory entries */
-	tsect = LD_WORD(fs->win+BPB_TotSec16);				/* Number of sectors on the volume */
-	if (!tsect) tsect = LD_DWORD(fs->win+BPB_TotSec32);
-	fs->max_clust = mclst = (tsect						/* Last cluster# + 1 (Number of clusters + 2) */
-		- LD_WORD(fs->win+BPB_RsvdSecCnt) - fsize - fs->n_rootdir / (SS(fs)/32)
-		) / fs->csize + 2;
-
-	fmt = FS_FAT12;										/* Determine the FAT sub type */
-	if (mclst >= 0xFF7) fmt = FS_FAT16;					/* Number of clusters >= 0xFF5 */
-	if (mclst >= 0xFFF7) fmt = FS_FAT32;				/* Number of clusters >= 0xFFF5 */
-
-	if (fmt == FS_FAT32)
-		fs->dirbase = LD_DWORD(fs->win+BPB_RootClus);	/* Root directory start cluster */
-	else
-		fs->dirbase = fs->fatbase + fsize;				/* Root directory start sector (lba) */
-	fs->database = fs->fatbase + fsize + fs->n_rootdir / (SS(fs)/32);	/* Data start sector (lba) */
+#if _FS_EXFAT
+	if (fmt == 4) {										/* exFAT volume */
+		if (fs->win[BPB_BytsPerSecEx] > 12 || (1U << fs->win[BPB_BytsPerSecEx]) != SS(fs)
+			|| fs->win[BPB_SecPerClusEx] > 15 || fs->win[BPB_NumFATsEx] != 1
+			|| LD_DWORD(fs->win+BPB_TotSecEx+4))		/* Clusters over 16 MB, TexFAT or 2 TB volume */
+			return FR_NO_FILESYSTEM;
+		fs->sects_fat = LD_DWORD(fs->win+BPB_FatSzEx);
+		fs->n_fats = 1;
+		fs->fatbase = bsect + LD_DWORD(fs->win+BPB_FatOfsEx);
+		fs->csize = 1 << fs->win[BPB_SecPerClusEx];
+		fs->n_rootdir = 0;
+		fs->max_clust = mclst = LD_DWORD(fs->win+BPB_NumClusEx) + 2;
+		fs->dirbase = LD_DWORD(fs->win+BPB_RootClusEx);	/* Root directory start cluster */
+		fs->database = bsect + LD_DWORD(fs->win+BPB_DataOfsEx);
+		fmt = FS_EXFAT;
+	} else
+#endif
+	{
+		if (fmt || LD_WORD(fs->win+BPB_BytsPerSec) != SS(fs))	/* No valid FAT partition is found */
+			return FR_NO_FILESYSTEM;
+
+		/* Initialize the file system object */
+		fsize = LD_WORD(fs->win+BPB_FATSz16);				/* Number of sectors per FAT */
+		if (!fsize) fsize = LD_DWORD(fs->win+BPB_FATSz32);
+		fs->sects_fat = fsize;
+		fs->n_fats = fs->win[BPB_NumFATs];					/* Number of FAT copies */
+		fsize *= fs->n_fats;								/* (Number of sectors in FAT area) */
+		fs->fatbase = bsect + LD_WORD(fs->win+BPB_RsvdSecCnt); /* FAT start sector (lba) */
+		fs->csize = fs->win[BPB_SecPerClus];				/* Number of sectors per cluster */
+		fs->n_rootdir = LD_WORD(fs->win+BPB_RootEntCnt);	/* Number of root directory entries */
+		tsect = LD_WORD(fs->win+BPB_TotSec16);				/* Number of sectors on the volume */
+		if (!tsect) tsect = LD_DWORD(fs->win+BPB_TotSec32);
+		fs->max_clust = mclst = (tsect						/* Last cluster# + 1 (Number of clusters + 2) */
+			- LD_WORD(fs->win+BPB_RsvdSecCnt) - fsize - fs->n_rootdir / (SS(fs)/32)
+			) / fs->csize + 2;
+
+		fmt = FS_FAT12;										/* Determine the FAT sub type */
+		if (mclst >= 0xFF7) fmt = FS_FAT16;					/* Number of clusters >= 0xFF5 */
+		if (mclst >= 0xFFF7) fmt = FS_FAT32;				/* Number of clusters >= 0xFFF5 */
+
+		if (fmt == FS_FAT32)
+			fs->dirbase = LD_DWORD(fs->win+BPB_RootClus);	/* Root directory start cluster */
+		else
+			fs->dirbase = fs->fatbase + fsize;				/* Root directory start sector (lba) */
+		fs->database = fs->fatbase + fsize + fs->n_rootdir / (SS(fs)/32);	/* Data start sector (lba) */
+	}
 
 #if !_FS_READONLY
 	/* Initialize allocation information */
@@ -1578,8 +2660,29 @@ FRESULT chk_mounted (	/* FR_OK(0): successful, !=0: any error occurred */
 #endif
 	fs->fs_type = fmt;		/* FAT sub-type */
 	fs->winsect = 0;		/* Invalidate sector cache */
+	fs->r_join = 0;
+	fs->d_scan = 0;
+#if !_FS_READONLY && _FS_FREEMAP
+	fmap_init(fs);
+#endif
+#if _FS_CACHE_SECTS
+	cache_init(fs);
+#endif
+#if !_FS_READONLY && _FS_WBUF
+	fs->wown = 0; fs->wcnt = 0;	/* Write-back buffer is empty (a run left for a changed medium is dropped) */
+#endif
+#if _FS_DIRINDEX
+	fs->hdir = 1;			/* No directory indexed */
+	fs->h_find = 0;
+#endif
 #if _FS_RPATH
 	fs->cdir = 0;			/* Current directory (root dir) */
+#endif
+#if _FS_EXFAT
+	if (fmt == FS_EXFAT && find_bitmap(fs) != FR_OK) {	/* Locate the allocation bitmap */
+		fs->fs_type = 0;
+		return FR_NO_FILESYSTEM;
+	}
 #endif
 	fs->id = ++Fsid;		/* File system mount ID */
 
@@ -1631,6 +2734,7 @@ FRESULT f_mount (
 )
 {
 	FATFS *rfs;
+	FRESULT res = FR_OK;
 
 
 	if (vol >= _DRIVES)				/* Check if the drive number is valid */
@@ -1638,6 +2742,11 @@ FRESULT f_mount (
 	rfs = FatFs[vol];				/* Get current fs object */
 
 	if (rfs) {
+#if !_FS_READONLY && _FS_WBUF		/* Write out the buffered run of the current volume */
+		if (rfs->fs_type && !(disk_status(rfs->drive) & STA_NOINIT) && wb_send(rfs) != FR_OK)
+			res = FR_DISK_ERR;		/* The volume is released anyway, never to write the run to another medium */
+		rfs->wcnt = 0;
+#endif
 #if _FS_REENTRANT					/* Discard sync object of the current volume */
 		if (!ff_del_syncobj(rfs->sobj)) return FR_INT_ERR;
 #endif
@@ -1652,8 +2761,105 @@ FRESULT f_mount (
 	}
 	FatFs[vol] = fs;				/* Register new fs object */
 
+	return res;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Open or Create a File on an exFAT volume                              */
+/*-----------------------------------------------------------------------*/
+#if _FS_EXFAT
+static
+FRESULT xopen (
+	FIL *fp,		/* Pointer to the blank file object */
+	DIR *dj,		/* Directory object after follow_path */
+	FRESULT res,	/* Result of follow_path */
+	BYTE mode		/* Access mode and file open mode flags */
+)
+{
+	BYTE *dir;
+	DWORD cl;
+#if !_FS_READONLY
+	BYTE buf[64];
+
+
+	if (mode & (FA_CREATE_ALWAYS | FA_OPEN_ALWAYS | FA_CREATE_NEW)) {
+		if (res != FR_OK) {			/* No file, create new */
+			if (res == FR_NO_FILE)
+				res = xdir_register(dj);
+			if (res != FR_OK) return res;
+			mode |= FA__WRITTEN;
+		}
+		else {						/* Any object is already existing */
+			if (mode & FA_CREATE_NEW) return FR_EXIST;
+			dir = dj->dir;
+			if (!dir || (dir[DIR_Attr] & (AM_RDO | AM_DIR)))	/* Cannot overwrite it (R/O or DIR) */
+				return FR_DENIED;
+			if (mode & FA_CREATE_ALWAYS) {	/* Resize it to zero on over write mode */
+				cl = LD_CLUST(dir);
+				if (cl) {
+					res = (dj->xstat & 2) ? remove_cont(dj->fs, cl, dj->xclst) : remove_chain(dj->fs, cl);
+					if (res != FR_OK) return res;
+					dj->fs->last_clust = cl - 1;	/* Reuse the cluster hole */
+				}
+				res = xset_load(dj, buf);
+				if (res != FR_OK) return res;
+				buf[XDIR_Attr] = 0;					/* Reset attribute */
+				ST_DWORD(buf+XDIR_CrtTime, get_fattime());	/* Created time */
+				buf[32+XDIR_GenFlags] = 1;			/* cluster = 0, size = 0 */
+				mem_set(buf+32+XDIR_ValidFileSize, 0, 24);
+				res = xset_store(dj, buf);
+				if (res != FR_OK) return res;
+				mem_set(dir+DIR_Attr, 0, 21);
+				dj->xstat = 1;
+				dj->xclst = 0;
+				mode |= FA__WRITTEN;
+			}
+		}
+	}
+	/* Open an existing file */
+	else {
+#endif /* !_FS_READONLY */
+		if (res != FR_OK) return res;	/* Follow failed */
+		dir = dj->dir;
+		if (!dir || (dir[DIR_Attr] & AM_DIR))	/* It is a directory */
+			return FR_NO_FILE;
+#if !_FS_READONLY
+		if ((mode & FA_WRITE) && (dir[DIR_Attr] & AM_RDO)) /* R/O violation */
+			return FR_DENIED;
+	}
+	cl = LD_CLUST(dj->dir);
+	if (mode & FA_WRITE) {
+		if (dj->xstat & 0x80) return FR_DENIED;	/* Over 4 GB or not all valid */
+		if ((dj->xstat & 2) && cl) {			/* Put the NoFatChain clusters into the FAT to change them */
+			res = fill_fat(dj->fs, cl, dj->xclst);
+			if (res != FR_OK) return res;
+		}
+	}
+	fp->dir_sclust = dj->sclust;		/* Location of the set */
+	fp->dir_ncont = dj->ncont;
+	fp->dir_xidx = dj->xidx;
+	fp->flag = mode & (FA_READ | FA_WRITE | FA__WRITTEN);
+#else
+	cl = LD_CLUST(dir);
+	fp->flag = mode & FA_READ;
+#endif
+	if (!cl || (dj->xstat & 2)) fp->flag |= FA__CONT;	/* No FAT lookup while the clusters are contiguous */
+	fp->org_clust = cl;					/* File start cluster */
+	fp->fsize = LD_DWORD(dj->dir+DIR_FileSize);	/* File size */
+	fp->fptr = 0; fp->csect = 0xFFFF;	/* File pointer */
+	fp->dsect = 0;
+#if !_FS_READONLY && _FS_WBUF
+	if (dj->fs->wown == fp && wb_send(dj->fs) != FR_OK)	/* Write out the data of a file object reused without f_close */
+		return FR_DISK_ERR;
+#endif
+	fp->fs = dj->fs; fp->id = dj->fs->id;	/* Owner file system object of the file */
+
 	return FR_OK;
 }
+#endif
 
 
 
@@ -1685,6 +2891,12 @@ FRESULT f_open (
 	if (res != FR_OK) LEAVE_FF(dj.fs, res);
 	INITBUF(dj, sfn, lfn);
 	res = follow_path(&dj, path);	/* Follow the file path */
+#if _FS_EXFAT
+	if (dj.fs->fs_type == FS_EXFAT) {	/* exFAT volume */
+		res = xopen(fp, &dj, res, mode);
+		LEAVE_FF(dj.fs, res);
+	}
+#endif
 
 #if !_FS_READONLY
 	/* Create or Open a file */
@@ -1741,13 +2953,18 @@ FRESULT f_open (
 	}
 	fp->dir_sect = dj.fs->winsect;		/* Pointer to the directory entry */
 	fp->dir_ptr = dj.dir;
+	mode &= FA_READ | FA_WRITE | FA__WRITTEN;	/* Clear the open mode flags */
 #endif
 	fp->flag = mode;					/* File access mode */
 	fp->org_clust =						/* File start cluster */
 		((DWORD)LD_WORD(dir+DIR_FstClusHI) << 16) | LD_WORD(dir+DIR_FstClusLO);
 	fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
-	fp->fptr = 0; fp->csect = 255;		/* File pointer */
+	fp->fptr = 0; fp->csect = 0xFFFF;	/* File pointer */
 	fp->dsect = 0;
+#if !_FS_READONLY && _FS_WBUF
+	if (dj.fs->wown == fp && wb_send(dj.fs) != FR_OK)	/* Write out the data of a file object reused without f_close */
+		LEAVE_FF(dj.fs, FR_DISK_ERR);
+#endif
 	fp->fs = dj.fs; fp->id = dj.fs->id;	/* Owner file system object of the file */
 
 	LEAVE_FF(dj.fs, FR_OK);
@@ -1756,6 +2973,82 @@ FRESULT f_open (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Merge contiguous clusters into one direct transfer                    */
+/*-----------------------------------------------------------------------*/
+
+static
+UINT get_run (		/* Number of sectors to transfer from the current sector */
+	FIL *fp,		/* Pointer to the file object */
+	UINT cc,		/* Number of sectors wanted */
+	BYTE stretch	/* 1: Stretch the cluster chain when it ends */
+)					/* The file object is moved past the transferred sectors */
+{
+	DWORD clst, nxt;
+	UINT n;
+
+
+	clst = fp->curr_clust;
+	n = fp->fs->csize - fp->csect;			/* Sectors left in the current cluster */
+	while (n < cc) {						/* Follow the chain while the next cluster is adjacent */
+#if _FS_EXFAT
+		if (!stretch && (fp->flag & FA__CONT))	/* Contiguous clusters: no FAT lookup */
+			nxt = clst + 1;
+		else
+#endif
+#if !_FS_READONLY
+		nxt = stretch ? create_chain(fp->fs, clst) : get_fat(fp->fs, clst);
+#else
+		nxt = get_fat(fp->fs, clst);
+#endif
+		if (nxt != clst + 1) break;			/* Fragmented, end of chain or error (left to the caller) */
+		clst = nxt;
+		n += fp->fs->csize;
+		if (!stretch) fp->fs->r_join++;
+	}
+	if (cc > n) cc = n;
+	fp->curr_clust = clst;					/* Last cluster of the run */
+	fp->csect = (WORD)(fp->fs->csize - (n - cc));	/* Next sector address in it */
+
+	return cc;
+}
+
+
+
+
+#if !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Write Back the Data Buffers of a File                                 */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT flush_data (	/* FR_OK:succeeded, FR_DISK_ERR:failed */
+	FIL *fp				/* Pointer to the file object */
+)
+{
+#if _FS_TINY
+	if (move_window(fp->fs, 0)) return FR_DISK_ERR;	/* Write back the window holding the file data */
+#else
+	if (fp->flag & FA__DIRTY) {			/* Write back the sector buffer */
+#if _FS_WBUF
+		if (wb_write(fp, fp->buf, fp->dsect, 1) != FR_OK)
+#else
+		if (disk_write(fp->fs->drive, fp->buf, fp->dsect, 1) != RES_OK)
+#endif
+			return FR_DISK_ERR;
+		fp->flag &= ~FA__DIRTY;
+	}
+#if _FS_WBUF
+	if (wb_flush(fp) != FR_OK) return FR_DISK_ERR;
+#endif
+#endif
+	return FR_OK;
+}
+#endif /* !_FS_READONLY */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Read File                                                             */
 /*-----------------------------------------------------------------------*/
@@ -1781,6 +3074,10 @@ FRESULT f_read (
 		LEAVE_FF(fp->fs, FR_INT_ERR);
 	if (!(fp->flag & FA_READ)) 						/* Check access mode */
 		LEAVE_FF(fp->fs, FR_DENIED);
+#if !_FS_READONLY && _FS_WBUF
+	if (wb_flush(fp) != FR_OK)						/* The data read may be in the write-back buffer */
+		ABORT(fp->fs, FR_DISK_ERR);
+#endif
 	remain = fp->fsize - fp->fptr;
 	if (btr > remain) btr = (UINT)remain;			/* Truncate btr by remaining bytes */
 
@@ -1788,6 +3085,11 @@ FRESULT f_read (
 		rbuff += rcnt, fp->fptr += rcnt, *br += rcnt, btr -= rcnt) {
 		if ((fp->fptr % SS(fp->fs)) == 0) {			/* On the sector boundary? */
 			if (fp->csect >= fp->fs->csize) {		/* On the cluster boundary? */
+#if _FS_EXFAT
+				if (fp->fptr && (fp->flag & FA__CONT))	/* Contiguous clusters: no FAT lookup */
+					clst = fp->curr_clust + 1;
+				else
+#endif
 				clst = (fp->fptr == 0) ?			/* On the top of the file? */
 					fp->org_clust : get_fat(fp->fs, fp->curr_clust);
 				if (clst <= 1) ABORT(fp->fs, FR_INT_ERR);
@@ -1800,9 +3102,8 @@ FRESULT f_read (
 			sect += fp->csect;
 			cc = btr / SS(fp->fs);					/* When remaining bytes >= sector size, */
 			if (cc) {								/* Read maximum contiguous sectors directly */
-				if (fp->csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
-					cc = fp->fs->csize - fp->csect;
-				if (disk_read(fp->fs->drive, rbuff, sect, (BYTE)cc) != RES_OK)
+				cc = get_run(fp, cc, 0);			/* Clip at the end of the contiguous clusters */
+				if (disk_read(fp->fs->drive, rbuff, sect, cc) != RES_OK)
 					ABORT(fp->fs, FR_DISK_ERR);
 #if !_FS_READONLY && _FS_MINIMIZE <= 2
 #if _FS_TINY
@@ -1813,7 +3114,6 @@ FRESULT f_read (
 					mem_cpy(rbuff + ((fp->dsect - sect) * SS(fp->fs)), fp->buf, SS(fp->fs));
 #endif
 #endif
-				fp->csect += (BYTE)cc;				/* Next sector address in the cluster */
 				rcnt = SS(fp->fs) * cc;				/* Number of bytes transferred */
 				continue;
 			}
@@ -1892,6 +3192,10 @@ FRESULT f_write (
 				if (clst == 0) break;				/* Could not allocate a new cluster (disk full) */
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
+#if _FS_EXFAT
+				if (fp->fptr && clst != fp->curr_clust + 1)	/* The clusters are no longer contiguous */
+					fp->flag &= ~FA__CONT;
+#endif
 				fp->curr_clust = clst;				/* Update current cluster */
 				fp->csect = 0;						/* Reset sector address in the cluster */
 			}
@@ -1900,7 +3204,11 @@ FRESULT f_write (
 				ABORT(fp->fs, FR_DISK_ERR);
 #else
 			if (fp->flag & FA__DIRTY) {		/* Write back data buffer prior to following direct transfer */
+#if _FS_WBUF
+				if (wb_write(fp, fp->buf, fp->dsect, 1) != FR_OK)
+#else
 				if (disk_write(fp->fs->drive, fp->buf, fp->dsect, 1) != RES_OK)
+#endif
 					ABORT(fp->fs, FR_DISK_ERR);
 				fp->flag &= ~FA__DIRTY;
 			}
@@ -1910,9 +3218,12 @@ FRESULT f_write (
 			sect += fp->csect;
 			cc = btw / SS(fp->fs);					/* When remaining bytes >= sector size, */
 			if (cc) {								/* Write maximum contiguous sectors directly */
-				if (fp->csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
-					cc = fp->fs->csize - fp->csect;
-				if (disk_write(fp->fs->drive, wbuff, sect, (BYTE)cc) != RES_OK)
+				cc = get_run(fp, cc, 1);			/* Clip at the end of the contiguous clusters */
+#if _FS_WBUF
+				if (wb_write(fp, wbuff, sect, cc) != FR_OK)
+#else
+				if (disk_write(fp->fs->drive, wbuff, sect, cc) != RES_OK)
+#endif
 					ABORT(fp->fs, FR_DISK_ERR);
 #if _FS_TINY
 				if (fp->fs->winsect - sect < cc) {	/* Refill sector cache if it gets dirty by the direct write */
@@ -1925,7 +3236,6 @@ FRESULT f_write (
 					fp->flag &= ~FA__DIRTY;
 				}
 #endif
-				fp->csect += (BYTE)cc;				/* Next sector address in the cluster */
 				wcnt = SS(fp->fs) * cc;				/* Number of bytes transferred */
 				continue;
 			}
@@ -1935,10 +3245,13 @@ FRESULT f_write (
 				fp->fs->winsect = sect;
 			}
 #else
-			if (fp->dsect != sect) {				/* Fill sector buffer with file data */
-				if (fp->fptr < fp->fsize &&
-					disk_read(fp->fs->drive, fp->buf, sect, 1) != RES_OK)
-						ABORT(fp->fs, FR_DISK_ERR);
+			if (fp->dsect != sect && fp->fptr < fp->fsize) {	/* Fill sector buffer with file data */
+#if _FS_WBUF
+				if (wb_flush(fp) != FR_OK)
+					ABORT(fp->fs, FR_DISK_ERR);
+#endif
+				if (disk_read(fp->fs->drive, fp->buf, sect, 1) != RES_OK)
+					ABORT(fp->fs, FR_DISK_ERR);
 			}
 #endif
 			fp->dsect = sect;
@@ -1982,11 +3295,37 @@ FRESULT f_sync (
 	res = validate(fp->fs, fp->id);		/* Check validity of the object */
 	if (res == FR_OK) {
 		if (fp->flag & FA__WRITTEN) {	/* Has the file been written? */
-#if !_FS_TINY	/* Write-back dirty buffer */
-			if (fp->flag & FA__DIRTY) {
-				if (disk_write(fp->fs->drive, fp->buf, fp->dsect, 1) != RES_OK)
-					LEAVE_FF(fp->fs, FR_DISK_ERR);
-				fp->flag &= ~FA__DIRTY;
+#if !_FS_TINY	/* Write-back dirty buffers */
+			if (flush_data(fp) != FR_OK)
+				LEAVE_FF(fp->fs, FR_DISK_ERR);
+#endif
+#if _FS_EXFAT
+			if (fp->fs->fs_type == FS_EXFAT) {	/* Update the entry set */
+				DIR dj;
+				BYTE buf[64];
+
+				dj.fs = fp->fs; dj.sclust = fp->dir_sclust;
+				dj.ncont = fp->dir_ncont; dj.xidx = fp->dir_xidx;
+				res = xset_load(&dj, buf);
+				if (res == FR_OK) {
+					buf[XDIR_Attr] |= AM_ARC;				/* Set archive bit */
+					tim = get_fattime();					/* Updated time */
+					ST_DWORD(buf+XDIR_ModTime, tim);
+					ST_DWORD(buf+XDIR_AccTime, tim);
+					buf[21] = 0;
+					buf[32+XDIR_GenFlags] = ((fp->flag & FA__CONT) && fp->org_clust) ? 3 : 1;	/* NoFatChain if contiguous */
+					ST_DWORD(buf+32+XDIR_ValidFileSize, fp->fsize);	/* Update file size */
+					ST_DWORD(buf+32+XDIR_ValidFileSize+4, 0);
+					ST_DWORD(buf+32+XDIR_FileSize, fp->fsize);
+					ST_DWORD(buf+32+XDIR_FileSize+4, 0);
+					ST_DWORD(buf+32+XDIR_FstClus, fp->org_clust);	/* Update start cluster */
+					res = xset_store(&dj, buf);
+				}
+				if (res == FR_OK) {
+					fp->flag &= ~FA__WRITTEN;
+					res = sync(fp->fs);
+				}
+				LEAVE_FF(fp->fs, res);
 			}
 #endif
 			/* Update the directory entry */
@@ -2009,6 +3348,30 @@ FRESULT f_sync (
 	LEAVE_FF(fp->fs, res);
 }
 
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Flush the Buffered Data of a File                                     */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_flush (
+	FIL *fp		/* Pointer to the file object */
+)					/* The directory entry is left to f_sync */
+{
+	FRESULT res;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res == FR_OK) {
+		res = flush_data(fp);
+		if (res == FR_OK && disk_ioctl(fp->fs->drive, CTRL_SYNC, (void*)0) != RES_OK)
+			res = FR_DISK_ERR;
+	}
+
+	LEAVE_FF(fp->fs, res);
+}
+
 #endif /* !_FS_READONLY */
 
 
@@ -2119,7 +3482,7 @@ FRESULT f_lseek (
 		) ofs = fp->fsize;
 
 	ifptr = fp->fptr;
-	fp->fptr = nsect = 0; fp->csect = 255;
+	fp->fptr = nsect = 0; fp->csect = 0xFFFF;
 	if (ofs > 0) {
 		bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
 		if (ifptr > 0 &&
@@ -2147,7 +3510,16 @@ FRESULT f_lseek (
 					if (clst == 0) {				/* When disk gets full, clip file size */
 						ofs = bcs; break;
 					}
+#if _FS_EXFAT
+					if (clst != fp->curr_clust + 1)	/* The clusters are no longer contiguous */
+						fp->flag &= ~FA__CONT;
+#endif
 				} else
+#endif
+#if _FS_EXFAT
+				if (fp->flag & FA__CONT)			/* Contiguous clusters: no FAT lookup */
+					clst++;
+				else
 #endif
 					clst = get_fat(fp->fs, clst);	/* Follow cluster chain if not in write mode */
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
@@ -2157,7 +3529,7 @@ FRESULT f_lseek (
 				ofs -= bcs;
 			}
 			fp->fptr += ofs;
-			fp->csect = (BYTE)(ofs / SS(fp->fs));	/* Sector offset in the cluster */
+			fp->csect = (WORD)(ofs / SS(fp->fs));	/* Sector offset in the cluster */
 			if (ofs % SS(fp->fs)) {
 				nsect = clust2sect(fp->fs, clst);	/* Current sector */
 				if (!nsect) ABORT(fp->fs, FR_INT_ERR);
@@ -2169,6 +3541,10 @@ FRESULT f_lseek (
 	if (fp->fptr % SS(fp->fs) && nsect != fp->dsect) {
 #if !_FS_TINY
 #if !_FS_READONLY
+#if _FS_WBUF
+		if (wb_flush(fp) != FR_OK)			/* The sector read may be in the write-back buffer */
+			ABORT(fp->fs, FR_DISK_ERR);
+#endif
 		if (fp->flag & FA__DIRTY) {			/* Write-back dirty buffer if needed */
 			if (disk_write(fp->fs->drive, fp->buf, fp->dsect, 1) != RES_OK)
 				ABORT(fp->fs, FR_DISK_ERR);
@@ -2216,6 +3592,9 @@ FRESULT f_opendir (
 			if (dir) {							/* It is not the root dir */
 				if (dir[DIR_Attr] & AM_DIR) {	/* The object is a directory */
 					dj->sclust = ((DWORD)LD_WORD(dir+DIR_FstClusHI) << 16) | LD_WORD(dir+DIR_FstClusLO);
+#if _FS_EXFAT
+					dj->ncont = XD_NCONT(dj);
+#endif
 				} else {						/* The object is not a directory */
 					res = FR_NO_PATH;
 				}
@@ -2321,6 +3700,9 @@ FRESULT f_getfree (
 	DWORD n, clst, sect, stat;
 	UINT i;
 	BYTE fat, *p;
+#if _FS_FREEMAP
+	DWORD rsize;
+#endif
 
 
 	/* Get drive number */
@@ -2333,6 +3715,28 @@ FRESULT f_getfree (
 		LEAVE_FF(*fatfs, FR_OK);
 	}
 
+#if _FS_FREEMAP
+	/* Sum the free space map if all the regions are counted, else count
+	   them with the scan (the map is not used until the scan ends) */
+	rsize = (*fatfs)->frsize;
+	if (rsize) {
+		n = 0;
+		for (i = 0; i < _FS_FREEMAP && i * rsize < (*fatfs)->max_clust - 2; i++) {
+			if ((*fatfs)->fmap[i] == 0xFFFF) break;
+			n += (*fatfs)->fmap[i];
+		}
+		if (i == _FS_FREEMAP || i * rsize >= (*fatfs)->max_clust - 2) {
+			(*fatfs)->m_skip += (*fatfs)->max_clust - 2;
+			(*fatfs)->free_clust = n;
+			if ((*fatfs)->fs_type == FS_FAT32) (*fatfs)->fsi_flag = 1;
+			*nclst = n;
+			LEAVE_FF(*fatfs, FR_OK);
+		}
+		(*fatfs)->frsize = 0;
+		mem_set((*fatfs)->fmap, 0, sizeof((*fatfs)->fmap));
+	}
+#endif
+
 	/* Get number of free clusters */
 	fat = (*fatfs)->fs_type;
 	n = 0;
@@ -2342,9 +3746,28 @@ FRESULT f_getfree (
 			stat = get_fat(*fatfs, clst);
 			if (stat == 0xFFFFFFFF) LEAVE_FF(*fatfs, FR_DISK_ERR);
 			if (stat == 1) LEAVE_FF(*fatfs, FR_INT_ERR);
-			if (stat == 0) n++;
+			if (stat == 0) {
+				n++;
+#if _FS_FREEMAP
+				if (rsize) (*fatfs)->fmap[(clst - 2) / rsize]++;
+#endif
+			}
 		} while (++clst < (*fatfs)->max_clust);
-	} else {
+	}
+#if _FS_EXFAT
+	else if (fat == FS_EXFAT) {		/* Count the clear bits in the allocation bitmap */
+		sect = (*fatfs)->bitbase;
+		for (clst = 0; clst < (*fatfs)->max_clust - 2; clst++) {
+			if (!(clst % (SS(*fatfs) * 8))) {
+				res = move_window(*fatfs, sect++);
+				if (res != FR_OK)
+					LEAVE_FF(*fatfs, res);
+			}
+			if (!((*fatfs)->win[clst / 8 % SS(*fatfs)] & (1 << (clst % 8)))) n++;
+		}
+	}
+#endif
+	else {
 		clst = (*fatfs)->max_clust;
 		sect = (*fatfs)->fatbase;
 		i = 0; p = 0;
@@ -2357,14 +3780,24 @@ FRESULT f_getfree (
 				i = SS(*fatfs);
 			}
 			if (fat == FS_FAT16) {
-				if (LD_WORD(p) == 0) n++;
+				stat = LD_WORD(p);
 				p += 2; i -= 2;
 			} else {
-				if ((LD_DWORD(p) & 0x0FFFFFFF) == 0) n++;
+				stat = LD_DWORD(p) & 0x0FFFFFFF;
 				p += 4; i -= 4;
 			}
+			if (stat == 0) {
+				n++;
+#if _FS_FREEMAP
+				if (rsize && (*fatfs)->max_clust - clst >= 2)	/* Cluster number of the entry */
+					(*fatfs)->fmap[((*fatfs)->max_clust - clst - 2) / rsize]++;
+#endif
+			}
 		} while (--clst);
 	}
+#if _FS_FREEMAP
+	(*fatfs)->frsize = rsize;
+#endif
 	(*fatfs)->free_clust = n;
 	if (fat == FS_FAT32) (*fatfs)->fsi_flag = 1;
 	*nclst = n;
@@ -2393,6 +3826,10 @@ FRESULT f_truncate (
 		LEAVE_FF(fp->fs, FR_INT_ERR);
 	if (!(fp->flag & FA_WRITE))			/* Check access mode */
 		LEAVE_FF(fp->fs, FR_DENIED);
+#if _FS_WBUF
+	if (wb_flush(fp) != FR_OK)			/* Write the buffered sectors before their clusters are freed */
+		ABORT(fp->fs, FR_DISK_ERR);
+#endif
 
 	if (fp->fsize > fp->fptr) {
 		fp->fsize = fp->fptr;	/* Set file size to current R/W point */
@@ -2400,6 +3837,9 @@ FRESULT f_truncate (
 		if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
 			res = remove_chain(fp->fs, fp->org_clust);
 			fp->org_clust = 0;
+#if _FS_EXFAT
+			if (fp->fs->fs_type == FS_EXFAT) fp->flag |= FA__CONT;
+#endif
 		} else {				/* When truncate a part of the file, remove remaining clusters */
 			ncl = get_fat(fp->fs, fp->curr_clust);
 			res = FR_OK;
@@ -2454,7 +3894,10 @@ FRESULT f_unlink (
 		if (dclst < 2) LEAVE_FF(dj.fs, FR_INT_ERR);
 		mem_cpy(&sdj, &dj, sizeof(DIR));	/* Check if the sub-dir is empty or not */
 		sdj.sclust = dclst;
-		res = dir_seek(&sdj, 2);
+#if _FS_EXFAT
+		sdj.ncont = XD_NCONT(&dj);
+#endif
+		res = dir_seek(&sdj, (dj.fs->fs_type == FS_EXFAT) ? 0 : 2);	/* Skip the dot entries (none on exFAT) */
 		if (res != FR_OK) LEAVE_FF(dj.fs, res);
 		res = dir_read(&sdj);
 		if (res == FR_OK) res = FR_DENIED;	/* Not empty sub-dir */
@@ -2463,8 +3906,14 @@ FRESULT f_unlink (
 
 	res = dir_remove(&dj);					/* Remove directory entry */
 	if (res == FR_OK) {
-		if (dclst)
+		if (dclst) {
+#if _FS_EXFAT
+			if (dj.fs->fs_type == FS_EXFAT && (dj.xstat & 2))	/* Free the contiguous clusters */
+				res = remove_cont(dj.fs, dclst, dj.xclst);
+			else
+#endif
 			res = remove_chain(dj.fs, dclst);	/* Remove the cluster chain */
+		}
 		if (res == FR_OK) res = sync(dj.fs);
 	}
 
@@ -2485,7 +3934,8 @@ FRESULT f_mkdir (
 	FRESULT res;
 	DIR dj;
 	NAMEBUF(sfn, lfn);
-	BYTE *dir, n;
+	BYTE *dir;
+	WORD n;
 	DWORD dsect, dclst, pclst, tim;
 
 
@@ -2526,6 +3976,9 @@ FRESULT f_mkdir (
 		pclst = 0;
 	ST_WORD(dir+32+DIR_FstClusLO, pclst);
 	ST_WORD(dir+32+DIR_FstClusHI, pclst >> 16);
+#if _FS_EXFAT
+	if (dj.fs->fs_type == FS_EXFAT) mem_set(dir, 0, 64);	/* No dot entries on exFAT */
+#endif
 	for (n = 0; n < dj.fs->csize; n++) {	/* Write dot entries and clear left sectors */
 		dj.fs->winsect = dsect++;
 		dj.fs->wflag = 1;
@@ -2538,6 +3991,23 @@ FRESULT f_mkdir (
 	if (res != FR_OK) {
 		remove_chain(dj.fs, dclst);
 	} else {
+#if _FS_EXFAT
+		if (dj.fs->fs_type == FS_EXFAT) {	/* Set the directory in the entry set */
+			BYTE buf[64];
+
+			res = xset_load(&dj, buf);
+			if (res == FR_OK) {
+				buf[XDIR_Attr] = AM_DIR;
+				buf[32+XDIR_GenFlags] = 3;			/* One cluster (NoFatChain) */
+				ST_DWORD(buf+32+XDIR_ValidFileSize, (DWORD)dj.fs->csize * SS(dj.fs));
+				ST_DWORD(buf+32+XDIR_FileSize, (DWORD)dj.fs->csize * SS(dj.fs));
+				ST_DWORD(buf+32+XDIR_FstClus, dclst);
+				res = xset_store(&dj, buf);
+			}
+			if (res == FR_OK) res = sync(dj.fs);
+			LEAVE_FF(dj.fs, res);
+		}
+#endif
 		dir = dj.dir;
 		dir[DIR_Attr] = AM_DIR;					/* Attribute */
 		ST_DWORD(dir+DIR_WrtTime, tim);			/* Create time */
@@ -2582,8 +4052,13 @@ FRESULT f_chmod (
 			} else {						/* File or sub directory */
 				mask &= AM_RDO|AM_HID|AM_SYS|AM_ARC;	/* Valid attribute mask */
 				dir[DIR_Attr] = (value & mask) | (dir[DIR_Attr] & (BYTE)~mask);	/* Apply attribute change */
+#if _FS_EXFAT
+				if (dj.fs->fs_type == FS_EXFAT)
+					res = xdir_sync(&dj);		/* Write the change into the entry set */
+				else
+#endif
 				dj.fs->wflag = 1;
-				res = sync(dj.fs);
+				if (res == FR_OK) res = sync(dj.fs);
 			}
 		}
 	}
@@ -2622,8 +4097,13 @@ FRESULT f_utime (
 			} else {				/* File or sub-directory */
 				ST_WORD(dir+DIR_WrtTime, fno->ftime);
 				ST_WORD(dir+DIR_WrtDate, fno->fdate);
+#if _FS_EXFAT
+				if (dj.fs->fs_type == FS_EXFAT)
+					res = xdir_sync(&dj);	/* Write the change into the entry set */
+				else
+#endif
 				dj.fs->wflag = 1;
-				res = sync(dj.fs);
+				if (res == FR_OK) res = sync(dj.fs);
 			}
 		}
 	}
@@ -2662,6 +4142,29 @@ FRESULT f_rename (
 
 	if (!dj_old.dir) LEAVE_FF(dj_old.fs, FR_NO_FILE);	/* Is root dir? */
 	mem_cpy(buf, dj_old.dir+DIR_Attr, 21);		/* Save the object information */
+#if _FS_EXFAT
+	if (dj_old.fs->fs_type == FS_EXFAT) {		/* Move the file and stream entries into a new set */
+		BYTE xbuf[128];
+
+		res = xset_load(&dj_old, xbuf);
+		if (res != FR_OK) LEAVE_FF(dj_old.fs, res);
+		mem_cpy(&dj_new, &dj_old, sizeof(DIR));
+		res = follow_path(&dj_new, path_new);	/* Check new object */
+		if (res == FR_OK) res = FR_EXIST;		/* The new object name is already existing */
+		if (res == FR_NO_FILE) res = xdir_register(&dj_new);
+		if (res == FR_OK) res = xset_load(&dj_new, xbuf + 64);
+		if (res == FR_OK) {
+			mem_cpy(xbuf+64+4, xbuf+4, 28);		/* Attribute and time */
+			xbuf[64+XDIR_Attr] |= AM_ARC;
+			xbuf[64+32+XDIR_GenFlags] = xbuf[32+XDIR_GenFlags];
+			mem_cpy(xbuf+64+32+8, xbuf+32+8, 24);	/* Sizes and start cluster */
+			res = xset_store(&dj_new, xbuf + 64);
+		}
+		if (res == FR_OK) res = xdir_remove(&dj_old);	/* Remove old set */
+		if (res == FR_OK) res = sync(dj_old.fs);
+		LEAVE_FF(dj_old.fs, res);
+	}
+#endif
 
 	mem_cpy(&dj_new, &dj_old, sizeof(DIR));
 	res = follow_path(&dj_new, path_new);		/* Check new object */
@@ -2739,6 +4242,11 @@ FRESULT f_forward (
 		fp->fptr += rcnt, *bf += rcnt, btr -= rcnt) {
 		if ((fp->fptr % SS(fp->fs)) == 0) {			/* On the sector boundary? */
 			if (fp->csect >= fp->fs->csize) {		/* On the cluster boundary? */
+#if _FS_EXFAT
+				if (fp->fptr && (fp->flag & FA__CONT))	/* Contiguous clusters: no FAT lookup */
+					clst = fp->curr_clust + 1;
+				else
+#endif
 				clst = (fp->fptr == 0) ?			/* On the top of the file? */
 					fp->org_clust : get_fat(fp->fs, fp->curr_clust);
 				if (clst <= 1) ABORT(fp->fs, FR_INT_ERR);
@@ -52,7 +52,8 @@ uint32_t SYSTICK_GetTime(void) {
 }
 
 extern __IO uint8_t Command_index;
-extern __IO uint16_t Time_Rec_Base;
+extern __IO uint32_t Time_Rec_Base;
+extern void EVAL_AUDIO_CodecTick(void);
 /**
  * @brief Interrupt handler for SysTick.
  */
@@ -63,6 +64,7 @@ void SysTick_Handler(void) {
   {
       Time_Rec_Base ++;
   }
+  EVAL_AUDIO_CodecTick(); // Watchdog of the codec I2C writes
 #endif
 
   sysTicks++; // Update system time
@@ -0,0 +1,80 @@
+/**
+ * @file    audiosink.h
+ * @brief   Audio output sinks
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef AUDIOSINK_H_
+#define AUDIOSINK_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  SINK SINK
+ * @brief     Destinations of the played audio: the codec, the on-chip DAC,
+ *            nowhere (CPU benchmarks) or a file (bit-exact capture)
+ */
+
+/**
+ * @addtogroup SINK
+ * @{
+ */
+
+#define SINK_FILE_NAME  "0:sink.raw" ///< Output of the file sink
+
+/**
+ * @brief Audio sink.
+ * @details A sink plays blocks of interleaved samples one at a time:
+ * 16 bit samples, or 24 bit samples in 32 bit words with the most
+ * significant half word first (the order of the I2S transfers). The
+ * block handed to Play must stay untouched until the sink calls
+ * SINK_BlockDone, from an interrupt or from SINK_Poll. All sizes are in
+ * bytes.
+ */
+typedef struct {
+  const char* name;                             ///< Name used by the :SINK command
+  uint8_t     maxBits;                          ///< Widest samples taken (16 or 24)
+  uint8_t   (*Init)     (uint32_t freq, uint8_t bits, uint8_t volume); ///< Start the output, 0 if OK
+  void      (*Play)     (uint16_t* buf, uint32_t size);  ///< Output a block
+  uint32_t  (*Remaining)(void);                 ///< Part of the block not yet output
+  void      (*Pause)    (uint8_t resume);       ///< Pause (0) or resume (1)
+  void      (*Volume)   (uint8_t volume);       ///< Output volume (0-100)
+  void      (*Poll)     (void);                 ///< Work done in the main loop (may be 0)
+  void      (*Stop)     (void);                 ///< Stop the output
+} SINK_TypeDef;
+
+extern const SINK_TypeDef SINK_I2S;   ///< CS43L22 codec over I2S3 with DMA
+extern const SINK_TypeDef SINK_DAC;   ///< On-chip DAC (PA4) paced by TIM6, without the codec
+extern const SINK_TypeDef SINK_Null;  ///< Blocks are dropped as fast as they come
+extern const SINK_TypeDef SINK_File;  ///< Blocks are written to SINK_FILE_NAME
+
+uint8_t               SINK_Select     (const char* name);
+void                  SINK_SelectSink (const SINK_TypeDef* sink);
+const SINK_TypeDef*   SINK_Selected   (void);
+uint8_t               SINK_Start      (const SINK_TypeDef* sink, uint32_t freq,
+                                       uint8_t bits, uint8_t volume, void (*done)(void));
+void                  SINK_Play       (uint16_t* buf, uint32_t size);
+uint32_t              SINK_Remaining  (void);
+uint64_t              SINK_Position   (void);
+void                  SINK_Pause      (uint8_t resume);
+void                  SINK_Volume     (uint8_t volume);
+void                  SINK_Poll       (void);
+void                  SINK_Stop       (void);
+void                  SINK_BlockDone  (void);
+
+/**
+ * @}
+ */
+
+#endif /* AUDIOSINK_H_ */
@@ -0,0 +1,49 @@
+/**
+ * @file    dacout.h
+ * @brief   Audio output through the on-chip DAC
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef DACOUT_H_
+#define DACOUT_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  DACOUT DACOUT
+ * @brief     Mono 12 bit output on PA4, paced by TIM6, without the codec
+ */
+
+/**
+ * @addtogroup DACOUT
+ * @{
+ */
+
+#define DACOUT_FRAMES       256 ///< Samples per DMA buffer (two buffers)
+#define DACOUT_IRQ_PREPRIO  0   ///< Preemption priority of the DMA interrupt
+#define DACOUT_IRQ_SUBPRIO  0   ///< Subpriority of the DMA interrupt
+
+uint32_t  DACOUT_Start      (uint32_t freq, uint8_t volume, void (*done)(void));
+void      DACOUT_Play       (uint16_t* buf, uint32_t size);
+uint32_t  DACOUT_Remaining  (void);
+void      DACOUT_Pause      (uint8_t resume);
+void      DACOUT_Volume     (uint8_t volume);
+void      DACOUT_Stop       (void);
+void      DACOUT_Convert    (uint16_t* out, const uint16_t* in, uint32_t frames);
+
+/**
+ * @}
+ */
+
+#endif /* DACOUT_H_ */
@@ -45,6 +45,13 @@
 /** @defgroup STM32F4_DISCOVERY_AUDIO_CODEC_Exported_Types
   * @{
   */
+/* Completion callback of a batch of codec register writes. Status is 0 when
+   every write of the batch was acknowledged by the codec, else the batch was
+   aborted on the first failed write. It is called from the I2C interrupt. */
+typedef void (*Codec_BatchCallback)(uint32_t Status);
+/**
+  * @}
+  */ 
 
 /** @defgroup STM32F4_DISCOVERY_AUDIO_CODEC_Exported_Constants
   * @{
@@ -71,6 +78,12 @@
 #define EVAL_AUDIO_IRQ_PREPRIO           0   /* Select the preemption priority level(0 is the highest) */
 #define EVAL_AUDIO_IRQ_SUBRIO            0   /* Select the sub-priority level (0 is the highest) */
 
+/* The codec registers are written by the I2C event interrupt from a queue, so
+   the codec control functions return as soon as their writes are queued.
+   Select the interrupt priority of the control interface (below the audio DMA) */
+#define EVAL_AUDIO_I2C_IRQ_PREPRIO       1   /* Select the preemption priority level(0 is the highest) */
+#define EVAL_AUDIO_I2C_IRQ_SUBRIO        2   /* Select the sub-priority level (0 is the highest) */
+
 /* Uncomment the following line to use the default Codec_TIMEOUT_UserCallback() 
    function implemented in stm32f4_discovery_audio_codec.c file.
    Codec_TIMEOUT_UserCallback() function is called whenever a timeout condition 
@@ -105,8 +118,19 @@
 /* #deine CODEC_MCLK_DISABLED */
 
 /* Uncomment this line to enable verifying data sent to codec after each write 
-  operation */
+  operation (only the blocking writes of Codec_DeInit(), the queued writes are
+  checked by the acknowledge of the codec) */
 #define VERIFY_WRITTENDATA 
+
+/* Number of register writes waiting for the control interface (power of 2).
+   A batch is queued whole or not at all. */
+#define CODEC_QUEUE_SIZE                 32
+/* Largest batch of register writes (the initialization sequence) */
+#define CODEC_BATCH_SIZE                 24
+/* Longest time a queued write may stay on the bus, in calls of 
+   EVAL_AUDIO_CodecTick() (SysTick periods). A write takes about 0.4 ms, a
+   write not done by then is aborted with its batch and the I2C is reset. */
+#define CODEC_WRITE_WATCHDOG             10
 /*----------------------------------------------------------------------------*/
 
 /*-----------------------------------
@@ -188,6 +212,10 @@
 #define CODEC_I2C_SDA_PIN              GPIO_Pin_9
 #define CODEC_I2S_SCL_PINSRC           GPIO_PinSource6
 #define CODEC_I2S_SDA_PINSRC           GPIO_PinSource9
+#define CODEC_I2C_EV_IRQ               I2C1_EV_IRQn
+#define CODEC_I2C_ER_IRQ               I2C1_ER_IRQn
+#define Codec_I2C_EV_IRQHandler        I2C1_EV_IRQHandler
+#define Codec_I2C_ER_IRQHandler        I2C1_ER_IRQHandler
 
 /* Maximum Timeout values for flags and events waiting loops. These timeouts are
    not based on accurate values, they just guarantee that the application will 
@@ -205,6 +233,12 @@
 #define AUDIO_INTERFACE_I2S           1
 #define AUDIO_INTERFACE_DAC           2
 
+/* Audio data format of the I2S interface: 16-bit samples in 16-bit frames or
+   24-bit samples in 32-bit frames. The 24-bit samples are played from 32-bit
+   words, the most significant half word first */
+#define AUDIO_FORMAT_16B              16
+#define AUDIO_FORMAT_24B              24
+
 /* Codec output DEVICE */
 #define OUTPUT_DEVICE_SPEAKER         1
 #define OUTPUT_DEVICE_HEADPHONE       2
@@ -226,6 +260,9 @@
 /* MUTE commands */
 #define AUDIO_MUTE_ON                 1
 #define AUDIO_MUTE_OFF                0
+
+/* Value returned by EVAL_AUDIO_ReadRegister() when the register is not known */
+#define CODEC_REG_UNKNOWN             0xFFFF
 /*----------------------------------------------------------------------------*/
 /**
   * @}
@@ -245,6 +282,7 @@
   * @{
   */ 
 void EVAL_AUDIO_SetAudioInterface(uint32_t Interface);
+void EVAL_AUDIO_SetDataFormat(uint32_t DataFormat);
 uint32_t EVAL_AUDIO_Init(uint16_t OutputDevice, uint8_t Volume, uint32_t AudioFreq);
 uint32_t EVAL_AUDIO_DeInit(void);
 uint32_t EVAL_AUDIO_Play(uint16_t* pBuffer, uint32_t Size);
@@ -252,6 +290,11 @@ uint32_t EVAL_AUDIO_PauseResume(uint32_t Cmd);
 uint32_t EVAL_AUDIO_Stop(uint32_t CodecPowerDown_Mode);
 uint32_t EVAL_AUDIO_VolumeCtl(uint8_t Volume);
 uint32_t EVAL_AUDIO_Mute(uint32_t Command);
+uint32_t EVAL_AUDIO_WriteRegisters(const uint8_t* pRegs, uint32_t Count, Codec_BatchCallback Callback);
+uint32_t EVAL_AUDIO_CodecBusy(void);
+uint32_t EVAL_AUDIO_CodecErrors(void);
+void EVAL_AUDIO_CodecTick(void);
+uint32_t EVAL_AUDIO_ReadRegister(uint8_t RegisterAddr);
 void Audio_MAL_Play(uint32_t Addr, uint32_t Size);
 void DAC_Config(void);
 
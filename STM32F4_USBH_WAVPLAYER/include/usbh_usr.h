@@ -41,6 +41,8 @@
 
 #define CMD_PLAY           ((uint8_t)0x00)
 #define CMD_RECORD         ((uint8_t)0x01)
+#define CMD_DUPLEX         ((uint8_t)0x03)
+#define CMD_BENCH          ((uint8_t)0x04)
 
 /* Exported macros -----------------------------------------------------------*/
 /* Exported variables --------------------------------------------------------*/
@@ -73,6 +75,10 @@ extern void WaveRecorderUpdate(void);
 extern void Delay(__IO uint32_t nTime);
 extern void WavePlayer_CallBack(void);
 extern uint32_t WaveRecorderStop(void);
+extern uint32_t WaveRecorderArm(void);
+extern void WaveRecorderTrigger(void);
+extern void WaveRecorderSetMonitor(uint8_t State);
+extern void commandCallback(void);
 #ifdef __cplusplus
 }
 #endif
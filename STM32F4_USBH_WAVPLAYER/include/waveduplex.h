@@ -0,0 +1,54 @@
+/**
+ * @file    waveduplex.h
+ * @brief   Simultaneous playback and recording
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef WAVEDUPLEX_H_
+#define WAVEDUPLEX_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  DUPLEX DUPLEX
+ * @brief     Full duplex audio: playback and recording at the same time
+ */
+
+/**
+ * @addtogroup DUPLEX
+ * @{
+ */
+
+/**
+ * @brief Statistics of the last duplex session.
+ */
+typedef struct {
+  uint32_t reads;         ///< Playback buffers read from the USB Key
+  uint32_t writes;        ///< Recording buffers written to the USB Key
+  uint32_t maxReadTime;   ///< Longest read in ms
+  uint32_t maxWriteTime;  ///< Longest write (with checkpoint) in ms
+  uint32_t minPlaySlack;  ///< Lowest playback slack seen by the scheduler in ms
+  uint32_t minRecSlack;   ///< Lowest recording slack seen by the scheduler in ms
+  uint32_t underruns;     ///< Playback ring ran empty
+  uint32_t overruns;      ///< Captured blocks lost
+} DUPLEX_StatsTypeDef;
+
+void DUPLEX_Start     (void);
+void DUPLEX_GetStats  (DUPLEX_StatsTypeDef* stats);
+
+/**
+ * @}
+ */
+
+#endif /* WAVEDUPLEX_H_ */
@@ -0,0 +1,58 @@
+/**
+ * @file    wavemonitor.h
+ * @brief   Input monitoring: microphone to headphones
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef WAVEMONITOR_H_
+#define WAVEMONITOR_H_
+
+#include <inttypes.h>
+
+/**
+ * @defgroup  MONITOR MONITOR
+ * @brief     Plays the captured audio on the codec output while recording
+ */
+
+/**
+ * @addtogroup MONITOR
+ * @{
+ */
+
+/**
+ * @brief Statistics of the monitor path.
+ * @details The latency is the time between the capture of a sample (end
+ * of the PDM filter block) and the end of its playback, in microseconds.
+ */
+typedef struct {
+  uint32_t blocks;      ///< Blocks played
+  uint32_t minLatency;  ///< Lowest latency in us
+  uint32_t maxLatency;  ///< Highest latency in us
+  uint32_t avgLatency;  ///< Average latency in us
+  uint32_t dropped;     ///< Blocks dropped to keep the latency bounded
+  uint32_t silences;    ///< Silent blocks played because the ring was empty
+} MONITOR_StatsTypeDef;
+
+void    MONITOR_Start             (uint32_t freq);
+void    MONITOR_Stop              (void);
+uint8_t MONITOR_IsActive          (void);
+void    MONITOR_Write             (uint16_t* pcm, uint32_t len);
+void    MONITOR_TransferComplete  (void);
+void    MONITOR_GetStats          (MONITOR_StatsTypeDef* stats);
+
+/**
+ * @}
+ */
+
+#endif /* WAVEMONITOR_H_ */
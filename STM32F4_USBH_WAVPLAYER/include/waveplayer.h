@@ -23,6 +23,7 @@
 #ifndef __WAVE_PLAYER_H
 #define __WAVE_PLAYER_H
 
+#include <dither.h>
 
 typedef enum
 {
@@ -65,15 +66,24 @@ typedef enum
 #define  DATA_ID                             0x64617461  /* correspond to the letters 'data' */
 #define  FACT_ID                             0x66616374  /* correspond to the letters 'fact' */
 #define  WAVE_FORMAT_PCM                     0x01
+#define  WAVE_FORMAT_IEEE_FLOAT              0x03
+#define  WAVE_FORMAT_IMA_ADPCM               0x11
+#define  WAVE_FORMAT_EXTENSIBLE              0xFFFE
 #define  FORMAT_CHNUK_SIZE                   0x10
 #define  CHANNEL_MONO                        0x01
 #define  CHANNEL_STEREO                      0x02
 #define  SAMPLE_RATE_8000                    8000
 #define  SAMPLE_RATE_11025                   11025
+#define  SAMPLE_RATE_16000                   16000
 #define  SAMPLE_RATE_22050                   22050
+#define  SAMPLE_RATE_32000                   32000
 #define  SAMPLE_RATE_44100                   44100
+#define  SAMPLE_RATE_48000                   48000
+#define  BITS_PER_SAMPLE_4                   4
 #define  BITS_PER_SAMPLE_8                   8
 #define  BITS_PER_SAMPLE_16                  16
+#define  BITS_PER_SAMPLE_24                  24
+#define  BITS_PER_SAMPLE_32                  32
 
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
@@ -86,8 +96,15 @@ void WavePlayerStop(void);
 void WavePlayerPauseResume(uint8_t state);
 uint8_t WaveplayerCtrlVolume(uint8_t volume);
 void WavePlayerStart(void);
+uint32_t WavePlayerOpen(char* FileName);
+void WavePlayerStreamStart(void);
+uint8_t WavePlayerFill(void);
+uint8_t WavePlayerNeedData(void);
+uint32_t WavePlayerSlack(void);
+void WavePlayerPoll(void);
 void WavePlayer_CallBack(void);
-uint32_t ReadUnit(uint8_t *buffer, uint8_t idx, uint8_t NbrOfBytes, Endianness BytesFormat);
+DITHER_TypeDef* WavePlayerGetDither(void);
+uint32_t ReadUnit(uint8_t *buffer, uint32_t idx, uint8_t NbrOfBytes, Endianness BytesFormat);
 
 #endif /* __WAVE_PLAYER_H */
 
@@ -26,20 +26,69 @@
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f4xx.h"
 #include <waveplayer.h>
+#include <agc.h>
+#include <denoise.h>
 
 /* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t  SampleRate;     /* Output sampling rate: 8000, 16000, 32000 or 48000 Hz */
+  uint16_t  NbrChannels;    /* CHANNEL_MONO or CHANNEL_STEREO */
+  uint16_t  BitsPerSample;  /* BITS_PER_SAMPLE_16 or BITS_PER_SAMPLE_24 */
+  uint16_t  FormatTag;      /* WAVE_FORMAT_PCM or WAVE_FORMAT_IMA_ADPCM (from 16-bit samples) */
+}
+WaveRecorder_ConfigTypeDef;
+
+/* Results of WaveRecorderBench(), the costs are per second of audio */
+typedef struct
+{
+  uint32_t  AudioTime;      /* Audio recorded in milliseconds */
+  uint32_t  RunTime;        /* Duration of the benchmark in milliseconds */
+  uint32_t  FilterCycles;   /* PDM filter and AGC (interrupt part) in CPU cycles */
+  uint32_t  ProcessCycles;  /* Processing and formatting (main loop part) in CPU cycles */
+  uint32_t  WriteTime;      /* Writes to the USB Key in milliseconds */
+  uint32_t  MaxWriteTime;   /* Longest write in milliseconds */
+  uint32_t  MaxRate;        /* Highest sustainable sampling rate in Hz */
+  uint32_t  Overruns;       /* Blocks lost because the ring was full */
+}
+WaveRecorder_BenchTypeDef;
+
 /* Exported Defines ----------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
+/* Size of the wave header written at the beginning of the recorded file.
+   The audio data starts on the next sector boundary. */
+#define REC_HEADER_SIZE         512
+
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 void AUDIO_REC_SPI_IRQHANDLER(void);
+uint32_t WaveRecorderConfig(WaveRecorder_ConfigTypeDef* pConfig);
+void WaveRecorderGetConfig(WaveRecorder_ConfigTypeDef* pConfig);
+void WaveRecorderSetCheckpoint(uint32_t Interval);
+void WaveRecorderSetSegment(uint32_t Time);
+const char* WaveRecorderFileName(void);
+void WaveRecorderSetVad(uint8_t State);
+void WaveRecorderSetPreroll(uint32_t Time);
+void WaveRecorderSetMonitor(uint8_t State);
+AGC_TypeDef* WaveRecorderGetAgc(void);
+void WaveRecorderSetDenoise(uint8_t State);
+DENOISE_TypeDef* WaveRecorderGetDenoise(void);
+uint32_t WaveRecorderArm(void);
+void WaveRecorderTrigger(void);
 uint32_t WaveRecorderInit(uint32_t AudioFreq, uint32_t BitRes, uint32_t ChnlNbr);
-uint8_t WaveRecorderStart(uint16_t* pbuf, uint32_t size);
+uint8_t WaveRecorderStart(void);
 uint32_t WaveRecorderStop(void);
 uint32_t WavaRecorderHeaderInit(uint8_t* pHeadBuf);
+void WaveRecorderHeaderUpdate(uint8_t* pHeadBuf, uint32_t DataSize);
 void Delay(__IO uint32_t nTime);
 void WaveRecorderUpdate(void);
-extern uint32_t ReadUnit(uint8_t *buffer, uint8_t idx, uint8_t NbrOfBytes, Endianness BytesFormat);
+uint32_t WaveRecorderOpen(void);
+uint8_t WaveRecorderProcess(void);
+uint8_t WaveRecorderWrite(void);
+uint32_t WaveRecorderSlack(void);
+void WaveRecorderClose(void);
+uint32_t WaveRecorderBench(uint32_t Time, uint32_t Speed, WaveRecorder_BenchTypeDef* pStats);
+extern uint32_t ReadUnit(uint8_t *buffer, uint32_t idx, uint8_t NbrOfBytes, Endianness BytesFormat);
 
 #endif /* __WAVE_RECORDER_H */
 
@@ -10,6 +10,10 @@ Module Private Functions and Variables
 
 static volatile DSTATUS Stat = STA_NOINIT;	/* Disk status */
 
+/* Longest READ10/WRITE10 command, longer transfers are split (some devices
+   fail above 120 KB, the usual limit of USB storage hosts) */
+#define MSC_MAX_SECTORS   240
+
 extern USB_OTG_CORE_HANDLE          USB_OTG_Core;
 extern USBH_HOST                     USB_Host;
 
@@ -56,21 +60,23 @@ DRESULT disk_read (
                    BYTE drv,			/* Physical drive number (0) */
                    BYTE *buff,			/* Pointer to the data buffer to store read data */
                    DWORD sector,		/* Start sector number (LBA) */
-                   BYTE count			/* Sector count (1..255) */
+                   UINT count			/* Sector count */
                      )
 {
   BYTE status = USBH_MSC_OK;
+  UINT n;
   
   if (drv || !count) return RES_PARERR;
   if (Stat & STA_NOINIT) return RES_NOTRDY;
   
   
-  if(HCD_IsDeviceConnected(&USB_OTG_Core))
+  while (HCD_IsDeviceConnected(&USB_OTG_Core) && count && (status == USBH_MSC_OK))
   {  
+    n = (count > MSC_MAX_SECTORS) ? MSC_MAX_SECTORS : count;
     
     do
     {
-      status = USBH_MSC_Read10(&USB_OTG_Core, buff, sector, 512*count);
+      status = USBH_MSC_Read10(&USB_OTG_Core, buff, sector, 512*n);
       USBH_MSC_HandleBOTXfer(&USB_OTG_Core ,&USB_Host);
       
       if(!HCD_IsDeviceConnected(&USB_OTG_Core))
@@ -79,6 +85,10 @@ DRESULT disk_read (
       }      
     }
     while(status == USBH_MSC_BUSY );
+    
+    buff += 512*n;
+    sector += n;
+    count -= n;
   }
   
   if(status == USBH_MSC_OK)
@@ -98,20 +108,24 @@ DRESULT disk_write (
                     BYTE drv,			/* Physical drive number (0) */
                     const BYTE *buff,	/* Pointer to the data to be written */
                     DWORD sector,		/* Start sector number (LBA) */
-                    BYTE count			/* Sector count (1..255) */
+                    UINT count			/* Sector count */
                       )
 {
   BYTE status = USBH_MSC_OK;
+  UINT n;
+  
   if (drv || !count) return RES_PARERR;
   if (Stat & STA_NOINIT) return RES_NOTRDY;
   if (Stat & STA_PROTECT) return RES_WRPRT;
   
   
-  if(HCD_IsDeviceConnected(&USB_OTG_Core))
+  while (HCD_IsDeviceConnected(&USB_OTG_Core) && count && (status == USBH_MSC_OK))
   {  
+    n = (count > MSC_MAX_SECTORS) ? MSC_MAX_SECTORS : count;
+    
     do
     {
-      status = USBH_MSC_Write10(&USB_OTG_Core,(BYTE*)buff, sector, 512*count);
+      status = USBH_MSC_Write10(&USB_OTG_Core,(BYTE*)buff, sector, 512*n);
       USBH_MSC_HandleBOTXfer(&USB_OTG_Core, &USB_Host);
       
       if(!HCD_IsDeviceConnected(&USB_OTG_Core))
@@ -122,6 +136,9 @@ DRESULT disk_write (
     
     while(status == USBH_MSC_BUSY );
     
+    buff += 512*n;
+    sector += n;
+    count -= n;
   }
   
   if(status == USBH_MSC_OK)
@@ -0,0 +1,430 @@
+/**
+ * @file    audiosink.c
+ * @brief   Audio output sinks
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The players hand one block at a time to the active sink and
+ * queue the next one from the completion callback, so the ring buffer
+ * engine does not depend on where the audio goes. The I2S sink is the
+ * codec DMA path, the DAC sink is the timer driven DAC output of DACOUT
+ * (mono, no codec). The null and file sinks complete the
+ * blocks from SINK_Poll in the main loop: the null sink as fast as the
+ * pipeline produces them, to measure its CPU time, and the file sink
+ * after writing them to SINK_FILE_NAME, so the output of the whole
+ * pipeline can be compared bit for bit with a reference.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stm32f4xx.h>
+#include <ff.h>
+#include <timers.h>
+#include "stm32f4_discovery_audio_codec.h"
+#include <dacout.h>
+#include <audiosink.h>
+
+#define DEBUG
+
+#ifdef DEBUG
+#define print(str, args...) printf(""str"%s",##args,"")
+#define println(str, args...) printf("SINK--> "str"%s",##args,"\r\n")
+#else
+#define print(str, args...) (void)0
+#define println(str, args...) (void)0
+#endif
+
+/**
+ * @addtogroup SINK
+ * @{
+ */
+
+static const SINK_TypeDef* sinkSelected = &SINK_I2S; ///< Used by the next playback
+static const SINK_TypeDef* sinkActive;    ///< Started sink
+static void (*sinkDone)(void);            ///< Block completion callback
+static volatile uint32_t sinkSize;        ///< Size of the block being output
+static volatile uint64_t sinkBytes;       ///< Bytes of the completed blocks
+static uint8_t sinkPaused;
+static uint32_t sinkStartTime;            ///< For the throughput, in ms
+
+static uint16_t* pollBuf;                 ///< Block waiting for SINK_Poll
+static volatile uint32_t pollSize;        ///< Its size, 0 if none
+static FIL sinkFile;
+static uint8_t sinkFileOpen;
+
+/**
+ * @brief Start the codec over I2S.
+ * @param freq Sampling frequency
+ * @param bits Bits per sample (16 or 24)
+ * @param volume Volume
+ * @return 0 if OK
+ */
+static uint8_t SINK_I2sInit(uint32_t freq, uint8_t bits, uint8_t volume) {
+
+  EVAL_AUDIO_SetAudioInterface(AUDIO_INTERFACE_I2S);
+  EVAL_AUDIO_SetDataFormat(bits == 24 ? AUDIO_FORMAT_24B : AUDIO_FORMAT_16B);
+  return EVAL_AUDIO_Init(OUTPUT_DEVICE_AUTO, volume, freq) ? 1 : 0;
+}
+
+/**
+ * @brief Start the DMA on a block.
+ * @param buf Block
+ * @param size Size in bytes
+ */
+static void SINK_I2sPlay(uint16_t* buf, uint32_t size) {
+  Audio_MAL_Play((uint32_t)buf, size);
+}
+
+/**
+ * @brief Get the rest of the block.
+ * @return Bytes the DMA has not sent yet
+ */
+static uint32_t SINK_I2sRemaining(void) {
+  return DMA_GetCurrDataCounter(AUDIO_I2S_DMA_STREAM) * 2; // counts half words in both formats
+}
+
+/**
+ * @brief Pause or resume the DMA and the codec.
+ * @param resume 0 to pause, 1 to resume
+ */
+static void SINK_I2sPause(uint8_t resume) {
+  EVAL_AUDIO_PauseResume(resume ? AUDIO_RESUME : AUDIO_PAUSE);
+}
+
+/**
+ * @brief Set the codec volume.
+ * @param volume Volume
+ */
+static void SINK_CodecVolume(uint8_t volume) {
+  EVAL_AUDIO_VolumeCtl(volume);
+}
+
+/**
+ * @brief Stop the codec.
+ */
+static void SINK_CodecStop(void) {
+  EVAL_AUDIO_Stop(CODEC_PDWN_SW);
+}
+
+/**
+ * @brief Start the DAC output.
+ * @param freq Sampling frequency
+ * @param bits Bits per sample (16)
+ * @param volume Volume
+ * @return 0
+ */
+static uint8_t SINK_DacInit(uint32_t freq, uint8_t bits, uint8_t volume) {
+
+  println("DAC at %u Hz", (unsigned int)DACOUT_Start(freq, volume, SINK_BlockDone));
+  return 0;
+}
+
+/**
+ * @brief Start the null sink.
+ * @param freq Sampling frequency (unused)
+ * @param bits Bits per sample (unused)
+ * @param volume Volume (unused)
+ * @return 0
+ */
+static uint8_t SINK_NullInit(uint32_t freq, uint8_t bits, uint8_t volume) {
+
+  pollSize = 0;
+  return 0;
+}
+
+/**
+ * @brief Queue a block for SINK_Poll.
+ * @param buf Block
+ * @param size Size in bytes
+ */
+static void SINK_PollPlay(uint16_t* buf, uint32_t size) {
+
+  pollBuf = buf;
+  pollSize = size;
+}
+
+/**
+ * @brief Get the rest of the block.
+ * @return Size of the block waiting for SINK_Poll
+ */
+static uint32_t SINK_PollRemaining(void) {
+  return pollSize;
+}
+
+/**
+ * @brief Drop the waiting block.
+ */
+static void SINK_NullPoll(void) {
+
+  if (pollSize == 0) {
+    return;
+  }
+  pollSize = 0;
+  __disable_irq(); // the callback expects the interrupt context
+  SINK_BlockDone();
+  __enable_irq();
+}
+
+/**
+ * @brief Stop the null sink.
+ */
+static void SINK_NullStop(void) {
+  pollSize = 0;
+}
+
+/**
+ * @brief Create the capture file.
+ * @param freq Sampling frequency (unused)
+ * @param bits Bits per sample (unused, the blocks are written as they are)
+ * @param volume Volume (unused, the capture is bit-exact)
+ * @return 0 if OK
+ */
+static uint8_t SINK_FileInit(uint32_t freq, uint8_t bits, uint8_t volume) {
+
+  pollSize = 0;
+  sinkFileOpen = (f_open(&sinkFile, SINK_FILE_NAME, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+  return sinkFileOpen ? 0 : 1;
+}
+
+/**
+ * @brief Write the waiting block to the file.
+ */
+static void SINK_FilePoll(void) {
+
+  UINT written;
+
+  if (pollSize == 0) {
+    return;
+  }
+  if (sinkFileOpen) {
+    if ((f_write(&sinkFile, pollBuf, pollSize, &written) != FR_OK) || (written < pollSize)) {
+      println("Write error, capture stopped");
+      f_close(&sinkFile);
+      sinkFileOpen = 0;
+    }
+  }
+  pollSize = 0;
+  __disable_irq(); // the callback expects the interrupt context
+  SINK_BlockDone();
+  __enable_irq();
+}
+
+/**
+ * @brief Close the capture file.
+ */
+static void SINK_FileStop(void) {
+
+  pollSize = 0;
+  if (sinkFileOpen) {
+    f_close(&sinkFile);
+    sinkFileOpen = 0;
+  }
+}
+
+const SINK_TypeDef SINK_I2S = {
+  "I2S", 24, SINK_I2sInit, SINK_I2sPlay, SINK_I2sRemaining, SINK_I2sPause,
+  SINK_CodecVolume, 0, SINK_CodecStop
+};
+
+const SINK_TypeDef SINK_DAC = {
+  "DAC", 16, SINK_DacInit, DACOUT_Play, DACOUT_Remaining, DACOUT_Pause,
+  DACOUT_Volume, 0, DACOUT_Stop
+};
+
+const SINK_TypeDef SINK_Null = {
+  "NULL", 24, SINK_NullInit, SINK_PollPlay, SINK_PollRemaining, 0,
+  0, SINK_NullPoll, SINK_NullStop
+};
+
+const SINK_TypeDef SINK_File = {
+  "FILE", 24, SINK_FileInit, SINK_PollPlay, SINK_PollRemaining, 0,
+  0, SINK_FilePoll, SINK_FileStop
+};
+
+static const SINK_TypeDef* const sinkList[] = {&SINK_I2S, &SINK_DAC, &SINK_Null, &SINK_File};
+
+/**
+ * @brief Select the sink of the next playback.
+ * @param name Name of the sink
+ * @return 0 if OK, 1 if there is no such sink
+ */
+uint8_t SINK_Select(const char* name) {
+
+  uint8_t i;
+
+  for (i = 0; i < sizeof(sinkList) / sizeof(sinkList[0]); i++) {
+    if (!strcmp(name, sinkList[i]->name)) {
+      sinkSelected = sinkList[i];
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief Select the sink of the next playback by its structure.
+ * @details For the sinks that are not in the list of SINK_Select, like
+ * the host file sink of usb/bench/playbench.c.
+ * @param sink Sink
+ */
+void SINK_SelectSink(const SINK_TypeDef* sink) {
+  sinkSelected = sink;
+}
+
+/**
+ * @brief Get the sink of the next playback.
+ * @return Selected sink
+ */
+const SINK_TypeDef* SINK_Selected(void) {
+  return sinkSelected;
+}
+
+/**
+ * @brief Start a sink.
+ * @param sink Sink (SINK_Selected for the playback)
+ * @param freq Sampling frequency
+ * @param bits Bits per sample (16, or 24 up to maxBits of the sink)
+ * @param volume Volume
+ * @param done Called when a block has been output, from an interrupt or
+ * with the interrupts disabled. It may call SINK_Play.
+ * @return 0 if OK
+ */
+uint8_t SINK_Start(const SINK_TypeDef* sink, uint32_t freq, uint8_t bits,
+    uint8_t volume, void (*done)(void)) {
+
+  sinkActive = sink;
+  sinkDone = done;
+  sinkSize = 0;
+  sinkBytes = 0;
+  sinkPaused = 0;
+  sinkStartTime = TIMER_GetTime();
+
+  if (sink->Init(freq, (bits > sink->maxBits) ? sink->maxBits : bits, volume)) {
+    println("%s failed to start", sink->name);
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Output a block.
+ * @details Called with the interrupts disabled or from the callback.
+ * @param buf Block (16 bit stereo)
+ * @param size Size in bytes
+ */
+void SINK_Play(uint16_t* buf, uint32_t size) {
+
+  if (sinkActive == 0) {
+    return;
+  }
+  sinkSize = size;
+  sinkActive->Play(buf, size);
+}
+
+/**
+ * @brief Get the rest of the block being output.
+ * @return Bytes
+ */
+uint32_t SINK_Remaining(void) {
+  return sinkSize ? sinkActive->Remaining() : 0;
+}
+
+/**
+ * @brief Get the output position.
+ * @return Bytes output since SINK_Start
+ */
+uint64_t SINK_Position(void) {
+
+  uint64_t bytes;
+
+  __disable_irq();
+  bytes = sinkBytes + sinkSize - SINK_Remaining();
+  __enable_irq();
+  return bytes;
+}
+
+/**
+ * @brief Pause or resume the output.
+ * @param resume 0 to pause, 1 to resume
+ */
+void SINK_Pause(uint8_t resume) {
+
+  if (sinkActive == 0) {
+    return;
+  }
+  sinkPaused = !resume;
+  if (sinkActive->Pause) {
+    sinkActive->Pause(resume);
+  }
+}
+
+/**
+ * @brief Set the output volume.
+ * @param volume Volume (0-100)
+ */
+void SINK_Volume(uint8_t volume) {
+
+  if (sinkActive && sinkActive->Volume) {
+    sinkActive->Volume(volume);
+  }
+}
+
+/**
+ * @brief Main loop work of the sink.
+ * @details Must be called by the playback loop.
+ */
+void SINK_Poll(void) {
+
+  if (sinkActive && sinkActive->Poll && !sinkPaused) {
+    sinkActive->Poll();
+  }
+}
+
+/**
+ * @brief Stop the output.
+ */
+void SINK_Stop(void) {
+
+  uint32_t time;
+
+  if (sinkActive == 0) {
+    return;
+  }
+  sinkDone = 0; // disabling the DMA completes the block
+  sinkActive->Stop();
+  time = TIMER_GetTime() - sinkStartTime;
+  println("%s: %u bytes in %u ms", sinkActive->name,
+      (unsigned int)sinkBytes, (unsigned int)time);
+  sinkActive = 0;
+  sinkSize = 0;
+}
+
+/**
+ * @brief Called by the sinks when a block has been output.
+ */
+void SINK_BlockDone(void) {
+
+  // disabling the DMA stream on a pause completes the transfer too
+  if (sinkPaused) {
+    return;
+  }
+  sinkBytes += sinkSize;
+  sinkSize = 0;
+  if (sinkDone) {
+    sinkDone();
+  }
+}
+
+/**
+ * @}
+ */
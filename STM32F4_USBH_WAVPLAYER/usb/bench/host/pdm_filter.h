@@ -0,0 +1,57 @@
+/**
+ * @file    pdm_filter.h
+ * @brief   Host (Linux) stand-in of the PDM filter library
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The library is only available for the Cortex-M4. The host
+ * build uses the reference filter of pdm_ref.c with the same interface:
+ * PDM_Filter_64_LSB turns Fs / 1000 x 64 bits into Fs / 1000 samples.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef PDM_FILTER_H_
+#define PDM_FILTER_H_
+
+#include <stdint.h>
+
+#define PDM_REF_CIC_ORDER   4   ///< Order of the CIC decimator
+#define PDM_REF_CIC_DECIM   32  ///< Decimation of the CIC
+#define PDM_REF_FIR_TAPS    32  ///< Taps of the FIR decimator (by 2)
+
+/**
+ * @brief Filter parameters (as in the library) and state.
+ */
+typedef struct {
+  uint16_t Fs;              ///< Output sampling frequency
+  float    LP_HZ;           ///< Low-pass cut-off
+  float    HP_HZ;           ///< High-pass cut-off (0: none)
+  uint16_t In_MicChannels;  ///< Interleaved microphones in the input
+  uint16_t Out_MicChannels; ///< Interleaved channels in the output
+
+  int32_t  integ[PDM_REF_CIC_ORDER];  ///< CIC integrators
+  int32_t  comb[PDM_REF_CIC_ORDER];   ///< CIC comb delays
+  float    fir[PDM_REF_FIR_TAPS];     ///< FIR taps
+  float    hist[PDM_REF_FIR_TAPS];    ///< FIR input history
+  float    hpAlpha;                   ///< High-pass pole
+  float    hpIn;                      ///< Last high-pass input
+  float    hpOut;                     ///< Last high-pass output
+} PDMFilter_InitStruct;
+
+#define HTONS(A)  ((((u16)(A) & 0xff00) >> 8) | \
+                   (((u16)(A) & 0x00ff) << 8))
+
+void    PDM_Filter_Init   (PDMFilter_InitStruct* Filter);
+int32_t PDM_Filter_64_LSB (uint8_t* data, uint16_t* dataOut, uint16_t MicGain,
+                           PDMFilter_InitStruct* Filter);
+
+#endif /* PDM_FILTER_H_ */
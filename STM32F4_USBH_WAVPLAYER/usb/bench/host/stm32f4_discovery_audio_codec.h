@@ -0,0 +1,56 @@
+/**
+ * @file    stm32f4_discovery_audio_codec.h
+ * @brief   Host (Linux) stand-in of the codec driver header for the player
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details Only what waveplayer.c and audiosink.c use. The codec is not
+ * simulated: the calls of the I2S sink do nothing and its DMA never
+ * completes a block, so the host runs the player with the host file sink
+ * (playbench.c) or the null sink.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef STM32F4_DISCOVERY_AUDIO_CODEC_H_
+#define STM32F4_DISCOVERY_AUDIO_CODEC_H_
+
+#include "stm32f4xx.h"
+
+#define AUDIO_MAL_MODE_NORMAL         ///< Blocks chained by the transfer complete callback
+
+#define AUDIO_I2S_DMA_STREAM          0
+#define AUDIO_INTERFACE_I2S           1
+#define AUDIO_FORMAT_16B              16
+#define AUDIO_FORMAT_24B              24
+#define OUTPUT_DEVICE_AUTO            4
+#define AUDIO_PAUSE                   0
+#define AUDIO_RESUME                  1
+#define CODEC_PDWN_HW                 1
+#define CODEC_PDWN_SW                 2
+
+static inline void EVAL_AUDIO_SetAudioInterface(uint32_t i) { (void)i; }
+static inline void EVAL_AUDIO_SetDataFormat(uint32_t f) { (void)f; }
+static inline uint32_t EVAL_AUDIO_Init(uint16_t o, uint8_t v, uint32_t f) { (void)o; (void)v; (void)f; return 0; }
+static inline uint32_t EVAL_AUDIO_Play(uint16_t* b, uint32_t s) { (void)b; (void)s; return 0; }
+static inline uint32_t EVAL_AUDIO_PauseResume(uint32_t c) { (void)c; return 0; }
+static inline uint32_t EVAL_AUDIO_Stop(uint32_t o) { (void)o; return 0; }
+static inline uint32_t EVAL_AUDIO_VolumeCtl(uint8_t v) { (void)v; return 0; }
+static inline void Audio_MAL_Play(uint32_t a, uint32_t s) { (void)a; (void)s; }
+static inline uint16_t DMA_GetCurrDataCounter(uint32_t s) { (void)s; return 0; }
+
+void EVAL_AUDIO_TransferComplete_CallBack(uint32_t pBuffer, uint32_t Size);
+void EVAL_AUDIO_HalfTransfer_CallBack(uint32_t pBuffer, uint32_t Size);
+void EVAL_AUDIO_Error_CallBack(void* pData);
+uint16_t EVAL_AUDIO_GetSampleCallBack(void);
+uint32_t Codec_TIMEOUT_UserCallback(void);
+
+#endif /* STM32F4_DISCOVERY_AUDIO_CODEC_H_ */
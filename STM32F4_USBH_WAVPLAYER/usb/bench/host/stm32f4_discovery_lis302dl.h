@@ -0,0 +1,65 @@
+/**
+ * @file    stm32f4_discovery_lis302dl.h
+ * @brief   Host (Linux) stand-in of the accelerometer driver header
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The player configures the click detection of the LIS302DL
+ * (pause, resume, volume). On the host the configuration goes nowhere.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef STM32F4_DISCOVERY_LIS302DL_H_
+#define STM32F4_DISCOVERY_LIS302DL_H_
+
+#include <inttypes.h>
+
+typedef struct {
+  uint8_t Power_Mode;
+  uint8_t Output_DataRate;
+  uint8_t Axes_Enable;
+  uint8_t Full_Scale;
+  uint8_t Self_Test;
+} LIS302DL_InitTypeDef;
+
+typedef struct {
+  uint8_t Latch_Request;
+  uint8_t SingleClick_Axes;
+  uint8_t DoubleClick_Axes;
+} LIS302DL_InterruptConfigTypeDef;
+
+#define LIS302DL_LOWPOWERMODE_ACTIVE            0x40
+#define LIS302DL_DATARATE_100                   0x00
+#define LIS302DL_X_ENABLE                       0x01
+#define LIS302DL_Y_ENABLE                       0x02
+#define LIS302DL_Z_ENABLE                       0x04
+#define LIS302DL_FULLSCALE_2_3                  0x00
+#define LIS302DL_SELFTEST_NORMAL                0x00
+#define LIS302DL_INTERRUPTREQUEST_LATCHED       0x40
+#define LIS302DL_CLICKINTERRUPT_Z_ENABLE        0x10
+#define LIS302DL_DOUBLECLICKINTERRUPT_Z_ENABLE  0x20
+#define LIS302DL_CTRL_REG3_ADDR                 0x22
+#define LIS302DL_FF_WU_CFG1_REG_ADDR            0x30
+#define LIS302DL_CLICK_CFG_REG_ADDR             0x38
+#define LIS302DL_CLICK_THSY_X_REG_ADDR          0x3B
+#define LIS302DL_CLICK_THSZ_REG_ADDR            0x3C
+#define LIS302DL_CLICK_TIMELIMIT_REG_ADDR       0x3D
+#define LIS302DL_CLICK_LATENCY_REG_ADDR         0x3E
+#define LIS302DL_CLICK_WINDOW_REG_ADDR          0x3F
+
+static inline void LIS302DL_Init(LIS302DL_InitTypeDef* i) { (void)i; }
+static inline void LIS302DL_InterruptConfig(LIS302DL_InterruptConfigTypeDef* i) { (void)i; }
+static inline void LIS302DL_Write(uint8_t* b, uint8_t a, uint16_t n) { (void)b; (void)a; (void)n; }
+
+uint32_t LIS302DL_TIMEOUT_UserCallback(void);
+
+#endif /* STM32F4_DISCOVERY_LIS302DL_H_ */
@@ -0,0 +1,212 @@
+/**
+ * @file    stm32f4xx.h
+ * @brief   Host (Linux) stand-in of the device header for the recorder
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details Only what waverecorder.c, waveplayer.c, audiosink.c, i2sclk.c
+ * and dither.c use. The peripherals are plain structures: the Standard
+ * Peripheral Library calls do nothing, except those of the PLLI2S and the I2S enable, which set the
+ * registers read by the clock planner, and the RNG, which gives a fixed
+ * seed. The
+ * DWT cycle counter runs from the host clock at HOST_CORE_CLOCK, so the
+ * cycles reported are host time expressed in cycles of the board.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef STM32F4XX_H_
+#define STM32F4XX_H_
+
+#include <inttypes.h>
+
+#define HOST_CORE_CLOCK   168000000 ///< Clock of the cycle counter
+#define HSE_VALUE         8000000   ///< Crystal of the board
+
+#define __IO              volatile
+
+typedef uint16_t u16;
+typedef enum { RESET = 0, SET = !RESET } FlagStatus, ITStatus;
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+
+extern uint32_t SystemCoreClock;
+
+/**
+ * @brief Cycle counter.
+ */
+typedef struct {
+  uint32_t CTRL;
+  uint32_t CYCCNT;
+} DWT_Type;
+
+/**
+ * @brief Debug control.
+ */
+typedef struct {
+  uint32_t DEMCR;
+} CoreDebug_Type;
+
+/**
+ * @brief Clock control.
+ */
+typedef struct {
+  uint32_t PLLCFGR;
+  uint32_t AHB1ENR;
+  uint32_t PLLI2SCFGR;
+} RCC_TypeDef;
+
+/**
+ * @brief SPI/I2S.
+ */
+typedef struct {
+  uint32_t DR;
+  uint16_t I2SCFGR;
+  uint16_t I2SPR;
+} SPI_TypeDef;
+
+typedef struct { uint32_t ODR; } GPIO_TypeDef; ///< GPIO port
+
+DWT_Type*       HOST_Dwt  (void);
+extern CoreDebug_Type HOST_CoreDebug;
+extern RCC_TypeDef    HOST_Rcc;
+extern SPI_TypeDef    HOST_Spi2, HOST_Spi3;
+extern GPIO_TypeDef   HOST_GpioB, HOST_GpioC, HOST_GpioE;
+
+#define DWT               (HOST_Dwt())      ///< Counter updated on every access
+#define CoreDebug         (&HOST_CoreDebug)
+#define RCC               (&HOST_Rcc)
+#define SPI2              (&HOST_Spi2)
+#define SPI3              (&HOST_Spi3)
+#define GPIOB             (&HOST_GpioB)
+#define GPIOC             (&HOST_GpioC)
+#define GPIOE             (&HOST_GpioE)
+#define TIM4              0                 ///< Timers are not simulated
+
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define RCC_AHB1ENR_CRCEN           (1UL << 12)
+#define RCC_PLLCFGR_PLLM            0x0000003FUL
+#define RCC_PLLI2SCFGR_PLLI2SN      0x00007FC0UL
+#define RCC_PLLI2SCFGR_PLLI2SR      0x70000000UL
+#define RCC_FLAG_PLLI2SRDY          0x3B
+#define RCC_AHB2Periph_RNG          0x0040
+#define RNG_FLAG_DRDY               0x0001
+#define HOST_RNG_SEED               0x12345678UL ///< Number given by the RNG
+#define SPI_I2SCFGR_CHLEN           0x0001
+#define SPI_I2SCFGR_I2SE            0x0400
+#define SPI_I2SPR_MCKOE             0x0200
+
+#define GPIO_Pin_0                  0x0001
+#define GPIO_Pin_1                  0x0002
+#define GPIO_Pin_3                  0x0008
+#define GPIO_Pin_10                 0x0400
+#define GPIO_PinSource3             3
+#define GPIO_PinSource10            10
+#define GPIO_AF_SPI2                5
+#define RCC_AHB1Periph_GPIOB        0x0002
+#define RCC_AHB1Periph_GPIOC        0x0004
+#define RCC_AHB1Periph_GPIOE        0x0010
+#define RCC_APB2Periph_SYSCFG       0x4000
+#define RCC_APB1Periph_SPI2         0x4000
+
+typedef enum { GPIO_Mode_IN, GPIO_Mode_OUT, GPIO_Mode_AF, GPIO_Mode_AN } GPIOMode_TypeDef;
+typedef enum { GPIO_OType_PP, GPIO_OType_OD } GPIOOType_TypeDef;
+typedef enum { GPIO_PuPd_NOPULL, GPIO_PuPd_UP, GPIO_PuPd_DOWN } GPIOPuPd_TypeDef;
+typedef enum { GPIO_Speed_2MHz, GPIO_Speed_25MHz, GPIO_Speed_50MHz, GPIO_Speed_100MHz } GPIOSpeed_TypeDef;
+
+typedef struct {
+  uint32_t          GPIO_Pin;
+  GPIOMode_TypeDef  GPIO_Mode;
+  GPIOSpeed_TypeDef GPIO_Speed;
+  GPIOOType_TypeDef GPIO_OType;
+  GPIOPuPd_TypeDef  GPIO_PuPd;
+} GPIO_InitTypeDef;
+
+#define I2S_Mode_MasterRx           0x0300
+#define I2S_Standard_LSB            0x0020
+#define I2S_DataFormat_16b          0x0000
+#define I2S_MCLKOutput_Disable      0x0000
+#define I2S_CPOL_High               0x0008
+#define SPI_I2S_IT_RXNE             0x60
+
+typedef struct {
+  uint16_t I2S_Mode;
+  uint16_t I2S_Standard;
+  uint16_t I2S_DataFormat;
+  uint16_t I2S_MCLKOutput;
+  uint32_t I2S_AudioFreq;
+  uint16_t I2S_CPOL;
+} I2S_InitTypeDef;
+
+#define NVIC_PriorityGroup_3        0x400
+#define EXTI1_IRQn                  7
+#define SPI2_IRQn                   36
+
+#define EXTI_Line1                  0x0002
+#define EXTI_PortSourceGPIOE        4
+#define EXTI_PinSource1             1
+#define TIM_IT_CC1                  0x0002
+
+typedef enum { EXTI_Mode_Interrupt = 0x00 } EXTIMode_TypeDef;
+typedef enum { EXTI_Trigger_Rising = 0x08 } EXTITrigger_TypeDef;
+
+typedef struct {
+  uint32_t            EXTI_Line;
+  EXTIMode_TypeDef    EXTI_Mode;
+  EXTITrigger_TypeDef EXTI_Trigger;
+  FunctionalState     EXTI_LineCmd;
+} EXTI_InitTypeDef;
+
+typedef struct {
+  uint8_t         NVIC_IRQChannel;
+  uint8_t         NVIC_IRQChannelPreemptionPriority;
+  uint8_t         NVIC_IRQChannelSubPriority;
+  FunctionalState NVIC_IRQChannelCmd;
+} NVIC_InitTypeDef;
+
+static inline void RCC_AHB1PeriphClockCmd(uint32_t p, FunctionalState s) { (void)p; (void)s; }
+static inline void RCC_APB1PeriphClockCmd(uint32_t p, FunctionalState s) { (void)p; (void)s; }
+static inline void GPIO_Init(GPIO_TypeDef* g, GPIO_InitTypeDef* i) { (void)g; (void)i; }
+static inline void GPIO_PinAFConfig(GPIO_TypeDef* g, uint16_t s, uint8_t a) { (void)g; (void)s; (void)a; }
+static inline void SPI_I2S_DeInit(SPI_TypeDef* spi) { (void)spi; }
+static inline void I2S_Init(SPI_TypeDef* spi, I2S_InitTypeDef* i) { (void)spi; (void)i; }
+static inline void I2S_Cmd(SPI_TypeDef* spi, FunctionalState s) {
+  spi->I2SCFGR = s ? (spi->I2SCFGR | SPI_I2SCFGR_I2SE) : (spi->I2SCFGR & ~SPI_I2SCFGR_I2SE);
+}
+static inline void RCC_PLLI2SCmd(FunctionalState s) { (void)s; }
+static inline void RCC_PLLI2SConfig(uint32_t n, uint32_t r) {
+  RCC->PLLI2SCFGR = (n << 6) | (r << 28);
+}
+static inline FlagStatus RCC_GetFlagStatus(uint8_t f) { (void)f; return SET; }
+static inline void RCC_AHB2PeriphClockCmd(uint32_t p, FunctionalState s) { (void)p; (void)s; }
+static inline void RNG_Cmd(FunctionalState s) { (void)s; }
+static inline FlagStatus RNG_GetFlagStatus(uint8_t f) { (void)f; return SET; }
+static inline uint32_t RNG_GetRandomNumber(void) { return HOST_RNG_SEED; }
+static inline void SPI_I2S_ITConfig(SPI_TypeDef* spi, uint8_t it, FunctionalState s) { (void)spi; (void)it; (void)s; }
+static inline ITStatus SPI_GetITStatus(SPI_TypeDef* spi, uint8_t it) { (void)spi; (void)it; return RESET; }
+static inline uint16_t SPI_I2S_ReceiveData(SPI_TypeDef* spi) { return (uint16_t)spi->DR; }
+static inline void NVIC_PriorityGroupConfig(uint32_t g) { (void)g; }
+static inline void NVIC_Init(NVIC_InitTypeDef* i) { (void)i; }
+static inline void RCC_APB2PeriphClockCmd(uint32_t p, FunctionalState s) { (void)p; (void)s; }
+static inline void SYSCFG_EXTILineConfig(uint8_t p, uint8_t s) { (void)p; (void)s; }
+static inline void EXTI_Init(EXTI_InitTypeDef* i) { (void)i; }
+static inline void TIM_ITConfig(int tim, uint16_t it, FunctionalState s) { (void)tim; (void)it; (void)s; }
+
+/*
+ * The host has no interrupts: the sinks complete the blocks from the main
+ * loop.
+ */
+static inline void __disable_irq(void) { }
+static inline void __enable_irq(void) { }
+static inline uint32_t __ROR(uint32_t x, uint32_t n) { return (x >> n) | (x << (32 - n)); }
+static inline uint32_t __REV(uint32_t x) { return __builtin_bswap32(x); }
+
+#endif /* STM32F4XX_H_ */
@@ -0,0 +1,34 @@
+/**
+ * @file    usb_core.h
+ * @brief   Host (Linux) stand-in of the USB core header for the recorder
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The USB Key is an image file (diskio_img.c), always connected.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#ifndef USB_CORE_H_
+#define USB_CORE_H_
+
+#include <inttypes.h>
+
+/**
+ * @brief USB core handle.
+ */
+typedef struct {
+  uint8_t connected;  ///< The USB Key is present
+} USB_OTG_CORE_HANDLE;
+
+uint32_t HCD_IsDeviceConnected(USB_OTG_CORE_HANDLE* pdev);
+
+#endif /* USB_CORE_H_ */
@@ -0,0 +1,128 @@
+/**
+ * @file    pdm_ref.c
+ * @brief   Reference PDM to PCM filter (host build)
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details A plain implementation of the decimation by 64 done by the PDM
+ * filter library: a CIC of order PDM_REF_CIC_ORDER decimating by 32, a
+ * windowed sinc FIR decimating by 2 with the cut-off at LP_HZ, and a first
+ * order high-pass at HP_HZ. The bytes are taken in order, the first bit
+ * in time being the most significant one (the words of the SPI swapped
+ * with HTONS, as the recorder passes them). The CIC droop is not
+ * compensated: the filter stands in for the library in the cost and
+ * throughput measurements, not in the frequency response.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <math.h>
+#include <string.h>
+#include "pdm_filter.h"
+
+/**
+ * @addtogroup PDMREF
+ * @{
+ */
+
+#define PDM_REF_UNITY_GAIN  64  ///< MicGain of a full scale output
+
+/**
+ * @brief Initialize the filter from the parameters.
+ * @param Filter Filter with Fs, LP_HZ and HP_HZ set
+ */
+void PDM_Filter_Init(PDMFilter_InitStruct* Filter) {
+
+  float fc = Filter->LP_HZ / (2.0f * Filter->Fs); // at the FIR input rate
+  float sum = 0, n;
+  uint32_t i;
+
+  memset(Filter->integ, 0, sizeof(Filter->integ));
+  memset(Filter->comb, 0, sizeof(Filter->comb));
+  memset(Filter->hist, 0, sizeof(Filter->hist));
+
+  // Hamming windowed sinc
+  for (i = 0; i < PDM_REF_FIR_TAPS; i++) {
+    n = i - (PDM_REF_FIR_TAPS - 1) / 2.0f;
+    Filter->fir[i] = (n == 0) ? 2 * fc : sinf(2 * (float)M_PI * fc * n) / ((float)M_PI * n);
+    Filter->fir[i] *= 0.54f - 0.46f * cosf(2 * (float)M_PI * i / (PDM_REF_FIR_TAPS - 1));
+    sum += Filter->fir[i];
+  }
+  for (i = 0; i < PDM_REF_FIR_TAPS; i++) {
+    Filter->fir[i] /= sum;
+  }
+
+  Filter->hpAlpha = (Filter->HP_HZ > 0) ? 1.0f - 2 * (float)M_PI * Filter->HP_HZ / Filter->Fs : 1.0f;
+  Filter->hpIn = 0;
+  Filter->hpOut = 0;
+}
+
+/**
+ * @brief Filter one millisecond of PDM data.
+ * @param data Fs / 1000 x 8 bytes of PDM bits
+ * @param dataOut Fs / 1000 output samples
+ * @param MicGain Gain, PDM_REF_UNITY_GAIN gives full scale
+ * @param Filter Filter
+ * @return 0
+ */
+int32_t PDM_Filter_64_LSB(uint8_t* data, uint16_t* dataOut, uint16_t MicGain,
+    PDMFilter_InitStruct* Filter) {
+
+  const float scale = 32767.0f * MicGain / PDM_REF_UNITY_GAIN /
+      (float)(1UL << (5 * PDM_REF_CIC_ORDER)); // CIC gain 32^order
+  uint32_t out, half, byte, bit, k, len = Filter->Fs / 1000;
+  int32_t x, y, t;
+  float acc;
+
+  for (out = 0; out < len; out++) {
+    for (half = 0; half < 2; half++) {
+      // CIC: integrators at the bit rate (wrapping), combs at the output
+      for (byte = 0; byte < PDM_REF_CIC_DECIM / 8; byte++) {
+        for (bit = 0; bit < 8; bit++) {
+          x = ((*data >> (7 - bit)) & 1) ? 1 : -1;
+          for (k = 0; k < PDM_REF_CIC_ORDER; k++) {
+            x = (int32_t)((uint32_t)Filter->integ[k] + (uint32_t)x);
+            Filter->integ[k] = x;
+          }
+        }
+        data++;
+      }
+      y = Filter->integ[PDM_REF_CIC_ORDER - 1];
+      for (k = 0; k < PDM_REF_CIC_ORDER; k++) {
+        t = y;
+        y = (int32_t)((uint32_t)y - (uint32_t)Filter->comb[k]);
+        Filter->comb[k] = t;
+      }
+      memmove(Filter->hist, &Filter->hist[1], (PDM_REF_FIR_TAPS - 1) * sizeof(float));
+      Filter->hist[PDM_REF_FIR_TAPS - 1] = (float)y;
+    }
+
+    // FIR, one output for two CIC outputs
+    acc = 0;
+    for (k = 0; k < PDM_REF_FIR_TAPS; k++) {
+      acc += Filter->fir[k] * Filter->hist[k];
+    }
+
+    // DC removal
+    y = (int32_t)lrintf(acc * scale);
+    acc = (float)y - Filter->hpIn + Filter->hpAlpha * Filter->hpOut;
+    Filter->hpIn = (float)y;
+    Filter->hpOut = acc;
+
+    y = lrintf(acc);
+    dataOut[out] = (uint16_t)(int16_t)(y > 32767 ? 32767 : (y < -32768 ? -32768 : y));
+  }
+  return 0;
+}
+
+/**
+ * @}
+ */
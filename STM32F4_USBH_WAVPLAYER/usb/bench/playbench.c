@@ -0,0 +1,353 @@
+/**
+ * @file    playbench.c
+ * @brief   Host (Linux) capture of the playback chain
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details Plays a wave file of a disk image with WavePlayBack() of
+ * waveplayer.c on the host: FatFs reads the file from the image
+ * (../../fat_fs/bench/diskio_img.c), the player decodes IMA ADPCM,
+ * converts and dithers the samples and queues the blocks on its ring, and
+ * the host file sink of this file writes every block of audiosink.c to a
+ * file with stdio. The capture is the exact output of the pipeline: the
+ * words the I2S DMA would send, 16 bit samples or 24 bit samples in 32 bit
+ * words with the most significant half word first. For 16 bit PCM the
+ * capture is compared with the data chunk of the file, and its hash
+ * compares other formats between two builds.
+ *
+ * Usage: playbench [-p file] [-o capture] [-b bits] image
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "stm32f4xx.h"
+#include "usb_core.h"
+#include "ff.h"
+#include "diskio_img.h"
+#include "waveplayer.h"
+#include "audiosink.h"
+#include "dacout.h"
+#include "led.h"
+
+/**
+ * @addtogroup PLAYBENCH
+ * @{
+ */
+
+uint32_t        SystemCoreClock = HOST_CORE_CLOCK;
+CoreDebug_Type  HOST_CoreDebug;
+RCC_TypeDef     HOST_Rcc = { 8, 0, (258 << 6) | (3UL << 28) }; // PLLM, PLLI2S of the board
+SPI_TypeDef     HOST_Spi2, HOST_Spi3;
+GPIO_TypeDef    HOST_GpioB, HOST_GpioC, HOST_GpioE;
+
+/*
+ * Globals of the application used by the player
+ */
+__IO uint8_t        Command_index = 0;
+__IO uint8_t        Count;
+__IO uint8_t        RepeatState;
+__IO uint8_t        LED_Toggle1;
+__IO uint8_t        PauseResumeStatus = 1;
+uint32_t            AudioRemSize;
+uint8_t             WaveRecStatus;
+USB_OTG_CORE_HANDLE USB_OTG_Core = { 1 };
+FIL                 fileR;
+DIR                 dir;
+
+extern __IO uint32_t WaveCounter;
+extern __IO uint32_t PlayUnderruns;
+extern WAVE_FormatTypeDef WAVE_Format;
+
+static FATFS fs;                ///< Volume of the image
+static const char* hostPath;    ///< Capture file
+static FILE* hostFile;          ///< Capture, 0 if closed
+static uint16_t* hostBuf;       ///< Block waiting for SINK_Poll
+static uint32_t hostSize;       ///< Its size, 0 if none
+static uint64_t hostBytes;      ///< Bytes captured
+static uint64_t hostHash;       ///< FNV-1a hash of the capture
+
+/**
+ * @brief Host time in nanoseconds.
+ */
+static uint64_t HOST_Time(void) {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+DWT_Type* HOST_Dwt(void) {
+
+  static DWT_Type dwt;
+
+  dwt.CYCCNT = (uint32_t)(HOST_Time() * (HOST_CORE_CLOCK / 1000000) / 1000);
+  return &dwt;
+}
+
+uint32_t TIMER_GetTime(void) {
+
+  return (uint32_t)(HOST_Time() / 1000000);
+}
+
+void TIMER_Delay(uint32_t millis) {
+
+}
+
+uint32_t HCD_IsDeviceConnected(USB_OTG_CORE_HANDLE* pdev) {
+
+  return pdev->connected;
+}
+
+DWORD get_fattime(void) {
+
+  return ((DWORD)(2026 - 1980) << 25) | (10UL << 21) | (19UL << 16) | (12UL << 11);
+}
+
+/*
+ * The LEDs, the commands, the recorder and the DAC are not simulated
+ */
+void LED_Toggle(LED_Number_TypeDef led) {
+
+}
+
+void LED_ChangeState(LED_Number_TypeDef led, LED_State_TypeDef state) {
+
+}
+
+void commandCallback(void) {
+
+}
+
+const char* WaveRecorderFileName(void) {
+
+  return "0:rec.wav";
+}
+
+uint32_t DACOUT_Start(uint32_t freq, uint8_t volume, void (*done)(void)) {
+
+  return freq;
+}
+
+void DACOUT_Play(uint16_t* buf, uint32_t size) {
+
+}
+
+uint32_t DACOUT_Remaining(void) {
+
+  return 0;
+}
+
+void DACOUT_Pause(uint8_t resume) {
+
+}
+
+void DACOUT_Volume(uint8_t volume) {
+
+}
+
+void DACOUT_Stop(void) {
+
+}
+
+/**
+ * @brief Create the capture file.
+ * @param freq Sampling frequency (unused)
+ * @param bits Bits per sample (unused, the blocks are written as they are)
+ * @param volume Volume (unused, the capture is bit-exact)
+ * @return 0 if OK
+ */
+static uint8_t PLAYBENCH_SinkInit(uint32_t freq, uint8_t bits, uint8_t volume) {
+
+  hostSize = 0;
+  hostBytes = 0;
+  hostHash = 14695981039346656037ULL;
+  hostFile = fopen(hostPath, "wb");
+  return hostFile ? 0 : 1;
+}
+
+/**
+ * @brief Queue a block for SINK_Poll.
+ * @param buf Block
+ * @param size Size in bytes
+ */
+static void PLAYBENCH_SinkPlay(uint16_t* buf, uint32_t size) {
+
+  hostBuf = buf;
+  hostSize = size;
+}
+
+/**
+ * @brief Get the rest of the block.
+ * @return Size of the block waiting for SINK_Poll
+ */
+static uint32_t PLAYBENCH_SinkRemaining(void) {
+
+  return hostSize;
+}
+
+/**
+ * @brief Write the waiting block to the capture file.
+ */
+static void PLAYBENCH_SinkPoll(void) {
+
+  const uint8_t* p = (const uint8_t*)hostBuf;
+  uint32_t i;
+
+  if (hostSize == 0) {
+    return;
+  }
+  if (fwrite(hostBuf, 1, hostSize, hostFile) != hostSize) {
+    perror(hostPath);
+    exit(1);
+  }
+  for (i = 0; i < hostSize; i++) {
+    hostHash = (hostHash ^ p[i]) * 1099511628211ULL;
+  }
+  hostBytes += hostSize;
+  hostSize = 0;
+  SINK_BlockDone();
+}
+
+/**
+ * @brief Close the capture file.
+ */
+static void PLAYBENCH_SinkStop(void) {
+
+  hostSize = 0;
+  if (hostFile) {
+    fclose(hostFile);
+    hostFile = 0;
+  }
+}
+
+/**
+ * @brief Host file sink, the widest samples are set by -b.
+ */
+static SINK_TypeDef PLAYBENCH_Sink = {
+  "HOST", 24, PLAYBENCH_SinkInit, PLAYBENCH_SinkPlay, PLAYBENCH_SinkRemaining, 0,
+  0, PLAYBENCH_SinkPoll, PLAYBENCH_SinkStop
+};
+
+/**
+ * @brief Compare the capture with the data chunk of the file.
+ * @param path Capture file
+ * @return 0 if they are the same
+ */
+static int PLAYBENCH_Compare(const char* path) {
+
+  static uint8_t a[4096], b[4096];
+  FILE* cap;
+  UINT n;
+  size_t m;
+  int diff = 0;
+
+  cap = fopen(path, "rb");
+  if (!cap || (f_lseek(&fileR, WaveCounter) != FR_OK)) {
+    return -1;
+  }
+  do {
+    if (f_read(&fileR, a, sizeof(a), &n) != FR_OK) {
+      diff = -1;
+      break;
+    }
+    m = fread(b, 1, sizeof(b), cap);
+    if ((m != n) || memcmp(a, b, n)) {
+      diff = 1;
+      break;
+    }
+  } while (n);
+  fclose(cap);
+  return diff;
+}
+
+/**
+ * @brief Print the usage.
+ */
+static void PLAYBENCH_Usage(void) {
+
+  fprintf(stderr,
+      "usage: playbench [options] image\n"
+      "  -p file   wave file of the image (0:rec.wav)\n"
+      "  -o file   capture (play.raw)\n"
+      "  -b bits   widest samples taken by the sink, 16 or 24 (24)\n");
+}
+
+int main(int argc, char* argv[]) {
+
+  char* name = "0:rec.wav";
+  uint32_t start, time, status;
+  int opt, same = -1;
+
+  hostPath = "play.raw";
+  while ((opt = getopt(argc, argv, "p:o:b:")) != -1) {
+    switch (opt) {
+    case 'p': name     = optarg; break;
+    case 'o': hostPath = optarg; break;
+    case 'b': PLAYBENCH_Sink.maxBits = strtoul(optarg, 0, 0); break;
+    default:
+      PLAYBENCH_Usage();
+      return 2;
+    }
+  }
+  if ((optind != argc - 1) || ((PLAYBENCH_Sink.maxBits != 16) && (PLAYBENCH_Sink.maxBits != 24))) {
+    PLAYBENCH_Usage();
+    return 2;
+  }
+
+  if (IMG_Open(argv[optind], 0, 0)) {
+    perror(argv[optind]);
+    return 1;
+  }
+  f_mount(0, &fs);
+  status = WavePlayerOpen(name);
+  if (status) {
+    fprintf(stderr, "%s: %s\n", name, status == 1 ? "cannot open" : "not a supported wave file");
+    IMG_Close();
+    return 1;
+  }
+
+  SINK_SelectSink(&PLAYBENCH_Sink);
+  memset(&IMG_Stats, 0, sizeof(IMG_Stats));
+  start = TIMER_GetTime();
+  WavePlayBack(WAVE_Format.SampleRate);
+  time = TIMER_GetTime() - start;
+
+  if ((WAVE_Format.FormatTag == WAVE_FORMAT_PCM) && (WAVE_Format.BitsPerSample == 16)) {
+    same = PLAYBENCH_Compare(hostPath);
+  }
+
+  printf("%s: %u Hz, %u ch, %u bits, format 0x%04x, %u data bytes\n\n", name,
+      (unsigned)WAVE_Format.SampleRate, (unsigned)WAVE_Format.NumChannels,
+      (unsigned)WAVE_Format.BitsPerSample, (unsigned)WAVE_Format.FormatTag,
+      (unsigned)WAVE_Format.DataSize);
+  printf("captured         %10llu bytes (%s)\n", (unsigned long long)hostBytes, hostPath);
+  printf("hash             %016llx\n", (unsigned long long)hostHash);
+  printf("data chunk       %s\n", same < 0 ? "not compared (16 bit PCM only)" :
+      same ? "DIFFERENT" : "same");
+  printf("run              %10u ms\n", (unsigned)time);
+  printf("underruns        %10u\n", (unsigned)PlayUnderruns);
+  printf("disk reads       %10u calls %10u sectors\n",
+      (unsigned)IMG_Stats.rdCalls, (unsigned)IMG_Stats.rdSectors);
+
+  f_mount(0, NULL);
+  IMG_Close();
+  return same > 0;
+}
+
+/**
+ * @}
+ */
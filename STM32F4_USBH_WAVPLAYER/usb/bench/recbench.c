@@ -0,0 +1,218 @@
+/**
+ * @file    recbench.c
+ * @brief   Host (Linux) benchmark of the recording chain
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details Runs WaveRecorderBench() of waverecorder.c on the host: the
+ * synthetic PDM bitstream of pdmsim goes through the reference filter
+ * (pdm_ref.c in place of the PDM filter library), the decimator and the
+ * processing of the recorder, and the file is written with FatFs to a disk
+ * image (../../fat_fs/bench/diskio_img.c). The peripherals are replaced by
+ * the structures of host/stm32f4xx.h. The cycle counts are host time
+ * scaled to HOST_CORE_CLOCK, so they compare configurations, not the
+ * Cortex-M4.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "stm32f4xx.h"
+#include "usb_core.h"
+#include "ff.h"
+#include "diskio_img.h"
+#include "waverecorder.h"
+#include "wavemonitor.h"
+#include "led.h"
+
+/**
+ * @addtogroup RECBENCH
+ * @{
+ */
+
+uint32_t        SystemCoreClock = HOST_CORE_CLOCK;
+CoreDebug_Type  HOST_CoreDebug;
+RCC_TypeDef     HOST_Rcc = { 8, 0, (258 << 6) | (3UL << 28) }; // PLLM, PLLI2S of the board
+SPI_TypeDef     HOST_Spi2, HOST_Spi3;
+GPIO_TypeDef    HOST_GpioB, HOST_GpioC;
+
+/*
+ * Globals of the player used by the recorder
+ */
+__IO uint32_t       Time_Rec_Base;
+__IO uint8_t        Command_index = 1;
+USB_OTG_CORE_HANDLE USB_OTG_Core = { 1 };
+__IO uint32_t       WaveCounter;
+FIL                 file;
+__IO uint8_t        LED_Toggle1;
+
+static FATFS fs; ///< Volume of the image
+
+/**
+ * @brief Host time in nanoseconds.
+ */
+static uint64_t HOST_Time(void) {
+
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+DWT_Type* HOST_Dwt(void) {
+
+  static DWT_Type dwt;
+
+  dwt.CYCCNT = (uint32_t)(HOST_Time() * (HOST_CORE_CLOCK / 1000000) / 1000);
+  return &dwt;
+}
+
+uint32_t TIMER_GetTime(void) {
+
+  return (uint32_t)(HOST_Time() / 1000000);
+}
+
+uint32_t HCD_IsDeviceConnected(USB_OTG_CORE_HANDLE* pdev) {
+
+  return pdev->connected;
+}
+
+DWORD get_fattime(void) {
+
+  return ((DWORD)(2026 - 1980) << 25) | (10UL << 21) | (19UL << 16) | (12UL << 11);
+}
+
+/*
+ * The monitor, the LEDs and the commands are not simulated
+ */
+void MONITOR_Start(uint32_t freq) {
+
+}
+
+void MONITOR_Stop(void) {
+
+}
+
+void MONITOR_Write(uint16_t* pcm, uint32_t len) {
+
+}
+
+void LED_Toggle(LED_Number_TypeDef led) {
+
+}
+
+void commandCallback(void) {
+
+}
+
+/**
+ * @brief Print the usage.
+ */
+static void RECBENCH_Usage(void) {
+
+  fprintf(stderr,
+      "usage: recbench [options] image\n"
+      "  -f MB     create the image and format it (f_mkfs), implies -w\n"
+      "  -w        write the changes to the image (default: private copy)\n"
+      "  -r Hz     sampling rate (16000)\n"
+      "  -c ch     channels (1)\n"
+      "  -b bits   bits per sample (16)\n"
+      "  -a        IMA ADPCM\n"
+      "  -t ms     audio recorded (10000)\n"
+      "  -g s      segments of s seconds (0: one file)\n"
+      "  -s %%      PDM data rate in percent of real time (0: as fast as possible)\n");
+}
+
+int main(int argc, char* argv[]) {
+
+  WaveRecorder_ConfigTypeDef config = { 16000, 1, 16, WAVE_FORMAT_PCM };
+  WaveRecorder_BenchTypeDef stats;
+  uint32_t formatMB = 0, audioTime = 10000, speed = 0;
+  uint8_t writeBack = 0;
+  FRESULT res;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:wr:c:b:at:g:s:")) != -1) {
+    switch (opt) {
+    case 'f': formatMB  = strtoul(optarg, 0, 0); break;
+    case 'w': writeBack = 1; break;
+    case 'r': config.SampleRate    = strtoul(optarg, 0, 0); break;
+    case 'c': config.NbrChannels   = strtoul(optarg, 0, 0); break;
+    case 'b': config.BitsPerSample = strtoul(optarg, 0, 0); break;
+    case 'a': config.FormatTag     = WAVE_FORMAT_IMA_ADPCM; break;
+    case 't': audioTime = strtoul(optarg, 0, 0); break;
+    case 'g': WaveRecorderSetSegment(strtoul(optarg, 0, 0)); break;
+    case 's': speed     = strtoul(optarg, 0, 0); break;
+    default:
+      RECBENCH_Usage();
+      return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    RECBENCH_Usage();
+    return 2;
+  }
+  if (WaveRecorderConfig(&config)) {
+    fprintf(stderr, "configuration not supported\n");
+    return 2;
+  }
+
+  if (IMG_Open(argv[optind], formatMB, writeBack || formatMB)) {
+    perror(argv[optind]);
+    return 1;
+  }
+  f_mount(0, &fs);
+  if (formatMB) {
+    res = f_mkfs(0, 0, 0);
+    if (res != FR_OK) {
+      fprintf(stderr, "f_mkfs: error %d\n", res);
+      IMG_Close();
+      return 1;
+    }
+  }
+
+  memset(&IMG_Stats, 0, sizeof(IMG_Stats));
+  if (WaveRecorderBench(audioTime, speed, &stats)) {
+    fprintf(stderr, "%s: cannot create the recording\n", WaveRecorderFileName());
+    IMG_Close();
+    return 1;
+  }
+
+  printf("%u Hz, %u ch, %u bits, %s, %s\n\n", (unsigned)config.SampleRate,
+      (unsigned)config.NbrChannels, (unsigned)config.BitsPerSample,
+      config.FormatTag == WAVE_FORMAT_IMA_ADPCM ? "IMA ADPCM" : "PCM",
+      WaveRecorderFileName());
+  printf("audio            %10u ms\n", (unsigned)stats.AudioTime);
+  printf("run              %10u ms\n", (unsigned)stats.RunTime);
+  printf("filter           %10u cycles/s\n", (unsigned)stats.FilterCycles);
+  printf("process          %10u cycles/s\n", (unsigned)stats.ProcessCycles);
+  printf("write            %10u ms/s\n", (unsigned)stats.WriteTime);
+  printf("longest write    %10u ms\n", (unsigned)stats.MaxWriteTime);
+  printf("highest rate     %10u Hz\n", (unsigned)stats.MaxRate);
+  printf("overruns         %10u blocks\n", (unsigned)stats.Overruns);
+  printf("disk reads       %10u calls %10u sectors\n",
+      (unsigned)IMG_Stats.rdCalls, (unsigned)IMG_Stats.rdSectors);
+  printf("disk writes      %10u calls %10u sectors\n",
+      (unsigned)IMG_Stats.wrCalls, (unsigned)IMG_Stats.wrSectors);
+  printf("syncs            %10u\n", (unsigned)IMG_Stats.syncs);
+
+  f_mount(0, NULL);
+  IMG_Close();
+  return 0;
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,301 @@
+/**
+ * @file    dacout.c
+ * @brief   Audio output through the on-chip DAC
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details TIM6 runs at the sampling frequency and its update event
+ * triggers DAC channel 1, which requests the next sample from DMA1
+ * stream 5. The stream alternates between two buffers of DACOUT_FRAMES
+ * samples (double buffer mode): when it switches, the transfer complete
+ * interrupt converts the next part of the current block into the buffer
+ * it has just left. When a block is used up the completion callback is
+ * called, which hands over the next one. If there is none the output
+ * stays at mid-scale. The conversion mixes the stereo pair to mono,
+ * applies the volume, adds triangular dither of one 12 bit step and
+ * produces the unsigned left aligned value of DHR12L1, two frames per
+ * iteration. The codec is not used, the output is the PA4 pin.
+ * The rate is the timer clock divided by an integer, e.g. 44092 Hz for
+ * 44.1 kHz with an 84 MHz timer clock.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stm32f4xx.h>
+#include <dacout.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#define DACOUT_MIX(pair, gain)  ((int32_t)__SMUAD((pair), (gain)))
+#define DACOUT_SAT16(x)         ((int32_t)__SSAT((x), 16))
+#define DACOUT_PACK(lo, hi)     __PKHBT((lo), (hi), 16)
+#else
+#define DACOUT_MIX(pair, gain)  ((int32_t)(int16_t)(pair) * (int16_t)(gain) + \
+    (int32_t)(int16_t)((pair) >> 16) * (int16_t)((gain) >> 16))
+#define DACOUT_SAT16(x)         ((x) > 32767 ? 32767 : ((x) < -32768 ? -32768 : (x)))
+#define DACOUT_PACK(lo, hi)     (((uint32_t)(lo) & 0xFFFF) | ((uint32_t)(hi) << 16))
+#endif
+
+/**
+ * @addtogroup DACOUT
+ * @{
+ */
+
+#define DACOUT_DMA_STREAM   DMA1_Stream5          ///< DAC channel 1 request
+#define DACOUT_DMA_CHANNEL  DMA_Channel_7
+#define DACOUT_DMA_IRQ      DMA1_Stream5_IRQn
+#define DACOUT_DMA_FLAG_TC  DMA_FLAG_TCIF5
+#define DACOUT_DMA_FLAGS    (DMA_FLAG_TCIF5 | DMA_FLAG_HTIF5 | DMA_FLAG_TEIF5 | \
+                             DMA_FLAG_DMEIF5 | DMA_FLAG_FEIF5)
+#define DACOUT_IRQHandler   DMA1_Stream5_IRQHandler
+#define DACOUT_MIDSCALE     0x8000                ///< Silence (unsigned, left aligned)
+#define DACOUT_MASK         0xFFF0                ///< Bits converted by the DAC
+
+static uint16_t dacoutBuf[2][DACOUT_FRAMES] __attribute__ ((aligned (4)));
+static const uint16_t* volatile dacoutSrc;    ///< Block being converted
+static volatile uint32_t dacoutLen;           ///< Frames in the block
+static volatile uint32_t dacoutPos;           ///< Next frame of the block
+static void (*dacoutDone)(void);              ///< Block completion callback
+static uint32_t dacoutGain;                   ///< Volume of both channels (Q15 / 2)
+static uint32_t dacoutSeed = 1;               ///< State of the dither generator
+
+/**
+ * @brief Convert stereo frames to DAC samples.
+ * @details The output of a frame is (L + R) / 2 scaled by the volume,
+ * plus triangular dither of +/- one 12 bit step, saturated and offset
+ * to unsigned.
+ * @param out DAC samples, 32-bit aligned
+ * @param in 16 bit stereo frames, 32-bit aligned
+ * @param frames Number of frames (even)
+ */
+void DACOUT_Convert(uint16_t* out, const uint16_t* in, uint32_t frames) {
+
+  const uint32_t* pairs = (const uint32_t*)in;
+  uint32_t* words = (uint32_t*)out;
+  uint32_t gain = dacoutGain, seed = dacoutSeed;
+  int32_t lo, hi;
+
+  for (frames >>= 1; frames; frames--) {
+    // two uniform values of -8..7 per frame, their sum is triangular
+    seed = seed * 1664525UL + 1013904223UL;
+    lo = (DACOUT_MIX(pairs[0], gain) >> 15) + ((int32_t)(seed << 16) >> 28) +
+        ((int32_t)seed >> 28) + 8;
+    seed = seed * 1664525UL + 1013904223UL;
+    hi = (DACOUT_MIX(pairs[1], gain) >> 15) + ((int32_t)(seed << 16) >> 28) +
+        ((int32_t)seed >> 28) + 8;
+    pairs += 2;
+
+    lo = (DACOUT_SAT16(lo) + DACOUT_MIDSCALE) & DACOUT_MASK;
+    hi = (DACOUT_SAT16(hi) + DACOUT_MIDSCALE) & DACOUT_MASK;
+    *words++ = DACOUT_PACK(lo, hi);
+  }
+  dacoutSeed = seed;
+}
+
+/**
+ * @brief Fill a DMA buffer from the queued blocks.
+ * @param out DMA buffer
+ */
+static void DACOUT_Fill(uint16_t* out) {
+
+  uint32_t left = DACOUT_FRAMES, n;
+
+  while (left) {
+    if (dacoutPos >= dacoutLen) {
+      if (dacoutSrc == 0) {
+        break;
+      }
+      dacoutSrc = 0;
+      if (dacoutDone) {
+        dacoutDone(); // may hand over the next block
+      }
+      continue;
+    }
+    n = dacoutLen - dacoutPos;
+    n = (n > left) ? left : n;
+    DACOUT_Convert(out, dacoutSrc + dacoutPos * 2, n);
+    dacoutPos += n;
+    out += n;
+    left -= n;
+  }
+  while (left--) {
+    *out++ = DACOUT_MIDSCALE;
+  }
+}
+
+/**
+ * @brief Start the output.
+ * @details Plays silence until the first block is handed over.
+ * @param freq Sampling frequency
+ * @param volume Volume (0-100)
+ * @param done Called from the DMA interrupt when a block has been
+ * converted, it may call DACOUT_Play
+ * @return Actual sampling frequency
+ */
+uint32_t DACOUT_Start(uint32_t freq, uint8_t volume, void (*done)(void)) {
+
+  GPIO_InitTypeDef GPIO_InitStructure;
+  DAC_InitTypeDef DAC_InitStructure;
+  DMA_InitTypeDef DMA_InitStructure;
+  TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
+  RCC_ClocksTypeDef clocks;
+  uint32_t timClock, period, i;
+
+  DACOUT_Stop();
+  dacoutDone = done;
+  dacoutSrc = 0;
+  dacoutLen = 0;
+  dacoutPos = 0;
+  DACOUT_Volume(volume);
+  for (i = 0; i < DACOUT_FRAMES; i++) {
+    dacoutBuf[0][i] = DACOUT_MIDSCALE;
+    dacoutBuf[1][i] = DACOUT_MIDSCALE;
+  }
+
+  RCC_AHB1PeriphClockCmd(RCC_AHB1Periph_DMA1 | RCC_AHB1Periph_GPIOA, ENABLE);
+  RCC_APB1PeriphClockCmd(RCC_APB1Periph_DAC | RCC_APB1Periph_TIM6, ENABLE);
+
+  // DAC_OUT1 (the I2S3 WS pin of the codec)
+  GPIO_InitStructure.GPIO_Pin = GPIO_Pin_4;
+  GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AN;
+  GPIO_InitStructure.GPIO_PuPd = GPIO_PuPd_NOPULL;
+  GPIO_Init(GPIOA, &GPIO_InitStructure);
+
+  DAC_InitStructure.DAC_Trigger = DAC_Trigger_T6_TRGO;
+  DAC_InitStructure.DAC_WaveGeneration = DAC_WaveGeneration_None;
+  DAC_InitStructure.DAC_LFSRUnmask_TriangleAmplitude = DAC_LFSRUnmask_Bit0;
+  DAC_InitStructure.DAC_OutputBuffer = DAC_OutputBuffer_Enable;
+  DAC_Init(DAC_Channel_1, &DAC_InitStructure);
+  DAC_SetChannel1Data(DAC_Align_12b_L, DACOUT_MIDSCALE);
+  DAC_Cmd(DAC_Channel_1, ENABLE);
+
+  // Two buffers, the stream switches between them by itself
+  DMA_DeInit(DACOUT_DMA_STREAM);
+  DMA_InitStructure.DMA_Channel = DACOUT_DMA_CHANNEL;
+  DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&DAC->DHR12L1;
+  DMA_InitStructure.DMA_Memory0BaseAddr = (uint32_t)dacoutBuf[0];
+  DMA_InitStructure.DMA_DIR = DMA_DIR_MemoryToPeripheral;
+  DMA_InitStructure.DMA_BufferSize = DACOUT_FRAMES;
+  DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+  DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+  DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+  DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+  DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;
+  DMA_InitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_HalfFull;
+  DMA_InitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
+  DMA_InitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;
+  DMA_Init(DACOUT_DMA_STREAM, &DMA_InitStructure);
+  DMA_DoubleBufferModeConfig(DACOUT_DMA_STREAM, (uint32_t)dacoutBuf[1], DMA_Memory_0);
+  DMA_DoubleBufferModeCmd(DACOUT_DMA_STREAM, ENABLE);
+  DMA_ITConfig(DACOUT_DMA_STREAM, DMA_IT_TC, ENABLE);
+
+  NVIC_InitStructure.NVIC_IRQChannel = DACOUT_DMA_IRQ;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = DACOUT_IRQ_PREPRIO;
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = DACOUT_IRQ_SUBPRIO;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+
+  DMA_Cmd(DACOUT_DMA_STREAM, ENABLE);
+  DAC_DMACmd(DAC_Channel_1, ENABLE);
+
+  // The timers of APB1 run at twice its clock when it is divided
+  RCC_GetClocksFreq(&clocks);
+  timClock = clocks.PCLK1_Frequency;
+  if (clocks.PCLK1_Frequency != clocks.HCLK_Frequency) {
+    timClock *= 2;
+  }
+  period = (timClock + freq / 2) / freq;
+
+  TIM_TimeBaseStructInit(&TIM_TimeBaseStructure);
+  TIM_TimeBaseStructure.TIM_Period = period - 1;
+  TIM_TimeBaseStructure.TIM_Prescaler = 0;
+  TIM_TimeBaseInit(TIM6, &TIM_TimeBaseStructure);
+  TIM_SelectOutputTrigger(TIM6, TIM_TRGOSource_Update);
+  TIM_Cmd(TIM6, ENABLE);
+
+  return timClock / period;
+}
+
+/**
+ * @brief Queue a block.
+ * @details Called from the completion callback or with the interrupts
+ * disabled. The block is converted by the following DMA interrupts.
+ * @param buf 16 bit stereo frames
+ * @param size Size in bytes
+ */
+void DACOUT_Play(uint16_t* buf, uint32_t size) {
+
+  dacoutPos = 0;
+  dacoutLen = (size / 4) & ~1; // pairs of frames
+  dacoutSrc = buf;
+}
+
+/**
+ * @brief Get the rest of the block.
+ * @return Bytes not converted yet
+ */
+uint32_t DACOUT_Remaining(void) {
+
+  uint32_t len = dacoutLen, pos = dacoutPos;
+
+  return (dacoutSrc && (pos < len)) ? (len - pos) * 4 : 0;
+}
+
+/**
+ * @brief Pause or resume the output.
+ * @details The timer is stopped, the DAC holds the last sample.
+ * @param resume 0 to pause, 1 to resume
+ */
+void DACOUT_Pause(uint8_t resume) {
+  TIM_Cmd(TIM6, resume ? ENABLE : DISABLE);
+}
+
+/**
+ * @brief Set the volume.
+ * @param volume Volume (0-100)
+ */
+void DACOUT_Volume(uint8_t volume) {
+
+  uint32_t gain = ((uint32_t)(volume > 100 ? 100 : volume) * 16384) / 100;
+
+  dacoutGain = (gain << 16) | gain;
+}
+
+/**
+ * @brief Stop the output.
+ */
+void DACOUT_Stop(void) {
+
+  TIM_Cmd(TIM6, DISABLE);
+  DMA_Cmd(DACOUT_DMA_STREAM, DISABLE);
+  DMA_ClearFlag(DACOUT_DMA_STREAM, DACOUT_DMA_FLAGS);
+  DAC_DMACmd(DAC_Channel_1, DISABLE);
+  DAC_Cmd(DAC_Channel_1, DISABLE);
+  dacoutSrc = 0;
+  dacoutDone = 0;
+}
+
+/**
+ * @brief Refill the buffer the DMA has just left.
+ */
+void DACOUT_IRQHandler(void) {
+
+  if (DMA_GetFlagStatus(DACOUT_DMA_STREAM, DACOUT_DMA_FLAG_TC) != RESET) {
+    DMA_ClearFlag(DACOUT_DMA_STREAM, DACOUT_DMA_FLAG_TC);
+    DACOUT_Fill(dacoutBuf[DMA_GetCurrentMemoryTarget(DACOUT_DMA_STREAM) ? 0 : 1]);
+  }
+}
+
+/**
+ * @}
+ */
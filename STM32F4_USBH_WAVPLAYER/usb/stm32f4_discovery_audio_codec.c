@@ -126,6 +126,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32f4_discovery_audio_codec.h"
+#include "i2sclk.h"
 
 /** @addtogroup Utilities
   * @{
@@ -144,6 +145,21 @@
 /** @defgroup STM32F4_DISCOVERY_AUDIO_CODEC_Private_Types
   * @{
   */ 
+/* One queued codec register write */
+typedef struct
+{
+  uint8_t Reg;                    /* Register address */
+  uint8_t Value;                  /* Register value */
+  uint8_t Last;                   /* Last write of its batch */
+  Codec_BatchCallback Callback;   /* Called after the last write of the batch */
+} Codec_WriteTypeDef;
+
+/* Register writes collected before they are queued together */
+typedef struct
+{
+  uint32_t Count;                       /* Number of writes */
+  uint8_t  Regs[2 * CODEC_BATCH_SIZE];  /* Register address and value pairs */
+} Codec_BatchTypeDef;
 /**
   * @}
   */ 
@@ -174,6 +190,19 @@
 
 /* The 7 bits Codec address (sent through I2C interface) */
 #define CODEC_ADDRESS                   0x94  /* b00100111 */
+
+/* Steps of a queued register write in the I2C event interrupt */
+#define CODEC_STEP_IDLE                 0     /* No write on the bus */
+#define CODEC_STEP_START                1     /* Waiting for the start condition (EV5) */
+#define CODEC_STEP_ADDRESS              2     /* Waiting for the address acknowledge (EV6) */
+#define CODEC_STEP_VALUE                3     /* Register address sent (EV8) */
+#define CODEC_STEP_STOP                 4     /* Value sent, waiting for BTF (EV8_2) */
+
+/* I2C interrupts used by the queue */
+#define CODEC_I2C_IT                    (I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR)
+
+/* Number of codec registers kept in RAM (0x00 to 0x34) */
+#define CODEC_REG_COUNT                 0x35
 /**
   * @}
   */ 
@@ -201,6 +230,28 @@ __IO uint8_t OutputDev = 0;
 
 
 __IO uint32_t CurrAudioInterface = AUDIO_INTERFACE_I2S; //AUDIO_INTERFACE_DAC
+__IO uint32_t CurrDataFormat = AUDIO_FORMAT_16B; //AUDIO_FORMAT_24B
+
+/* Queue of the codec register writes sent by the I2C interrupt. The indexes
+   run freely, the entry is the index modulo CODEC_QUEUE_SIZE. */
+static Codec_WriteTypeDef CodecQueue[CODEC_QUEUE_SIZE];
+static __IO uint32_t CodecQueueHead = 0;      /* Next free entry */
+static __IO uint32_t CodecQueueTail = 0;      /* Entry on the bus */
+static __IO uint8_t  CodecStep = CODEC_STEP_IDLE;
+static __IO uint32_t CodecErrorCount = 0;     /* Aborted batches */
+static __IO uint32_t CodecWriteTicks = 0;     /* Ticks since the write was started */
+static __IO uint8_t  CodecStopPending = 0;    /* Stop waiting for the codec power down */
+static __IO uint32_t CodecStopMode = CODEC_PDWN_SW;
+
+/* Sampling frequency of the stream and the I2S clock setting giving it */
+static uint32_t CodecAudioFreq = 0;
+static I2SCLK_PlanTypeDef CodecClockPlan;
+
+/* Copy of the codec registers: the last value queued for each register. A 
+   register is valid once written after the codec reset, and invalid again if
+   its write was aborted. */
+static uint8_t CodecShadow[CODEC_REG_COUNT];
+static __IO uint8_t CodecShadowValid[CODEC_REG_COUNT];
 /**
   * @}
   */ 
@@ -227,6 +278,19 @@ static uint32_t Codec_PauseResume(uint32_t Cmd);
 static uint32_t Codec_Stop(uint32_t Cmd);
 static uint32_t Codec_VolumeCtrl(uint8_t Volume);
 static uint32_t Codec_Mute(uint32_t Cmd);
+static void     Codec_StopDone(uint32_t Status);
+/* Codec register batches */
+static void     Codec_BatchAdd(Codec_BatchTypeDef* Batch, uint8_t RegisterAddr, uint8_t RegisterValue);
+static void     Codec_BatchForce(Codec_BatchTypeDef* Batch, uint8_t RegisterAddr, uint8_t RegisterValue);
+static void     Codec_VolumeRegs(Codec_BatchTypeDef* Batch, uint8_t Volume);
+static void     Codec_MuteRegs(Codec_BatchTypeDef* Batch, uint32_t Cmd);
+static uint32_t Codec_QueueWrites(const uint8_t* pRegs, uint32_t Count, Codec_BatchCallback Callback);
+static uint32_t Codec_QueueNext(void);
+static void     Codec_QueueStart(uint32_t Tail);
+static void     Codec_QueueDone(uint32_t Status);
+static void     Codec_QueueFlush(void);
+static void     Codec_ShadowSet(uint8_t RegisterAddr, uint8_t RegisterValue);
+static void     Codec_ShadowClear(void);
 /* Low layer codec functions */
 static void     Codec_CtrlInterface_Init(void);
 static void     Codec_CtrlInterface_DeInit(void);
@@ -262,6 +326,17 @@ static void     Audio_MAL_Stop(void);
  uint32_t AUDIO_MAL_DMA_FLAG_TE  = AUDIO_I2S_DMA_FLAG_TE;
  uint32_t AUDIO_MAL_DMA_FLAG_DME = AUDIO_I2S_DMA_FLAG_DME;
 
+/**
+  * @brief  Set the audio data format of the I2S interface, used by the next
+  *         EVAL_AUDIO_Init().
+  * @param  DataFormat: AUDIO_FORMAT_16B or AUDIO_FORMAT_24B
+  * @retval None
+  */
+void EVAL_AUDIO_SetDataFormat(uint32_t DataFormat)
+{
+  CurrDataFormat = DataFormat;
+}
+
 /**
   * @brief  Set the current audio interface (I2S or DAC).
   * @param  Interface: AUDIO_INTERFACE_I2S or AUDIO_INTERFACE_DAC
@@ -352,6 +427,9 @@ uint32_t EVAL_AUDIO_DeInit(void)
   */
 uint32_t EVAL_AUDIO_Play(uint16_t* pBuffer, uint32_t Size)
 {
+  /* A power down still on the bus must not stop this stream */
+  CodecStopPending = 0;
+
   /* Set the total number of data to be played (count in half-word) */
   AudioTotalSize = Size;
 
@@ -407,23 +485,28 @@ uint32_t EVAL_AUDIO_PauseResume(uint32_t Cmd)
   *                            Then no need to reconfigure the Codec after power on.
   *           - CODEC_PDWN_HW: completely shut down the codec (physically). 
   *                            Then need to reconfigure the Codec after power on.  
-  * @retval 0 if correct communication, else wrong communication
+  * @note   The DMA stops at once. The audio interface keeps clocking the codec
+  *         until it has powered down, then it is stopped by Codec_StopDone().
+  * @retval 0 if the power down was queued, else the audio interface is stopped
+  *         without powering down the codec.
   */
 uint32_t EVAL_AUDIO_Stop(uint32_t Option)
 {
+  /* Stop feeding the audio interface */
+  DMA_Cmd(AUDIO_MAL_DMA_STREAM, DISABLE);
+  
+  /* Update the remaining data number */
+  AudioRemSize = AudioTotalSize;    
+  
   /* Call Audio Codec Stop function */
   if (Codec_Stop(Option) != 0)
   {
+    /* No room in the queue: call Media layer Stop function now */
+    Audio_MAL_Stop();
     return 1;
   }
   else
   {
-    /* Call Media layer Stop function */
-    Audio_MAL_Stop();
-    
-    /* Update the remaining data number */
-    AudioRemSize = AudioTotalSize;    
-    
     /* Return 0 when all operations are correctly done */
     return 0;
   }
@@ -453,6 +536,101 @@ uint32_t EVAL_AUDIO_Mute(uint32_t Cmd)
   return (Codec_Mute(Cmd));
 }
 
+/**
+  * @brief  Queues a batch of codec register writes. The writes are sent in 
+  *         order by the I2C interrupt, after the batches queued before.
+  * @param  pRegs: Register address and value pairs.
+  * @param  Count: Number of writes (pairs), up to CODEC_QUEUE_SIZE.
+  * @param  Callback: Called from the I2C interrupt when the batch is done or 
+  *         aborted (may be 0).
+  * @retval 0 if the batch was queued, 1 if the queue has no room for it
+  */
+uint32_t EVAL_AUDIO_WriteRegisters(const uint8_t* pRegs, uint32_t Count, Codec_BatchCallback Callback)
+{
+  return (Codec_QueueWrites(pRegs, Count, Callback));
+}
+
+/**
+  * @brief  Checks if codec register writes are waiting or on the bus.
+  * @param  None
+  * @retval 1 if the control interface is busy, else 0
+  */
+uint32_t EVAL_AUDIO_CodecBusy(void)
+{
+  return (CodecQueueHead != CodecQueueTail);
+}
+
+/**
+  * @brief  Gets the number of batches aborted by an I2C error (no acknowledge,
+  *         bus error or arbitration lost).
+  * @param  None
+  * @retval Number of aborted batches
+  */
+uint32_t EVAL_AUDIO_CodecErrors(void)
+{
+  return CodecErrorCount;
+}
+
+/**
+  * @brief  Watchdog of the codec control interface, called by the SysTick
+  *         interrupt. A write not done CODEC_WRITE_WATCHDOG ticks after its
+  *         start (SB, ADDR or BTF never came) is aborted with its batch, whose
+  *         callback is called with an error, and the I2C is reset.
+  * @param  None
+  * @retval None
+  */
+void EVAL_AUDIO_CodecTick(void)
+{
+  uint32_t primask;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if ((CodecStep == CODEC_STEP_IDLE) || (++CodecWriteTicks <= CODEC_WRITE_WATCHDOG))
+  {
+    __set_PRIMASK(primask);
+    return;
+  }
+  
+  /* The step stays busy until the batch is removed, so that no write is
+     started on the I2C being reset */
+  I2C_ITConfig(CODEC_I2C, CODEC_I2C_IT, DISABLE);
+  CodecErrorCount++;
+  __set_PRIMASK(primask);
+  
+  /* Reset the I2C (I2C_DeInit) and configure it again */
+  Codec_CtrlInterface_Init();
+  
+  Codec_QueueDone(1);
+}
+
+/**
+  * @brief  Reads a codec register from its copy in RAM. A register not written
+  *         since the codec reset is read once through the control interface,
+  *         which is possible only while no writes are queued.
+  * @note   Call it from the main loop, not from an interrupt.
+  * @param  RegisterAddr: Address of the register to be read.
+  * @retval Value of the register, or CODEC_REG_UNKNOWN
+  */
+uint32_t EVAL_AUDIO_ReadRegister(uint8_t RegisterAddr)
+{
+  if (RegisterAddr >= CODEC_REG_COUNT)
+  {
+    return CODEC_REG_UNKNOWN;
+  }
+  
+  if (!CodecShadowValid[RegisterAddr])
+  {
+    if (EVAL_AUDIO_CodecBusy())
+    {
+      return CODEC_REG_UNKNOWN;
+    }
+    Codec_ShadowSet(RegisterAddr, (uint8_t)Codec_ReadRegister(RegisterAddr));
+  }
+  
+  return CodecShadow[RegisterAddr];
+}
+
 /**
   * @brief  This function handles main Media layer interrupt. 
   * @param  None
@@ -585,12 +763,19 @@ void Audio_I2S_IRQHandler(void)
   { 
     if (CurrAudioInterface == AUDIO_INTERFACE_DAC)
     {
-      /* Wirte data to the DAC interface */
-      DAC_SetChannel1Data(DAC_Align_12b_L, EVAL_AUDIO_GetSampleCallBack()); 
+      /* Write one sample per frame to the DAC interface: the I2S only paces it */
+      if (SPI_I2S_GetFlagStatus(SPI3, I2S_FLAG_CHSIDE) == RESET)
+      {
+        DAC_SetChannel1Data(DAC_Align_12b_L, EVAL_AUDIO_GetSampleCallBack()); 
+      }
+      
+      /* Send dummy data on I2S to avoid the underrun condition */
+      SPI_I2S_SendData(CODEC_I2S, 0); 
+    }
+    else
+    {
+      SPI_I2S_SendData(CODEC_I2S, EVAL_AUDIO_GetSampleCallBack()); 
     }
-    
-    /* Send dummy data on I2S to avoid the underrun condition */
-    SPI_I2S_SendData(CODEC_I2S, EVAL_AUDIO_GetSampleCallBack()); 
   }
 }
 /*========================
@@ -608,7 +793,10 @@ void Audio_I2S_IRQHandler(void)
   */
 static uint32_t Codec_Init(uint16_t OutputDevice, uint8_t Volume, uint32_t AudioFreq)
 {
-  uint32_t counter = 0; 
+  Codec_BatchTypeDef batch;
+
+  /* Drop the writes queued for the previous stream, the codec is reset anyway */
+  Codec_QueueFlush();
 
   /* Configure the Codec related IOs */
   Codec_GPIO_Init();   
@@ -619,37 +807,41 @@ static uint32_t Codec_Init(uint16_t OutputDevice, uint8_t Volume, uint32_t Audio
   /* Initialize the Control interface of the Audio Codec */
   Codec_CtrlInterface_Init();     
   
+  batch.Count = 0;
+
   /* Keep Codec powered OFF */
-  counter += Codec_WriteRegister(0x02, 0x01);  
+  Codec_BatchAdd(&batch, 0x02, 0x01);  
       
-  counter += Codec_WriteRegister(0x04, 0xAF); /* SPK always OFF & HP always ON */
+  Codec_BatchAdd(&batch, 0x04, 0xAF); /* SPK always OFF & HP always ON */
   OutputDev = 0xAF;
   
   /* Clock configuration: Auto detection */  
-  counter += Codec_WriteRegister(0x05, 0x81);
+  Codec_BatchAdd(&batch, 0x05, 0x81);
   
-  /* Set the Slave Mode and the audio Standard */  
-  counter += Codec_WriteRegister(0x06, CODEC_STANDARD);
+  /* Set the Slave Mode and the audio Standard. The word length only matters
+     in the right justified standard (24-bit when 0) */  
+  Codec_BatchAdd(&batch, 0x06, CODEC_STANDARD | 
+      (((CODEC_STANDARD == 0x08) && (CurrDataFormat == AUDIO_FORMAT_16B)) ? 0x03 : 0x00));
       
   /* Set the Master volume */
-  Codec_VolumeCtrl(Volume);
+  Codec_VolumeRegs(&batch, Volume);
   
   if (CurrAudioInterface == AUDIO_INTERFACE_DAC)
   {
     /* Enable the PassThrough on AIN1A and AIN1B */
-    counter += Codec_WriteRegister(0x08, 0x01);
-    counter += Codec_WriteRegister(0x09, 0x01);
+    Codec_BatchAdd(&batch, 0x08, 0x01);
+    Codec_BatchAdd(&batch, 0x09, 0x01);
     
     /* Route the analog input to the HP line */
-    counter += Codec_WriteRegister(0x0E, 0xC0);
+    Codec_BatchAdd(&batch, 0x0E, 0xC0);
     
     /* Set the Passthough volume */
-    counter += Codec_WriteRegister(0x14, 0x00);
-    counter += Codec_WriteRegister(0x15, 0x00);
+    Codec_BatchAdd(&batch, 0x14, 0x00);
+    Codec_BatchAdd(&batch, 0x15, 0x00);
   }
 
   /* Power on the Codec */
-  counter += Codec_WriteRegister(0x02, 0x9E);  
+  Codec_BatchAdd(&batch, 0x02, 0x9E);  
   
   /* Additional configuration for the CODEC. These configurations are done to reduce
       the time needed for the Codec to power off. If these configurations are removed, 
@@ -659,25 +851,31 @@ static uint32_t Codec_Init(uint16_t OutputDevice, uint8_t Volume, uint32_t Audio
       it results in high noise after shut down. */
   
   /* Disable the analog soft ramp */
-  counter += Codec_WriteRegister(0x0A, 0x00);
+  Codec_BatchAdd(&batch, 0x0A, 0x00);
   if (CurrAudioInterface != AUDIO_INTERFACE_DAC)
   {  
     /* Disable the digital soft ramp */
-    counter += Codec_WriteRegister(0x0E, 0x04);
+    Codec_BatchAdd(&batch, 0x0E, 0x04);
   }
   /* Disable the limiter attack level */
-  counter += Codec_WriteRegister(0x27, 0x00);
+  Codec_BatchAdd(&batch, 0x27, 0x00);
   /* Adjust Bass and Treble levels */
-  counter += Codec_WriteRegister(0x1F, 0x0F);
+  Codec_BatchAdd(&batch, 0x1F, 0x0F);
   /* Adjust PCM volume level */
-  counter += Codec_WriteRegister(0x1A, 0x0A);
-  counter += Codec_WriteRegister(0x1B, 0x0A);
+  Codec_BatchAdd(&batch, 0x1A, 0x0A);
+  Codec_BatchAdd(&batch, 0x1B, 0x0A);
+
+  /* Queue the whole sequence, it is sent by the I2C interrupt */
+  if (Codec_QueueWrites(batch.Regs, batch.Count, 0) != 0)
+  {
+    return 1;
+  }
 
-  /* Configure the I2S peripheral */
+  /* Configure the I2S peripheral (the codec is clocked while it is configured) */
   Codec_AudioInterface_Init(AudioFreq);  
   
   /* Return communication control value */
-  return counter;  
+  return 0;  
 }
 
 /**
@@ -690,6 +888,9 @@ static uint32_t Codec_DeInit(void)
 {
   uint32_t counter = 0; 
 
+  /* Drop the queued writes, the rest is done with blocking writes */
+  Codec_QueueFlush();
+
   /* Reset the Codec Registers */
   Codec_Reset();  
   
@@ -733,29 +934,31 @@ static uint32_t Codec_Play(void)
   */
 static uint32_t Codec_PauseResume(uint32_t Cmd)
 {
-  uint32_t counter = 0;   
+  Codec_BatchTypeDef batch;
+  
+  batch.Count = 0;
   
   /* Pause the audio file playing */
   if (Cmd == AUDIO_PAUSE)
   { 
     /* Mute the output first */
-    counter += Codec_Mute(AUDIO_MUTE_ON);
+    Codec_MuteRegs(&batch, AUDIO_MUTE_ON);
 
     /* Put the Codec in Power save mode */    
-    counter += Codec_WriteRegister(0x02, 0x01);    
+    Codec_BatchAdd(&batch, 0x02, 0x01);    
   }
   else /* AUDIO_RESUME */
   {
     /* Unmute the output first */
-    counter += Codec_Mute(AUDIO_MUTE_OFF);
+    Codec_MuteRegs(&batch, AUDIO_MUTE_OFF);
     
-    counter += Codec_WriteRegister(0x04, OutputDev);
+    Codec_BatchAdd(&batch, 0x04, OutputDev);
     
     /* Exit the Power save mode */
-    counter += Codec_WriteRegister(0x02, 0x9E); 
+    Codec_BatchAdd(&batch, 0x02, 0x9E); 
   }
 
-  return counter;
+  return Codec_QueueWrites(batch.Regs, batch.Count, 0);
 }
 
 /**
@@ -768,33 +971,64 @@ static uint32_t Codec_PauseResume(uint32_t Cmd)
   *                           mode, the codec is set to default configuration 
   *                           (user should re-Initialize the codec in order to 
   *                            play again the audio stream).
-  * @retval 0 if correct communication, else wrong communication
+  * @retval 0 if the power down was queued, else 1
   */
 static uint32_t Codec_Stop(uint32_t CodecPdwnMode)
 {
-  uint32_t counter = 0;   
+  Codec_BatchTypeDef batch;
+  
+  batch.Count = 0;
 
   /* Mute the output first */
-  Codec_Mute(AUDIO_MUTE_ON);
+  Codec_MuteRegs(&batch, AUDIO_MUTE_ON);
   
-  if (CodecPdwnMode == CODEC_PDWN_SW)
-  {    
-    /* Power down the DAC and the speaker (PMDAC and PMSPK bits)*/
-    counter += Codec_WriteRegister(0x02, 0x9F);
-  }
-  else /* CODEC_PDWN_HW */
+  /* Power down the DAC and the speaker (PMDAC and PMSPK bits)*/
+  Codec_BatchAdd(&batch, 0x02, 0x9F);
+  
+  if (CodecPdwnMode == CODEC_PDWN_HW)
   { 
-    /* Power down the DAC components */
-    counter += Codec_WriteRegister(0x02, 0x9F);
+    /* Wait at least 100us before the reset: writing the register again 
+       takes about 300us on the bus */
+    Codec_BatchForce(&batch, 0x02, 0x9F);
+  }
+  
+  /* The rest is done by Codec_StopDone() */
+  CodecStopMode = CodecPdwnMode;
+  CodecStopPending = 1;
+  
+  if (Codec_QueueWrites(batch.Regs, batch.Count, Codec_StopDone) != 0)
+  {
+    CodecStopPending = 0;
+    return 1;
+  }
+  
+  return 0;    
+}
+
+/**
+  * @brief  Completes the stop when the codec has powered down: stops the audio
+  *         interface (the codec clock) and in CODEC_PDWN_HW mode resets the codec.
+  * @note   Called from the I2C interrupt. Nothing is done if the audio was
+  *         played again in the meantime.
+  * @param  Status: 0 if the power down was acknowledged.
+  * @retval None
+  */
+static void Codec_StopDone(uint32_t Status)
+{
+  if (CodecStopPending)
+  {
+    CodecStopPending = 0;
     
-    /* Wait at least 100us */
-    Delay(0xFFF);
+    /* Call Media layer Stop function */
+    Audio_MAL_Stop();
     
-    /* Reset The pin */
-    GPIO_WriteBit(AUDIO_RESET_GPIO, AUDIO_RESET_PIN, Bit_RESET);
+    if (CodecStopMode == CODEC_PDWN_HW)
+    {
+      /* Reset The pin */
+      GPIO_WriteBit(AUDIO_RESET_GPIO, AUDIO_RESET_PIN, Bit_RESET);
+      Codec_ShadowClear();
+    }
   }
-  
-  return counter;    
 }
 
 /**
@@ -805,45 +1039,422 @@ static uint32_t Codec_Stop(uint32_t CodecPdwnMode)
   */
 static uint32_t Codec_VolumeCtrl(uint8_t Volume)
 {
-  uint32_t counter = 0;
+  Codec_BatchTypeDef batch;
   
+  batch.Count = 0;
+  Codec_VolumeRegs(&batch, Volume);
+
+  return Codec_QueueWrites(batch.Regs, batch.Count, 0);  
+}
+
+/**
+  * @brief  Enables or disables the mute feature on the audio codec.
+  * @param  Cmd: AUDIO_MUTE_ON to enable the mute or AUDIO_MUTE_OFF to disable the
+  *             mute mode.
+  * @retval 0 if correct communication, else wrong communication
+  */
+static uint32_t Codec_Mute(uint32_t Cmd)
+{
+  Codec_BatchTypeDef batch;
+  
+  batch.Count = 0;
+  Codec_MuteRegs(&batch, Cmd);
+  
+  return Codec_QueueWrites(batch.Regs, batch.Count, 0); 
+}
+
+/**
+  * @brief  Adds a register write to a batch, unless the register already holds
+  *         the value (the last value for the register in the batch, or its 
+  *         copy in RAM).
+  * @param  Batch: Batch of register writes.
+  * @param  RegisterAddr: The address (location) of the register to be written.
+  * @param  RegisterValue: the Byte value to be written into destination register.
+  * @retval None
+  */
+static void Codec_BatchAdd(Codec_BatchTypeDef* Batch, uint8_t RegisterAddr, uint8_t RegisterValue)
+{
+  uint32_t i;
+  
+  for (i = Batch->Count; i > 0; i--)
+  {
+    if (Batch->Regs[2 * (i - 1)] == RegisterAddr)
+    {
+      if (Batch->Regs[2 * (i - 1) + 1] == RegisterValue)
+      {
+        return;
+      }
+      break;
+    }
+  }
+  
+  if ((i == 0) && (RegisterAddr < CODEC_REG_COUNT) && CodecShadowValid[RegisterAddr] &&
+      (CodecShadow[RegisterAddr] == RegisterValue))
+  {
+    return;
+  }
+  
+  Codec_BatchForce(Batch, RegisterAddr, RegisterValue);
+}
+
+/**
+  * @brief  Adds a register write to a batch, even if it does not change the 
+  *         register.
+  * @param  Batch: Batch of register writes.
+  * @param  RegisterAddr: The address (location) of the register to be written.
+  * @param  RegisterValue: the Byte value to be written into destination register.
+  * @retval None
+  */
+static void Codec_BatchForce(Codec_BatchTypeDef* Batch, uint8_t RegisterAddr, uint8_t RegisterValue)
+{
+  if (Batch->Count < CODEC_BATCH_SIZE)
+  {
+    Batch->Regs[2 * Batch->Count] = RegisterAddr;
+    Batch->Regs[2 * Batch->Count + 1] = RegisterValue;
+    Batch->Count++;
+  }
+}
+
+/**
+  * @brief  Adds the master volume writes to a batch.
+  * @param  Batch: Batch of register writes.
+  * @param  Volume: a byte value from 0 to 255 (refer to codec registers 
+  *         description for more details).
+  * @retval None
+  */
+static void Codec_VolumeRegs(Codec_BatchTypeDef* Batch, uint8_t Volume)
+{
   if (Volume > 0xE6)
   {
     /* Set the Master volume */
-    counter += Codec_WriteRegister(0x20, Volume - 0xE7); 
-    counter += Codec_WriteRegister(0x21, Volume - 0xE7);     
+    Codec_BatchAdd(Batch, 0x20, Volume - 0xE7); 
+    Codec_BatchAdd(Batch, 0x21, Volume - 0xE7);     
   }
   else
   {
     /* Set the Master volume */
-    counter += Codec_WriteRegister(0x20, Volume + 0x19); 
-    counter += Codec_WriteRegister(0x21, Volume + 0x19); 
+    Codec_BatchAdd(Batch, 0x20, Volume + 0x19); 
+    Codec_BatchAdd(Batch, 0x21, Volume + 0x19); 
   }
-
-  return counter;  
 }
 
 /**
-  * @brief  Enables or disables the mute feature on the audio codec.
+  * @brief  Adds the mute write to a batch.
+  * @param  Batch: Batch of register writes.
   * @param  Cmd: AUDIO_MUTE_ON to enable the mute or AUDIO_MUTE_OFF to disable the
   *             mute mode.
-  * @retval 0 if correct communication, else wrong communication
+  * @retval None
   */
-static uint32_t Codec_Mute(uint32_t Cmd)
+static void Codec_MuteRegs(Codec_BatchTypeDef* Batch, uint32_t Cmd)
 {
-  uint32_t counter = 0;  
-  
   /* Set the Mute mode */
   if (Cmd == AUDIO_MUTE_ON)
   {
-    counter += Codec_WriteRegister(0x04, 0xFF);
+    Codec_BatchAdd(Batch, 0x04, 0xFF);
   }
   else /* AUDIO_MUTE_OFF Disable the Mute */
   {
-    counter += Codec_WriteRegister(0x04, OutputDev);
+    Codec_BatchAdd(Batch, 0x04, OutputDev);
+  }
+}
+
+/**
+  * @brief  Queues register writes for the I2C interrupt and starts the first 
+  *         one if the bus is idle. Can be called from any context.
+  * @param  pRegs: Register address and value pairs.
+  * @param  Count: Number of writes (pairs). If it is 0 (all writes of a batch 
+  *         were skipped) the callback is called at once.
+  * @param  Callback: Called when the last write is done or the batch is aborted.
+  * @retval 0 if the writes were queued, 1 if the queue has no room for all of them
+  */
+static uint32_t Codec_QueueWrites(const uint8_t* pRegs, uint32_t Count, Codec_BatchCallback Callback)
+{
+  Codec_WriteTypeDef* write;
+  uint32_t primask;
+  uint32_t head;
+  uint32_t start = 0;
+  uint32_t i;
+  
+  if (Count == 0)
+  {
+    if (Callback != 0)
+    {
+      Callback(0);
+    }
+    return 0;
+  }
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  /* A batch is queued whole or not at all */
+  if (Count > CODEC_QUEUE_SIZE - (CodecQueueHead - CodecQueueTail))
+  {
+    __set_PRIMASK(primask);
+    return 1;
+  }
+  
+  head = CodecQueueHead;
+  for (i = 0; i < Count; i++, head++)
+  {
+    write = &CodecQueue[head & (CODEC_QUEUE_SIZE - 1)];
+    write->Reg = pRegs[2 * i];
+    write->Value = pRegs[2 * i + 1];
+    write->Last = (i == Count - 1);
+    write->Callback = Callback;
+    Codec_ShadowSet(write->Reg, write->Value);
+  }
+  CodecQueueHead = head;
+  
+  if (CodecStep == CODEC_STEP_IDLE)
+  {
+    start = Codec_QueueNext();
+  }
+  
+  __set_PRIMASK(primask);
+  
+  if (start)
+  {
+    Codec_QueueStart(CodecQueueTail);
+  }
+  return 0;
+}
+
+/**
+  * @brief  Takes the bus for the write at the tail of the queue, or disables
+  *         the I2C interrupts if the queue is empty. Called with the 
+  *         interrupts disabled, the write is started by Codec_QueueStart().
+  * @param  None
+  * @retval 1 if a write has to be started, else 0
+  */
+static uint32_t Codec_QueueNext(void)
+{
+  if (CodecQueueHead == CodecQueueTail)
+  {
+    CodecStep = CODEC_STEP_IDLE;
+    I2C_ITConfig(CODEC_I2C, CODEC_I2C_IT, DISABLE);
+    return 0;
+  }
+  
+  CodecStep = CODEC_STEP_START;
+  CodecWriteTicks = 0;
+  return 1;
+}
+
+/**
+  * @brief  Starts the write taken by Codec_QueueNext(). Called with the 
+  *         interrupts enabled: it waits for the end of the stop condition
+  *         of the previous write.
+  * @param  Tail: Queue index of the write.
+  * @retval None
+  */
+static void Codec_QueueStart(uint32_t Tail)
+{
+  uint32_t timeout;
+  uint32_t primask;
+  
+  /* The stop condition of the previous write takes a few us */
+  timeout = CODEC_FLAG_TIMEOUT;
+  while ((CODEC_I2C->CR1 & I2C_CR1_STOP) && (timeout-- != 0))
+  {
+  }
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  /* Not if the write was aborted or flushed in the meantime */
+  if ((CodecStep == CODEC_STEP_START) && (CodecQueueTail == Tail))
+  {
+    I2C_ITConfig(CODEC_I2C, CODEC_I2C_IT, ENABLE);
+    
+    /* Start the config sequence */
+    I2C_GenerateSTART(CODEC_I2C, ENABLE);
+  }
+  
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Removes the write on the bus from the queue (with the rest of its 
+  *         batch if it failed), starts the next one and calls the callback of 
+  *         a finished batch.
+  * @param  Status: 0 if the write was acknowledged, else the batch is aborted.
+  * @retval None
+  */
+static void Codec_QueueDone(uint32_t Status)
+{
+  Codec_WriteTypeDef* write;
+  Codec_BatchCallback callback = 0;
+  uint32_t primask;
+  uint32_t start;
+  uint32_t tail;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  do
+  {
+    write = &CodecQueue[CodecQueueTail & (CODEC_QUEUE_SIZE - 1)];
+    CodecQueueTail++;
+    
+    /* The register value is not known after a failed write */
+    if ((Status != 0) && (write->Reg < CODEC_REG_COUNT))
+    {
+      CodecShadowValid[write->Reg] = 0;
+    }
+  } while ((Status != 0) && !write->Last && (CodecQueueTail != CodecQueueHead));
+  
+  if (write->Last)
+  {
+    callback = write->Callback;
+  }
+  
+  start = Codec_QueueNext();
+  tail = CodecQueueTail;
+  
+  __set_PRIMASK(primask);
+  
+  if (start)
+  {
+    Codec_QueueStart(tail);
+  }
+  
+  if (callback != 0)
+  {
+    callback(Status);
   }
+}
+
+/**
+  * @brief  Drops all the queued writes without calling their callbacks and 
+  *         disables the I2C interrupts.
+  * @param  None
+  * @retval None
+  */
+static void Codec_QueueFlush(void)
+{
+  uint32_t primask;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
   
-  return counter; 
+  I2C_ITConfig(CODEC_I2C, CODEC_I2C_IT, DISABLE);
+  CodecQueueTail = CodecQueueHead;
+  CodecStep = CODEC_STEP_IDLE;
+  CodecStopPending = 0;
+  
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Updates the copy of a register in RAM.
+  * @param  RegisterAddr: Address of the register.
+  * @param  RegisterValue: Value written to the register.
+  * @retval None
+  */
+static void Codec_ShadowSet(uint8_t RegisterAddr, uint8_t RegisterValue)
+{
+  if (RegisterAddr < CODEC_REG_COUNT)
+  {
+    CodecShadow[RegisterAddr] = RegisterValue;
+    CodecShadowValid[RegisterAddr] = 1;
+  }
+}
+
+/**
+  * @brief  Invalidates the copy of all the registers (the codec was reset).
+  * @param  None
+  * @retval None
+  */
+static void Codec_ShadowClear(void)
+{
+  uint32_t i;
+  
+  for (i = 0; i < CODEC_REG_COUNT; i++)
+  {
+    CodecShadowValid[i] = 0;
+  }
+}
+
+/**
+  * @brief  This function handles the codec I2C event interrupt: it sends the
+  *         write at the tail of the queue one step at a time.
+  * @param  None
+  * @retval None
+  */
+void Codec_I2C_EV_IRQHandler(void)
+{
+  Codec_WriteTypeDef* write = &CodecQueue[CodecQueueTail & (CODEC_QUEUE_SIZE - 1)];
+  uint32_t sr1 = CODEC_I2C->SR1;
+  
+  switch (CodecStep)
+  {
+  case CODEC_STEP_START:
+    if (sr1 & I2C_SR1_SB)
+    {
+      /* EV5: transmit the slave address, this clears SB */
+      I2C_Send7bitAddress(CODEC_I2C, CODEC_ADDRESS, I2C_Direction_Transmitter);
+      CodecStep = CODEC_STEP_ADDRESS;
+    }
+    break;
+    
+  case CODEC_STEP_ADDRESS:
+    if (sr1 & I2C_SR1_ADDR)
+    {
+      /* EV6: clear ADDR by reading SR2 and transmit the register address */
+      (void)CODEC_I2C->SR2;
+      I2C_SendData(CODEC_I2C, write->Reg);
+      CodecStep = CODEC_STEP_VALUE;
+    }
+    break;
+    
+  case CODEC_STEP_VALUE:
+    if (sr1 & I2C_SR1_TXE)
+    {
+      /* EV8: transmit the register value and wait for BTF only */
+      I2C_SendData(CODEC_I2C, write->Value);
+      I2C_ITConfig(CODEC_I2C, I2C_IT_BUF, DISABLE);
+      CodecStep = CODEC_STEP_STOP;
+    }
+    break;
+    
+  case CODEC_STEP_STOP:
+    if (sr1 & I2C_SR1_BTF)
+    {
+      /* EV8_2: all data have been transferred, end the write */
+      I2C_GenerateSTOP(CODEC_I2C, ENABLE);
+      Codec_QueueDone(0);
+    }
+    break;
+    
+  default:
+    /* No write on the bus */
+    I2C_ITConfig(CODEC_I2C, CODEC_I2C_IT, DISABLE);
+    break;
+  }
+}
+
+/**
+  * @brief  This function handles the codec I2C error interrupt: the batch of 
+  *         the failed write is aborted.
+  * @param  None
+  * @retval None
+  */
+void Codec_I2C_ER_IRQHandler(void)
+{
+  if (CODEC_I2C->SR1 & (I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR))
+  {
+    I2C_ClearFlag(CODEC_I2C, I2C_FLAG_AF | I2C_FLAG_BERR | I2C_FLAG_ARLO | I2C_FLAG_OVR);
+    
+    /* Release the bus */
+    I2C_GenerateSTOP(CODEC_I2C, ENABLE);
+    
+    if (CodecStep != CODEC_STEP_IDLE)
+    {
+      CodecErrorCount++;
+      Codec_QueueDone(1);
+    }
+  }
 }
 
 /**
@@ -860,6 +1471,7 @@ static void Codec_Reset(void)
 
   /* wait for a delay to insure registers erasing */
   Delay(CODEC_RESET_DELAY); 
+  Codec_ShadowClear();
   
   /* Power on the codec */
   GPIO_WriteBit(AUDIO_RESET_GPIO, AUDIO_RESET_PIN, Bit_SET);
@@ -926,6 +1538,8 @@ static uint32_t Codec_WriteRegister(uint8_t RegisterAddr, uint8_t RegisterValue)
   /* End the configuration sequence */
   I2C_GenerateSTOP(CODEC_I2C, ENABLE);  
   
+  Codec_ShadowSet(RegisterAddr, RegisterValue);
+  
 #ifdef VERIFY_WRITTENDATA
   /* Verify that the data has been correctly written */  
   result = (Codec_ReadRegister(RegisterAddr) == RegisterValue)? 0:1;
@@ -1047,6 +1661,7 @@ static uint32_t Codec_ReadRegister(uint8_t RegisterAddr)
 static void Codec_CtrlInterface_Init(void)
 {
   I2C_InitTypeDef I2C_InitStructure;
+  NVIC_InitTypeDef NVIC_InitStructure;
   
   /* Enable the CODEC_I2C peripheral clock */
   RCC_APB1PeriphClockCmd(CODEC_I2C_CLK, ENABLE);
@@ -1062,6 +1677,17 @@ static void Codec_CtrlInterface_Init(void)
   /* Enable the I2C peripheral */
   I2C_Cmd(CODEC_I2C, ENABLE);  
   I2C_Init(CODEC_I2C, &I2C_InitStructure);
+  
+  /* I2C event and error interrupts of the write queue (the interrupt sources
+     are enabled only while writes are queued) */
+  NVIC_InitStructure.NVIC_IRQChannel = CODEC_I2C_EV_IRQ;
+  NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = EVAL_AUDIO_I2C_IRQ_PREPRIO;
+  NVIC_InitStructure.NVIC_IRQChannelSubPriority = EVAL_AUDIO_I2C_IRQ_SUBRIO;
+  NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+  NVIC_Init(&NVIC_InitStructure);
+  
+  NVIC_InitStructure.NVIC_IRQChannel = CODEC_I2C_ER_IRQ;
+  NVIC_Init(&NVIC_InitStructure);
 }
 
 /**
@@ -1098,7 +1724,8 @@ static void Codec_AudioInterface_Init(uint32_t AudioFreq)
   SPI_I2S_DeInit(CODEC_I2S);
   I2S_InitStructure.I2S_AudioFreq = AudioFreq;
   I2S_InitStructure.I2S_Standard = I2S_STANDARD;
-  I2S_InitStructure.I2S_DataFormat = I2S_DataFormat_16b;
+  I2S_InitStructure.I2S_DataFormat = (CurrDataFormat == AUDIO_FORMAT_24B) ? 
+                                      I2S_DataFormat_24b : I2S_DataFormat_16b;
   I2S_InitStructure.I2S_CPOL = I2S_CPOL_Low;
 #ifdef DAC_USE_I2S_DMA
   if (CurrAudioInterface == AUDIO_INTERFACE_DAC)
@@ -1123,6 +1750,11 @@ static void Codec_AudioInterface_Init(uint32_t AudioFreq)
   
   /* Initialize the I2S peripheral with the structure above */
   I2S_Init(CODEC_I2S, &I2S_InitStructure);
+  
+  /* Replace the prescaler of I2S_Init (computed for the fixed PLLI2S) by 
+     the PLLI2S and prescaler setting closest to the audio frequency */
+  CodecAudioFreq = AudioFreq;
+  I2SCLK_Config(CODEC_I2S, AudioFreq, &CodecClockPlan);
 
 
   /* Configure the DAC interface */
@@ -1358,6 +1990,14 @@ static void Audio_MAL_Init(void)
     DMA_InitStructure.DMA_Priority = DMA_Priority_High;
     DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Disable;         
     DMA_InitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_1QuarterFull;
+    if (CurrDataFormat == AUDIO_FORMAT_24B)
+    {
+      /* One memory read per sample, the FIFO splits it into the two half 
+         words of the SPI data register. The counter still counts half words */
+      DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Word;
+      DMA_InitStructure.DMA_FIFOMode = DMA_FIFOMode_Enable;
+      DMA_InitStructure.DMA_FIFOThreshold = DMA_FIFOThreshold_HalfFull;
+    }
     DMA_InitStructure.DMA_MemoryBurst = DMA_MemoryBurst_Single;
     DMA_InitStructure.DMA_PeripheralBurst = DMA_PeripheralBurst_Single;  
     DMA_Init(AUDIO_MAL_DMA_STREAM, &DMA_InitStructure);  
@@ -1532,6 +2172,8 @@ void Audio_MAL_Play(uint32_t Addr, uint32_t Size)
   /* If the I2S peripheral is still not enabled, enable it */
   if ((CODEC_I2S->I2SCFGR & I2S_ENABLE_MASK) == 0)
   {
+    /* The microphone may have changed the shared PLLI2S since the init */
+    I2SCLK_Config(CODEC_I2S, CodecAudioFreq, &CodecClockPlan);
     I2S_Cmd(CODEC_I2S, ENABLE);
   }
 }
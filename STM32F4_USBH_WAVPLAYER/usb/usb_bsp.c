@@ -27,6 +27,7 @@
 #include <ff.h>
 #include "stm32f4_discovery_lis302dl.h"
 #include "stm32f4_discovery_audio_codec.h"
+#include "waverecorder.h"
 /** @addtogroup STM32F4-Discovery_Audio_Player_Recorder
   * @{
   */
@@ -70,7 +71,7 @@ ErrorStatus HSEStartUpStatus;
  extern uint8_t Buffer[];
 
  #if defined MEDIA_USB_KEY
- __IO uint16_t Time_Rec_Base = 0;
+ __IO uint32_t Time_Rec_Base = 0;
   extern USB_OTG_CORE_HANDLE          USB_OTG_Core;
   extern __IO uint32_t XferCplt ;
   extern __IO uint8_t Command_index;
@@ -601,6 +602,7 @@ void EXTI0_IRQHandler(void)
     else if (Command_index == 0)
     {
       /* Switch to record command */
+      WaveRecorderTrigger();
       Command_index = 1;
       XferCplt = 1;
       EVAL_AUDIO_Stop(CODEC_PDWN_SW);
@@ -21,6 +21,8 @@
 
 #include "usbh_usr.h"
 #include <led.h>
+#include <waveduplex.h>
+#include <waverecorder.h>
 
 #define DEBUG
 
@@ -67,10 +69,14 @@ USBH_Usr_cb_TypeDef USR_Callbacks = {
 extern __IO uint8_t RepeatState ;
 extern __IO uint8_t LED_Toggle1;
 extern __IO uint32_t WaveDataLength ;
-extern __IO uint16_t Time_Rec_Base;
+extern __IO uint32_t Time_Rec_Base;
+extern uint32_t BenchTime;
+extern uint32_t BenchSpeed;
 
 static uint8_t USBH_USR_ApplicationState = USH_USR_FS_INIT;
 
+static void COMMAND_Bench(void);
+
 /**
   * @brief  USBH_USR_MSC_Application
   * @param  None
@@ -96,6 +102,9 @@ int USBH_USR_MSC_Application(void) {
           println("Disk write protected");
         }
       }
+      /* Keep the microphone running for the pre-trigger history */
+      WaveRecorderArm();
+
       /* Go to menu */
       USBH_USR_ApplicationState = USH_USR_AUDIO;
       break;
@@ -134,10 +143,46 @@ void COMMAND_AudioExecuteApplication(void) {
     RepeatState = 0;
     WaveRecorderUpdate();
     break;
+    /* Play and record at the same time */
+  case CMD_DUPLEX:
+    RepeatState = 0;
+    DUPLEX_Start();
+    break;
+    /* Recorder benchmark with a synthetic microphone */
+  case CMD_BENCH:
+    RepeatState = 0;
+    COMMAND_Bench();
+    break;
   default:
     break;
   }
 }
+/**
+  * @brief  Run the recorder benchmark and print the results, then play
+  *         the recorded file.
+  * @param  None
+  * @retval None
+  */
+static void COMMAND_Bench(void) {
+
+  WaveRecorder_BenchTypeDef stats;
+
+  println("Bench: %u ms of audio at %u%% of real time", (unsigned int)BenchTime,
+      (unsigned int)BenchSpeed);
+  if (WaveRecorderBench(BenchTime, BenchSpeed, &stats) != 0) {
+    println("Bench: cannot record");
+  } else {
+    println("Bench: %u ms of audio in %u ms, %u overruns", (unsigned int)stats.AudioTime,
+        (unsigned int)stats.RunTime, (unsigned int)stats.Overruns);
+    println("Bench: per second of audio filter %u cycles, processing %u cycles, writes %u ms (max %u ms)",
+        (unsigned int)stats.FilterCycles, (unsigned int)stats.ProcessCycles,
+        (unsigned int)stats.WriteTime, (unsigned int)stats.MaxWriteTime);
+    println("Bench: highest sustainable rate %u Hz", (unsigned int)stats.MaxRate);
+  }
+  f_mount(0, 0);
+  Command_index = CMD_PLAY;
+}
+
 /**
 * @brief  USBH_USR_Init
 *         Displays the message on LCD for host lib initialization
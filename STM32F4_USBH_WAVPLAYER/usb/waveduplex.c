@@ -0,0 +1,206 @@
+/**
+ * @file    waveduplex.c
+ * @brief   Simultaneous playback and recording
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The playback ring (I2S3 DMA) and the capture ring (SPI2 PDM)
+ * both run from interrupts. The only work left for the main loop is the
+ * USB Key traffic: reading the played file into empty playback buffers and
+ * writing full recording buffers. Only one transfer can be in progress on
+ * the bus, so the scheduler always serves the ring with the earliest
+ * deadline (the one which runs out of buffered audio first).
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stm32f4xx.h>
+#include <ff.h>
+#include <usb_core.h>
+#include <usbh_usr.h>
+#include <led.h>
+#include <timers.h>
+#include <waveplayer.h>
+#include <waverecorder.h>
+#include <waveduplex.h>
+
+#define DEBUG
+
+#ifdef DEBUG
+#define print(str, args...) printf(""str"%s",##args,"")
+#define println(str, args...) printf("DUPLEX--> "str"%s",##args,"\r\n")
+#else
+#define print(str, args...) (void)0
+#define println(str, args...) (void)0
+#endif
+
+/**
+ * @addtogroup DUPLEX
+ * @{
+ */
+
+#define DUPLEX_WAVE_NAME    "0:audio.wav" ///< File played while recording
+#define DUPLEX_NO_DEADLINE  0xFFFFFFFF    ///< Nothing to do for a ring
+
+extern __IO uint8_t Command_index;
+extern USB_OTG_CORE_HANDLE USB_OTG_Core;
+extern __IO uint32_t WaveDataLength;
+extern WAVE_FormatTypeDef WAVE_Format;
+extern FIL fileR;
+extern __IO uint8_t LED_Toggle1;
+extern __IO uint8_t PauseResumeStatus;
+extern __IO uint8_t Count;
+extern __IO uint32_t PlayUnderruns;
+extern uint32_t RecOverruns;
+
+static DUPLEX_StatsTypeDef duplexStats; ///< Statistics of the session
+
+static void DUPLEX_Schedule(void);
+
+/**
+ * @brief Play the wave file and record the microphone at the same time.
+ * @details Runs until the end of the played file, until the command
+ * changes (User button or COMM) or until the USB Key is removed. At the
+ * end of the file the recording is played back.
+ */
+void DUPLEX_Start(void) {
+
+  uint8_t recording = 1;
+  uint32_t underruns = PlayUnderruns;
+  uint32_t overruns = RecOverruns;
+
+  memset(&duplexStats, 0, sizeof(duplexStats));
+  duplexStats.minPlaySlack = DUPLEX_NO_DEADLINE;
+  duplexStats.minRecSlack = DUPLEX_NO_DEADLINE;
+
+  if (WavePlayerOpen(DUPLEX_WAVE_NAME) != 0) {
+    println("Cannot play %s", DUPLEX_WAVE_NAME);
+    // Nothing to play along with, just record
+    WaveRecorderTrigger();
+    Command_index = CMD_RECORD;
+    return;
+  }
+
+  // Initialize wave player (Codec, DMA, I2C)
+  WavePlayerInit(WAVE_Format.SampleRate);
+
+  // The recording starts with the playback (and its pre-roll)
+  WaveRecorderTrigger();
+  if (WaveRecorderOpen() != 0) {
+    println("Cannot record");
+    f_close(&fileR);
+    Command_index = CMD_PLAY;
+    return;
+  }
+
+  WavePlayerStreamStart();
+  LED_Toggle1 = 6;
+  PauseResumeStatus = 1;
+  Count = 0;
+
+  while (HCD_IsDeviceConnected(&USB_OTG_Core) &&
+      (Command_index == CMD_DUPLEX) && (WaveDataLength != 0)) {
+
+    WavePlayerPoll();
+
+    // Move the captured blocks to the RAM buffers
+    if (recording && (WaveRecorderProcess() == 0)) {
+      // Recording limit reached, the playback goes on
+      WaveRecorderClose();
+      recording = 0;
+    }
+
+    DUPLEX_Schedule();
+
+    commandCallback();
+  }
+
+  WavePlayerStop();
+  f_close(&fileR);
+  if (recording) {
+    WaveRecorderClose();
+  }
+  f_mount(0, 0);
+
+  if (Command_index == CMD_DUPLEX) {
+    // End of the file: listen to the recording
+    Command_index = CMD_PLAY;
+  }
+  LED_Toggle1 = 7;
+
+  duplexStats.underruns = PlayUnderruns - underruns;
+  duplexStats.overruns = RecOverruns - overruns;
+
+  println("Reads %u (max %u ms), writes %u (max %u ms)",
+      (unsigned int)duplexStats.reads, (unsigned int)duplexStats.maxReadTime,
+      (unsigned int)duplexStats.writes, (unsigned int)duplexStats.maxWriteTime);
+  println("Slack play %u ms, rec %u ms, underruns %u, overruns %u",
+      (unsigned int)duplexStats.minPlaySlack, (unsigned int)duplexStats.minRecSlack,
+      (unsigned int)duplexStats.underruns, (unsigned int)duplexStats.overruns);
+}
+
+/**
+ * @brief Get the statistics of the last duplex session.
+ * @param stats Structure to be filled
+ */
+void DUPLEX_GetStats(DUPLEX_StatsTypeDef* stats) {
+  *stats = duplexStats;
+}
+
+/**
+ * @brief Do one USB Key transfer, earliest deadline first.
+ * @details The deadline of the playback is the audio left in its ring, the
+ * deadline of the recording is the space left in the RAM buffer being
+ * filled and in the capture ring.
+ */
+static void DUPLEX_Schedule(void) {
+
+  uint32_t playSlack = DUPLEX_NO_DEADLINE;
+  uint32_t recSlack = WaveRecorderSlack();
+  uint32_t start;
+
+  if (WavePlayerNeedData()) {
+    playSlack = WavePlayerSlack();
+  }
+
+  if ((playSlack == DUPLEX_NO_DEADLINE) && (recSlack == DUPLEX_NO_DEADLINE)) {
+    return; // nothing to do
+  }
+
+  if (playSlack < duplexStats.minPlaySlack) {
+    duplexStats.minPlaySlack = playSlack;
+  }
+  if (recSlack < duplexStats.minRecSlack) {
+    duplexStats.minRecSlack = recSlack;
+  }
+
+  start = TIMER_GetTime();
+
+  if (playSlack <= recSlack) {
+    WavePlayerFill();
+    duplexStats.reads++;
+    if (TIMER_GetTime() - start > duplexStats.maxReadTime) {
+      duplexStats.maxReadTime = TIMER_GetTime() - start;
+    }
+  } else {
+    WaveRecorderWrite();
+    duplexStats.writes++;
+    if (TIMER_GetTime() - start > duplexStats.maxWriteTime) {
+      duplexStats.maxWriteTime = TIMER_GetTime() - start;
+    }
+  }
+}
+
+/**
+ * @}
+ */
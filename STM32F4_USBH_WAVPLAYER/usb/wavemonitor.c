@@ -0,0 +1,210 @@
+/**
+ * @file    wavemonitor.c
+ * @brief   Input monitoring: microphone to headphones
+ * @date    19 paź 2026
+ * @author  Michal Ksiezopolski
+ *
+ * @details The recorder's block at the recorded frequency (one block per
+ * millisecond, filtered and decimated in the SPI2 interrupt) is copied to a small ring which the I2S3 DMA plays
+ * block by block from its transfer complete interrupt. Neither side goes
+ * through the main loop, so USB Key write stalls do not affect the path.
+ * The microphone and codec clocks are not locked to each other: the ring
+ * holds at most MONITOR_MAX_QUEUE blocks (newer blocks are dropped) and
+ * silence is played when it runs empty, so the latency stays bounded.
+ *
+ * @verbatim
+ * Copyright (c) 2026 Michal Ksiezopolski.
+ * All rights reserved. This program and the
+ * accompanying materials are made available
+ * under the terms of the GNU Public License
+ * v3.0 which accompanies this distribution,
+ * and is available at
+ * http://www.gnu.org/licenses/gpl.html
+ * @endverbatim
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stm32f4xx.h>
+#include <audiosink.h>
+#include <wavemonitor.h>
+
+#define DEBUG
+
+#ifdef DEBUG
+#define print(str, args...) printf(""str"%s",##args,"")
+#define println(str, args...) printf("MONITOR--> "str"%s",##args,"\r\n")
+#else
+#define print(str, args...) (void)0
+#define println(str, args...) (void)0
+#endif
+
+/**
+ * @addtogroup MONITOR
+ * @{
+ */
+
+#define MONITOR_BLOCKS      8   ///< Blocks in the ring (power of 2)
+#define MONITOR_MAX_QUEUE   3   ///< Blocks queued (with the one playing) above which new ones are dropped
+#define MONITOR_MAX_FRAMES  48  ///< Frames per block at 48 kHz
+
+static int16_t monitorRing[MONITOR_BLOCKS][MONITOR_MAX_FRAMES * 2]; ///< Stereo blocks
+static uint32_t monitorStamp[MONITOR_BLOCKS];   ///< Capture time of the blocks (CPU cycles)
+static int16_t monitorSilence[MONITOR_MAX_FRAMES * 2];
+static volatile uint32_t monitorHead;           ///< Blocks written by the capture
+static volatile uint32_t monitorTail;           ///< Blocks played by the DMA
+static volatile uint8_t monitorActive;
+static volatile uint8_t monitorPlaying;         ///< The DMA plays the block at the tail
+static uint32_t monitorFrames;                  ///< Frames per block
+static uint64_t monitorLatencySum;              ///< For the average, in us
+static MONITOR_StatsTypeDef monitorStats;
+
+extern __IO uint8_t volume;                     ///< Volume of the wave player
+
+/**
+ * @brief Start playing the captured audio.
+ * @details Initializes the codec, the wave player must not be running.
+ * @param freq Recording (and playback) sampling frequency
+ */
+void MONITOR_Start(uint32_t freq) {
+
+  monitorFrames = freq / 1000;
+  if (monitorFrames > MONITOR_MAX_FRAMES) {
+    return;
+  }
+
+  memset(&monitorStats, 0, sizeof(monitorStats));
+  monitorStats.minLatency = 0xFFFFFFFF;
+  monitorLatencySum = 0;
+  memset(monitorSilence, 0, sizeof(monitorSilence));
+  monitorHead = 0;
+  monitorTail = 0;
+  monitorPlaying = 0;
+
+  // Cycle counter for the latency measurement
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  // The codec at the recording frequency, whatever the playback sink is
+  if (SINK_Start(&SINK_I2S, freq, 16, volume, MONITOR_TransferComplete)) {
+    return;
+  }
+
+  // Start with silence, the blocks are chained from now on
+  monitorActive = 1;
+  SINK_Play((uint16_t*)monitorSilence, monitorFrames * 4);
+}
+
+/**
+ * @brief Stop the monitor and the codec.
+ */
+void MONITOR_Stop(void) {
+
+  if (monitorActive == 0) {
+    return;
+  }
+  monitorActive = 0;
+  SINK_Stop();
+
+  if (monitorStats.blocks) {
+    monitorStats.avgLatency = (uint32_t)(monitorLatencySum / monitorStats.blocks);
+  }
+  println("Latency %u..%u us (avg %u), dropped %u, silent %u",
+      (unsigned int)monitorStats.minLatency, (unsigned int)monitorStats.maxLatency,
+      (unsigned int)monitorStats.avgLatency, (unsigned int)monitorStats.dropped,
+      (unsigned int)monitorStats.silences);
+}
+
+/**
+ * @brief Check if the codec is used by the monitor.
+ * @return 1 if the monitor is running
+ */
+uint8_t MONITOR_IsActive(void) {
+  return monitorActive;
+}
+
+/**
+ * @brief Queue one captured block. Called from the capture interrupt.
+ * @param pcm Samples at the recording frequency (mono)
+ * @param len Number of samples
+ */
+void MONITOR_Write(uint16_t* pcm, uint32_t len) {
+
+  int16_t* out;
+  uint32_t i;
+
+  if (monitorActive == 0) {
+    return;
+  }
+
+  // Keep the latency bounded when the capture clock is faster
+  if (monitorHead - monitorTail >= MONITOR_MAX_QUEUE) {
+    monitorStats.dropped++;
+    return;
+  }
+
+  out = monitorRing[monitorHead % MONITOR_BLOCKS];
+  for (i = 0; (i < len) && (i < monitorFrames); i++) {
+    out[2 * i]     = (int16_t)pcm[i];
+    out[2 * i + 1] = (int16_t)pcm[i];
+  }
+  monitorStamp[monitorHead % MONITOR_BLOCKS] = DWT->CYCCNT;
+  monitorHead++;
+}
+
+/**
+ * @brief Play the next block. Called by the sink from the DMA transfer
+ * complete interrupt of the codec.
+ */
+void MONITOR_TransferComplete(void) {
+
+  uint32_t latency;
+
+  if (monitorActive == 0) {
+    return;
+  }
+
+  // Release the block which has been played
+  if (monitorPlaying) {
+    monitorTail++;
+    monitorPlaying = 0;
+  }
+
+  if (monitorHead == monitorTail) {
+    // The capture clock is slower, or the capture has not started yet
+    monitorStats.silences++;
+    SINK_Play((uint16_t*)monitorSilence, monitorFrames * 4);
+    return;
+  }
+
+  monitorPlaying = 1;
+  SINK_Play((uint16_t*)monitorRing[monitorTail % MONITOR_BLOCKS], monitorFrames * 4);
+
+  // Every sample waits in the ring and is then played within one block
+  latency = (DWT->CYCCNT - monitorStamp[monitorTail % MONITOR_BLOCKS]) /
+      (SystemCoreClock / 1000000) + 1000;
+  monitorStats.blocks++;
+  monitorLatencySum += latency;
+  if (latency < monitorStats.minLatency) {
+    monitorStats.minLatency = latency;
+  }
+  if (latency > monitorStats.maxLatency) {
+    monitorStats.maxLatency = latency;
+  }
+}
+
+/**
+ * @brief Get the statistics of the monitor path.
+ * @param stats Structure to be filled
+ */
+void MONITOR_GetStats(MONITOR_StatsTypeDef* stats) {
+
+  *stats = monitorStats;
+  if (stats->blocks) {
+    stats->avgLatency = (uint32_t)(monitorLatencySum / stats->blocks);
+  }
+}
+
+/**
+ * @}
+ */
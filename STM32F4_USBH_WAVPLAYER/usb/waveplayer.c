@@ -26,6 +26,9 @@
 #include "stm32f4_discovery_lis302dl.h"
 #include "stm32f4_discovery_audio_codec.h"
 #include <waveplayer.h>
+#include <audiosink.h>
+#include <waverecorder.h>
+#include <adpcm.h>
 
 /* Uncomment this define to disable repeat option */
 //#define PLAY_REPEAT_OFF
@@ -33,7 +36,6 @@
 /** @addtogroup STM32F4-Discovery_Audio_Player_Recorder
 * @{
 */ 
-  #define REC_WAVE_NAME "0:rec.wav"
 #define WAVE_NAME "0:audio.wav"
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -47,6 +49,23 @@ extern uint16_t AUDIO_SAMPLE[];
 #define AUIDO_START_ADDRESS     58 /* Offset relative to audio file header size */
 #endif
 
+#if defined MEDIA_USB_KEY
+/* Playback ring: the buffers are chained by the DMA transfer complete
+   interrupt, the main loop only refills the empty ones. The playback
+   goes on while the main loop is busy with other work (e.g. recording)
+   as long as one buffer is queued. A buffer holds the same number of
+   frames whatever the format, so the ring covers the same time: 24 and
+   32-bit files are played as 24 bits in 32-bit words, which take twice
+   the memory and DMA bandwidth of 16-bit samples. */
+#define PLAY_BUFFER_FRAMES      1024
+#define PLAY_BUFFER_SIZE        (PLAY_BUFFER_FRAMES * 8)  /* in bytes: stereo, 32-bit words */
+#define PLAY_BUFFER_NBR         3
+/* When the sink takes fewer bits than the file, the samples are dithered
+   (order of the noise shaping: 0 flat, 1 or 2) */
+#define PLAY_DITHER_ORDER       0
+#define PLAY_DITHER_CHUNK       64        /* 24-bit samples widened at a time */
+#endif
+
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 #if defined MEDIA_USB_KEY
@@ -57,13 +76,27 @@ extern uint16_t AUDIO_SAMPLE[];
  __IO ErrorCode WaveFileStatus = Unvalid_RIFF_ID;
  UINT BytesRead;
  WAVE_FormatTypeDef WAVE_Format;
- uint16_t buffer1[_MAX_SS] ={0x00};
- uint16_t buffer2[_MAX_SS] ={0x00};
- uint8_t buffer_switch = 1;
+ uint32_t PlayBuf[PLAY_BUFFER_NBR][PLAY_BUFFER_SIZE / 4];
+ static __IO uint32_t PlayBufSize[PLAY_BUFFER_NBR]; /* Bytes of audio in each buffer */
+ static uint32_t PlayBufHead = 0;                   /* Next buffer to be filled */
+ static __IO uint32_t PlayBufTail = 0;              /* Buffer being played */
+ static __IO uint32_t PlayBufCount = 0;             /* Queued buffers, with the one being played */
+ static __IO uint8_t PlayRunning = 0;               /* The DMA is playing a buffer */
+ static uint8_t PlayHold = 0;                       /* Do not start the DMA yet */
+ static __IO uint8_t PlayEof = 0;                   /* The last buffer has been queued */
+ static uint32_t PlayReadSize = 0;                  /* Audio data left in the file */
+ static uint32_t PlayInBytes = 2;                   /* Bytes of a sample in the file */
+ static uint32_t PlayOutBytes = 2;                  /* Bytes of a sample played (2 or 4) */
+ static uint32_t PlayOutRate = 0;                   /* Bytes played per second */
+ static uint16_t PlayAdpcmSamples = 0;              /* Samples per channel in an IMA ADPCM block, 0 for PCM */
+ static uint8_t PlayFloat = 0;                      /* The file has 32-bit float samples */
+ static DITHER_TypeDef PlayDither;                  /* Reduction of the file to 16 bits */
+ __IO uint32_t PlayUnderruns = 0;                   /* The ring was empty before the end */
  extern FIL fileR;
  extern DIR dir;
  extern USB_OTG_CORE_HANDLE USB_OTG_Core;
  extern uint8_t WaveRecStatus;
+ extern void commandCallback(void);
 #endif
 
 __IO uint32_t XferCplt = 0;
@@ -82,6 +115,9 @@ static void Mems_Config(void);
 static void EXTILine_Config(void);
 #if defined MEDIA_USB_KEY
  static ErrorCode WavePlayer_WaveParsing(uint32_t *FileLen);
+ static void WavePlayer_Kick(void);
+ static void WavePlayer_TransferComplete(void);
+ static uint32_t WavePlayer_Convert(uint8_t* buf, uint32_t size);
 #endif
 
 /* Private functions ---------------------------------------------------------*/
@@ -160,16 +196,9 @@ void WavePlayBack(uint32_t AudioFreq)
 #elif defined MEDIA_USB_KEY
   /* Initialize wave player (Codec, DMA, I2C) */
   WavePlayerInit(AudioFreq);
-  AudioRemSize   = 0; 
 
-  /* Get Data from USB Key */
-  f_lseek(&fileR, WaveCounter);
-  f_read (&fileR, buffer1, _MAX_SS, &BytesRead); 
-  f_read (&fileR, buffer2, _MAX_SS, &BytesRead);
- 
-  /* Start playing wave */
-  Audio_MAL_Play((uint32_t)buffer1, _MAX_SS);
-  buffer_switch = 1;
+  /* Get Data from USB Key and start playing wave */
+  WavePlayerStreamStart();
   XferCplt = 0;
   LED_Toggle1 = 6;
   PauseResumeStatus = 1;
@@ -180,42 +209,13 @@ void WavePlayBack(uint32_t AudioFreq)
     /* Test on the command: Playing */
     if (Command_index == 0)
     { 
-      /* wait for DMA transfert complete */
-      while((XferCplt == 0) &&  HCD_IsDeviceConnected(&USB_OTG_Core))
-      {
-        if (PauseResumeStatus == 0)
-        {
-          /* Pause Playing wave */
-          LED_Toggle1 = 0;
-          WavePlayerPauseResume(PauseResumeStatus);
-          PauseResumeStatus = 2;
-        }
-        else if (PauseResumeStatus == 1)
-        {
-          LED_Toggle1 = 6;
-          /* Resume Playing wave */
-          WavePlayerPauseResume(PauseResumeStatus);
-          PauseResumeStatus = 2;
-        }  
-      }
-      XferCplt = 0;
-
-      if(buffer_switch == 0)
-      {
-        /* Play data from buffer1 */
-        Audio_MAL_Play((uint32_t)buffer1, _MAX_SS);
-        /* Store data in buffer2 */
-        f_read (&fileR, buffer2, _MAX_SS, &BytesRead);
-        buffer_switch = 1;
-      }
-      else 
-      {   
-        /* Play data from buffer2 */
-        Audio_MAL_Play((uint32_t)buffer2, _MAX_SS);
-        /* Store data in buffer1 */
-        f_read (&fileR, buffer1, _MAX_SS, &BytesRead);
-        buffer_switch = 0;
-      } 
+      WavePlayerPoll();
+      
+      /* Refill the buffers played by the DMA */
+      WavePlayerFill();
+      
+      /* Commands from PC */
+      commandCallback();
     }
     else 
     {
@@ -247,7 +247,7 @@ void WavePlayBack(uint32_t AudioFreq)
   */
 void WavePlayerPauseResume(uint8_t state)
 { 
-  EVAL_AUDIO_PauseResume(state);   
+  SINK_Pause(state);   
 }
 
 /**
@@ -257,7 +257,7 @@ void WavePlayerPauseResume(uint8_t state)
   */
 uint8_t WaveplayerCtrlVolume(uint8_t vol)
 { 
-  EVAL_AUDIO_VolumeCtl(vol);
+  SINK_Volume(vol);
   return 0;
 }
 
@@ -269,7 +269,12 @@ uint8_t WaveplayerCtrlVolume(uint8_t vol)
   */
 void WavePlayerStop(void)
 { 
-  EVAL_AUDIO_Stop(CODEC_PDWN_SW);
+#if defined MEDIA_USB_KEY
+  /* Do not chain the next buffer */
+  PlayRunning = 0;
+  PlayBufCount = 0;
+#endif
+  SINK_Stop();
 }
  
 /**
@@ -279,6 +284,9 @@ void WavePlayerStop(void)
 */
 int WavePlayerInit(uint32_t AudioFreq)
 { 
+#if defined MEDIA_USB_KEY
+  uint8_t bits = BITS_PER_SAMPLE_16;
+#endif
   
   /* MEMS Accelerometre configure to manage PAUSE, RESUME and Controle Volume operation */
   Mems_Config();
@@ -286,13 +294,24 @@ int WavePlayerInit(uint32_t AudioFreq)
   /* EXTI configue to detect interrupts on Z axis click and on Y axis high event */
   EXTILine_Config();  
     
-  /* Initialize I2S interface */  
-  EVAL_AUDIO_SetAudioInterface(AUDIO_INTERFACE_I2S);
-  
-  /* Initialize the Audio codec and all related peripherals (I2S, I2C, IOExpander, IOs...) */  
-  EVAL_AUDIO_Init(OUTPUT_DEVICE_AUTO, volume, AudioFreq );  
+  /* Initialize the selected output (the codec and all related peripherals 
+     for the I2S and DAC sinks) */  
+#if defined MEDIA_USB_KEY
+  /* More than 16 bits are played as 24 bits if the sink takes them,
+     IMA ADPCM is decoded to 16 bits */
+  PlayInBytes = PlayAdpcmSamples ? 2 : WAVE_Format.BitsPerSample / 8;
+  if ((PlayInBytes > 2) && (SINK_Selected()->maxBits >= BITS_PER_SAMPLE_24))
+  {
+    bits = BITS_PER_SAMPLE_24;
+  }
+  PlayOutBytes = (bits == BITS_PER_SAMPLE_24) ? 4 : 2;
+  PlayOutRate = AudioFreq * WAVE_Format.NumChannels * PlayOutBytes;
+  WavePlayerGetDither()->channels = WAVE_Format.NumChannels;
   
-  return 0;
+  return SINK_Start(SINK_Selected(), AudioFreq, bits, volume, WavePlayer_TransferComplete);
+#else
+  return SINK_Start(&SINK_I2S, AudioFreq, BITS_PER_SAMPLE_16, volume, 0);
+#endif
 }
 
 /**
@@ -353,8 +372,8 @@ void EVAL_AUDIO_TransferComplete_CallBack(uint32_t pBuffer, uint32_t Size)
   
 #elif defined MEDIA_USB_KEY  
   XferCplt = 1;
-  if (WaveDataLength) WaveDataLength -= _MAX_SS;
-  if (WaveDataLength < _MAX_SS) WaveDataLength = 0;
+  /* The sink calls the player or the monitor */
+  SINK_BlockDone();
     
 #endif 
     
@@ -410,7 +429,6 @@ uint16_t EVAL_AUDIO_GetSampleCallBack(void)
   return 0;
 }
 
-
 #ifndef USE_DEFAULT_TIMEOUT_CALLBACK
 /**
   * @brief  Basic management of the timeout situation.
@@ -435,8 +453,7 @@ uint32_t Codec_TIMEOUT_UserCallback(void)
 void WavePlayerStart(void)
 {
   char path[] = "0:/";
-  
-  buffer_switch = 1;
+  uint32_t status = 0;
   
   /* Get the read out protection status */
   if (f_opendir(&dir, path)!= FR_OK) { // open root
@@ -447,30 +464,20 @@ void WavePlayerStart(void)
   }
   else {
     if (WaveRecStatus == 1) {
-      WaveFileName = REC_WAVE_NAME; // recorded wave
+      WaveFileName = (char*)WaveRecorderFileName(); // recorded wave (last segment)
     }
     else {
       WaveFileName = WAVE_NAME; 
     }
     /* Open the wave file to be played */
-    if (f_open(&fileR, WaveFileName, FA_READ) != FR_OK) {
+    status = WavePlayerOpen(WaveFileName);
+    if (status == 1) {
       LED_ChangeState(LED0, LED_ON);
       Command_index = 1; // start recording if no wave
     }
     else
     {    
-      /* Read data(_MAX_SS byte) from the selected file */
-      // read first sector
-      f_read (&fileR, buffer1, _MAX_SS, &BytesRead);
-      
-      WaveFileStatus = WavePlayer_WaveParsing(&wavelen);
-      
-      if (WaveFileStatus == Valid_WAVE_File)  /* the .WAV file is valid */
-      {
-        /* Set WaveDataLenght to the Speech wave length */
-        WaveDataLength = WAVE_Format.DataSize;
-      }
-      else /* Unvalid wave file */
+      if (status != 0) /* Unvalid wave file */
       {
         /* Led Red Toggles in infinite loop */
         while(1)
@@ -485,6 +492,364 @@ void WavePlayerStart(void)
   }
 }
 
+/**
+  * @brief  Open a wave file and check its header
+  * @param  FileName: Name of the file
+  * @retval 0 if the file can be played, 1 if it cannot be opened,
+  *         2 if it is not a supported wave file (see WaveFileStatus)
+  */
+uint32_t WavePlayerOpen(char* FileName)
+{
+  if (f_open(&fileR, FileName, FA_READ) != FR_OK)
+  {
+    return 1;
+  }
+  
+  /* Read the first sector, it holds the header */
+  f_read (&fileR, PlayBuf[0], _MAX_SS, &BytesRead);
+  
+  WaveFileStatus = WavePlayer_WaveParsing(&wavelen);
+  if (WaveFileStatus != Valid_WAVE_File)
+  {
+    return 2;
+  }
+  
+  /* Set WaveDataLenght to the Speech wave length */
+  WaveDataLength = WAVE_Format.DataSize;
+  return 0;
+}
+
+/**
+  * @brief  Fill the playback ring from the beginning of the audio data
+  *         and start the DMA. The wave player must be initialized.
+  * @param  None
+  * @retval None
+  */
+void WavePlayerStreamStart(void)
+{
+  PlayBufHead = 0;
+  PlayBufTail = 0;
+  PlayBufCount = 0;
+  PlayRunning = 0;
+  PlayEof = 0;
+  PlayReadSize = WaveDataLength;
+  AudioRemSize = 0;
+  
+  f_lseek(&fileR, WaveCounter);
+  
+  /* Start with a full ring */
+  PlayHold = 1;
+  while (WavePlayerFill());
+  PlayHold = 0;
+  WavePlayer_Kick();
+}
+
+/**
+  * @brief  Read the next part of the file into an empty playback buffer
+  * @param  None
+  * @retval 1 if a buffer has been queued, 0 if there is nothing to do
+  */
+uint8_t WavePlayerFill(void)
+{
+  uint32_t frame = WAVE_Format.NumChannels * PlayInBytes;
+  uint32_t size = PLAY_BUFFER_FRAMES * frame;
+  uint32_t blocks = 0, idx = 0;
+  uint8_t* buf = (uint8_t*)PlayBuf[PlayBufHead];
+  uint8_t* in = buf;
+  
+  if ((PlayBufCount >= PLAY_BUFFER_NBR) || PlayEof)
+  {
+    return 0;
+  }
+  
+  if (PlayAdpcmSamples)
+  {
+    /* Whole IMA ADPCM blocks, read to the end of the buffer and decoded
+       in place to its beginning (see ADPCM_DecodeBlock) */
+    blocks = (PLAY_BUFFER_SIZE - 4) / (PlayAdpcmSamples * frame);
+    size = blocks * WAVE_Format.BlockAlign;
+    in = buf + PLAY_BUFFER_SIZE - size;
+  }
+  if (size >= PlayReadSize)
+  {
+    size = PlayReadSize;
+  }
+  if ((f_read (&fileR, in, size, &BytesRead) != FR_OK) || (BytesRead < size))
+  {
+    /* Truncated file: play what is there */
+    size = BytesRead;
+    PlayReadSize = size;
+  }
+  PlayReadSize -= size;
+  
+  if (PlayAdpcmSamples)
+  {
+    /* A partial block at the end of the file is dropped */
+    blocks = size / WAVE_Format.BlockAlign;
+    for (idx = 0; idx < blocks; idx++)
+    {
+      ADPCM_DecodeBlock(in + idx * WAVE_Format.BlockAlign,
+          (int16_t*)(buf + idx * PlayAdpcmSamples * frame),
+          WAVE_Format.NumChannels, PlayAdpcmSamples);
+    }
+    size = blocks * PlayAdpcmSamples * frame;
+  }
+  else
+  {
+    /* Whole frames only, in the format of the sink */
+    size = WavePlayer_Convert(buf, size - (size % frame));
+  }
+  
+  __disable_irq();
+  if (PlayReadSize == 0)
+  {
+    PlayEof = 1;
+  }
+  if (size)
+  {
+    PlayBufSize[PlayBufHead] = size;
+    PlayBufHead = (PlayBufHead + 1) % PLAY_BUFFER_NBR;
+    PlayBufCount++;
+    if (PlayHold == 0)
+    {
+      WavePlayer_Kick();
+    }
+  }
+  else if (PlayBufCount == 0)
+  {
+    /* Nothing left to play */
+    WaveDataLength = 0;
+  }
+  __enable_irq();
+  
+  return (size != 0);
+}
+
+/**
+  * @brief  Check if the playback ring has an empty buffer to be filled
+  * @param  None
+  * @retval 1 if WavePlayerFill() has work to do, 0 otherwise
+  */
+uint8_t WavePlayerNeedData(void)
+{
+  return ((PlayBufCount < PLAY_BUFFER_NBR) && (PlayEof == 0));
+}
+
+/**
+  * @brief  Get the time left before the playback ring runs empty
+  * @param  None
+  * @retval Queued audio in milliseconds
+  */
+uint32_t WavePlayerSlack(void)
+{
+  uint32_t bytes = 0, idx = 0, count = 0;
+  
+  if (PlayOutRate == 0)
+  {
+    return 0;
+  }
+  
+  __disable_irq();
+  count = PlayBufCount;
+  if (PlayRunning && count)
+  {
+    /* Rest of the buffer being played */
+    bytes = SINK_Remaining();
+    count--;
+  }
+  for (idx = 1; idx <= count; idx++)
+  {
+    bytes += PlayBufSize[(PlayBufTail + idx) % PLAY_BUFFER_NBR];
+  }
+  __enable_irq();
+  
+  return (uint32_t)(((uint64_t)bytes * 1000) / PlayOutRate);
+}
+
+/**
+  * @brief  Handle the pause and resume requests
+  * @param  None
+  * @retval None
+  */
+void WavePlayerPoll(void)
+{
+  if (PauseResumeStatus == 0)
+  {
+    /* Pause Playing wave */
+    LED_Toggle1 = 0;
+    WavePlayerPauseResume(PauseResumeStatus);
+    PauseResumeStatus = 2;
+  }
+  else if (PauseResumeStatus == 1)
+  {
+    LED_Toggle1 = 6;
+    /* Resume Playing wave */
+    WavePlayerPauseResume(PauseResumeStatus);
+    PauseResumeStatus = 2;
+  }  
+  
+  /* Output of the null and file sinks */
+  SINK_Poll();
+}
+
+/**
+  * @brief  Start the sink on the oldest queued buffer if it is idle.
+  *         Called with the interrupts disabled or from the sink callback.
+  * @param  None
+  * @retval None
+  */
+static void WavePlayer_Kick(void)
+{
+  if ((PlayRunning == 0) && PlayBufCount)
+  {
+    PlayRunning = 1;
+    SINK_Play((uint16_t*)PlayBuf[PlayBufTail], PlayBufSize[PlayBufTail]);
+  }
+}
+
+/**
+  * @brief  Release the buffer played by the sink and chain the next one
+  * @param  None
+  * @retval None
+  */
+static void WavePlayer_TransferComplete(void)
+{
+  /* Audio data of the file in the buffer */
+  uint32_t size = (PlayBufSize[PlayBufTail] / PlayOutBytes) * PlayInBytes;
+  
+  /* Stopped by the application */
+  if ((PlayRunning == 0) || (PlayBufCount == 0))
+  {
+    return;
+  }
+  
+  if (PlayAdpcmSamples)
+  {
+    /* The buffer holds whole decoded blocks */
+    size = (PlayBufSize[PlayBufTail] / (PlayAdpcmSamples * WAVE_Format.NumChannels * 2)) *
+        WAVE_Format.BlockAlign;
+  }
+  
+  WaveDataLength = (WaveDataLength > size) ? WaveDataLength - size : 0;
+  PlayBufTail = (PlayBufTail + 1) % PLAY_BUFFER_NBR;
+  PlayBufCount--;
+  PlayRunning = 0;
+  
+  if (PlayBufCount)
+  {
+    WavePlayer_Kick();
+  }
+  else if (PlayEof)
+  {
+    /* End of the audio data */
+    WaveDataLength = 0;
+  }
+  else
+  {
+    /* The ring ran empty, WavePlayerFill() restarts the DMA */
+    PlayUnderruns++;
+  }
+}
+
+/**
+  * @brief  Convert the samples read from the file to the format of the sink,
+  *         in place. 24-bit samples are played in 32-bit words, most
+  *         significant half word first (the order of the I2S transfers).
+  * @param  buf: Samples of the file
+  * @param  size: Size of the samples in bytes
+  * @retval Size of the converted samples in bytes
+  */
+static uint32_t WavePlayer_Convert(uint8_t* buf, uint32_t size)
+{
+  uint32_t count = size / PlayInBytes, idx = 0, n, i;
+  uint32_t* out32 = (uint32_t*)buf;
+  uint16_t* out16 = (uint16_t*)buf;
+  uint32_t b0, b1, b2;
+  int32_t chunk[PLAY_DITHER_CHUNK];
+  float f;
+  
+  if (PlayFloat)
+  {
+    /* Float samples become 32-bit integers, clipped at full scale */
+    for (idx = 0; idx < count; idx++)
+    {
+      f = ((float*)buf)[idx];
+      if (f >= 1.0f)
+      {
+        out32[idx] = 0x7FFFFFFF;
+      }
+      else if (f <= -1.0f)
+      {
+        out32[idx] = 0x80000000;
+      }
+      else
+      {
+        out32[idx] = (uint32_t)(int32_t)(f * 2147483648.0f);
+      }
+    }
+  }
+  
+  if (PlayInBytes == PlayOutBytes)
+  {
+    if (PlayOutBytes == 4)
+    {
+      /* 32-bit samples: only the half words are swapped */
+      for (idx = 0; idx < count; idx++)
+      {
+        out32[idx] = __ROR(out32[idx], 16);
+      }
+    }
+  }
+  else if (PlayOutBytes == 4)
+  {
+    /* 24-bit samples grow by one byte: from the end */
+    for (idx = count; idx-- > 0; )
+    {
+      b0 = buf[3 * idx];
+      b1 = buf[3 * idx + 1];
+      b2 = buf[3 * idx + 2];
+      out32[idx] = (b2 << 8) | b1 | (b0 << 24);
+    }
+  }
+  else if (PlayInBytes == 4)
+  {
+    /* The sink takes 16 bits: dithered in place */
+    DITHER_Process(&PlayDither, (int16_t*)buf, (int32_t*)buf, count);
+  }
+  else
+  {
+    /* 24-bit samples are widened a chunk at a time (an even number of
+       samples, so the stereo frames stay whole) and dithered */
+    for (idx = 0; idx < count; idx += n)
+    {
+      n = ((count - idx) < PLAY_DITHER_CHUNK) ? (count - idx) : PLAY_DITHER_CHUNK;
+      for (i = 0; i < n; i++)
+      {
+        b0 = buf[3 * (idx + i)];
+        b1 = buf[3 * (idx + i) + 1];
+        b2 = buf[3 * (idx + i) + 2];
+        chunk[i] = (int32_t)((b2 << 24) | (b1 << 16) | (b0 << 8));
+      }
+      DITHER_Process(&PlayDither, (int16_t*)&out16[idx], chunk, n);
+    }
+  }
+  return count * PlayOutBytes;
+}
+
+/**
+  * @brief  Get the dither used when the file has more bits than the sink
+  * @param  None
+  * @retval Dither of the player
+  */
+DITHER_TypeDef* WavePlayerGetDither(void)
+{
+  if (PlayDither.seed == 0)
+  {
+    DITHER_Init(&PlayDither, CHANNEL_STEREO, PLAY_DITHER_ORDER);
+  }
+  return &PlayDither;
+}
+
 /**
   * @brief  Reset the wave player
   * @param  None
@@ -535,84 +900,136 @@ static ErrorCode WavePlayer_WaveParsing(uint32_t *FileLen)
 {
   uint32_t temp = 0x00;
   uint32_t extraformatbytes = 0;
+  uint32_t formatsize = 0;
   
   /* Read chunkID, must be 'RIFF' */
-  temp = ReadUnit((uint8_t*)buffer1, 0, 4, BigEndian);
+  temp = ReadUnit((uint8_t*)PlayBuf[0], 0, 4, BigEndian);
   if (temp != CHUNK_ID)
   {
     return(Unvalid_RIFF_ID);
   }
   
   /* Read the file length */
-  WAVE_Format.RIFFchunksize = ReadUnit((uint8_t*)buffer1, 4, 4, LittleEndian);
+  WAVE_Format.RIFFchunksize = ReadUnit((uint8_t*)PlayBuf[0], 4, 4, LittleEndian);
   
   /* Read the file format, must be 'WAVE' */
-  temp = ReadUnit((uint8_t*)buffer1, 8, 4, BigEndian);
+  temp = ReadUnit((uint8_t*)PlayBuf[0], 8, 4, BigEndian);
   if (temp != FILE_FORMAT)
   {
     return(Unvalid_WAVE_Format);
   }
   
   /* Read the format chunk, must be'fmt ' */
-  temp = ReadUnit((uint8_t*)buffer1, 12, 4, BigEndian);
+  temp = ReadUnit((uint8_t*)PlayBuf[0], 12, 4, BigEndian);
   if (temp != FORMAT_ID)
   {
     return(Unvalid_FormatChunk_ID);
   }
   /* Read the length of the 'fmt' data, must be 0x10 -------------------------*/
-  temp = ReadUnit((uint8_t*)buffer1, 16, 4, LittleEndian);
+  temp = ReadUnit((uint8_t*)PlayBuf[0], 16, 4, LittleEndian);
+  formatsize = temp;
   if (temp != 0x10)
   {
     extraformatbytes = 1;
   }
   /* Read the audio format, must be 0x01 (PCM) */
-  WAVE_Format.FormatTag = ReadUnit((uint8_t*)buffer1, 20, 2, LittleEndian);
-  if (WAVE_Format.FormatTag != WAVE_FORMAT_PCM)
+  WAVE_Format.FormatTag = ReadUnit((uint8_t*)PlayBuf[0], 20, 2, LittleEndian);
+  if ((WAVE_Format.FormatTag == WAVE_FORMAT_EXTENSIBLE) && (formatsize >= 40))
+  {
+    /* Extensible format (usual for more than 16 bits): the sub-format counts */
+    WAVE_Format.FormatTag = ReadUnit((uint8_t*)PlayBuf[0], 44, 2, LittleEndian);
+    extraformatbytes = 2;
+  }
+  PlayFloat = (WAVE_Format.FormatTag == WAVE_FORMAT_IEEE_FLOAT);
+  PlayAdpcmSamples = 0;
+  if ((WAVE_Format.FormatTag != WAVE_FORMAT_PCM) && (PlayFloat == 0) &&
+      (WAVE_Format.FormatTag != WAVE_FORMAT_IMA_ADPCM))
   {
     return(Unsupporetd_FormatTag);
   }
   
   /* Read the number of channels, must be 0x01 (Mono) or 0x02 (Stereo) */
-  WAVE_Format.NumChannels = ReadUnit((uint8_t*)buffer1, 22, 2, LittleEndian);
+  WAVE_Format.NumChannels = ReadUnit((uint8_t*)PlayBuf[0], 22, 2, LittleEndian);
+  if ((WAVE_Format.NumChannels != CHANNEL_MONO) && (WAVE_Format.NumChannels != CHANNEL_STEREO))
+  {
+    return(Unsupporetd_Number_Of_Channel);
+  }
   
   /* Read the Sample Rate */
-  WAVE_Format.SampleRate = ReadUnit((uint8_t*)buffer1, 24, 4, LittleEndian);
+  WAVE_Format.SampleRate = ReadUnit((uint8_t*)PlayBuf[0], 24, 4, LittleEndian);
 
   /* Read the Byte Rate */
-  WAVE_Format.ByteRate = ReadUnit((uint8_t*)buffer1, 28, 4, LittleEndian);
+  WAVE_Format.ByteRate = ReadUnit((uint8_t*)PlayBuf[0], 28, 4, LittleEndian);
   
   /* Read the block alignment */
-  WAVE_Format.BlockAlign = ReadUnit((uint8_t*)buffer1, 32, 2, LittleEndian);
+  WAVE_Format.BlockAlign = ReadUnit((uint8_t*)PlayBuf[0], 32, 2, LittleEndian);
   
   /* Read the number of bits per sample */
-  WAVE_Format.BitsPerSample = ReadUnit((uint8_t*)buffer1, 34, 2, LittleEndian);
-  if (WAVE_Format.BitsPerSample != BITS_PER_SAMPLE_16) 
+  WAVE_Format.BitsPerSample = ReadUnit((uint8_t*)PlayBuf[0], 34, 2, LittleEndian);
+  if (WAVE_Format.FormatTag == WAVE_FORMAT_IMA_ADPCM)
+  {
+    if (WAVE_Format.BitsPerSample != BITS_PER_SAMPLE_4)
+    {
+      return(Unsupporetd_Bits_Per_Sample);
+    }
+    /* The extra format bytes hold the number of samples per block, the
+       block is made of 4-byte groups and has to fit in a playback buffer
+       once decoded */
+    PlayAdpcmSamples = ADPCM_SAMPLES_PER_BLOCK(WAVE_Format.BlockAlign, WAVE_Format.NumChannels);
+    if ((formatsize < 0x14) || (ReadUnit((uint8_t*)PlayBuf[0], 36, 2, LittleEndian) < 2) ||
+        (WAVE_Format.BlockAlign <= 4 * WAVE_Format.NumChannels) ||
+        (WAVE_Format.BlockAlign % (4 * WAVE_Format.NumChannels)) ||
+        (ReadUnit((uint8_t*)PlayBuf[0], 38, 2, LittleEndian) != PlayAdpcmSamples) ||
+        ((PlayAdpcmSamples * WAVE_Format.NumChannels * 2 + 4) > PLAY_BUFFER_SIZE))
+    {
+      PlayAdpcmSamples = 0;
+      return(Unsupporetd_ExtraFormatBytes);
+    }
+    /* Skip the extension and the optional "Fact Chunk" */
+    extraformatbytes = 2;
+  }
+  else if ((WAVE_Format.BitsPerSample != BITS_PER_SAMPLE_16) &&
+      (WAVE_Format.BitsPerSample != BITS_PER_SAMPLE_24) &&
+      (WAVE_Format.BitsPerSample != BITS_PER_SAMPLE_32)) 
+  {
+    return(Unsupporetd_Bits_Per_Sample);
+  }
+  if (PlayFloat && (WAVE_Format.BitsPerSample != BITS_PER_SAMPLE_32))
   {
     return(Unsupporetd_Bits_Per_Sample);
   }
   SpeechDataOffset = 36;
+  if (extraformatbytes == 2)
+  {
+    /* Skip the extension and the optional "Fact Chunk" */
+    SpeechDataOffset = 20 + formatsize;
+    if (ReadUnit((uint8_t*)PlayBuf[0], SpeechDataOffset, 4, BigEndian) == FACT_ID)
+    {
+      SpeechDataOffset += 8 + ReadUnit((uint8_t*)PlayBuf[0], SpeechDataOffset + 4, 4, LittleEndian);
+    }
+  }
   /* If there is Extra format bytes, these bytes will be defined in "Fact Chunk" */
-  if (extraformatbytes == 1)
+  else if (extraformatbytes == 1)
   {
     /* Read th Extra format bytes, must be 0x00 */
-    temp = ReadUnit((uint8_t*)buffer1, 36, 2, LittleEndian);
+    temp = ReadUnit((uint8_t*)PlayBuf[0], 36, 2, LittleEndian);
     if (temp != 0x00)
     {
       return(Unsupporetd_ExtraFormatBytes);
     }
     /* Read the Fact chunk, must be 'fact' */
-    temp = ReadUnit((uint8_t*)buffer1, 38, 4, BigEndian);
+    temp = ReadUnit((uint8_t*)PlayBuf[0], 38, 4, BigEndian);
     if (temp != FACT_ID)
     {
       return(Unvalid_FactChunk_ID);
     }
     /* Read Fact chunk data Size */
-    temp = ReadUnit((uint8_t*)buffer1, 42, 4, LittleEndian);
+    temp = ReadUnit((uint8_t*)PlayBuf[0], 42, 4, LittleEndian);
     
     SpeechDataOffset += 10 + temp;
   }
   /* Read the Data chunk, must be 'data' */
-  temp = ReadUnit((uint8_t*)buffer1, SpeechDataOffset, 4, BigEndian);
+  temp = ReadUnit((uint8_t*)PlayBuf[0], SpeechDataOffset, 4, BigEndian);
   SpeechDataOffset += 4;
   if (temp != DATA_ID)
   {
@@ -620,7 +1037,7 @@ static ErrorCode WavePlayer_WaveParsing(uint32_t *FileLen)
   }
   
   /* Read the number of sample data */
-  WAVE_Format.DataSize = ReadUnit((uint8_t*)buffer1, SpeechDataOffset, 4, LittleEndian);
+  WAVE_Format.DataSize = ReadUnit((uint8_t*)PlayBuf[0], SpeechDataOffset, 4, LittleEndian);
   SpeechDataOffset += 4;
   WaveCounter =  SpeechDataOffset;
   return(Valid_WAVE_File);
@@ -638,7 +1055,7 @@ static ErrorCode WavePlayer_WaveParsing(uint32_t *FileLen)
 *             - BigEndian
 * @retval Bytes read from the SPI Flash.
 */
-uint32_t ReadUnit(uint8_t *buffer, uint8_t idx, uint8_t NbrOfBytes, Endianness BytesFormat)
+uint32_t ReadUnit(uint8_t *buffer, uint32_t idx, uint8_t NbrOfBytes, Endianness BytesFormat)
 {
   uint32_t index = 0;
   uint32_t temp = 0;
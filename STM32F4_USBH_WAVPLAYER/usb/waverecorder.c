@@ -23,15 +23,26 @@
 #include "pdm_filter.h"
 #include "waverecorder.h" 
 #include "ff.h"
+#include "diskio.h"
+#include "adpcm.h"
+#include "vad.h"
+#include "wavemonitor.h"
+#include "agc.h"
+#include "denoise.h"
+#include "pdmsim.h"
+#include "i2sclk.h"
+#include <stdio.h>
+#include <string.h>
 #include <usb_core.h>
 #include <led.h>
+#include <timers.h>
 
 /** @addtogroup STM32F4-Discovery_Audio_Player_Recorder
 * @{
 */ 
 
-#define TIME_REC                20000 /* Recording time in millisecond(Systick Time Base*TIME_REC= 10ms*3000)
-                                         (default: 30s) */
+#define TIME_REC                0     /* Recording time in millisecond (Systick Time Base*TIME_REC= 1ms*TIME_REC)
+                                         0: no limit, the recording is stopped with the User button */
 #define REC_WAVE_NAME "0:rec.wav"
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -50,68 +61,443 @@
 
 #define AUDIO_REC_SPI_IRQHANDLER          SPI2_IRQHandler
 
-/* Audio recording frequency in Hz */
-#define REC_FREQ                8000
+/* Default recording configuration */
+#define REC_DEFAULT_FREQ        SAMPLE_RATE_16000
+#define REC_DEFAULT_CHANNELS    CHANNEL_MONO
+#define REC_DEFAULT_BITS        BITS_PER_SAMPLE_16
+#define REC_DEFAULT_FORMAT      WAVE_FORMAT_PCM
 
-/* PDM buffer input size */
-#define INTERNAL_BUFF_SIZE      64
+/* PDM decimation ratio of the PDM filter library (PDM_Filter_64_LSB) */
+#define PDM_DECIMATION          64
 
-/* PCM buffer output size */
-#define PCM_OUT_SIZE            16
+/* Lowest PDM filter output frequency. The MEMS microphone needs a clock of
+   at least 1 MHz, so lower rates are decimated further in software. */
+#define PDM_MIN_FREQ            SAMPLE_RATE_16000
 
+/* Software decimation by 2: half-band low-pass of PDM_HALFBAND_TAPS taps
+   (Kaiser window, beta 4), pass band to 0.2 and stop band (-47 dB) from 0.3
+   of the PDM filter output frequency */
+#define PDM_HALFBAND_TAPS       31
 
-#define RAM_BUFFER_SIZE         1500  /* 3Kbytes (1500 x 16 bit) as a RAM buffer size.
-                                           More the size is higher, the recorded quality is better */
+/* Highest supported recording frequency */
+#define REC_MAX_FREQ            SAMPLE_RATE_48000
+
+/* PDM buffer input size (16-bit words per millisecond at the highest rate) */
+#define INTERNAL_BUFF_SIZE      ((REC_MAX_FREQ / 1000) * PDM_DECIMATION / 16)
+
+/* PCM buffer output size (samples per millisecond at the highest rate) */
+#define PCM_OUT_SIZE            (REC_MAX_FREQ / 1000)
+
+/* Largest frame: stereo, 24-bit */
+#define REC_MAX_FRAME_SIZE      (CHANNEL_STEREO * 3)
+
+/* Amount of audio held in one RAM buffer before it is written to the disk.
+   The buffer size is derived from the byte rate, rounded down to whole
+   sectors and limited to RAM_BUFFER_MAX_SIZE. */
+#define RAM_BUFFER_TIME         100   /* in milliseconds */
+#define RAM_BUFFER_MAX_SIZE     8192  /* in bytes */
+#define RAM_BUFFER_ALIGN        512   /* in bytes */
+
+/* Default interval between two checkpoints of the recorded file.
+   A checkpoint updates the wave header and the directory entry, so the
+   file stays playable when the USB Key is removed or the power is lost. */
+#define REC_CHECKPOINT_TIME     2000  /* in milliseconds, 0: disabled */
+
+/* Voice activity gating: only the segments with voice activity are
+   written, the start of every segment is indexed in a 'cue ' chunk */
+#define REC_VAD_FRAME_TIME      10    /* Analysis frame in milliseconds */
+#define REC_VAD_HANGOVER_TIME   500   /* Silence kept after the voice in milliseconds */
+#define REC_VAD_MAX_CUES        256   /* Indexed segments */
+#define REC_CUE_POINT_SIZE      24
+#define REC_CUE_BATCH           8     /* Cue points written at a time */
+
+/* Pre-trigger history: the PDM filter output is kept in a ring buffer in
+   CCM RAM. When the pre-roll is enabled the microphone runs all the time
+   and a recording starts with the audio captured before the trigger. The
+   ring holds one block (1 ms) per entry, the pre-roll is limited to half
+   of the ring so that the file creation is hidden in the other half. */
+#define REC_PREROLL_TIME        500   /* in milliseconds, 0: disabled */
+#define REC_RING_SIZE           30720 /* in samples (60 KB) */
+
+/* Input monitoring: the captured audio is played on the codec output
+   while recording (not in the duplex mode, where the codec plays a file) */
+#define REC_MONITOR             1     /* 1: enabled, 0: disabled */
+
+/* Gain of the PDM filter. The level is then set by the automatic gain
+   control on every block (1 ms), so the monitor hears the same level as
+   the recording. */
+#define REC_PDM_GAIN            50
+#define REC_AGC                 1     /* 1: enabled, 0: disabled */
+
+/* Spectral suppression of the steady background noise, at the recorded
+   frequency. It delays the recording by DENOISE_FFT_LEN samples. */
+#define REC_DENOISE             0     /* 1: enabled, 0: disabled */
+
+/* Largest wave file: the sizes in the header are 32-bit */
+#define REC_MAX_FILE_SIZE       (0xFFFFFFFF - RAM_BUFFER_MAX_SIZE)
+
+/* IMA ADPCM block size: one block per sector */
+#define REC_ADPCM_BLOCK_SIZE    512
+#define REC_ADPCM_MAX_SAMPLES   ADPCM_SAMPLES_PER_BLOCK(REC_ADPCM_BLOCK_SIZE, CHANNEL_MONO)
+
+/* Segmented recording: the audio goes to a series of files of
+   REC_SEGMENT_TIME each. The next segment is created and its clusters are
+   allocated in the background, in steps of REC_SEGMENT_STEP bytes, while
+   the current one is written. When the free space is lower than
+   REC_SEGMENT_SPARE + 1 segments, the oldest segment is recycled as the
+   next one (its clusters are reused without being freed). */
+#define REC_SEGMENT_TIME        0     /* in seconds, 0: one file (REC_WAVE_NAME) */
+#define REC_SEGMENT_NAME        "0:rec%03u.wav"
+#define REC_SEGMENT_MAX         1000  /* Segment names wrap after rec999.wav */
+#define REC_SEGMENT_STEP        65536 /* in bytes */
+#define REC_SEGMENT_SPARE       1     /* in segments */
+
+/* Preparation of the next segment */
+#define SEGMENT_NONE            0     /* Not started */
+#define SEGMENT_ALLOC           1     /* File open, allocating the clusters */
+#define SEGMENT_READY           2     /* Allocated, header written */
+
+/* Benchmark of the recorder: a synthetic PDM bitstream replaces the
+   microphone, the rest of the chain (PDM filter, processing, RAM buffers,
+   FatFs on the USB Key) is the one used for recording */
+#define REC_BENCH_TONE_FREQ     1000  /* in Hz */
+#define REC_BENCH_TONE_LEVEL    -6    /* in dBFS */
+#define REC_BENCH_NOISE_LEVEL   -40   /* in dBFS */
+
+/* Offsets of the size fields in the wave header */
+#define REC_RIFF_SIZE_OFFSET    4
+#define REC_DATA_SIZE_OFFSET    (REC_HEADER_SIZE - 4)
 
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
-extern __IO uint16_t Time_Rec_Base;
+extern __IO uint32_t Time_Rec_Base;
 extern __IO uint8_t Command_index;
 extern USB_OTG_CORE_HANDLE  USB_OTG_Core;
 extern __IO uint32_t WaveCounter;
 extern FIL file;
 extern __IO uint8_t LED_Toggle1;
-uint16_t RAM_Buf[RAM_BUFFER_SIZE];
-uint16_t RAM_Buf1 [RAM_BUFFER_SIZE];
-uint16_t buf_idx = 0, buf_idx1 =0;
-uint16_t *writebuffer;
-uint16_t counter = 0;
+extern void commandCallback(void);
+uint8_t RAM_Buf[RAM_BUFFER_MAX_SIZE];
+uint8_t RAM_Buf1 [RAM_BUFFER_MAX_SIZE];
+uint32_t buf_idx = 0;
+uint8_t *pRamBuf;
+static uint8_t *pRamPending = 0;      /* Full RAM buffer waiting to be written */
 uint8_t WaveRecStatus = 0;
 /* Current state of the audio recorder interface intialization */
 static uint32_t AudioRecInited = 0;
 PDMFilter_InitStruct Filter;
-/* Audio recording Samples format (from 8 to 16 bits) */
+/* Audio recording Samples format (16 or 24 bits) */
 uint32_t AudioRecBitRes = 16; 
-uint16_t RecBuf[PCM_OUT_SIZE], RecBuf1[PCM_OUT_SIZE];
-uint8_t RecBufHeader[512], Switch = 0;
-__IO uint32_t Data_Status =0;
+uint16_t RecBuf[PCM_OUT_SIZE];
+uint8_t RecBufHeader[REC_HEADER_SIZE];
 /* Audio recording number of channels (1 for Mono or 2 for Stereo) */
 uint32_t AudioRecChnlNbr = 1;
-/* Main buffer pointer for the recorded data storing */
-uint16_t* pAudioRecBuf;
-/* Current size of the recorded buffer */
-uint32_t AudioRecCurrSize = 0; 
-uint16_t bytesWritten;
+/* State of the microphone capture */
+static uint32_t AudioRecRunning = 0;
+UINT bytesWritten;
 /* Temporary data sample */
 static uint16_t InternalBuffer[INTERNAL_BUFF_SIZE];
 static uint32_t InternalBufferSize = 0;
+/* Requested recording configuration */
+static WaveRecorder_ConfigTypeDef RecConfig =
+{
+  REC_DEFAULT_FREQ,
+  REC_DEFAULT_CHANNELS,
+  REC_DEFAULT_BITS,
+  REC_DEFAULT_FORMAT
+};
+/* Parameters derived from the recording configuration */
+static uint32_t AudioRecFreq = REC_DEFAULT_FREQ;
+static uint32_t PdmFreq = PDM_MIN_FREQ;         /* PDM filter output frequency */
+static I2SCLK_PlanTypeDef RecClockPlan;          /* Clock setting of the microphone I2S */
+static uint32_t PdmDecim = 1;                   /* Software decimation after the PDM filter */
+static uint32_t PdmInSize = INTERNAL_BUFF_SIZE; /* PDM words consumed by one filter call */
+static uint32_t PcmOutSize = PCM_OUT_SIZE;      /* PCM samples produced by one filter call */
+static uint32_t RecFrameSize = 2;               /* Bytes per recorded frame */
+static uint32_t RecFormat = WAVE_FORMAT_PCM;    /* Format tag of the recorded file */
+static uint32_t RecByteRate = 0;                /* Bytes per second in the file */
+static uint32_t RecFactOffset = 46;             /* Offset of the number of samples in the header */
+static uint32_t RamBufferSize = RAM_BUFFER_ALIGN;
+static uint32_t RecBlockMaxSize = 0;            /* Largest data stored for one block */
+/* Odd taps of the half-band low-pass from the centre on (Q15), the even
+   ones are 0 and the centre is 0.5 */
+static const int16_t PdmHalfBand[(PDM_HALFBAND_TAPS + 1) / 4] =
+{
+  10359, -3245, 1715, -1005, 590, -328, 161, -62
+};
+static int16_t PdmDecimHist[PDM_HALFBAND_TAPS - 1 + PCM_OUT_SIZE]; /* Filter history and block */
+/* Checkpoints of the recorded file */
+static uint32_t CheckpointTime = REC_CHECKPOINT_TIME;
+static uint32_t CheckpointSize = 0;   /* Bytes of audio between two checkpoints */
+static uint32_t CheckpointData = 0;   /* Audio data size at the last checkpoint */
+static uint32_t RecDataSize = 0;      /* Audio data written to the file */
+static uint8_t  RecWriteError = 0;
+static uint32_t RecTrailerSize = 0;   /* Chunks written after the 'data' chunk */
+/* Voice activity gating */
+static uint8_t  RecVadEnable = 0;
+static uint8_t  RecVadActive = 0;
+static VAD_TypeDef RecVad;
+static uint32_t RecFrames = 0;        /* Frames sent to the file */
+static uint32_t RecCues[REC_VAD_MAX_CUES];
+static uint32_t RecCueCount = 0;
+/* Segmented recording */
+static FIL SegmentFile;                 /* Second file object of the segments */
+static FIL* RecFile = &file;            /* File being recorded */
+static FIL* SegmentNext = &SegmentFile; /* Next segment */
+static uint32_t SegmentTime = REC_SEGMENT_TIME;
+static uint32_t SegmentSize = 0;        /* Audio data bytes in one segment */
+static uint32_t SegmentIndex = 0;       /* Segment being written */
+static uint32_t SegmentOldest = 0;      /* Oldest segment on the disk */
+static uint8_t  SegmentState = SEGMENT_NONE;
+static char     RecFileName[16] = REC_WAVE_NAME; /* File being written */
+/* Ring buffer of the PDM filter output */
+static uint16_t RecRing[REC_RING_SIZE] __attribute__ ((section(".bss.CCMRAM"), aligned(4)));
+static uint32_t RecRingBlocks = REC_RING_SIZE / PCM_OUT_SIZE;
+static __IO uint32_t RecRingHead = 0; /* Blocks written by the SPI interrupt */
+static uint32_t RecRingTail = 0;      /* Blocks read by the recorder */
+static __IO uint32_t RecTrigger = 0;  /* Head at the trigger */
+static __IO uint8_t RecTriggered = 0;
+static uint32_t PrerollTime = REC_PREROLL_TIME;
+static uint8_t  RecMonitorEnable = REC_MONITOR;
+static uint8_t  RecSimulation = 0;    /* The blocks come from WaveRecorderBench() */
+/* Automatic gain control of the captured blocks */
+static AGC_TypeDef RecAgc;
+uint32_t RecAgcCycles = 0;            /* Longest AGC block in CPU cycles */
+/* Noise suppression of the recorded samples */
+static DENOISE_TypeDef RecDenoise;
+static uint8_t  RecDenoiseEnable = REC_DENOISE;
+uint32_t RecDenoiseCycles = 0;        /* Longest suppressor block in CPU cycles */
+uint32_t RecOverruns = 0;             /* Blocks lost because the ring was full */
+/* Recorded frames waiting to be stored in the RAM buffer */
+static uint8_t FrameBuf[PCM_OUT_SIZE * REC_MAX_FRAME_SIZE];
+/* IMA ADPCM encoder: frames of the block being collected and the encoded block */
+static ADPCM_StateTypeDef AdpcmState[CHANNEL_STEREO];
+static int16_t AdpcmPcm[REC_ADPCM_MAX_SAMPLES];
+static uint8_t AdpcmBlock[REC_ADPCM_BLOCK_SIZE];
+static uint32_t AdpcmSamplesPerBlock = REC_ADPCM_MAX_SAMPLES;
+static uint32_t AdpcmIdx = 0;                   /* Bytes collected in AdpcmPcm */
+static uint32_t AdpcmPadFrames = 0;             /* Padding frames in the last block */
 
 /* Private function prototypes -----------------------------------------------*/
 static void WaveRecorder_GPIO_Init(void);
 static void WaveRecorder_SPI_Init(uint32_t Freq);
 static void WaveRecorder_NVIC_Init(void);
+static uint32_t WaveRecorder_FormatFrames(uint16_t* pPcm, uint32_t Len, uint8_t* pFrames);
+static void WaveRecorder_EncodeData(uint8_t* pData, uint32_t Size);
+static void WaveRecorder_EncodeFlush(void);
+static void WaveRecorder_StoreData(uint8_t* pData, uint32_t Size);
+static void WaveRecorder_FlushData(void);
+static void WaveRecorder_Checkpoint(void);
+static uint32_t WaveRecorder_CueChunk(uint32_t Count);
+static void WaveRecorder_WritePending(void);
+static uint32_t WaveRecorder_DataFrames(uint32_t DataSize);
+static void WaveRecorder_FinishFile(uint32_t Frames);
+static void WaveRecorder_SegmentName(char* pName, uint32_t Index);
+static uint8_t WaveRecorder_SegmentPrepare(void);
+static void WaveRecorder_SegmentSwitch(void);
+static uint32_t WaveRecorder_Run(void);
+static void WaveRecorder_FilterBlock(void);
+static uint32_t WaveRecorder_Decimate(uint16_t* pPcm);
+static uint8_t WaveRecorder_ReadBlock(uint16_t* pPcm);
+static void WaveRecorder_ProcessBlock(uint16_t* pPcm);
+static uint8_t WaveRecorder_Continue(void);
+static void WaveRecorder_WriteUnit(uint8_t* pBuf, uint32_t idx, uint32_t Value, uint8_t NbrOfBytes);
 
 /* Private functions ---------------------------------------------------------*/
 
 /**
-  * @brief  Initialize wave recording
-  * @param  AudioFreq: Sampling frequency
-  *         BitRes: Audio recording Samples format (from 8 to 16 bits)
-  *         ChnlNbr: Number of input microphone channel
+  * @brief  Set the recording configuration used by the next recording
+  * @param  pConfig: Pointer to the requested configuration
+  * @retval 0 if the configuration is supported, 1 otherwise
+  */
+uint32_t WaveRecorderConfig(WaveRecorder_ConfigTypeDef* pConfig)
+{
+  if ((pConfig->SampleRate != SAMPLE_RATE_8000) && (pConfig->SampleRate != SAMPLE_RATE_16000) &&
+      (pConfig->SampleRate != SAMPLE_RATE_32000) && (pConfig->SampleRate != SAMPLE_RATE_48000))
+  {
+    return 1;
+  }
+  if ((pConfig->NbrChannels != CHANNEL_MONO) && (pConfig->NbrChannels != CHANNEL_STEREO))
+  {
+    return 1;
+  }
+  if ((pConfig->BitsPerSample != BITS_PER_SAMPLE_16) && (pConfig->BitsPerSample != BITS_PER_SAMPLE_24))
+  {
+    return 1;
+  }
+  if ((pConfig->FormatTag != WAVE_FORMAT_PCM) &&
+      ((pConfig->FormatTag != WAVE_FORMAT_IMA_ADPCM) || (pConfig->BitsPerSample != BITS_PER_SAMPLE_16)))
+  {
+    return 1;
+  }
+  
+  RecConfig = *pConfig;
+  
+  /* Force a new initialization with the new parameters */
+  AudioRecInited = 0;
+  
+  return 0;
+}
+
+/**
+  * @brief  Get the current recording configuration
+  * @param  pConfig: Pointer to the structure to be filled
+  * @retval None
+  */
+void WaveRecorderGetConfig(WaveRecorder_ConfigTypeDef* pConfig)
+{
+  *pConfig = RecConfig;
+}
+
+/**
+  * @brief  Set the interval between two checkpoints of the recorded file
+  * @param  Interval: Time of audio between two checkpoints in milliseconds,
+  *         0 disables the checkpoints (the header is written only at the end)
+  * @retval None
+  */
+void WaveRecorderSetCheckpoint(uint32_t Interval)
+{
+  CheckpointTime = Interval;
+}
+
+/**
+  * @brief  Set the length of the segments of the recording
+  * @param  Time: Length of one file in seconds, 0 records to a single file
+  *         (used by the next recording)
+  * @retval None
+  */
+void WaveRecorderSetSegment(uint32_t Time)
+{
+  SegmentTime = Time;
+}
+
+/**
+  * @brief  Get the name of the file being recorded, or of the last
+  *         recorded file (the last segment of a segmented recording).
+  * @param  None
+  * @retval File name
+  */
+const char* WaveRecorderFileName(void)
+{
+  return RecFileName;
+}
+
+/**
+  * @brief  Enable or disable voice activity gating. When enabled, silence is
+  *         not written to the file and the start of every voice segment
+  *         is stored in a 'cue ' chunk at the end of the file.
+  * @param  State: 1 to enable, 0 to disable
   * @retval None
   */
+void WaveRecorderSetVad(uint8_t State)
+{
+  RecVadEnable = State;
+}
+
+/**
+  * @brief  Set the length of the pre-trigger history
+  * @param  Time: Audio recorded before the trigger in milliseconds, 0 disables
+  *         the pre-roll (the microphone runs only while recording). It is
+  *         limited to half of the ring buffer.
+  * @retval None
+  */
+void WaveRecorderSetPreroll(uint32_t Time)
+{
+  PrerollTime = Time;
+}
+
+/**
+  * @brief  Enable or disable the input monitoring: the microphone is heard
+  *         on the headphones while recording.
+  * @param  State: 1 to enable, 0 to disable (used by the next recording)
+  * @retval None
+  */
+void WaveRecorderSetMonitor(uint8_t State)
+{
+  RecMonitorEnable = State;
+}
+
+/**
+  * @brief  Enable or disable the noise suppression of the recording.
+  * @param  State: 1 to enable, 0 to disable (used by the next recording)
+  * @retval None
+  */
+void WaveRecorderSetDenoise(uint8_t State)
+{
+  RecDenoiseEnable = State;
+}
+
+/**
+  * @brief  Get the noise suppressor of the recording, its parameters can be
+  *         changed at any time and its statistics are kept until the next
+  *         recording.
+  * @param  None
+  * @retval Pointer to the suppressor
+  */
+DENOISE_TypeDef* WaveRecorderGetDenoise(void)
+{
+  return &RecDenoise;
+}
+
+/**
+  * @brief  Get the automatic gain control of the capture, its parameters
+  *         can be changed at any time.
+  * @param  None
+  * @retval Pointer to the AGC
+  */
+AGC_TypeDef* WaveRecorderGetAgc(void)
+{
+  if (RecAgc.blockTime == 0)
+  {
+    AGC_Init(&RecAgc, 1000);
+    RecAgc.enabled = REC_AGC;
+  }
+  return &RecAgc;
+}
+
+/**
+  * @brief  Start the microphone capture in advance when the pre-roll is
+  *         enabled, so that the next recording has its history.
+  * @param  None
+  * @retval 0 if all operations are OK, 1 otherwise
+  */
+uint32_t WaveRecorderArm(void)
+{
+  if (PrerollTime == 0)
+  {
+    return 0;
+  }
+  return WaveRecorder_Run();
+}
+
+/**
+  * @brief  Mark the start of a recording. Called as soon as the record
+  *         command is given, the audio from Time ms before this point is
+  *         the beginning of the file.
+  * @param  None
+  * @retval None
+  */
+void WaveRecorderTrigger(void)
+{
+  RecTrigger = RecRingHead;
+  RecTriggered = 1;
+}
+
+/**
+  * @brief  Initialize wave recording
+  * @param  AudioFreq: Sampling frequency (8000, 16000, 32000 or 48000 Hz)
+  *         BitRes: Audio recording Samples format (16 or 24 bits)
+  *         ChnlNbr: Number of recorded channels (1 for Mono or 2 for Stereo).
+  *         The board has a single microphone, in stereo it is recorded
+  *         on both channels.
+  * @note   The file format (PCM or IMA ADPCM) is taken from the configuration
+  *         set with WaveRecorderConfig().
+  * @retval 0 if all operations are OK, 1 otherwise
+  */
 uint32_t WaveRecorderInit(uint32_t AudioFreq, uint32_t BitRes, uint32_t ChnlNbr)
 { 
+  uint32_t byterate = 0;
+  
   /* Check if the interface is already initialized */
   if (AudioRecInited)
   {
@@ -120,26 +506,85 @@ uint32_t WaveRecorderInit(uint32_t AudioFreq, uint32_t BitRes, uint32_t ChnlNbr)
   }
   else
   {
+    /* Derive the PDM clock and the decimation chain from the output rate:
+       PDM clock = PdmFreq x 64, output rate = PdmFreq / PdmDecim */
+    AudioRecFreq = AudioFreq;
+    PdmFreq = (AudioFreq < PDM_MIN_FREQ) ? PDM_MIN_FREQ : AudioFreq;
+    PdmDecim = PdmFreq / AudioFreq;
+    if ((PdmFreq > REC_MAX_FREQ) || (PdmDecim * AudioFreq != PdmFreq) || (PdmDecim > 2))
+    {
+      return 1;
+    }
+    memset(PdmDecimHist, 0, sizeof(PdmDecimHist));
+    PdmInSize = (PdmFreq / 1000) * PDM_DECIMATION / 16;
+    PcmOutSize = PdmFreq / 1000;
+    
+    /* The ring holds whole blocks */
+    RecRingBlocks = REC_RING_SIZE / PcmOutSize;
+    RecRingHead = 0;
+    RecRingTail = 0;
+    RecTriggered = 0;
+    AudioRecRunning = 0;
+    
+    /* Size of the RAM buffers: RAM_BUFFER_TIME of captured audio in whole
+       sectors. Encoded data fills the same buffers more slowly, so there
+       are fewer and larger writes. */
+    RecFrameSize = ChnlNbr * (BitRes / 8);
+    byterate = AudioFreq * RecFrameSize;
+    RecFormat = RecConfig.FormatTag;
+    RecByteRate = byterate;
+    if (RecFormat == WAVE_FORMAT_IMA_ADPCM)
+    {
+      AdpcmSamplesPerBlock = ADPCM_SAMPLES_PER_BLOCK(REC_ADPCM_BLOCK_SIZE, ChnlNbr);
+      RecByteRate = (AudioFreq * REC_ADPCM_BLOCK_SIZE) / AdpcmSamplesPerBlock;
+    }
+    RecBlockMaxSize = (PcmOutSize / PdmDecim) * RecFrameSize;
+    if (RecFormat == WAVE_FORMAT_IMA_ADPCM)
+    {
+      RecBlockMaxSize = REC_ADPCM_BLOCK_SIZE;
+    }
+    RamBufferSize = (byterate / 1000) * RAM_BUFFER_TIME;
+    RamBufferSize -= RamBufferSize % RAM_BUFFER_ALIGN;
+    if (RamBufferSize < RAM_BUFFER_ALIGN)
+    {
+      RamBufferSize = RAM_BUFFER_ALIGN;
+    }
+    else if (RamBufferSize > RAM_BUFFER_MAX_SIZE)
+    {
+      RamBufferSize = RAM_BUFFER_MAX_SIZE;
+    }
+    
     /* Enable CRC module */
     RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
     
-    /* Filter LP & HP Init */
-    Filter.LP_HZ = 8000;
+    /* Filter LP & HP Init: the low pass filter removes everything above
+       the Nyquist frequency of the final output rate */
+    Filter.LP_HZ = AudioFreq / 2;
     Filter.HP_HZ = 10;
-    Filter.Fs = 16000;
+    Filter.Fs = PdmFreq;
     Filter.Out_MicChannels = 1;
     Filter.In_MicChannels = 1;
     
     PDM_Filter_Init((PDMFilter_InitStruct *)&Filter);
     
+    /* Automatic gain control on the filter blocks (1 ms), the parameters
+       set over COMM are kept */
+    WaveRecorderGetAgc();
+    RecAgc.gain = AGC_UNITY_GAIN;
+    RecAgc.applied = AGC_UNITY_GAIN;
+    
+    /* Cycle counter for the AGC budget */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    
     /* Configure the GPIOs */
     WaveRecorder_GPIO_Init();
     
     /* Configure the interrupts (for timer) */
     WaveRecorder_NVIC_Init();
     
-    /* Configure the SPI */
-    WaveRecorder_SPI_Init(AudioFreq);
+    /* Configure the SPI: one 32-bit I2S frame carries 32 PDM bits */
+    WaveRecorder_SPI_Init(PdmFreq * PDM_DECIMATION / 32);
     
     /* Set the local parameters */
     AudioRecBitRes = BitRes;
@@ -154,19 +599,24 @@ uint32_t WaveRecorderInit(uint32_t AudioFreq, uint32_t BitRes, uint32_t ChnlNbr)
 }
 
 /**
-  * @brief  Start audio recording
-  * @param  pbuf: pointer to a buffer
-  *         size: Buffer size
+  * @brief  Start audio capture into the ring buffer
+  * @param  None
   * @retval None
   */
-uint8_t WaveRecorderStart(uint16_t* pbuf, uint32_t size)
+uint8_t WaveRecorderStart(void)
 {
 /* Check if the interface has already been initialized */
   if (AudioRecInited)
   {
-    /* Store the location and size of the audio buffer */
-    pAudioRecBuf = pbuf;
-    AudioRecCurrSize = size;
+    /* The playback may have changed the shared PLLI2S since the init. The
+       codec has the priority: a microphone clock too far off is refused */
+    if (I2SCLK_Config(SPI2, PdmFreq * PDM_DECIMATION / 32, &RecClockPlan) != 0)
+    {
+      return 1;
+    }
+    
+    InternalBufferSize = 0;
+    AudioRecRunning = 1;
     
     /* Enable the Rx buffer not empty interrupt */
     SPI_I2S_ITConfig(SPI2, SPI_I2S_IT_RXNE, ENABLE);
@@ -197,6 +647,7 @@ uint32_t WaveRecorderStop(void)
     
     /* Stop conversion */
     I2S_Cmd(SPI2, DISABLE); 
+    AudioRecRunning = 0;
     
     /* Return 0 if all operations are OK */
     return 0;
@@ -216,7 +667,6 @@ uint32_t WaveRecorderStop(void)
 
 void AUDIO_REC_SPI_IRQHANDLER(void)
 {  
-   u16 volume;
    u16 app;
 
   /* Check if data are available in SPI Data register */
@@ -226,26 +676,205 @@ void AUDIO_REC_SPI_IRQHANDLER(void)
     InternalBuffer[InternalBufferSize++] = HTONS(app);
     
     /* Check to prevent overflow condition */
-    if (InternalBufferSize >= INTERNAL_BUFF_SIZE)
+    if (InternalBufferSize >= PdmInSize)
     {
       InternalBufferSize = 0;
-     
-      volume = 50;
-      
-      PDM_Filter_64_LSB((uint8_t *)InternalBuffer, (uint16_t *)pAudioRecBuf, volume , (PDMFilter_InitStruct *)&Filter);
-      Data_Status = 1;       
+      WaveRecorder_FilterBlock();
+    }
+  }
+}
+
+/**
+  * @brief  Filter one millisecond of PDM data (InternalBuffer) into the
+  *         next block of the ring, at the recorded frequency.
+  * @param  None
+  * @retval None
+  */
+static void WaveRecorder_FilterBlock(void)
+{
+  uint16_t* pBlock = &RecRing[(RecRingHead % RecRingBlocks) * PcmOutSize];
+  uint32_t cycles = 0, len = 0;
+  
+  PDM_Filter_64_LSB((uint8_t *)InternalBuffer, pBlock, REC_PDM_GAIN, (PDMFilter_InitStruct *)&Filter);
+  len = WaveRecorder_Decimate(pBlock);
+  
+  /* Automatic gain control */
+  cycles = DWT->CYCCNT;
+  AGC_Process(&RecAgc, (int16_t*)pBlock, len);
+  cycles = DWT->CYCCNT - cycles;
+  if (cycles > RecAgcCycles)
+  {
+    RecAgcCycles = cycles;
+  }
+  
+  /* Input monitoring, straight to the codec */
+  MONITOR_Write(pBlock, len);
+  RecRingHead++;
+}
+
+/**
+  * @brief  Decimate one block of the PDM filter output to the recorded
+  *         frequency, in place. The half-band low-pass keeps the upper
+  *         half of the band from folding down into the recording and the
+  *         monitor output. It delays the audio by PDM_HALFBAND_TAPS / 2
+  *         samples of the PDM filter output.
+  * @param  pPcm: Block of PcmOutSize samples
+  * @retval Number of samples at the recorded frequency
+  */
+static uint32_t WaveRecorder_Decimate(uint16_t* pPcm)
+{
+  int16_t* pHist = PdmDecimHist;
+  uint32_t idx = 0, mid = 0, tap = 0, len = 0;
+  int32_t acc = 0;
+  
+  if (PdmDecim == 1)
+  {
+    return PcmOutSize;
+  }
+  
+  /* The new block follows the last PDM_HALFBAND_TAPS - 1 samples */
+  memcpy(&pHist[PDM_HALFBAND_TAPS - 1], pPcm, PcmOutSize * 2);
+  for (idx = 0; idx < PcmOutSize; idx += 2)
+  {
+    mid = idx + PDM_HALFBAND_TAPS / 2;
+    acc = (int32_t)pHist[mid] << 14;
+    for (tap = 0; tap < (PDM_HALFBAND_TAPS + 1) / 4; tap++)
+    {
+      acc += PdmHalfBand[tap] * ((int32_t)pHist[mid - 2 * tap - 1] + pHist[mid + 2 * tap + 1]);
+    }
+    acc = (acc + (1 << 14)) >> 15;
+    if (acc > 32767)
+    {
+      acc = 32767;
+    }
+    else if (acc < -32768)
+    {
+      acc = -32768;
+    }
+    pPcm[len++] = (uint16_t)acc;
+  }
+  memmove(pHist, &pHist[PcmOutSize], (PDM_HALFBAND_TAPS - 1) * 2);
+  
+  return len;
+}
+
+/**
+  * @brief  Measure the cost of the recording chain with a synthetic PDM
+  *         bitstream (tone and noise) instead of the microphone. The
+  *         recording configuration sets the PDM clock, the file is recorded
+  *         as usual.
+  * @param  Time: Audio to record in milliseconds
+  *         Speed: Rate of the PDM data in percent of real time, the blocks
+  *         which do not fit in the ring are lost (overruns). 0: as fast as
+  *         the chain can take them, to find its highest rate.
+  *         pStats: Results
+  * @retval 0 if all operations are OK, 1 otherwise
+  */
+uint32_t WaveRecorderBench(uint32_t Time, uint32_t Speed, WaveRecorder_BenchTypeDef* pStats)
+{
+  PDMSIM_TypeDef sim;
+  uint32_t blocks = 0, due = 0, idx = 0, start = 0, cycles = 0, busy = 0;
+  uint32_t overruns = RecOverruns;
+  uint32_t msCycles = SystemCoreClock / 1000;
+  uint64_t filter = 0, process = 0, write = 0;
+  
+  memset(pStats, 0, sizeof(WaveRecorder_BenchTypeDef));
+  
+  /* The microphone is not used */
+  WaveRecorderStop();
+  RecSimulation = 1;
+  if (WaveRecorderOpen() != 0)
+  {
+    RecSimulation = 0;
+    return 1;
+  }
+  PDMSIM_Init(&sim, PdmFreq * PDM_DECIMATION, REC_BENCH_TONE_FREQ, REC_BENCH_TONE_LEVEL, REC_BENCH_NOISE_LEVEL);
+  start = TIMER_GetTime();
+  
+  while ((blocks < Time) && HCD_IsDeviceConnected(&USB_OTG_Core) && WaveRecorder_Continue())
+  {
+    /* Blocks the microphone would have delivered by now */
+    due = Speed ? ((TIMER_GetTime() - start) * Speed) / 100 : blocks + (RecRingTail == RecRingHead);
+    while ((blocks < due) && (blocks < Time))
+    {
+      PDMSIM_Generate(&sim, InternalBuffer, PdmInSize);
+      for (idx = 0; idx < PdmInSize; idx++)
+      {
+        InternalBuffer[idx] = HTONS(InternalBuffer[idx]);
+      }
+      cycles = DWT->CYCCNT;
+      WaveRecorder_FilterBlock();
+      filter += DWT->CYCCNT - cycles;
+      blocks++;
+    }
+    
+    cycles = DWT->CYCCNT;
+    WaveRecorderProcess();
+    process += DWT->CYCCNT - cycles;
+    
+    cycles = DWT->CYCCNT;
+    if (WaveRecorderWrite())
+    {
+      cycles = DWT->CYCCNT - cycles;
+      write += cycles;
+      if (cycles / msCycles > pStats->MaxWriteTime)
+      {
+        pStats->MaxWriteTime = cycles / msCycles;
+      }
     }
   }
+  
+  /* Store the rest of the ring */
+  while ((RecRingTail != RecRingHead) && WaveRecorder_Continue())
+  {
+    cycles = DWT->CYCCNT;
+    WaveRecorderProcess();
+    process += DWT->CYCCNT - cycles;
+    cycles = DWT->CYCCNT;
+    WaveRecorderWrite();
+    write += DWT->CYCCNT - cycles;
+  }
+  WaveRecorderClose();
+  RecSimulation = 0;
+  
+  pStats->AudioTime = blocks;
+  pStats->RunTime = TIMER_GetTime() - start;
+  pStats->Overruns = RecOverruns - overruns;
+  if (blocks)
+  {
+    pStats->FilterCycles = (uint32_t)((filter * 1000) / blocks);
+    pStats->ProcessCycles = (uint32_t)((process * 1000) / blocks);
+    pStats->WriteTime = (uint32_t)((write * 1000) / blocks / msCycles);
+  }
+  
+  /* The cost grows with the rate, so the chain keeps up with the rate at
+     which it would be busy all the time */
+  busy = (uint32_t)((filter + process + write) / msCycles);
+  pStats->MaxRate = busy ? (uint32_t)(((uint64_t)AudioRecFreq * blocks) / busy) : 0;
+  
+  return 0;
 }
 
 /**
   * @brief  Initialize the wave header file
+  * @note   The header is REC_HEADER_SIZE bytes long so that the audio data
+  *         starts on a sector boundary. The space between the 'fmt ' and
+  *         the 'data' chunks is taken by the 'fact' chunk.
   * @param  pHeadBuf:Pointer to a buffer
   * @retval None
   */
 uint32_t WavaRecorderHeaderInit(uint8_t* pHeadBuf)
 {
   uint16_t count = 0;
+  uint32_t idx = 36;
+  uint32_t blockalign = AudioRecChnlNbr * (AudioRecBitRes / 8);
+  uint32_t bits = AudioRecBitRes;
+  
+  if (RecFormat == WAVE_FORMAT_IMA_ADPCM)
+  {
+    blockalign = REC_ADPCM_BLOCK_SIZE;
+    bits = BITS_PER_SAMPLE_4;
+  }
 
   /* write chunkID, must be 'RIFF'  ------------------------------------------*/
   pHeadBuf[0] = 'R';
@@ -253,14 +882,8 @@ uint32_t WavaRecorderHeaderInit(uint8_t* pHeadBuf)
   pHeadBuf[2] = 'F';
   pHeadBuf[3] = 'F';
 
-  /* Write the file length */
-  /* The sampling time 8000 Hz
-   To recorde 10s we need 8000 x 10 x 2 (16-Bit data) */
-  pHeadBuf[4] = 0x00;
-  pHeadBuf[5] = 0xE2;
-  pHeadBuf[6] = 0x04;
-  pHeadBuf[7] = 0x00;
-
+  /* Write the file length, updated when the recording is stopped */
+  WaveRecorder_WriteUnit(pHeadBuf, REC_RIFF_SIZE_OFFSET, REC_HEADER_SIZE - 8, 4);
   
   /* Write the file format, must be 'WAVE' */
   pHeadBuf[8]  = 'W';
@@ -274,62 +897,86 @@ uint32_t WavaRecorderHeaderInit(uint8_t* pHeadBuf)
   pHeadBuf[14]  = 't';
   pHeadBuf[15]  = ' ';
 
-  /* Write the length of the 'fmt' data, must be 0x10 */
-  pHeadBuf[16]  = 0x10;
-  pHeadBuf[17]  = 0x00;
-  pHeadBuf[18]  = 0x00;
-  pHeadBuf[19]  = 0x00;
+  /* Write the length of the 'fmt' data, 0x12 (with the extra format bytes)
+     or 0x14 for IMA ADPCM (with the number of samples per block) */
+  WaveRecorder_WriteUnit(pHeadBuf, 16, (RecFormat == WAVE_FORMAT_IMA_ADPCM) ? 0x14 : 0x12, 4);
 
-  /* Write the audio format, must be 0x01 (PCM) */
-  pHeadBuf[20]  = 0x01;
-  pHeadBuf[21]  = 0x00;
+  /* Write the audio format, 0x01 (PCM) or 0x11 (IMA ADPCM) */
+  WaveRecorder_WriteUnit(pHeadBuf, 20, RecFormat, 2);
 
   /* Write the number of channels, must be 0x01 (Mono) or 0x02 (Stereo) */
-  pHeadBuf[22]  = 0x02;
-  pHeadBuf[23]  = 0x00;
+  WaveRecorder_WriteUnit(pHeadBuf, 22, AudioRecChnlNbr, 2);
 
-  /* Write the Sample Rate 8000 Hz */
-  pHeadBuf[24]  = (uint8_t)((REC_FREQ & 0xFF));
-  pHeadBuf[25]  = (uint8_t)((REC_FREQ >> 8) & 0xFF);
-  pHeadBuf[26]  = (uint8_t)((REC_FREQ >> 16) & 0xFF);
-  pHeadBuf[27]  = (uint8_t)((REC_FREQ >> 24) & 0xFF);
+  /* Write the Sample Rate */
+  WaveRecorder_WriteUnit(pHeadBuf, 24, AudioRecFreq, 4);
 
   /* Write the Byte Rate */
-  pHeadBuf[28]  = (uint8_t)((REC_FREQ & 0xFF));
-  pHeadBuf[29]  = (uint8_t)((REC_FREQ >> 8) & 0xFF);
-  pHeadBuf[30]  = (uint8_t)((REC_FREQ >> 16) & 0xFF);
-  pHeadBuf[31]  = (uint8_t)((REC_FREQ >> 24) & 0xFF);
+  WaveRecorder_WriteUnit(pHeadBuf, 28, RecByteRate, 4);
 
   /* Write the block alignment */
-  pHeadBuf[32]  = 0x02;/*0x02*/
-  pHeadBuf[33]  = 0x00;
+  WaveRecorder_WriteUnit(pHeadBuf, 32, blockalign, 2);
 
   /* Write the number of bits per sample */
-  pHeadBuf[34]  = 0x10; /*0x08*/
-  pHeadBuf[35]  = 0x00;
+  WaveRecorder_WriteUnit(pHeadBuf, 34, bits, 2);
 
-  /* Write the Data chunk, must be 'data' */
-  pHeadBuf[36]  = 'd';
-  pHeadBuf[37]  = 'a';
-  pHeadBuf[38]  = 't';
-  pHeadBuf[39]  = 'a';
+  if (RecFormat == WAVE_FORMAT_IMA_ADPCM)
+  {
+    /* Write the number of extra format bytes and the samples per block */
+    WaveRecorder_WriteUnit(pHeadBuf, idx, 0x02, 2);
+    WaveRecorder_WriteUnit(pHeadBuf, idx + 2, AdpcmSamplesPerBlock, 2);
+    idx += 4;
+  }
+  else
+  {
+    /* Write the number of extra format bytes, must be 0x00 */
+    WaveRecorder_WriteUnit(pHeadBuf, idx, 0x00, 2);
+    idx += 2;
+  }
 
-  /* Write the number of sample data */
-  pHeadBuf[40] = 0x00;
-  pHeadBuf[41] = 0xE2;
-  pHeadBuf[42] = 0x04;
-  pHeadBuf[43] = 0x00;
+  /* Write the Fact chunk, must be 'fact' */
+  pHeadBuf[idx]      = 'f';
+  pHeadBuf[idx + 1]  = 'a';
+  pHeadBuf[idx + 2]  = 'c';
+  pHeadBuf[idx + 3]  = 't';
+  RecFactOffset = idx + 8;
 
-  /* Fill the missing bytes in Buffer with 0x80 */
-  for (count = 44; count < 512 ; count ++)
+  /* Write the Fact chunk size, it pads the header up to the 'data' chunk */
+  WaveRecorder_WriteUnit(pHeadBuf, idx + 4, (REC_HEADER_SIZE - 8) - RecFactOffset, 4);
+
+  /* Fill the Fact chunk (number of samples first) with zeros */
+  for (count = RecFactOffset; count < REC_HEADER_SIZE - 8; count ++)
   {
-    pHeadBuf[count] = 0x80;
+    pHeadBuf[count] = 0x00;
   }
+
+  /* Write the Data chunk, must be 'data' */
+  pHeadBuf[REC_HEADER_SIZE - 8]  = 'd';
+  pHeadBuf[REC_HEADER_SIZE - 7]  = 'a';
+  pHeadBuf[REC_HEADER_SIZE - 6]  = 't';
+  pHeadBuf[REC_HEADER_SIZE - 5]  = 'a';
+
+  /* Write the number of sample data, updated when the recording is stopped */
+  WaveRecorder_WriteUnit(pHeadBuf, REC_DATA_SIZE_OFFSET, 0, 4);
   
   /* Return 0 if all operations are OK */
   return 0;
 }
 
+/**
+  * @brief  Update the size fields of the wave header
+  * @param  pHeadBuf: Pointer to the header initialized by WavaRecorderHeaderInit
+  *         DataSize: Number of audio data bytes following the header
+  * @retval None
+  */
+void WaveRecorderHeaderUpdate(uint8_t* pHeadBuf, uint32_t DataSize)
+{
+  uint32_t samples = WaveRecorder_DataFrames(DataSize);
+  
+  WaveRecorder_WriteUnit(pHeadBuf, REC_RIFF_SIZE_OFFSET, DataSize + REC_HEADER_SIZE - 8 + RecTrailerSize, 4);
+  WaveRecorder_WriteUnit(pHeadBuf, RecFactOffset, samples, 4);
+  WaveRecorder_WriteUnit(pHeadBuf, REC_DATA_SIZE_OFFSET, DataSize, 4);
+}
+
 /**
   * @brief  Update the recorded data 
   * @param  None
@@ -337,15 +984,7 @@ uint32_t WavaRecorderHeaderInit(uint8_t* pHeadBuf)
   */
 void WaveRecorderUpdate(void)
 {     
-  WaveRecorderInit(32000,16, 1);
-  WaveCounter = 0;
-  LED_Toggle1 = 7;
-  
-  /* Remove Wave file if exist on flash disk */
-  f_unlink (REC_WAVE_NAME);
-     
-  /* Open the file to write on it */
-  if ((HCD_IsDeviceConnected(&USB_OTG_Core) != 1) || (f_open(&file, REC_WAVE_NAME, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK))
+  if (WaveRecorderOpen() != 0)
   {
     /* Set ON Red LED */ 
     while(1)
@@ -353,130 +992,886 @@ void WaveRecorderUpdate(void)
       LED_Toggle(LED2);
     }
   }
-  else
+  
+  /* Listen to the microphone while recording */
+  if (RecMonitorEnable)
   {
-    WaveRecStatus = 1;
+    MONITOR_Start(AudioRecFreq);
   }
-  /* Initialize the Header Wave */
-  WavaRecorderHeaderInit(RecBufHeader);
-  
-  /* Write the Header wave */
-  f_write (&file, RecBufHeader, 512, (void *)&bytesWritten);
-  
-  /* Increment tne wave counter */  
-  WaveCounter += 512;
-
-  /* Start the record */
-  WaveRecorderStart(RecBuf, PCM_OUT_SIZE);
-  
-  /* Reset the time base variable */
-  Time_Rec_Base = 0;
-  Switch = 0;
      
   while(HCD_IsDeviceConnected(&USB_OTG_Core))
   { 
     /* Wait for the recording time */  
-    if (Time_Rec_Base <= TIME_REC)
+    if (WaveRecorder_Continue())
     {
       /* Wait for the data to be ready with PCM form */
-      while((Data_Status == 0)&& HCD_IsDeviceConnected(&USB_OTG_Core));
-      Data_Status =0;
+      while((RecRingTail == RecRingHead) && HCD_IsDeviceConnected(&USB_OTG_Core));
+      
+      LED_Toggle1 = 3;
       
-      /* Switch the buffers*/
-      if (Switch ==1)
-     {
-       pAudioRecBuf = RecBuf;
-       writebuffer = RecBuf1;
-       WaveCounter += 32;
-       Switch = 0;
-     }
-      else
+      if (WaveRecorder_ReadBlock(RecBuf))
       {
-        pAudioRecBuf = RecBuf1;
-        writebuffer = RecBuf;
-        WaveCounter += 32;
-        Switch = 1;
+        WaveRecorder_ProcessBlock(RecBuf);
       }
       
-      for (counter=0; counter<16; counter++)
-      {
-        LED_Toggle1 = 3;
-        if (buf_idx< RAM_BUFFER_SIZE)
-        {
-          /* Store Data in RAM buffer */
-          RAM_Buf[buf_idx++]= *(writebuffer + counter);
-          if (buf_idx1 == RAM_BUFFER_SIZE)
-          {
-            buf_idx1 = 0;
-            /* Write the stored data in the RAm to the USB Key */
-            f_write (&file, (uint16_t*)RAM_Buf1, RAM_BUFFER_SIZE*2 , (void *)&bytesWritten);
-          }
-        }
-        else if (buf_idx1< RAM_BUFFER_SIZE)
-        {
-          /* Store Data in RAM buffer */
-          RAM_Buf1[buf_idx1++]= *(writebuffer + counter);
-          if (buf_idx == RAM_BUFFER_SIZE)
-          {
-            buf_idx = 0;
-            /* Write the stored data in the RAM to the USB Key */
-            f_write (&file, (uint16_t*)RAM_Buf, RAM_BUFFER_SIZE*2 , (void *)&bytesWritten);
-          }
-        }
-      }   
+      /* Write a full RAM buffer to the USB Key */
+      WaveRecorderWrite();
+ 
+      /* Commands from PC */
+      commandCallback();
  
       /* User button pressed */
       if ( Command_index != 1)
       {
-        /* Stop recording */
-        WaveRecorderStop();  
-        Command_index = 0;
+        /* Stop recording, go on with the new command */
         LED_Toggle1 = 6;
         break;
       }
     }
     else /* End of Recording time  */
     {
-      WaveRecorderStop();
       LED_Toggle1 = 4;
       Command_index = 2;
-      Data_Status =0;
       break;
     }
   }
-   
-  /* Update the data length in the header of the recorded wave */    
-  f_lseek(&file, 0);
-    
-  RecBufHeader[4] = (uint8_t)(WaveCounter + 512) ;
-  RecBufHeader[5] = (uint8_t)(((WaveCounter+512)  >> 8) & 0xFF);
-  RecBufHeader[6] = (uint8_t)(((WaveCounter+512)  >> 16) & 0xFF);
-  RecBufHeader[7] = (uint8_t)(((WaveCounter+512)  >> 24) & 0xFF);
-  
-  RecBufHeader[40] = (uint8_t)(WaveCounter);
-  RecBufHeader[41] = (uint8_t)((WaveCounter >> 8) & 0xFF);
-  RecBufHeader[42] = (uint8_t)((WaveCounter >> 16) & 0xFF);
-  RecBufHeader[43] = (uint8_t)((WaveCounter >> 24) & 0xFF);
-    
-  /* Write the updated header wave */
-  f_write (&file, RecBufHeader, 512, (void *)&bytesWritten);
   
-  /* Close file and filesystem */
-  f_close (&file);
-  f_mount(0, 0);
+  MONITOR_Stop();
+  WaveRecorderClose();
   
+  /* Close the filesystem */
+  f_mount(0, 0);
 }
 
 /**
-  * @brief  Initialize GPIO for wave recorder.
+  * @brief  Create the recorded file and start the capture. The recording
+  *         begins with the pre-trigger history.
   * @param  None
-  * @retval None
+  * @retval 0 if all operations are OK, 1 otherwise
   */
-static void WaveRecorder_GPIO_Init(void)
-{  
-  GPIO_InitTypeDef GPIO_InitStructure;
-
-  /* Enable GPIO clocks */
+uint32_t WaveRecorderOpen(void)
+{
+  uint32_t trigger = 0, history = 0;
+  uint8_t live = (AudioRecRunning && AudioRecInited);
+  
+  /* Position of the trigger in the captured audio */
+  trigger = RecTriggered ? RecTrigger : RecRingHead;
+  
+  if (WaveRecorder_Run() != 0)
+  {
+    /* Unsupported configuration */
+    return 1;
+  }
+  if (live == 0)
+  {
+    /* No history, start with the next captured block */
+    trigger = RecRingHead;
+  }
+  WaveCounter = 0;
+  RecDataSize = 0;
+  AdpcmIdx = 0;
+  AdpcmPadFrames = 0;
+  ADPCM_Init(AdpcmState, AudioRecChnlNbr);
+  RecTrailerSize = 0;
+  RecFrames = 0;
+  RecCueCount = 0;
+  RecVadActive = 0;
+  VAD_Init(&RecVad, (AudioRecFreq / 1000) * REC_VAD_FRAME_TIME, REC_VAD_HANGOVER_TIME / REC_VAD_FRAME_TIME);
+  DENOISE_Init(&RecDenoise, AudioRecFreq);
+  RecDenoiseCycles = 0;
+  CheckpointData = 0;
+  RecWriteError = 0;
+  CheckpointSize = (RecByteRate / 1000) * CheckpointTime;
+  LED_Toggle1 = 7;
+  
+  /* Segments in whole RAM buffers, so they end on a buffer write */
+  SegmentSize = ((RecByteRate * SegmentTime) / RamBufferSize) * RamBufferSize;
+  SegmentIndex = 0;
+  SegmentOldest = 0;
+  SegmentState = SEGMENT_NONE;
+  
+  if (SegmentSize)
+  {
+    /* Remove the segments of the previous recording */
+    WaveRecorder_SegmentName(RecFileName, 0);
+    while ((SegmentIndex < REC_SEGMENT_MAX) && (f_unlink(RecFileName) == FR_OK))
+    {
+      WaveRecorder_SegmentName(RecFileName, ++SegmentIndex);
+    }
+    SegmentIndex = 0;
+    WaveRecorder_SegmentName(RecFileName, 0);
+  }
+  else
+  {
+    /* Remove Wave file if exist on flash disk */
+    strcpy(RecFileName, REC_WAVE_NAME);
+    f_unlink (RecFileName);
+  }
+     
+  /* Open the file to write on it */
+  RecFile = &file;
+  SegmentNext = &SegmentFile;
+  if ((HCD_IsDeviceConnected(&USB_OTG_Core) != 1) || (f_open(RecFile, RecFileName, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK))
+  {
+    return 1;
+  }
+  WaveRecStatus = 1;
+  
+  /* Initialize the Header Wave */
+  WavaRecorderHeaderInit(RecBufHeader);
+  
+  /* Write the Header wave and create the directory entry on the disk */
+  f_write (RecFile, RecBufHeader, REC_HEADER_SIZE, (void *)&bytesWritten);
+  f_sync (RecFile);
+  
+  /* Increment tne wave counter */  
+  WaveCounter += REC_HEADER_SIZE;
+  
+  /* Prepare the RAM buffers */
+  pRamBuf = RAM_Buf;
+  pRamPending = 0;
+  buf_idx = 0;
+
+  /* Start with the history before the trigger (one block per millisecond).
+     Everything captured while the file was being created is still in the
+     ring and follows without a gap. */
+  history = (PrerollTime < RecRingBlocks / 2) ? PrerollTime : RecRingBlocks / 2;
+  if ((history > trigger) || (live == 0))
+  {
+    history = (live == 0) ? 0 : trigger;
+  }
+  RecRingTail = trigger - history;
+  RecTriggered = 0;
+  
+  /* Reset the time base variable */
+  Time_Rec_Base = 0;
+  
+  return 0;
+}
+
+/**
+  * @brief  Process the captured blocks without waiting. Nothing is written
+  *         to the USB Key unless both RAM buffers are full: the blocks that
+  *         do not fit stay in the ring until WaveRecorderWrite() is called.
+  * @param  None
+  * @retval 1 while the recording goes on, 0 at the end of the recording
+  *         time, when the file is full or after a write error
+  */
+uint8_t WaveRecorderProcess(void)
+{
+  while ((RecRingTail != RecRingHead) &&
+         ((pRamPending == 0) || (RamBufferSize - buf_idx >= RecBlockMaxSize)))
+  {
+    if (WaveRecorder_ReadBlock(RecBuf))
+    {
+      WaveRecorder_ProcessBlock(RecBuf);
+    }
+  }
+  return WaveRecorder_Continue();
+}
+
+/**
+  * @brief  Write the full RAM buffer to the USB Key, or do one step of the
+  *         preparation of the next segment when there is nothing to write
+  * @param  None
+  * @retval 1 if something has been done, 0 if there is nothing to do
+  */
+uint8_t WaveRecorderWrite(void)
+{
+  if (pRamPending == 0)
+  {
+    /* Idle: prepare the next segment */
+    return WaveRecorder_SegmentPrepare();
+  }
+  
+  WaveRecorder_WritePending();
+  return 1;
+}
+
+/**
+  * @brief  Write the full RAM buffer to the USB Key
+  * @param  None
+  * @retval None
+  */
+static void WaveRecorder_WritePending(void)
+{
+  if (RecWriteError == 0)
+  {
+    if ((f_write (RecFile, pRamPending, RamBufferSize, (void *)&bytesWritten) != FR_OK) ||
+        (bytesWritten != RamBufferSize))
+    {
+      /* Disk full or removed */
+      RecWriteError = 1;
+    }
+    RecDataSize += bytesWritten;
+    
+    if (CheckpointSize && (RecDataSize - CheckpointData >= CheckpointSize) && (RecWriteError == 0))
+    {
+      WaveRecorder_Checkpoint();
+    }
+    
+    /* Go on with the next segment when it is ready, the current one grows
+       until then */
+    if (SegmentSize && (RecDataSize >= SegmentSize) && (SegmentState == SEGMENT_READY))
+    {
+      WaveRecorder_SegmentSwitch();
+    }
+  }
+  pRamPending = 0;
+}
+
+/**
+  * @brief  Get the time left before the capture has to wait for
+  *         WaveRecorderWrite(): the free space in the RAM buffer being
+  *         filled and in the ring.
+  * @param  None
+  * @retval Time in milliseconds, 0xFFFFFFFF if there is nothing to write,
+  *         0xFFFFFFFE if only the next segment has to be prepared
+  */
+uint32_t WaveRecorderSlack(void)
+{
+  uint32_t used = RecRingHead - RecRingTail;
+  uint32_t blocks = 0;
+  
+  if (pRamPending == 0)
+  {
+    return (SegmentSize && (SegmentState != SEGMENT_READY)) ? 0xFFFFFFFE : 0xFFFFFFFF;
+  }
+  
+  /* One block per millisecond, two blocks are kept as a margin */
+  blocks = (used + 2 < RecRingBlocks) ? RecRingBlocks - used - 2 : 0;
+  
+  return blocks + (uint32_t)(((uint64_t)(RamBufferSize - buf_idx) * 1000) / RecByteRate);
+}
+
+/**
+  * @brief  Write the end of the recording and close the file. The
+  *         microphone keeps running only for the pre-roll.
+  * @param  None
+  * @retval None
+  */
+void WaveRecorderClose(void)
+{
+  char name[16];
+  
+  if (PrerollTime == 0)
+  {
+    WaveRecorderStop();
+  }
+  
+  /* Write the data remaining in the encoder and in the RAM buffers */
+  if (RecFormat == WAVE_FORMAT_IMA_ADPCM)
+  {
+    WaveRecorder_EncodeFlush();
+  }
+  if (pRamPending)
+  {
+    WaveRecorderWrite();
+  }
+  WaveRecorder_FlushData();
+  
+  WaveRecorder_FinishFile(RecFrames);
+  
+  /* Remove the next segment if it has been prepared */
+  if (SegmentState != SEGMENT_NONE)
+  {
+    f_close(SegmentNext);
+    WaveRecorder_SegmentName(name, (SegmentIndex + 1) % REC_SEGMENT_MAX);
+    f_unlink(name);
+    SegmentState = SEGMENT_NONE;
+  }
+}
+
+/**
+  * @brief  Complete the file being recorded: index of the voice segments,
+  *         release of the clusters allocated in advance and final header.
+  * @param  Frames: Frames in the file, the cues after them belong to the
+  *         next segment
+  * @retval None
+  */
+static void WaveRecorder_FinishFile(uint32_t Frames)
+{
+  uint32_t size = 0, count = 0;
+  
+  RecTrailerSize = 0;
+  
+  /* Append the index of the voice segments */
+  while ((count < RecCueCount) && (RecCues[count] < Frames))
+  {
+    count++;
+  }
+  if (RecVadEnable && count && (RecWriteError == 0))
+  {
+    RecTrailerSize = WaveRecorder_CueChunk(count);
+  }
+  
+  /* The cues of the next segment are relative to its start */
+  RecCueCount -= count;
+  memmove(RecCues, &RecCues[count], RecCueCount * sizeof(RecCues[0]));
+  for (size = 0; size < RecCueCount; size++)
+  {
+    RecCues[size] -= Frames;
+  }
+  
+  /* Free the clusters after the end of the data */
+  f_truncate(RecFile);
+   
+  /* Update the data length in the header of the recorded wave */    
+  f_lseek(RecFile, 0);
+    
+  WaveRecorderHeaderUpdate(RecBufHeader, RecDataSize);
+    
+  /* Write the updated header wave */
+  f_write (RecFile, RecBufHeader, REC_HEADER_SIZE, (void *)&bytesWritten);
+  
+  /* Close file */
+  f_close (RecFile);
+}
+
+/**
+  * @brief  Build the name of a segment
+  * @param  pName: Pointer to the name (at least 13 characters)
+  *         Index: Number of the segment
+  * @retval None
+  */
+static void WaveRecorder_SegmentName(char* pName, uint32_t Index)
+{
+  sprintf(pName, REC_SEGMENT_NAME, (unsigned int)Index);
+}
+
+/**
+  * @brief  Do one step of the preparation of the next segment: check the
+  *         free space (recycling the oldest segment when it is low), create
+  *         the file, allocate its clusters and write its header. Every step
+  *         takes at most a few sector transfers, so it can be done between
+  *         two RAM buffer writes.
+  * @param  None
+  * @retval 1 if a step has been done, 0 if there is nothing to do
+  */
+static uint8_t WaveRecorder_SegmentPrepare(void)
+{
+  char name[16], oldest[16];
+  uint32_t next = (SegmentIndex + 1) % REC_SEGMENT_MAX;
+  uint32_t fileSize = REC_HEADER_SIZE + SegmentSize;
+  DWORD clusters = 0, target = 0;
+  FATFS* fs;
+  
+  if ((SegmentSize == 0) || (SegmentState == SEGMENT_READY) || RecWriteError)
+  {
+    return 0;
+  }
+  
+  if (SegmentState == SEGMENT_NONE)
+  {
+    if (f_getfree("0:", &clusters, &fs) != FR_OK)
+    {
+      return 0;
+    }
+    WaveRecorder_SegmentName(name, next);
+    
+    if (next == SegmentOldest)
+    {
+      /* The names wrapped: the oldest segment is overwritten */
+      SegmentOldest = (SegmentOldest + 1) % REC_SEGMENT_MAX;
+    }
+    
+    if ((uint64_t)clusters * fs->csize * SS(fs) < (uint64_t)fileSize * (REC_SEGMENT_SPARE + 1))
+    {
+      if (SegmentOldest == SegmentIndex)
+      {
+        /* Nothing to recycle, the current segment goes on */
+        return 0;
+      }
+      /* Recycle the oldest segment, its clusters stay allocated */
+      WaveRecorder_SegmentName(oldest, SegmentOldest);
+      SegmentOldest = (SegmentOldest + 1) % REC_SEGMENT_MAX;
+      if ((f_rename(oldest, name) != FR_OK) ||
+          (f_open(SegmentNext, name, FA_OPEN_EXISTING | FA_WRITE) != FR_OK))
+      {
+        return 1;
+      }
+    }
+    else if (f_open(SegmentNext, name, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+    {
+      return 1;
+    }
+    SegmentState = SEGMENT_ALLOC;
+    return 1;
+  }
+  
+  /* Allocate the clusters, one step at a time */
+  if (SegmentNext->fsize < fileSize)
+  {
+    target = SegmentNext->fptr + REC_SEGMENT_STEP;
+    if (target > fileSize)
+    {
+      target = fileSize;
+    }
+    f_lseek(SegmentNext, target);
+    if (SegmentNext->fptr == target)
+    {
+      return 1;
+    }
+    /* Disk full: free the oldest segment and try again */
+    if (SegmentOldest != SegmentIndex)
+    {
+      WaveRecorder_SegmentName(oldest, SegmentOldest);
+      SegmentOldest = (SegmentOldest + 1) % REC_SEGMENT_MAX;
+      f_unlink(oldest);
+      return 1;
+    }
+    /* Use what has been allocated, the segment grows while written */
+  }
+  
+  /* Empty header, the sizes are written by the checkpoints */
+  f_lseek(SegmentNext, 0);
+  WaveRecorderHeaderUpdate(RecBufHeader, 0);
+  f_write(SegmentNext, RecBufHeader, REC_HEADER_SIZE, (void *)&bytesWritten);
+  f_sync(SegmentNext);
+  SegmentState = SEGMENT_READY;
+  return 1;
+}
+
+/**
+  * @brief  Close the current segment and continue in the prepared one.
+  *         Called right after a RAM buffer has been written, so all the
+  *         data written belongs to the current segment.
+  * @param  None
+  * @retval None
+  */
+static void WaveRecorder_SegmentSwitch(void)
+{
+  uint32_t frames = WaveRecorder_DataFrames(RecDataSize);
+  FIL* done;
+  
+  WaveRecorder_FinishFile(frames);
+  
+  /* The new segment has no trailer yet. The file objects swap: the closed
+     one takes the segment after */
+  RecTrailerSize = 0;
+  done = RecFile;
+  RecFile = SegmentNext;
+  SegmentNext = done;
+  SegmentIndex = (SegmentIndex + 1) % REC_SEGMENT_MAX;
+  SegmentState = SEGMENT_NONE;
+  WaveRecorder_SegmentName(RecFileName, SegmentIndex);
+  
+  /* The data waiting in the RAM buffer goes to the new segment */
+  RecFrames -= frames;
+  WaveCounter -= RecDataSize;
+  RecDataSize = 0;
+  CheckpointData = 0;
+}
+
+/**
+  * @brief  Check the limits of the recording
+  * @param  None
+  * @retval 1 while the recording can go on, 0 otherwise
+  */
+static uint8_t WaveRecorder_Continue(void)
+{
+  return (((TIME_REC == 0) || (Time_Rec_Base <= TIME_REC)) &&
+          (WaveCounter < REC_MAX_FILE_SIZE) && (RecWriteError == 0));
+}
+
+/**
+  * @brief  Initialize and start the microphone capture if needed.
+  * @param  None
+  * @retval 0 if all operations are OK, 1 otherwise
+  */
+static uint32_t WaveRecorder_Run(void)
+{
+  if (WaveRecorderInit(RecConfig.SampleRate, RecConfig.BitsPerSample, RecConfig.NbrChannels) != 0)
+  {
+    return 1;
+  }
+  if ((AudioRecRunning == 0) && (RecSimulation == 0))
+  {
+    return WaveRecorderStart();
+  }
+  return 0;
+}
+
+/**
+  * @brief  Read the next block from the ring.
+  * @param  pPcm: Pointer to the block (PcmOutSize / PdmDecim samples)
+  * @retval 1 if the block is valid, 0 if it was overwritten by the capture
+  */
+static uint8_t WaveRecorder_ReadBlock(uint16_t* pPcm)
+{
+  memcpy(pPcm, &RecRing[(RecRingTail % RecRingBlocks) * PcmOutSize], (PcmOutSize / PdmDecim) * 2);
+  
+  /* The block being filled is the one at the head */
+  if (RecRingHead - RecRingTail >= RecRingBlocks)
+  {
+    /* Overrun: resume with the oldest block that is safe to read */
+    RecOverruns += RecRingHead - RecRingTail - RecRingBlocks + 2;
+    RecRingTail = RecRingHead - RecRingBlocks + 2;
+    return 0;
+  }
+  RecRingTail++;
+  return 1;
+}
+
+/**
+  * @brief  Process one block of the ring: noise suppression, voice
+  *         activity gating, conversion to the recorded format and storing.
+  * @param  pPcm: Pointer to the block (PcmOutSize / PdmDecim samples)
+  * @retval None
+  */
+static void WaveRecorder_ProcessBlock(uint16_t* pPcm)
+{
+  uint32_t size = 0, len = PcmOutSize / PdmDecim, cycles = 0;
+  
+  /* Noise suppression */
+  if (RecDenoiseEnable)
+  {
+    cycles = DWT->CYCCNT;
+    DENOISE_Process(&RecDenoise, (int16_t*)pPcm, len);
+    cycles = DWT->CYCCNT - cycles;
+    if (cycles > RecDenoiseCycles)
+    {
+      RecDenoiseCycles = cycles;
+    }
+  }
+  
+  /* Voice activity gating: index the start of every voice segment */
+  if (RecVadEnable)
+  {
+    if (VAD_Process(&RecVad, (int16_t*)pPcm, len))
+    {
+      if ((RecVadActive == 0) && (RecCueCount < REC_VAD_MAX_CUES))
+      {
+        RecCues[RecCueCount++] = RecFrames;
+      }
+      RecVadActive = 1;
+    }
+    else
+    {
+      RecVadActive = 0;
+    }
+  }
+  
+  if ((RecVadEnable == 0) || RecVadActive)
+  {
+    /* Convert the samples to the recorded format and store them */
+    size = WaveRecorder_FormatFrames(pPcm, len, FrameBuf);
+    RecFrames += size / RecFrameSize;
+    if (RecFormat == WAVE_FORMAT_IMA_ADPCM)
+    {
+      WaveRecorder_EncodeData(FrameBuf, size);
+    }
+    else
+    {
+      WaveRecorder_StoreData(FrameBuf, size);
+    }
+  }
+}
+
+/**
+  * @brief  Convert one block of PCM samples at the recorded frequency to
+  *         recorded frames (channels and sample size).
+  * @param  pPcm: Pointer to the samples
+  *         Len: Number of samples
+  *         pFrames: Pointer to the output frames
+  * @retval Number of bytes written to pFrames
+  */
+static uint32_t WaveRecorder_FormatFrames(uint16_t* pPcm, uint32_t Len, uint8_t* pFrames)
+{
+  uint8_t* pOut = pFrames;
+  uint32_t idx = 0, ch = 0;
+  uint16_t sample = 0;
+  
+  for (idx = 0; idx < Len; idx++)
+  {
+    sample = pPcm[idx];
+    for (ch = 0; ch < AudioRecChnlNbr; ch++)
+    {
+      if (AudioRecBitRes == BITS_PER_SAMPLE_24)
+      {
+        /* 16-bit sample left justified in 24 bits */
+        *pOut++ = 0x00;
+      }
+      *pOut++ = (uint8_t)(sample & 0xFF);
+      *pOut++ = (uint8_t)((sample >> 8) & 0xFF);
+    }
+  }
+  return (uint32_t)(pOut - pFrames);
+}
+
+/**
+  * @brief  Collect recorded frames into IMA ADPCM blocks. Every full block
+  *         is encoded and stored in the RAM buffers.
+  * @param  pData: Pointer to 16-bit frames
+  *         Size: Number of bytes
+  * @retval None
+  */
+static void WaveRecorder_EncodeData(uint8_t* pData, uint32_t Size)
+{
+  uint32_t blocksize = AdpcmSamplesPerBlock * RecFrameSize;
+  uint32_t len = 0;
+  
+  while (Size)
+  {
+    len = blocksize - AdpcmIdx;
+    if (len > Size)
+    {
+      len = Size;
+    }
+    memcpy((uint8_t*)AdpcmPcm + AdpcmIdx, pData, len);
+    AdpcmIdx += len;
+    pData += len;
+    Size -= len;
+    
+    if (AdpcmIdx == blocksize)
+    {
+      ADPCM_EncodeBlock(AdpcmState, AdpcmPcm, AdpcmBlock, AudioRecChnlNbr, AdpcmSamplesPerBlock);
+      WaveRecorder_StoreData(AdpcmBlock, REC_ADPCM_BLOCK_SIZE);
+      AdpcmIdx = 0;
+    }
+  }
+}
+
+/**
+  * @brief  Encode the last, incomplete IMA ADPCM block. The block is padded
+  *         with silence, the padding is excluded from the number of samples
+  *         in the 'fact' chunk.
+  * @param  None
+  * @retval None
+  */
+static void WaveRecorder_EncodeFlush(void)
+{
+  uint32_t blocksize = AdpcmSamplesPerBlock * RecFrameSize;
+  
+  if (AdpcmIdx)
+  {
+    AdpcmPadFrames = (blocksize - AdpcmIdx) / RecFrameSize;
+    memset((uint8_t*)AdpcmPcm + AdpcmIdx, 0, blocksize - AdpcmIdx);
+    ADPCM_EncodeBlock(AdpcmState, AdpcmPcm, AdpcmBlock, AudioRecChnlNbr, AdpcmSamplesPerBlock);
+    WaveRecorder_StoreData(AdpcmBlock, REC_ADPCM_BLOCK_SIZE);
+    AdpcmIdx = 0;
+  }
+}
+
+/**
+  * @brief  Store the recorded data in the RAM buffers. A full buffer
+  *         waits for WaveRecorderWrite() and the buffers are switched.
+  *         If the other buffer is still waiting it is written first.
+  * @param  pData: Pointer to the data
+  *         Size: Number of bytes
+  * @retval None
+  */
+static void WaveRecorder_StoreData(uint8_t* pData, uint32_t Size)
+{
+  uint32_t len = 0;
+  
+  WaveCounter += Size;
+  
+  while (Size)
+  {
+    len = RamBufferSize - buf_idx;
+    if (len > Size)
+    {
+      len = Size;
+    }
+    /* Store Data in RAM buffer */
+    memcpy(pRamBuf + buf_idx, pData, len);
+    buf_idx += len;
+    pData += len;
+    Size -= len;
+    
+    if (buf_idx == RamBufferSize)
+    {
+      /* If the other buffer is still waiting it has to be written now.
+         Only the write is done here: the segments are prepared by the
+         WaveRecorderWrite() calls of the main loop. */
+      if (pRamPending)
+      {
+        WaveRecorder_WritePending();
+      }
+      pRamPending = pRamBuf;
+      pRamBuf = (pRamBuf == RAM_Buf) ? RAM_Buf1 : RAM_Buf;
+      buf_idx = 0;
+    }
+  }
+}
+
+/**
+  * @brief  Write the data remaining in the current RAM buffer to the USB Key.
+  * @param  None
+  * @retval None
+  */
+static void WaveRecorder_FlushData(void)
+{
+  if (buf_idx)
+  {
+    f_write (RecFile, pRamBuf, buf_idx, (void *)&bytesWritten);
+    RecDataSize += bytesWritten;
+    buf_idx = 0;
+  }
+}
+
+/**
+  * @brief  Make the recorded file consistent on the disk. The file data is
+  *         always written in whole sectors, so the checkpoint costs a fixed
+  *         number of sector writes whatever the length of the recording:
+  *         the directory entry, the FAT and FSInfo sectors held by FatFs
+  *         (f_sync) and the header sector, which is rewritten in place
+  *         without seeking back through the cluster chain. This needs the
+  *         header to fill the sector: with larger sectors the header is
+  *         rewritten through FatFs (read-modify-write of the sector and a
+  *         seek back to the end of the file).
+  * @param  None
+  * @retval None
+  */
+static void WaveRecorder_Checkpoint(void)
+{
+  FATFS* fs = RecFile->fs;
+  DWORD sect = 0, end = 0;
+  
+  /* Update the file size and the FAT */
+  if (f_sync(RecFile) != FR_OK)
+  {
+    RecWriteError = 1;
+    return;
+  }
+  
+  WaveRecorderHeaderUpdate(RecBufHeader, RecDataSize);
+  if (SS(fs) == REC_HEADER_SIZE)
+  {
+    /* The header is the first sector of the first cluster of the file */
+    sect = fs->database + (RecFile->org_clust - 2) * fs->csize;
+    if (disk_write(fs->drive, RecBufHeader, sect, 1) != RES_OK)
+    {
+      RecWriteError = 1;
+      return;
+    }
+  }
+  else
+  {
+    end = RecFile->fptr;
+    if ((f_lseek(RecFile, 0) != FR_OK) ||
+        (f_write(RecFile, RecBufHeader, REC_HEADER_SIZE, (void *)&bytesWritten) != FR_OK) ||
+        (f_lseek(RecFile, end) != FR_OK) || (f_sync(RecFile) != FR_OK))
+    {
+      RecWriteError = 1;
+      return;
+    }
+  }
+  
+  CheckpointData = RecDataSize;
+}
+
+/**
+  * @brief  Get the number of frames in the audio data of the file
+  * @param  DataSize: Number of audio data bytes
+  * @retval Number of frames
+  */
+static uint32_t WaveRecorder_DataFrames(uint32_t DataSize)
+{
+  if (RecFormat == WAVE_FORMAT_IMA_ADPCM)
+  {
+    return (DataSize / REC_ADPCM_BLOCK_SIZE) * AdpcmSamplesPerBlock - AdpcmPadFrames;
+  }
+  return DataSize / RecFrameSize;
+}
+
+/**
+  * @brief  Append the 'cue ' chunk indexing the start of the voice segments
+  *         to the file. The chunk is written REC_CUE_BATCH cue points at a
+  *         time from a small buffer: the RAM buffers hold the live audio.
+  * @param  Count: Number of cues (the first ones)
+  * @retval Size of the chunk (with the pad byte of an odd 'data' chunk),
+  *         0 if it could not be written
+  */
+static uint32_t WaveRecorder_CueChunk(uint32_t Count)
+{
+  uint8_t pBuf[REC_CUE_BATCH * REC_CUE_POINT_SIZE];
+  uint32_t idx = 0, cue = 0, block = 0, offset = 0, size = 0;
+  
+  /* Chunks start on even offsets */
+  if (RecDataSize & 1)
+  {
+    pBuf[idx++] = 0x00;
+  }
+  
+  /* Write the Cue chunk, 'cue ' */
+  pBuf[idx]     = 'c';
+  pBuf[idx + 1] = 'u';
+  pBuf[idx + 2] = 'e';
+  pBuf[idx + 3] = ' ';
+  WaveRecorder_WriteUnit(pBuf, idx + 4, 4 + Count * REC_CUE_POINT_SIZE, 4);
+  WaveRecorder_WriteUnit(pBuf, idx + 8, Count, 4);
+  idx += 12;
+  
+  for (cue = 0; cue < Count; cue++)
+  {
+    if (idx + REC_CUE_POINT_SIZE > sizeof(pBuf))
+    {
+      if ((f_write (RecFile, pBuf, idx, (void *)&bytesWritten) != FR_OK) || (bytesWritten != idx))
+      {
+        return 0;
+      }
+      size += idx;
+      idx = 0;
+    }
+    
+    /* Position of the first sample of the segment: for IMA ADPCM the
+       offset of its block and the sample within the block */
+    block = 0;
+    offset = RecCues[cue];
+    if (RecFormat == WAVE_FORMAT_IMA_ADPCM)
+    {
+      block = (offset / AdpcmSamplesPerBlock) * REC_ADPCM_BLOCK_SIZE;
+      offset = offset % AdpcmSamplesPerBlock;
+    }
+    WaveRecorder_WriteUnit(pBuf, idx, cue + 1, 4);          /* Identifier */
+    WaveRecorder_WriteUnit(pBuf, idx + 4, RecCues[cue], 4); /* Play order position */
+    pBuf[idx + 8]  = 'd';                                   /* Chunk containing the cue */
+    pBuf[idx + 9]  = 'a';
+    pBuf[idx + 10] = 't';
+    pBuf[idx + 11] = 'a';
+    WaveRecorder_WriteUnit(pBuf, idx + 12, 0, 4);           /* Chunk start */
+    WaveRecorder_WriteUnit(pBuf, idx + 16, block, 4);       /* Block start */
+    WaveRecorder_WriteUnit(pBuf, idx + 20, offset, 4);      /* Sample offset */
+    idx += REC_CUE_POINT_SIZE;
+  }
+  
+  if ((f_write (RecFile, pBuf, idx, (void *)&bytesWritten) != FR_OK) || (bytesWritten != idx))
+  {
+    return 0;
+  }
+  return size + idx;
+}
+
+/**
+  * @brief  Write a value to a buffer in little endian.
+  * @param  pBuf: Pointer to the buffer
+  *         idx: Offset in the buffer
+  *         Value: Value to write
+  *         NbrOfBytes: Number of bytes to write (1 to 4)
+  * @retval None
+  */
+static void WaveRecorder_WriteUnit(uint8_t* pBuf, uint32_t idx, uint32_t Value, uint8_t NbrOfBytes)
+{
+  uint32_t index = 0;
+  
+  for (index = 0; index < NbrOfBytes; index++)
+  {
+    pBuf[idx + index] = (uint8_t)((Value >> (index * 8)) & 0xFF);
+  }
+}
+
+/**
+  * @brief  Initialize GPIO for wave recorder.
+  * @param  None
+  * @retval None
+  */
+static void WaveRecorder_GPIO_Init(void)
+{  
+  GPIO_InitTypeDef GPIO_InitStructure;
+
+  /* Enable GPIO clocks */
   RCC_AHB1PeriphClockCmd(SPI_SCK_GPIO_CLK | SPI_MOSI_GPIO_CLK, ENABLE);
 
   /* Enable GPIO clocks */
@@ -514,7 +1909,7 @@ static void WaveRecorder_SPI_Init(uint32_t Freq)
   
   /* SPI configuration */
   SPI_I2S_DeInit(SPI2);
-  I2S_InitStructure.I2S_AudioFreq = 32000;
+  I2S_InitStructure.I2S_AudioFreq = Freq;
   I2S_InitStructure.I2S_Standard = I2S_Standard_LSB;
   I2S_InitStructure.I2S_DataFormat = I2S_DataFormat_16b;
   I2S_InitStructure.I2S_CPOL = I2S_CPOL_High;
@@ -522,6 +1917,9 @@ static void WaveRecorder_SPI_Init(uint32_t Freq)
   I2S_InitStructure.I2S_MCLKOutput = I2S_MCLKOutput_Disable;
   /* Initialize the I2S peripheral with the structure above */
   I2S_Init(SPI2, &I2S_InitStructure);
+  
+  /* Exact microphone clock (I2S_Init rounds for the fixed PLLI2S) */
+  I2SCLK_Config(SPI2, Freq, &RecClockPlan);
 
   /* Enable the Rx buffer not empty interrupt */
   SPI_I2S_ITConfig(SPI2, SPI_I2S_IT_RXNE, ENABLE);